@@ -1,8 +1,299 @@
 #ifndef AES_H
 #define AES_H
 
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#include "key_cache.h"
+
+#define AES_BLOCK_SIZE 16
+
 int encrypt(void* buffer, int buffer_len, char* IV, char* key, int key_len);
 int decrypt(void* buffer, int buffer_len, char* IV, char* key, int key_len);
 void display(char* data, int len);
 
+/*
+ * encrypt() and decrypt() take the key schedule for their raw key from
+ * a process-wide LRU cache (64 entries by default), so callers that
+ * reuse keys skip the key expansion. aes_key_cache_config changes the
+ * capacity (0 disables caching) and returns 1 if the cache could not be
+ * set up; aes_key_cache_flush evicts and wipes every entry. The hit and
+ * miss counts from aes_key_cache_stats help size the cache.
+ */
+int aes_key_cache_config(size_t capacity);
+void aes_key_cache_flush(void);
+void aes_key_cache_stats(key_cache_stats* st);
+
+/*
+ * Name of the AES kernel in use: "aesni", "bitslice-avx2",
+ * "bitslice-sse2" or "portable". The fastest one available is picked
+ * from CPUID on first use; aes_engine_select forces one by name and
+ * returns 1 if it is not usable on this CPU.
+ */
+const char* aes_engine_name(void);
+int aes_engine_select(const char* name);
+
+/*
+ * Reusable AES-CBC context: the cipher is set up and the key expanded
+ * once in aes_ctx_create, then any number of messages can be processed
+ * with their own IV. Keys are 16, 24 or 32 bytes (AES-128/192/256).
+ * Functions return 0 on success, 1 on failure.
+ */
+typedef struct aes_ctx aes_ctx;
+
+aes_ctx* aes_ctx_create(const char* key, int key_len);
+int aes_ctx_encrypt(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV);
+int aes_ctx_decrypt(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV);
+void aes_ctx_destroy(aes_ctx* ctx);
+
+/*
+ * Single-pass CBC with a SHA-256 digest of the ciphertext, for
+ * integrity manifests. Each chunk is hashed while still in cache right
+ * after it is encrypted, so the message is read from memory once.
+ * aes_ctx_decrypt_verify hashes before decrypting, compares against
+ * digest and returns 1 on a mismatch, with the buffer wiped.
+ */
+#define AES_HASH_SIZE 32
+
+int aes_ctx_encrypt_hash(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV,
+                         unsigned char digest[AES_HASH_SIZE]);
+int aes_ctx_decrypt_verify(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV,
+                           const unsigned char digest[AES_HASH_SIZE]);
+
+/*
+ * Scatter/gather CBC over fragment chains, without staging copies. The
+ * chains' total length must be a multiple of 16; blocks may straddle
+ * fragments. out == NULL works in place; otherwise out may be split
+ * differently from in, must hold at least as many bytes and must not
+ * overlap it.
+ */
+int aes_encrypt_iov(aes_ctx* ctx, const struct iovec* in, int in_cnt,
+                    const struct iovec* out, int out_cnt, const char* IV);
+int aes_decrypt_iov(aes_ctx* ctx, const struct iovec* in, int in_cnt,
+                    const struct iovec* out, int out_cnt, const char* IV);
+
+/*
+ * AES-CTR. The 16-byte IV is the initial counter block and counts up
+ * as one 128-bit big-endian integer per block. Encryption and
+ * decryption are the same operation, any length is accepted and in
+ * may equal out.
+ *
+ * aes_ctx_ctr processes a buffer that starts offset bytes into the
+ * stream. aes_ctr keeps a running position instead, so a stream can
+ * be fed in pieces of any size and repositioned with aes_ctr_seek.
+ */
+int aes_ctx_ctr(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV,
+                unsigned long long offset);
+
+typedef struct {
+    const aes_ctx* ctx;
+    unsigned char iv[AES_BLOCK_SIZE];   /* counter block at offset 0 */
+    unsigned char ctr[AES_BLOCK_SIZE];  /* next counter block to use */
+    unsigned char ks[AES_BLOCK_SIZE];   /* keystream of a partial block */
+    unsigned long long offset;          /* stream position in bytes */
+} aes_ctr;
+
+int aes_ctr_init(aes_ctr* st, const aes_ctx* ctx, const char* IV);
+void aes_ctr_seek(aes_ctr* st, unsigned long long offset);
+void aes_ctr_crypt(aes_ctr* st, const void* in, void* out, size_t len);
+
+/*
+ * Batch CBC encryption of many independent messages, each with its own
+ * context, IV and buffer (encrypted in place). With AES-NI up to eight
+ * messages are interleaved through the AES unit at once; other kernels
+ * process them one after another. Each job's status is set to 0 on
+ * success or 1 if it was rejected (no context, or a length that is not
+ * a multiple of 16). The call returns 1 if any job failed.
+ */
+typedef struct {
+    aes_ctx* ctx;
+    const char* IV;
+    void* buffer;
+    size_t buffer_len;
+    int status;
+} aes_cbc_job;
+
+int aes_cbc_encrypt_batch(aes_cbc_job* jobs, size_t njobs);
+
+/*
+ * Parallel bulk mode for large buffers: CBC decryption and CTR (either
+ * direction) split the buffer into chunks that are processed on a
+ * worker pool. Output is byte-identical to aes_ctx_decrypt and
+ * aes_ctx_ctr, which buffers smaller than one chunk fall back to.
+ *
+ * aes_parallel_config sets the thread count (0: one per online CPU,
+ * the default) and the chunk size in bytes (0: 256 KiB; otherwise a
+ * multiple of 16, at least 4 KiB). It returns 1 on a bad value and
+ * should not be called while a parallel operation is running.
+ */
+int aes_parallel_config(int threads, size_t chunk_size);
+int aes_ctx_decrypt_parallel(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV);
+int aes_ctx_ctr_parallel(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV,
+                         unsigned long long offset);
+
+/*
+ * Streaming init/update/final interface for messages of any size. Partial
+ * blocks are buffered in the stream, so update accepts any length; out
+ * needs room for len + AES_BLOCK_SIZE bytes and must not overlap in,
+ * and *out_len receives the bytes written. final writes at most one
+ * block and wipes the stream.
+ *
+ * AES_STREAM_CBC adds PKCS#7 padding on encryption and checks and strips
+ * it on decryption (final returns 1 on bad padding; padding errors must
+ * not be reported to a peer unless the data is authenticated).
+ * AES_STREAM_CBC_NOPAD requires a whole number of blocks overall.
+ * AES_STREAM_CTR is length-preserving and ignores enc.
+ *
+ * aes_stream_file runs a whole stream from in to out through fixed
+ * AES_STREAM_CHUNK buffers, so memory use does not depend on the size
+ * of the data, and calls final. It returns 1 on an I/O or padding error.
+ */
+#define AES_STREAM_CHUNK (64 << 10)
+
+enum { AES_STREAM_CBC, AES_STREAM_CBC_NOPAD, AES_STREAM_CTR };
+
+typedef struct {
+    const aes_ctx* ctx;
+    int mode;
+    int enc;
+    unsigned char iv[AES_BLOCK_SIZE];   /* CBC chaining value */
+    unsigned char buf[AES_BLOCK_SIZE];  /* buffered partial input */
+    size_t buf_len;
+    aes_ctr ctr;
+} aes_stream;
+
+int aes_stream_init(aes_stream* st, const aes_ctx* ctx, int mode, int enc, const char* IV);
+int aes_stream_update(aes_stream* st, const void* in, size_t len, void* out, size_t* out_len);
+int aes_stream_final(aes_stream* st, void* out, size_t* out_len);
+int aes_stream_file(aes_stream* st, FILE* in, FILE* out);
+
+/*
+ * File encryption pipeline: a ring of aligned buffers moves through
+ * io_uring reads, the cipher and io_uring writes at the same time (with
+ * plain pread/pwrite where io_uring is unavailable). mode is
+ * AES_STREAM_CTR, run on the parallel worker pool, or AES_STREAM_CBC
+ * with PKCS#7 padding; enc is ignored for CTR.
+ *
+ * Options may be NULL: 8 buffers of 1 MiB (buffer_size must be a
+ * multiple of 4096 and at most 1 GiB, as the kernel moves no more than
+ * about 2 GiB per read or write; 2 to 64 buffers). direct asks for
+ * O_DIRECT, used where the file system allows it and, for output, only
+ * in CTR mode.
+ * stats, if not NULL, receives sizes, elapsed time and what was used,
+ * with O_DIRECT reported separately for the input and the output.
+ */
+typedef struct {
+    size_t buffer_size;
+    int buffers;
+    int direct;
+} aes_file_opts;
+
+typedef struct {
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    double seconds;
+    int uring;
+    int direct_in;
+    int direct_out;
+} aes_file_stats;
+
+int aes_file_crypt(aes_ctx* ctx, int mode, int enc, const char* IV,
+                   const char* in_path, const char* out_path,
+                   const aes_file_opts* opts, aes_file_stats* stats);
+
+/*
+ * Key rotation: data encrypted under `from` is decrypted and encrypted
+ * under `to` in one pass, a few blocks at a time through a stack
+ * buffer, so each byte is read from memory once and the plaintext never
+ * appears in buffer. Each side has its own context, IV and mode:
+ * AES_STREAM_CBC (or _NOPAD; padding is carried over untouched) or
+ * AES_STREAM_CTR. If either side is CBC the length must be a multiple
+ * of 16.
+ *
+ * aes_reencrypt_parallel splits large buffers over the worker pool when
+ * the new mode is CTR. CBC encryption is serial, so towards CBC it is
+ * the same as aes_reencrypt.
+ */
+typedef struct {
+    aes_ctx* ctx;
+    int mode;
+    const char* IV;
+} aes_cipher_spec;
+
+int aes_reencrypt(const aes_cipher_spec* from, const aes_cipher_spec* to,
+                  void* buffer, size_t buffer_len);
+int aes_reencrypt_parallel(const aes_cipher_spec* from, const aes_cipher_spec* to,
+                           void* buffer, size_t buffer_len);
+
+/*
+ * AES-XTS (IEEE 1619, NIST SP 800-38E) for length-preserving,
+ * random-access encryption of sectors. The key is the data key followed
+ * by the tweak key: 32 bytes for XTS-AES-128, 64 for XTS-AES-256; the
+ * two halves must differ or aes_xts_create returns NULL.
+ *
+ * aes_xts_encrypt/aes_xts_decrypt process one data unit (sector) in
+ * place; the data unit number becomes the tweak as a 128-bit
+ * little-endian integer. Units are 16 bytes to 16 MiB and need not be
+ * a multiple of 16 (ciphertext stealing).
+ *
+ * The _sectors variants process nsectors consecutive units of
+ * sector_size bytes (a multiple of 16) starting at first_sector,
+ * spread over the worker pool configured by aes_parallel_config.
+ */
+typedef struct aes_xts aes_xts;
+
+aes_xts* aes_xts_create(const char* key, int key_len);
+void aes_xts_destroy(aes_xts* x);
+int aes_xts_encrypt(const aes_xts* x, void* buffer, size_t len, unsigned long long unit);
+int aes_xts_decrypt(const aes_xts* x, void* buffer, size_t len, unsigned long long unit);
+int aes_xts_encrypt_sectors(const aes_xts* x, void* buffer, size_t sector_size, size_t nsectors,
+                            unsigned long long first_sector);
+int aes_xts_decrypt_sectors(const aes_xts* x, void* buffer, size_t sector_size, size_t nsectors,
+                            unsigned long long first_sector);
+
+/*
+ * AES-GCM (NIST SP 800-38D). IVs of any non-zero length are accepted;
+ * 12 bytes is the recommended size. Tags are 16 bytes on output and
+ * may be truncated to no fewer than 4 bytes for verification.
+ *
+ * aes_gcm_encrypt/aes_gcm_decrypt work in place on one message.
+ * aes_gcm_decrypt checks the tag and, on mismatch, returns 1 and zeroes
+ * the buffer so unauthenticated plaintext is never handed back.
+ */
+#define AES_GCM_TAG_SIZE 16
+
+int aes_gcm_encrypt(aes_ctx* ctx, const char* IV, size_t iv_len,
+                    const void* aad, size_t aad_len,
+                    void* buffer, size_t buffer_len, char* tag);
+int aes_gcm_decrypt(aes_ctx* ctx, const char* IV, size_t iv_len,
+                    const void* aad, size_t aad_len,
+                    void* buffer, size_t buffer_len, const char* tag, size_t tag_len);
+
+/*
+ * Incremental AES-GCM: aes_gcm_aad any number of times, then
+ * aes_gcm_encrypt_update or aes_gcm_decrypt_update in pieces of any
+ * size (in may equal out), then aes_gcm_final for the tag or
+ * aes_gcm_verify to check one. Decrypted data is released before the
+ * tag is checked; callers must discard it if aes_gcm_verify fails.
+ */
+typedef struct {
+    const aes_ctx* ctx;
+    unsigned long long htab[32];        /* GHASH key tables */
+    unsigned char j0[AES_BLOCK_SIZE];   /* pre-counter block */
+    unsigned char ctr[AES_BLOCK_SIZE];  /* next counter block to use */
+    unsigned char ks[AES_BLOCK_SIZE];   /* keystream of a partial block */
+    unsigned char y[AES_BLOCK_SIZE];    /* GHASH accumulator */
+    unsigned char buf[AES_BLOCK_SIZE];  /* partial GHASH input block */
+    unsigned long long aad_len, msg_len;
+    int clmul;                          /* htab layout: PCLMULQDQ or table */
+    int phase;                          /* 0 aad, 1 data, 2 finished */
+} aes_gcm;
+
+int aes_gcm_init(aes_gcm* st, const aes_ctx* ctx, const char* IV, size_t iv_len);
+int aes_gcm_aad(aes_gcm* st, const void* aad, size_t len);
+int aes_gcm_encrypt_update(aes_gcm* st, const void* in, void* out, size_t len);
+int aes_gcm_decrypt_update(aes_gcm* st, const void* in, void* out, size_t len);
+int aes_gcm_final(aes_gcm* st, char* tag);
+int aes_gcm_verify(aes_gcm* st, const char* tag, size_t tag_len);
+
 #endif
@@ -0,0 +1,89 @@
+#ifndef CHACHA_H
+#define CHACHA_H
+
+#include <stddef.h>
+
+/*
+ * ChaCha20 and the ChaCha20-Poly1305 AEAD (RFC 8439), for hosts where
+ * AES has no hardware support. Keys are 32 bytes, nonces 12 bytes and
+ * tags 16 bytes. Functions return 0 on success, 1 on failure.
+ */
+#define CHACHA_KEY_SIZE   32
+#define CHACHA_NONCE_SIZE 12
+#define CHACHA_TAG_SIZE   16
+
+/*
+ * Name of the ChaCha20 kernel in use: "avx2" (8 blocks per pass),
+ * "sse2" (4 blocks) or "portable". The fastest one available is picked
+ * from CPUID on first use; chacha_engine_select forces one by name and
+ * returns 1 if it is not usable on this CPU.
+ */
+const char* chacha_engine_name(void);
+int chacha_engine_select(const char* name);
+
+/*
+ * Reusable context holding the key. chacha_ctx_xor applies the raw
+ * ChaCha20 keystream for nonce, starting at block counter, to a
+ * buffer in place; encryption and decryption are the same operation.
+ * The 32-bit counter does not wrap: a buffer longer than
+ * (2^32 - counter) * 64 bytes is refused with 1 and left unchanged.
+ */
+typedef struct chacha_ctx chacha_ctx;
+
+chacha_ctx* chacha_ctx_create(const char* key, int key_len);
+int chacha_ctx_xor(chacha_ctx* ctx, void* buffer, size_t buffer_len, const char* nonce,
+                   unsigned int counter);
+void chacha_ctx_destroy(chacha_ctx* ctx);
+
+/*
+ * Poly1305 one-time authenticator. The 32-byte key must never be used
+ * for a second message.
+ */
+typedef struct {
+    unsigned long long r[3];
+    unsigned long long h[3];
+    unsigned long long pad[2];
+    unsigned char buf[16];
+    size_t buf_len;
+} chacha_poly1305;
+
+void chacha_poly1305_init(chacha_poly1305* st, const unsigned char key[32]);
+void chacha_poly1305_update(chacha_poly1305* st, const void* data, size_t len);
+void chacha_poly1305_final(chacha_poly1305* st, unsigned char tag[CHACHA_TAG_SIZE]);
+
+/*
+ * ChaCha20-Poly1305 on one message, in place, shaped like
+ * aes_gcm_encrypt/aes_gcm_decrypt. chacha_aead_decrypt checks the tag
+ * and, on mismatch, returns 1 and zeroes the buffer so unauthenticated
+ * plaintext is never handed back.
+ */
+int chacha_aead_encrypt(chacha_ctx* ctx, const char* nonce, const void* aad, size_t aad_len,
+                        void* buffer, size_t buffer_len, char* tag);
+int chacha_aead_decrypt(chacha_ctx* ctx, const char* nonce, const void* aad, size_t aad_len,
+                        void* buffer, size_t buffer_len, const char* tag);
+
+/*
+ * Incremental ChaCha20-Poly1305, used like aes_gcm: chacha_aead_aad any
+ * number of times, then the encrypt or decrypt update in pieces of any
+ * size (in may equal out), then chacha_aead_final for the tag or
+ * chacha_aead_verify to check one. Decrypted data is released before
+ * the tag is checked; callers must discard it if verification fails.
+ */
+typedef struct {
+    const chacha_ctx* ctx;
+    unsigned int state[16];             /* next block: counter in word 12 */
+    unsigned char ks[64];               /* keystream of a partial block */
+    size_t ks_pos;                      /* bytes of ks used, 64 if none */
+    chacha_poly1305 mac;
+    unsigned long long aad_len, msg_len;
+    int phase;                          /* 0 aad, 1 data, 2 finished */
+} chacha_aead;
+
+int chacha_aead_init(chacha_aead* st, const chacha_ctx* ctx, const char* nonce);
+int chacha_aead_aad(chacha_aead* st, const void* aad, size_t len);
+int chacha_aead_encrypt_update(chacha_aead* st, const void* in, void* out, size_t len);
+int chacha_aead_decrypt_update(chacha_aead* st, const void* in, void* out, size_t len);
+int chacha_aead_final(chacha_aead* st, char* tag);
+int chacha_aead_verify(chacha_aead* st, const char* tag);
+
+#endif
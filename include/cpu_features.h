@@ -0,0 +1,23 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+/*
+ * Instruction set extensions usable on the running CPU, as reported by
+ * CPUID and confirmed against the OS-enabled register state (XGETBV).
+ * Every field is 0 on non-x86 builds.
+ */
+typedef struct {
+    int sse2;
+    int ssse3;
+    int sse41;
+    int avx;
+    int avx2;
+    int avx512f;
+    int aesni;
+    int pclmul;
+    int sha;
+} cpu_features;
+
+const cpu_features* cpu_get_features(void);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef KEY_CACHE_H
+#define KEY_CACHE_H
+
+#include <stddef.h>
+
+/*
+ * Bounded, thread-safe cache of expanded key schedules for workloads
+ * that see the same raw keys again and again. Entries are found by a
+ * SipHash fingerprint of the key under a per-process random secret,
+ * then confirmed by comparing the full key. The least recently used
+ * entry is evicted when the cache is full; raw key and schedule are
+ * wiped when an entry is freed.
+ *
+ * key_cache_acquire returns the schedule for a key, expanding it with
+ * the cache's expand function on a miss, or NULL if expand rejects the
+ * key (or it is longer than KEY_CACHE_MAX_KEY). The schedule stays
+ * valid until it is handed back with key_cache_release, even if it is
+ * evicted in the meantime. A capacity of 0 caches nothing: every
+ * acquire expands a private copy that release frees.
+ */
+#define KEY_CACHE_MAX_KEY 64
+
+typedef struct key_cache key_cache;
+
+typedef struct {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    size_t entries;
+    size_t capacity;
+} key_cache_stats;
+
+key_cache* key_cache_create(size_t capacity, size_t sched_size,
+                            int (*expand)(void* sched, const unsigned char* key, int key_len));
+const void* key_cache_acquire(key_cache* c, const void* key, int key_len);
+void key_cache_release(key_cache* c, const void* sched);
+
+/* Evicts down to the new capacity; counters are kept */
+void key_cache_resize(key_cache* c, size_t capacity);
+void key_cache_flush(key_cache* c);
+void key_cache_get_stats(key_cache* c, key_cache_stats* st);
+
+/* No schedule may still be acquired */
+void key_cache_destroy(key_cache* c);
+
+#endif
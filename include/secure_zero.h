@@ -0,0 +1,13 @@
+#ifndef SECURE_ZERO_H
+#define SECURE_ZERO_H
+
+#include <stddef.h>
+
+/*
+ * Zero len bytes at p in a way the compiler cannot drop, for keys,
+ * schedules and other secrets about to go out of scope or be freed.
+ * Shared by every component (AES, ChaCha20, SHA/HMAC, key cache).
+ */
+void secure_zero(void* p, size_t len);
+
+#endif
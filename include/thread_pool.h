@@ -0,0 +1,21 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+/*
+ * Process-wide worker pool for data-parallel bulk work. Workers are
+ * started on first use and kept for the life of the process.
+ *
+ * thread_pool_run calls fn(arg, i) once for every i in [0, n), spread
+ * over up to `threads` threads (the caller counts as one), and returns
+ * when all calls have finished. Items are handed out dynamically, so
+ * uneven items balance themselves. Calls from different threads are
+ * serialised; fn must not call thread_pool_run itself.
+ */
+void thread_pool_run(int threads, size_t n, void (*fn)(void* arg, size_t i), void* arg);
+
+/* Number of online CPUs, at least 1 */
+int thread_pool_cpus(void);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Minimal asynchronous file I/O queue on io_uring, driven through the
+ * raw system calls. Where io_uring is unavailable (old kernel, seccomp)
+ * the same calls run each request synchronously with pread/pwrite at
+ * submission, so callers need no second code path; uring_async tells
+ * which one is in use.
+ *
+ * uring_read/uring_write queue a request tagged with a caller value and
+ * return 1 if more than `entries` requests would be outstanding.
+ * uring_submit hands queued requests to the kernel; uring_wait submits
+ * as well and blocks for one completion, giving its tag and result
+ * (bytes transferred or -errno). uring_cancel asks the kernel to stop
+ * the request with a given tag; it still completes through uring_wait,
+ * possibly with -ECANCELED, and its buffer stays in use until then.
+ * Where io_uring is set up but lacks read/write opcodes (kernels before
+ * 5.6) the synchronous path is used. Not thread-safe.
+ */
+typedef struct uring uring;
+
+uring* uring_create(unsigned entries);
+void uring_destroy(uring* u);
+int uring_async(const uring* u);
+
+int uring_read(uring* u, int fd, void* buf, size_t len, off_t off, unsigned long long tag);
+int uring_write(uring* u, int fd, const void* buf, size_t len, off_t off, unsigned long long tag);
+int uring_cancel(uring* u, unsigned long long tag);
+int uring_submit(uring* u);
+int uring_wait(uring* u, unsigned long long* tag, long* res);
+
+#endif
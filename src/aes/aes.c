@@ -1,49 +1,130 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <mcrypt.h>
 #include "aes.h"
+#include "aes_internal.h"
 
-int encrypt(void* buffer, int buffer_len, char* IV, char* key, int key_len){
-    MCRYPT td = mcrypt_module_open("rijndael-128", NULL, "cbc", NULL);
-    if (td == MCRYPT_FAILED) return 1;
+#define AES_KEY_CACHE_DEFAULT 64
 
-    int blocksize = mcrypt_enc_get_block_size(td);
-    if (buffer_len % blocksize != 0) return 1;
+static key_cache* key_cache_aes;
+static pthread_once_t key_cache_once = PTHREAD_ONCE_INIT;
 
-    if (mcrypt_generic_init(td, key, key_len, IV) < 0) {
-        mcrypt_module_close(td);
-        return 1;
-    }
+static int expand_key(void* sched, const unsigned char* key, int key_len){
+    return aes_key_setup(sched, key, key_len);
+}
+
+static void key_cache_init(void){
+    key_cache_aes = key_cache_create(AES_KEY_CACHE_DEFAULT, sizeof(aes_key), expand_key);
+}
+
+static key_cache* aes_key_cache(void){
+    pthread_once(&key_cache_once, key_cache_init);
+    return key_cache_aes;
+}
+
+static int cbc_crypt(const aes_key* k, void* buffer, size_t buffer_len, const char* IV, int enc){
+    const aes_engine* e = aes_engine_get();
+    uint8_t iv[AES_BLOCK_SIZE];
+
+    if (buffer_len % AES_BLOCK_SIZE != 0) return 1;
 
-    mcrypt_generic(td, buffer, buffer_len);
-    mcrypt_generic_deinit(td);
-    mcrypt_module_close(td);
-    
+    memcpy(iv, IV, AES_BLOCK_SIZE);
+    if (enc)
+        e->cbc_encrypt(k, iv, buffer, buffer, buffer_len / AES_BLOCK_SIZE);
+    else
+        e->cbc_decrypt(k, iv, buffer, buffer, buffer_len / AES_BLOCK_SIZE);
     return 0;
 }
 
-int decrypt(void* buffer, int buffer_len, char* IV, char* key, int key_len){
-    MCRYPT td = mcrypt_module_open("rijndael-128", NULL, "cbc", NULL);
-    if (td == MCRYPT_FAILED) return 1;
+/* Schedules for raw keys come from the cache, so a key seen again is
+ * not expanded again */
+static int oneshot(void* buffer, int buffer_len, char* IV, char* key, int key_len, int enc){
+    key_cache* c = aes_key_cache();
+    const aes_key* ck;
+    aes_key k;
+    int ret;
 
-    int blocksize = mcrypt_enc_get_block_size(td);
-    if (buffer_len % blocksize != 0) return 1;
+    if (buffer_len < 0) return 1;
+    /* Rejected before the cache reads key_len bytes of the key */
+    if (key_len != 16 && key_len != 24 && key_len != 32) return 1;
 
-    if (mcrypt_generic_init(td, key, key_len, IV) < 0) {
-        mcrypt_module_close(td);
-        return 1;
+    if (c != NULL) {
+        ck = key_cache_acquire(c, key, key_len);
+        if (ck == NULL) return 1;
+        ret = cbc_crypt(ck, buffer, (size_t)buffer_len, IV, enc);
+        key_cache_release(c, ck);
+        return ret;
     }
 
-    mdecrypt_generic(td, buffer, buffer_len);
-    mcrypt_generic_deinit(td);
-    mcrypt_module_close(td);
-    
+    if (aes_key_setup(&k, (const uint8_t*)key, key_len) != 0) return 1;
+    ret = cbc_crypt(&k, buffer, (size_t)buffer_len, IV, enc);
+    aes_key_wipe(&k);
+    return ret;
+}
+
+int encrypt(void* buffer, int buffer_len, char* IV, char* key, int key_len){
+    return oneshot(buffer, buffer_len, IV, key, key_len, 1);
+}
+
+int decrypt(void* buffer, int buffer_len, char* IV, char* key, int key_len){
+    return oneshot(buffer, buffer_len, IV, key, key_len, 0);
+}
+
+int aes_key_cache_config(size_t capacity){
+    key_cache* c = aes_key_cache();
+
+    if (c == NULL) return 1;
+    key_cache_resize(c, capacity);
     return 0;
 }
 
+void aes_key_cache_flush(void){
+    key_cache* c = aes_key_cache();
+    if (c != NULL) key_cache_flush(c);
+}
+
+void aes_key_cache_stats(key_cache_stats* st){
+    key_cache* c = aes_key_cache();
+
+    if (c != NULL) {
+        key_cache_get_stats(c, st);
+        return;
+    }
+    memset(st, 0, sizeof(*st));
+}
+
 void display(char* data, int len){
     for (int i = 0; i < len; i++)
         printf("%02x ", (unsigned char)data[i]);
     printf("\n");
 }
+
+/* The key schedule is expanded once here and reused by every call */
+aes_ctx* aes_ctx_create(const char* key, int key_len){
+    aes_ctx* ctx = malloc(sizeof(*ctx));
+    if (ctx == NULL) return NULL;
+
+    if (aes_key_setup(&ctx->key, (const uint8_t*)key, key_len) != 0) {
+        free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+int aes_ctx_encrypt(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV){
+    if (ctx == NULL) return 1;
+    return cbc_crypt(&ctx->key, buffer, buffer_len, IV, 1);
+}
+
+int aes_ctx_decrypt(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV){
+    if (ctx == NULL) return 1;
+    return cbc_crypt(&ctx->key, buffer, buffer_len, IV, 0);
+}
+
+void aes_ctx_destroy(aes_ctx* ctx){
+    if (ctx == NULL) return;
+    aes_key_wipe(&ctx->key);
+    free(ctx);
+}
@@ -0,0 +1,81 @@
+/*********************************************************************
+ * Filename:   aes_batch.c
+ * Description: Batch CBC encryption of many small independent
+ *              messages. A single CBC stream is latency bound, so
+ *              with AES-NI up to eight streams are kept in flight;
+ *              whenever one ends its lane is refilled from the queue.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <string.h>
+#include "aes_internal.h"
+
+static int job_valid(const aes_cbc_job* job)
+{
+    return job->ctx != NULL && job->buffer_len % AES_BLOCK_SIZE == 0 &&
+           (job->buffer != NULL || job->buffer_len == 0);
+}
+
+/* Lanes only run in lockstep with the same round count, so each key
+ * size is drained as its own queue */
+static void run_lanes(aes_cbc_job* jobs, size_t njobs, int rounds)
+{
+    aes_cbc_lane lanes[AES_MAX_LANES];
+    size_t next = 0;
+    int active = 0;
+
+    for (;;) {
+        int l = 0;
+
+        while (active < AES_MAX_LANES && next < njobs) {
+            aes_cbc_job* job = &jobs[next++];
+
+            if (job->status != 0 || job->buffer_len == 0 || job->ctx->key.rounds != rounds)
+                continue;
+            lanes[active].k = &job->ctx->key;
+            memcpy(lanes[active].iv, job->IV, AES_BLOCK_SIZE);
+            lanes[active].buf = job->buffer;
+            lanes[active].nblocks = job->buffer_len / AES_BLOCK_SIZE;
+            active++;
+        }
+        if (active == 0) break;
+
+        aes_ni_cbc_encrypt_lanes(lanes, active);
+
+        /* Drop finished lanes, keeping the rest in order */
+        for (int i = 0; i < active; i++)
+            if (lanes[i].nblocks != 0) lanes[l++] = lanes[i];
+        active = l;
+    }
+
+    secure_zero(lanes, sizeof(lanes));
+}
+
+int aes_cbc_encrypt_batch(aes_cbc_job* jobs, size_t njobs)
+{
+    const aes_engine* e = aes_engine_get();
+    int failed = 0;
+
+    for (size_t i = 0; i < njobs; i++) {
+        jobs[i].status = job_valid(&jobs[i]) ? 0 : 1;
+        failed |= jobs[i].status;
+    }
+
+    if (e == &aes_engine_aesni) {
+        for (int rounds = 10; rounds <= AES_MAX_ROUNDS; rounds += 2)
+            run_lanes(jobs, njobs, rounds);
+        return failed;
+    }
+
+    for (size_t i = 0; i < njobs; i++) {
+        uint8_t iv[AES_BLOCK_SIZE];
+
+        if (jobs[i].status != 0 || jobs[i].buffer_len == 0) continue;
+        memcpy(iv, jobs[i].IV, AES_BLOCK_SIZE);
+        e->cbc_encrypt(&jobs[i].ctx->key, iv, jobs[i].buffer, jobs[i].buffer,
+                       jobs[i].buffer_len / AES_BLOCK_SIZE);
+    }
+    return failed;
+}
@@ -0,0 +1,511 @@
+/*********************************************************************
+ * Filename:   aes_bitslice.h
+ * Description: Bitsliced AES core, written once over a generic word
+ *              type and instantiated per register width by the file
+ *              including it. Every operation is a fixed sequence of
+ *              boolean ops and shifts, so timing is independent of
+ *              key and data.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+/*
+ * Define before including:
+ *   BS_T      word type: uint64_t, or a GCC vector of BS_LANES uint64_t
+ *   BS_LANES  number of 64-bit lanes in BS_T
+ *   BS_FN(x)  name of the instantiated function x
+ *   BS_ATTR   attributes for every function (e.g. a target())
+ *
+ * Each 64-bit lane holds four blocks: word q[i] has bit i of every
+ * state byte, and byte (row r, column c) of block b sits at bit
+ * 16*r + 4*c + b, so ShiftRows and MixColumns become shifts inside
+ * 16-bit row groups. One BS_T therefore carries 4 * BS_LANES blocks.
+ */
+
+#ifndef AES_BITSLICE_HELPERS
+#define AES_BITSLICE_HELPERS
+
+#define BS_SWAPMOVE(T, a, b, mask, n) do { \
+    T t_ = (((a) >> (n)) ^ (b)) & (mask); \
+    (b) ^= t_; \
+    (a) ^= t_ << (n); \
+} while (0)
+
+#define BS_ROTR16(x) (((x) >> 16) | ((x) << 48))
+#define BS_ROTR32(x) (((x) >> 32) | ((x) << 32))
+
+/* Spread the 4 bytes of x to the even byte positions of a 64-bit word */
+static inline uint64_t bs_spread_bytes(uint32_t x)
+{
+    uint64_t w = x;
+    w = (w | (w << 16)) & 0x0000FFFF0000FFFFULL;
+    w = (w | (w << 8)) & 0x00FF00FF00FF00FFULL;
+    return w;
+}
+
+static inline uint32_t bs_gather_bytes(uint64_t w)
+{
+    w &= 0x00FF00FF00FF00FFULL;
+    w = (w | (w >> 8)) & 0x0000FFFF0000FFFFULL;
+    w = (w | (w >> 16)) & 0x00000000FFFFFFFFULL;
+    return (uint32_t)w;
+}
+
+static inline uint32_t bs_load32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void bs_store32(uint8_t* p, uint32_t x)
+{
+    p[0] = (uint8_t)x;
+    p[1] = (uint8_t)(x >> 8);
+    p[2] = (uint8_t)(x >> 16);
+    p[3] = (uint8_t)(x >> 24);
+}
+
+#endif /* AES_BITSLICE_HELPERS */
+
+#define BS_BLOCKS (4 * BS_LANES)
+
+/* 8x8 bit transpose between byte words and bit-planes (an involution) */
+static BS_ATTR inline void BS_FN(ortho)(BS_T* q)
+{
+    BS_SWAPMOVE(BS_T, q[0], q[1], 0x5555555555555555ULL, 1);
+    BS_SWAPMOVE(BS_T, q[2], q[3], 0x5555555555555555ULL, 1);
+    BS_SWAPMOVE(BS_T, q[4], q[5], 0x5555555555555555ULL, 1);
+    BS_SWAPMOVE(BS_T, q[6], q[7], 0x5555555555555555ULL, 1);
+
+    BS_SWAPMOVE(BS_T, q[0], q[2], 0x3333333333333333ULL, 2);
+    BS_SWAPMOVE(BS_T, q[1], q[3], 0x3333333333333333ULL, 2);
+    BS_SWAPMOVE(BS_T, q[4], q[6], 0x3333333333333333ULL, 2);
+    BS_SWAPMOVE(BS_T, q[5], q[7], 0x3333333333333333ULL, 2);
+
+    BS_SWAPMOVE(BS_T, q[0], q[4], 0x0f0f0f0f0f0f0f0fULL, 4);
+    BS_SWAPMOVE(BS_T, q[1], q[5], 0x0f0f0f0f0f0f0f0fULL, 4);
+    BS_SWAPMOVE(BS_T, q[2], q[6], 0x0f0f0f0f0f0f0f0fULL, 4);
+    BS_SWAPMOVE(BS_T, q[3], q[7], 0x0f0f0f0f0f0f0f0fULL, 4);
+}
+
+/*
+ * Load up to BS_BLOCKS blocks; missing blocks are zero. Before the
+ * transpose, word k of a lane holds block k & 3, columns (k >> 2) and
+ * (k >> 2) + 2 interleaved byte by byte.
+ */
+static BS_ATTR void BS_FN(load)(BS_T* q, const uint8_t* in, size_t nblocks)
+{
+    uint64_t w[8][BS_LANES];
+
+    for (int l = 0; l < BS_LANES; l++) {
+        for (int k = 0; k < 8; k++) {
+            size_t b = 4 * l + (k & 3);
+            const uint8_t* src = in + b * AES_BLOCK_SIZE + 4 * (k >> 2);
+
+            if (b < nblocks)
+                w[k][l] = bs_spread_bytes(bs_load32(src)) |
+                          (bs_spread_bytes(bs_load32(src + 8)) << 8);
+            else
+                w[k][l] = 0;
+        }
+    }
+    for (int k = 0; k < 8; k++)
+        memcpy(&q[k], w[k], sizeof(BS_T));
+    BS_FN(ortho)(q);
+}
+
+static BS_ATTR void BS_FN(store)(uint8_t* out, BS_T* q, size_t nblocks)
+{
+    uint64_t w[8][BS_LANES];
+
+    BS_FN(ortho)(q);
+    for (int k = 0; k < 8; k++)
+        memcpy(w[k], &q[k], sizeof(BS_T));
+
+    for (int l = 0; l < BS_LANES; l++) {
+        for (int k = 0; k < 8; k++) {
+            size_t b = 4 * l + (k & 3);
+            uint8_t* dst = out + b * AES_BLOCK_SIZE + 4 * (k >> 2);
+
+            if (b >= nblocks) continue;
+            bs_store32(dst, bs_gather_bytes(w[k][l]));
+            bs_store32(dst + 8, bs_gather_bytes(w[k][l] >> 8));
+        }
+    }
+}
+
+/*
+ * S-box as the Boyar-Peralta circuit ("A new combinational logic
+ * minimization technique with applications to cryptology"). x0 is
+ * the most significant bit, hence the reversed plane order.
+ */
+static BS_ATTR void BS_FN(sbox)(BS_T* q)
+{
+    BS_T x0, x1, x2, x3, x4, x5, x6, x7;
+    BS_T y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11;
+    BS_T y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+    BS_T z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11;
+    BS_T z12, z13, z14, z15, z16, z17;
+    BS_T t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11;
+    BS_T t12, t13, t14, t15, t16, t17, t18, t19, t20, t21;
+    BS_T t22, t23, t24, t25, t26, t27, t28, t29, t30, t31;
+    BS_T t32, t33, t34, t35, t36, t37, t38, t39, t40, t41;
+    BS_T t42, t43, t44, t45, t46, t47, t48, t49, t50, t51;
+    BS_T t52, t53, t54, t55, t56, t57, t58, t59, t60, t61;
+    BS_T t62, t63, t64, t65, t66, t67;
+    BS_T s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7]; x1 = q[6]; x2 = q[5]; x3 = q[4];
+    x4 = q[3]; x5 = q[2]; x6 = q[1]; x7 = q[0];
+
+    /* Top linear transformation */
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    /* Non-linear section */
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    /* Bottom linear transformation */
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0; q[6] = s1; q[5] = s2; q[4] = s3;
+    q[3] = s4; q[2] = s5; q[1] = s6; q[0] = s7;
+}
+
+/* Inverse affine map of the S-box, A^-1(x) (constant included) */
+static BS_ATTR void BS_FN(inv_affine)(BS_T* q)
+{
+    BS_T q0 = ~q[0], q1 = ~q[1], q2 = q[2], q3 = q[3];
+    BS_T q4 = q[4], q5 = ~q[5], q6 = ~q[6], q7 = q[7];
+
+    q[7] = q1 ^ q4 ^ q6;
+    q[6] = q0 ^ q3 ^ q5;
+    q[5] = q7 ^ q2 ^ q4;
+    q[4] = q6 ^ q1 ^ q3;
+    q[3] = q5 ^ q0 ^ q2;
+    q[2] = q4 ^ q7 ^ q1;
+    q[1] = q3 ^ q6 ^ q0;
+    q[0] = q2 ^ q5 ^ q7;
+}
+
+/* InvSbox(y) = A^-1(Sbox(A^-1(y))), since Sbox = A o inverse */
+static BS_ATTR void BS_FN(inv_sbox)(BS_T* q)
+{
+    BS_FN(inv_affine)(q);
+    BS_FN(sbox)(q);
+    BS_FN(inv_affine)(q);
+}
+
+static BS_ATTR void BS_FN(shift_rows)(BS_T* q)
+{
+    for (int i = 0; i < 8; i++) {
+        BS_T x = q[i];
+        q[i] = (x & 0x000000000000FFFFULL)
+             | ((x & 0x00000000FFF00000ULL) >> 4)
+             | ((x & 0x00000000000F0000ULL) << 12)
+             | ((x & 0x0000FF0000000000ULL) >> 8)
+             | ((x & 0x000000FF00000000ULL) << 8)
+             | ((x & 0xF000000000000000ULL) >> 12)
+             | ((x & 0x0FFF000000000000ULL) << 4);
+    }
+}
+
+static BS_ATTR void BS_FN(inv_shift_rows)(BS_T* q)
+{
+    for (int i = 0; i < 8; i++) {
+        BS_T x = q[i];
+        q[i] = (x & 0x000000000000FFFFULL)
+             | ((x & 0x000000000FFF0000ULL) << 4)
+             | ((x & 0x00000000F0000000ULL) >> 12)
+             | ((x & 0x0000FF0000000000ULL) >> 8)
+             | ((x & 0x000000FF00000000ULL) << 8)
+             | ((x & 0x000F000000000000ULL) << 12)
+             | ((x & 0xFFF0000000000000ULL) >> 4);
+    }
+}
+
+/* out_r = 2*(a_r ^ a_r+1) ^ a_r+1 ^ (a_r+2 ^ a_r+3), on bit-planes */
+static BS_ATTR void BS_FN(mix_columns)(BS_T* q)
+{
+    BS_T q0, q1, q2, q3, q4, q5, q6, q7;
+    BS_T r0, r1, r2, r3, r4, r5, r6, r7;
+
+    q0 = q[0]; q1 = q[1]; q2 = q[2]; q3 = q[3];
+    q4 = q[4]; q5 = q[5]; q6 = q[6]; q7 = q[7];
+    r0 = BS_ROTR16(q0); r1 = BS_ROTR16(q1); r2 = BS_ROTR16(q2); r3 = BS_ROTR16(q3);
+    r4 = BS_ROTR16(q4); r5 = BS_ROTR16(q5); r6 = BS_ROTR16(q6); r7 = BS_ROTR16(q7);
+
+    q[0] = q7 ^ r7 ^ r0 ^ BS_ROTR32(q0 ^ r0);
+    q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ BS_ROTR32(q1 ^ r1);
+    q[2] = q1 ^ r1 ^ r2 ^ BS_ROTR32(q2 ^ r2);
+    q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ BS_ROTR32(q3 ^ r3);
+    q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ BS_ROTR32(q4 ^ r4);
+    q[5] = q4 ^ r4 ^ r5 ^ BS_ROTR32(q5 ^ r5);
+    q[6] = q5 ^ r5 ^ r6 ^ BS_ROTR32(q6 ^ r6);
+    q[7] = q6 ^ r6 ^ r7 ^ BS_ROTR32(q7 ^ r7);
+}
+
+/*
+ * InvMixColumns = MixColumns after adding 4*(a_r ^ a_r+2) to each row,
+ * which keeps the inverse down to a few extra XORs.
+ */
+static BS_ATTR void BS_FN(inv_mix_columns)(BS_T* q)
+{
+    BS_T t[8];
+
+    for (int i = 0; i < 8; i++)
+        t[i] = q[i] ^ BS_ROTR32(q[i]);
+
+    /* q += x^2 * t in GF(2^8), reduced by x^8 + x^4 + x^3 + x + 1 */
+    q[0] ^= t[6];
+    q[1] ^= t[6] ^ t[7];
+    q[2] ^= t[0] ^ t[7];
+    q[3] ^= t[1] ^ t[6];
+    q[4] ^= t[2] ^ t[6] ^ t[7];
+    q[5] ^= t[3] ^ t[7];
+    q[6] ^= t[4];
+    q[7] ^= t[5];
+
+    BS_FN(mix_columns)(q);
+}
+
+/* Round keys are stored once per lane and broadcast to wider words */
+static BS_ATTR inline void BS_FN(add_round_key)(BS_T* q, const uint64_t* sk)
+{
+    for (int i = 0; i < 8; i++)
+        q[i] ^= sk[i];
+}
+
+static BS_ATTR void BS_FN(encrypt)(const aes_key* k, BS_T* q)
+{
+    int r;
+
+    BS_FN(add_round_key)(q, k->sk);
+    for (r = 1; r < k->rounds; r++) {
+        BS_FN(sbox)(q);
+        BS_FN(shift_rows)(q);
+        BS_FN(mix_columns)(q);
+        BS_FN(add_round_key)(q, k->sk + 8 * r);
+    }
+    BS_FN(sbox)(q);
+    BS_FN(shift_rows)(q);
+    BS_FN(add_round_key)(q, k->sk + 8 * r);
+}
+
+static BS_ATTR void BS_FN(decrypt)(const aes_key* k, BS_T* q)
+{
+    int r;
+
+    BS_FN(add_round_key)(q, k->sk + 8 * k->rounds);
+    for (r = k->rounds - 1; r > 0; r--) {
+        BS_FN(inv_shift_rows)(q);
+        BS_FN(inv_sbox)(q);
+        BS_FN(add_round_key)(q, k->sk + 8 * r);
+        BS_FN(inv_mix_columns)(q);
+    }
+    BS_FN(inv_shift_rows)(q);
+    BS_FN(inv_sbox)(q);
+    BS_FN(add_round_key)(q, k->sk);
+}
+
+/* Mode loops, BS_BLOCKS blocks per pass; all allow in == out */
+
+static BS_ATTR void BS_FN(ecb_encrypt)(const aes_key* k, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    BS_T q[8];
+
+    while (nblocks > 0) {
+        size_t n = nblocks < BS_BLOCKS ? nblocks : BS_BLOCKS;
+
+        BS_FN(load)(q, in, n);
+        BS_FN(encrypt)(k, q);
+        BS_FN(store)(out, q, n);
+        in += n * AES_BLOCK_SIZE;
+        out += n * AES_BLOCK_SIZE;
+        nblocks -= n;
+    }
+}
+
+static BS_ATTR void BS_FN(ecb_decrypt)(const aes_key* k, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    BS_T q[8];
+
+    while (nblocks > 0) {
+        size_t n = nblocks < BS_BLOCKS ? nblocks : BS_BLOCKS;
+
+        BS_FN(load)(q, in, n);
+        BS_FN(decrypt)(k, q);
+        BS_FN(store)(out, q, n);
+        in += n * AES_BLOCK_SIZE;
+        out += n * AES_BLOCK_SIZE;
+        nblocks -= n;
+    }
+}
+
+static BS_ATTR void BS_FN(cbc_decrypt)(const aes_key* k, uint8_t* iv, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    uint8_t saved[BS_BLOCKS * AES_BLOCK_SIZE];
+    BS_T q[8];
+
+    while (nblocks > 0) {
+        size_t n = nblocks < BS_BLOCKS ? nblocks : BS_BLOCKS;
+        size_t len = n * AES_BLOCK_SIZE;
+
+        memcpy(saved, in, len);
+        BS_FN(load)(q, saved, n);
+        BS_FN(decrypt)(k, q);
+        BS_FN(store)(out, q, n);
+
+        for (int i = 0; i < AES_BLOCK_SIZE; i++)
+            out[i] ^= iv[i];
+        for (size_t i = AES_BLOCK_SIZE; i < len; i++)
+            out[i] ^= saved[i - AES_BLOCK_SIZE];
+        memcpy(iv, saved + len - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+
+        in += len;
+        out += len;
+        nblocks -= n;
+    }
+}
+
+static BS_ATTR void BS_FN(ctr_encrypt)(const aes_key* k, uint8_t* ctr, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    uint8_t ks[BS_BLOCKS * AES_BLOCK_SIZE];
+    BS_T q[8];
+
+    while (nblocks > 0) {
+        size_t n = nblocks < BS_BLOCKS ? nblocks : BS_BLOCKS;
+        size_t len = n * AES_BLOCK_SIZE;
+
+        for (size_t b = 0; b < n; b++) {
+            memcpy(ks + b * AES_BLOCK_SIZE, ctr, AES_BLOCK_SIZE);
+            aes_ctr_increment(ctr);
+        }
+        BS_FN(load)(q, ks, n);
+        BS_FN(encrypt)(k, q);
+        BS_FN(store)(ks, q, n);
+
+        for (size_t i = 0; i < len; i++)
+            out[i] = in[i] ^ ks[i];
+
+        in += len;
+        out += len;
+        nblocks -= n;
+    }
+}
+
+#undef BS_BLOCKS
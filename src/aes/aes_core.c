@@ -0,0 +1,138 @@
+/*********************************************************************
+ * Filename:   aes_core.c
+ * Description: AES key schedule (FIPS-197) and runtime selection of
+ *              the block cipher kernel.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <string.h>
+#include "aes_internal.h"
+#include "cpu_features.h"
+
+/* Multiply by x in GF(2^8), without a data-dependent branch */
+static uint8_t xtime(uint8_t a)
+{
+    return (uint8_t)((a << 1) ^ (0x1b & -(a >> 7)));
+}
+
+/* InvMixColumns of one column, from the x^1..x^3 multiples of each byte */
+static void inv_mix_column(const uint8_t* in, uint8_t* out)
+{
+    uint8_t m9[4], m11[4], m13[4], m14[4];
+
+    for (int i = 0; i < 4; i++) {
+        uint8_t x2 = xtime(in[i]), x4 = xtime(x2), x8 = xtime(x4);
+        m9[i] = x8 ^ in[i];
+        m11[i] = x8 ^ x2 ^ in[i];
+        m13[i] = x8 ^ x4 ^ in[i];
+        m14[i] = x8 ^ x4 ^ x2;
+    }
+    out[0] = m14[0] ^ m11[1] ^ m13[2] ^ m9[3];
+    out[1] = m9[0] ^ m14[1] ^ m11[2] ^ m13[3];
+    out[2] = m13[0] ^ m9[1] ^ m14[2] ^ m11[3];
+    out[3] = m11[0] ^ m13[1] ^ m9[2] ^ m14[3];
+}
+
+int aes_key_setup(aes_key* k, const uint8_t* key, int key_len)
+{
+    uint32_t w[4 * (AES_MAX_ROUNDS + 1)];
+    uint8_t rcon = 1;
+    int nk, total;
+
+    if (key_len != 16 && key_len != 24 && key_len != 32) return 1;
+
+    nk = key_len / 4;
+    k->rounds = nk + 6;
+    total = 4 * (k->rounds + 1);
+
+    /* Words are little-endian: byte 0 of the key lands in bits 0-7 */
+    for (int i = 0; i < nk; i++)
+        w[i] = (uint32_t)key[4 * i] | ((uint32_t)key[4 * i + 1] << 8) |
+               ((uint32_t)key[4 * i + 2] << 16) | ((uint32_t)key[4 * i + 3] << 24);
+
+    for (int i = nk; i < total; i++) {
+        uint32_t t = w[i - 1];
+        if (i % nk == 0) {
+            t = aes_ct64_sub_word((t >> 8) | (t << 24)) ^ rcon;
+            rcon = xtime(rcon);
+        } else if (nk > 6 && i % nk == 4) {
+            t = aes_ct64_sub_word(t);
+        }
+        w[i] = w[i - nk] ^ t;
+    }
+
+    for (int i = 0; i < total; i++)
+        for (int j = 0; j < 4; j++)
+            k->ek[4 * i + j] = (uint8_t)(w[i] >> (8 * j));
+
+    /* Equivalent inverse cipher: reversed order, InvMixColumns on the
+     * inner round keys, as consumed by AESDEC-style kernels */
+    memcpy(k->dk, k->ek + k->rounds * AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+    for (int r = 1; r < k->rounds; r++)
+        for (int c = 0; c < 4; c++)
+            inv_mix_column(k->ek + (k->rounds - r) * AES_BLOCK_SIZE + 4 * c,
+                           k->dk + r * AES_BLOCK_SIZE + 4 * c);
+    memcpy(k->dk + k->rounds * AES_BLOCK_SIZE, k->ek, AES_BLOCK_SIZE);
+
+    aes_ct64_bitslice_key(k);
+
+    secure_zero(w, sizeof(w));
+    return 0;
+}
+
+void aes_key_wipe(aes_key* k)
+{
+    secure_zero(k, sizeof(*k));
+}
+
+/* Fastest first; each is usable only if the CPU has what it needs */
+static const aes_engine* const engines[] = {
+    &aes_engine_aesni,
+    &aes_engine_bitslice_avx2,
+    &aes_engine_bitslice_sse2,
+    &aes_engine_portable,
+};
+
+static int engine_usable(const aes_engine* e)
+{
+    const cpu_features* f = cpu_get_features();
+
+    if (e == &aes_engine_aesni) return f->aesni;
+    if (e == &aes_engine_bitslice_avx2) return f->avx2;
+    if (e == &aes_engine_bitslice_sse2) return f->sse2;
+    return 1;
+}
+
+static const aes_engine* selected_engine = NULL;
+
+const aes_engine* aes_engine_get(void)
+{
+    const aes_engine* e = __atomic_load_n(&selected_engine, __ATOMIC_ACQUIRE);
+
+    if (e == NULL) {
+        for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+            e = engines[i];
+            if (engine_usable(e)) break;
+        }
+        __atomic_store_n(&selected_engine, e, __ATOMIC_RELEASE);
+    }
+    return e;
+}
+
+const char* aes_engine_name(void)
+{
+    return aes_engine_get()->name;
+}
+
+int aes_engine_select(const char* name)
+{
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (strcmp(name, engines[i]->name) == 0 && engine_usable(engines[i])) {
+            __atomic_store_n(&selected_engine, engines[i], __ATOMIC_RELEASE);
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,80 @@
+/*********************************************************************
+ * Filename:   aes_ct64.c
+ * Description: Portable, table-free AES kernel. Four blocks are
+ *              bitsliced into eight 64-bit words so the S-box is a
+ *              fixed boolean circuit and no memory access depends on
+ *              key or data.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <string.h>
+#include "aes_internal.h"
+
+#define BS_T        uint64_t
+#define BS_LANES    1
+#define BS_FN(name) ct64_##name
+#define BS_ATTR
+#include "aes_bitslice.h"
+
+/* Convert the byte round keys in k->ek to bitsliced form */
+void aes_ct64_bitslice_key(aes_key* k)
+{
+    uint8_t rk[4 * AES_BLOCK_SIZE];
+
+    for (int r = 0; r <= k->rounds; r++) {
+        for (int b = 0; b < 4; b++)
+            memcpy(rk + b * AES_BLOCK_SIZE, k->ek + r * AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        ct64_load(k->sk + 8 * r, rk, 4);
+    }
+    secure_zero(rk, sizeof(rk));
+}
+
+/* SubWord for the key schedule, through the same constant-time circuit */
+uint32_t aes_ct64_sub_word(uint32_t w)
+{
+    uint64_t q[8];
+
+    for (int i = 0; i < 8; i++) {
+        q[i] = 0;
+        for (int j = 0; j < 4; j++)
+            q[i] |= (uint64_t)((w >> (8 * j + i)) & 1) << j;
+    }
+    ct64_sbox(q);
+    w = 0;
+    for (int i = 0; i < 8; i++)
+        for (int j = 0; j < 4; j++)
+            w |= (uint32_t)((q[i] >> j) & 1) << (8 * j + i);
+    return w;
+}
+
+/*
+ * CBC encryption is serial, so only one block slot is ever used; the
+ * wider bitsliced kernels share this one rather than waste lanes.
+ */
+void aes_ct64_cbc_encrypt(const aes_key* k, uint8_t* iv, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    uint8_t block[AES_BLOCK_SIZE];
+    uint64_t q[8];
+
+    for (size_t n = 0; n < nblocks; n++) {
+        for (int i = 0; i < AES_BLOCK_SIZE; i++)
+            block[i] = in[i] ^ iv[i];
+        ct64_load(q, block, 1);
+        ct64_encrypt(k, q);
+        ct64_store(iv, q, 1);
+        memcpy(out, iv, AES_BLOCK_SIZE);
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+}
+
+const aes_engine aes_engine_portable = {
+    "portable",
+    ct64_ecb_encrypt,
+    ct64_ecb_decrypt,
+    aes_ct64_cbc_encrypt,
+    ct64_cbc_decrypt,
+    ct64_ctr_encrypt,
+};
@@ -0,0 +1,93 @@
+/*********************************************************************
+ * Filename:   aes_ctr.c
+ * Description: AES-CTR stream mode on top of the engine's CTR kernel:
+ *              arbitrary lengths, in-place operation and random
+ *              access to any byte offset of the keystream.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <string.h>
+#include "aes_internal.h"
+
+/*
+ * While offset is not block aligned, ks holds the keystream block the
+ * offset falls in and ctr already points past it. Otherwise ctr is
+ * the counter block for offset itself.
+ */
+
+int aes_ctr_init(aes_ctr* st, const aes_ctx* ctx, const char* IV)
+{
+    if (ctx == NULL) return 1;
+
+    st->ctx = ctx;
+    memcpy(st->iv, IV, AES_BLOCK_SIZE);
+    memcpy(st->ctr, IV, AES_BLOCK_SIZE);
+    st->offset = 0;
+    return 0;
+}
+
+void aes_ctr_seek(aes_ctr* st, unsigned long long offset)
+{
+    memcpy(st->ctr, st->iv, AES_BLOCK_SIZE);
+    aes_ctr_add(st->ctr, offset / AES_BLOCK_SIZE);
+    st->offset = offset;
+
+    if (offset % AES_BLOCK_SIZE != 0) {
+        aes_engine_get()->ecb_encrypt(&st->ctx->key, st->ctr, st->ks, 1);
+        aes_ctr_increment(st->ctr);
+    }
+}
+
+void aes_ctr_crypt(aes_ctr* st, const void* in, void* out, size_t len)
+{
+    const aes_engine* e = aes_engine_get();
+    const uint8_t* src = in;
+    uint8_t* dst = out;
+    size_t pos = st->offset % AES_BLOCK_SIZE;
+    size_t nblocks;
+
+    /* Finish the partial block left by the previous call */
+    if (pos != 0) {
+        size_t n = AES_BLOCK_SIZE - pos < len ? AES_BLOCK_SIZE - pos : len;
+
+        for (size_t i = 0; i < n; i++)
+            dst[i] = src[i] ^ st->ks[pos + i];
+        src += n;
+        dst += n;
+        len -= n;
+        st->offset += n;
+    }
+
+    nblocks = len / AES_BLOCK_SIZE;
+    if (nblocks > 0) {
+        e->ctr_encrypt(&st->ctx->key, st->ctr, src, dst, nblocks);
+        src += nblocks * AES_BLOCK_SIZE;
+        dst += nblocks * AES_BLOCK_SIZE;
+        len -= nblocks * AES_BLOCK_SIZE;
+        st->offset += nblocks * AES_BLOCK_SIZE;
+    }
+
+    /* Start a new partial block; its keystream is kept for next time */
+    if (len > 0) {
+        e->ecb_encrypt(&st->ctx->key, st->ctr, st->ks, 1);
+        aes_ctr_increment(st->ctr);
+        for (size_t i = 0; i < len; i++)
+            dst[i] = src[i] ^ st->ks[i];
+        st->offset += len;
+    }
+}
+
+int aes_ctx_ctr(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV,
+                unsigned long long offset)
+{
+    aes_ctr st;
+
+    if (aes_ctr_init(&st, ctx, IV) != 0) return 1;
+    if (offset != 0) aes_ctr_seek(&st, offset);
+    aes_ctr_crypt(&st, buffer, buffer, buffer_len);
+
+    secure_zero(&st, sizeof(st));
+    return 0;
+}
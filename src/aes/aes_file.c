@@ -0,0 +1,332 @@
+/*********************************************************************
+ * Filename:   aes_file.c
+ * Description: File encryption pipeline. A ring of aligned buffers
+ *              cycles through io_uring reads, encryption (CTR on the
+ *              worker pool, CBC through the streaming interface) and
+ *              io_uring writes, so reading ahead, the cipher and
+ *              writing behind all overlap.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "aes_internal.h"
+#include "uring.h"
+
+#define FILE_ALIGN       4096
+#define FILE_DEF_BUFFER  (1u << 20)
+#define FILE_DEF_BUFFERS 8
+#define FILE_MAX_BUFFERS 64
+/* io_uring lengths are 32-bit and the kernel moves at most ~2 GiB per
+ * read or write, so larger buffers would quietly go synchronous */
+#define FILE_MAX_BUFFER  (1u << 30)
+
+enum { SLOT_FREE, SLOT_READING, SLOT_READY, SLOT_WRITING };
+
+/* Tags carry the slot index and whether the request was a write */
+#define TAG_WRITE (1ull << 32)
+
+typedef struct {
+    uint8_t* buf;
+    uint8_t* out;               /* CBC output; CTR works in place */
+    uint8_t* wbuf;              /* what is written: buf or out */
+    size_t len;                 /* plaintext bytes in buf */
+    size_t want;                /* bytes requested from the kernel */
+    size_t wlen;                /* bytes being written */
+    unsigned long long off;     /* input offset */
+    unsigned long long wpos;    /* output offset */
+    unsigned long long seq;
+    int state;
+} file_slot;
+
+typedef struct {
+    aes_ctx* ctx;
+    int mode;
+    int enc;
+    const char* IV;
+    aes_stream st;
+    int in, out;
+    int direct_in, direct_out;
+    int stuck;                  /* requests may still be in flight */
+    unsigned long long size;
+    unsigned long long out_pos;
+    unsigned long long bytes_out;
+} file_job;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t round_up(size_t n)
+{
+    return (n + FILE_ALIGN - 1) & ~(size_t)(FILE_ALIGN - 1);
+}
+
+/* Finishes a short transfer synchronously until need bytes are done;
+ * returns 1 on error. O_DIRECT transfers must start and end on the
+ * alignment, so a direct retry goes back to the last aligned boundary
+ * and runs to the rounded-up end, moving the same bytes again */
+static int finish_io(int fd, uint8_t* buf, size_t done, size_t need, unsigned long long off,
+                     int wr, int direct)
+{
+    size_t end = direct ? round_up(need) : need;
+
+    while (done < need) {
+        ssize_t r;
+
+        if (direct) done &= ~(size_t)(FILE_ALIGN - 1);
+        r = wr ? pwrite(fd, buf + done, end - done, (off_t)(off + done))
+               : pread(fd, buf + done, end - done, (off_t)(off + done));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return 1;
+        done += (size_t)r;
+    }
+    return 0;
+}
+
+/* Encrypts or decrypts one slot in file order and picks its output
+ * range; returns 1 on a padding error */
+static int crypt_slot(file_job* j, file_slot* s)
+{
+    size_t n, fin;
+    int last = s->off + s->len == j->size;
+
+    if (j->mode == AES_STREAM_CTR) {
+        aes_ctx_ctr_parallel(j->ctx, s->buf, s->len, j->IV, s->off);
+        s->wbuf = s->buf;
+        s->wlen = s->len;
+        /* The rounded-up direct write must not carry stale data */
+        if (j->direct_out) memset(s->buf + s->len, 0, round_up(s->len) - s->len);
+    } else {
+        aes_stream_update(&j->st, s->buf, s->len, s->out, &n);
+        s->wbuf = s->out;
+        s->wlen = n;
+        if (last) {
+            if (aes_stream_final(&j->st, s->out + n, &fin) != 0) return 1;
+            s->wlen += fin;
+        }
+    }
+    s->wpos = j->out_pos;
+    j->out_pos += s->wlen;
+    return 0;
+}
+
+/*
+ * After a failed wait the kernel may still be moving data into or out of
+ * the buffers: cancels every request in flight and collects all of their
+ * completions. Returns 1 if the ring could not be drained, when the
+ * buffers must not be freed.
+ */
+static int drain_slots(const file_slot* slots, int nslots, int inflight, uring* u)
+{
+    int tries = 0;
+
+    for (int i = 0; i < nslots; i++) {
+        if (slots[i].state == SLOT_READING) uring_cancel(u, (unsigned long long)i);
+        if (slots[i].state == SLOT_WRITING) uring_cancel(u, TAG_WRITE | (unsigned long long)i);
+    }
+    while (inflight > 0) {
+        unsigned long long tag;
+        long res;
+
+        if (uring_wait(u, &tag, &res) == 0) {
+            inflight--;
+            tries = 0;
+        } else if (++tries == 100) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int run_pipeline(file_job* j, file_slot* slots, int nslots, size_t bufsize, uring* u)
+{
+    unsigned long long rd_off = 0, next_seq = 0, crypt_seq = 0;
+    int inflight = 0, failed = 0;
+
+    for (;;) {
+        unsigned long long tag;
+        long res;
+        int progress = 0;
+
+        /* Read ahead into every free buffer */
+        for (int i = 0; i < nslots && !failed && rd_off < j->size; i++) {
+            file_slot* s = &slots[i];
+
+            if (s->state != SLOT_FREE) continue;
+            s->off = rd_off;
+            s->len = j->size - rd_off < bufsize ? (size_t)(j->size - rd_off) : bufsize;
+            s->want = j->direct_in ? round_up(s->len) : s->len;
+            s->seq = next_seq++;
+            if (uring_read(u, j->in, s->buf, s->want, (off_t)s->off, (unsigned long long)i) != 0) {
+                failed = 1;
+                break;
+            }
+            s->state = SLOT_READING;
+            rd_off += s->len;
+            inflight++;
+        }
+        if (uring_submit(u) != 0) failed = 1;
+
+        /* The cipher runs while the kernel moves the other buffers */
+        for (int i = 0; i < nslots && !failed; i++) {
+            file_slot* s = &slots[i];
+
+            if (s->state != SLOT_READY || s->seq != crypt_seq) continue;
+            if (crypt_slot(j, s) != 0) {
+                failed = 1;
+                break;
+            }
+            crypt_seq++;
+            progress = 1;
+            if (s->wlen == 0) {
+                s->state = SLOT_FREE;
+                continue;
+            }
+            if (uring_write(u, j->out, s->wbuf, j->direct_out ? round_up(s->wlen) : s->wlen,
+                            (off_t)s->wpos, TAG_WRITE | (unsigned long long)i) != 0) {
+                failed = 1;
+                break;
+            }
+            s->state = SLOT_WRITING;
+            inflight++;
+            i = -1;     /* the next slot in order may be ready already */
+        }
+        if (progress) continue;
+        if (inflight == 0) break;
+
+        if (uring_wait(u, &tag, &res) != 0) {
+            j->stuck = drain_slots(slots, nslots, inflight, u);
+            return 1;
+        }
+        inflight--;
+        {
+            file_slot* s = &slots[tag & 0xffffffffu];
+
+            if (tag & TAG_WRITE) {
+                if (res < 0 ||
+                    finish_io(j->out, s->wbuf, (size_t)res, s->wlen, s->wpos, 1, j->direct_out) != 0)
+                    failed = 1;
+                j->bytes_out += s->wlen;
+                s->state = SLOT_FREE;
+            } else {
+                /* O_DIRECT reads stop at end of file, short of want */
+                if (res < 0 ||
+                    finish_io(j->in, s->buf, (size_t)res, s->len, s->off, 0, j->direct_in) != 0)
+                    failed = 1;
+                s->state = failed ? SLOT_FREE : SLOT_READY;
+            }
+        }
+    }
+
+    /* An empty input still gets its padding block */
+    if (!failed && j->size == 0 && j->mode != AES_STREAM_CTR) {
+        size_t n;
+
+        if (aes_stream_final(&j->st, slots[0].out, &n) != 0 ||
+            finish_io(j->out, slots[0].out, 0, n, 0, 1, 0) != 0)
+            failed = 1;
+        j->out_pos = j->bytes_out = n;
+    }
+    return failed;
+}
+
+static int open_file(const char* path, int flags, int direct, int* used_direct)
+{
+    int fd = -1;
+
+#ifdef O_DIRECT
+    if (direct) {
+        fd = open(path, flags | O_DIRECT, 0644);
+        /* Not every file system supports it */
+        if (fd >= 0) *used_direct = 1;
+    }
+#endif
+    if (fd < 0) fd = open(path, flags, 0644);
+    return fd;
+}
+
+int aes_file_crypt(aes_ctx* ctx, int mode, int enc, const char* IV,
+                   const char* in_path, const char* out_path,
+                   const aes_file_opts* opts, aes_file_stats* stats)
+{
+    size_t bufsize = opts && opts->buffer_size ? opts->buffer_size : FILE_DEF_BUFFER;
+    int nslots = opts && opts->buffers ? opts->buffers : FILE_DEF_BUFFERS;
+    int want_direct = opts ? opts->direct : 0;
+    file_slot slots[FILE_MAX_BUFFERS];
+    file_job j;
+    struct stat sb;
+    uring* u = NULL;
+    double t0 = now_s();
+    int failed = 1;
+
+    if (ctx == NULL || (mode != AES_STREAM_CBC && mode != AES_STREAM_CTR)) return 1;
+    if (bufsize % FILE_ALIGN != 0 || bufsize > FILE_MAX_BUFFER) return 1;
+    if (nslots < 2 || nslots > FILE_MAX_BUFFERS) return 1;
+
+    memset(&j, 0, sizeof(j));
+    memset(slots, 0, sizeof(slots));
+    j.ctx = ctx;
+    j.mode = mode;
+    j.enc = enc;
+    j.IV = IV;
+    j.in = open_file(in_path, O_RDONLY, want_direct, &j.direct_in);
+    /* CBC output offsets drift off alignment, so only CTR writes directly */
+    j.out = open_file(out_path, O_WRONLY | O_CREAT | O_TRUNC,
+                      want_direct && mode == AES_STREAM_CTR, &j.direct_out);
+    if (j.in < 0 || j.out < 0 || fstat(j.in, &sb) != 0) goto done;
+    j.size = (unsigned long long)sb.st_size;
+    if (mode != AES_STREAM_CTR && aes_stream_init(&j.st, ctx, mode, enc, IV) != 0) goto done;
+
+    for (int i = 0; i < nslots; i++) {
+        if (posix_memalign((void**)&slots[i].buf, FILE_ALIGN, bufsize) != 0) goto done;
+        if (mode != AES_STREAM_CTR &&
+            posix_memalign((void**)&slots[i].out, FILE_ALIGN, bufsize + FILE_ALIGN) != 0)
+            goto done;
+    }
+
+    /* One read and one write per buffer can be outstanding */
+    u = uring_create(2 * (unsigned)nslots);
+    if (u == NULL) goto done;
+
+    failed = run_pipeline(&j, slots, nslots, bufsize, u);
+    /* Direct writes of the last buffer were rounded up to the alignment */
+    if (!failed && j.direct_out && ftruncate(j.out, (off_t)j.out_pos) != 0) failed = 1;
+
+done:
+    if (stats != NULL) {
+        stats->bytes_in = j.size;
+        stats->bytes_out = j.bytes_out;
+        stats->seconds = now_s() - t0;
+        stats->uring = u != NULL && uring_async(u);
+        stats->direct_in = j.direct_in;
+        stats->direct_out = j.direct_out;
+    }
+    /* Leaked rather than handed back while the kernel may still use them */
+    if (j.stuck) {
+        nslots = 0;
+        u = NULL;
+    }
+    uring_destroy(u);
+    for (int i = 0; i < nslots && i < FILE_MAX_BUFFERS; i++) {
+        if (slots[i].buf) secure_zero(slots[i].buf, bufsize);
+        if (slots[i].out) secure_zero(slots[i].out, bufsize + FILE_ALIGN);
+        free(slots[i].buf);
+        free(slots[i].out);
+    }
+    secure_zero(&j.st, sizeof(j.st));
+    if (j.in >= 0) close(j.in);
+    if (j.out >= 0) close(j.out);
+    return failed;
+}
@@ -0,0 +1,379 @@
+/*********************************************************************
+ * Filename:   aes_gcm.c
+ * Description: AES-GCM authenticated encryption (NIST SP 800-38D).
+ *              GHASH runs on PCLMULQDQ alongside the AES-NI kernel,
+ *              and on 4-bit Shoup tables with the other kernels.
+ *              Bulk data is encrypted and hashed in chunks small
+ *              enough to stay in L1, so it is read from memory once.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <string.h>
+#include "aes_internal.h"
+#include "cpu_features.h"
+
+/* Blocks encrypted then hashed per step by the table-driven path */
+#define GCM_CHUNK_BLOCKS 64
+
+/* SP 800-38D limits: 2^39 - 256 bits of plaintext, 2^64 - 1 of AAD */
+#define GCM_MAX_MSG ((1ULL << 36) - 32)
+#define GCM_MAX_AAD ((1ULL << 61) - 1)
+
+enum { GCM_AAD, GCM_DATA, GCM_DONE };
+
+/* ---------------- 4-bit table GHASH ---------------- */
+
+/* Reduction of the four bits shifted out per step, for the top 16 bits */
+static const uint64_t last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static uint64_t load_be64(const uint8_t* p)
+{
+    uint64_t x = 0;
+    for (int i = 0; i < 8; i++)
+        x = (x << 8) | p[i];
+    return x;
+}
+
+static void store_be64(uint8_t* p, uint64_t x)
+{
+    for (int i = 7; i >= 0; i--, x >>= 8)
+        p[i] = (uint8_t)x;
+}
+
+/* htab[0..15] low and htab[16..31] high halves of i * H, i a 4-bit value */
+static void table_init(unsigned long long* htab, const uint8_t* h)
+{
+    unsigned long long* hl = htab;
+    unsigned long long* hh = htab + 16;
+    uint64_t vh = load_be64(h), vl = load_be64(h + 8);
+
+    hl[0] = hh[0] = 0;
+    hl[8] = vl;
+    hh[8] = vh;
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t t = (vl & 1) * 0xe100000000000000ULL;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ t;
+        hl[i] = vl;
+        hh[i] = vh;
+    }
+    for (int i = 2; i <= 8; i *= 2)
+        for (int j = 1; j < i; j++) {
+            hl[i + j] = hl[i] ^ hl[j];
+            hh[i + j] = hh[i] ^ hh[j];
+        }
+}
+
+/* y = y * H */
+static void table_mult(const unsigned long long* htab, uint8_t* y)
+{
+    const unsigned long long* hl = htab;
+    const unsigned long long* hh = htab + 16;
+    uint64_t zh, zl;
+    int lo = y[15] & 0xf;
+
+    zh = hh[lo];
+    zl = hl[lo];
+    for (int i = 15; i >= 0; i--) {
+        int hi = y[i] >> 4, rem;
+        lo = y[i] & 0xf;
+
+        if (i != 15) {
+            rem = (int)(zl & 0xf);
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (last4[rem] << 48) ^ hh[lo];
+            zl ^= hl[lo];
+        }
+        rem = (int)(zl & 0xf);
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ (last4[rem] << 48) ^ hh[hi];
+        zl ^= hl[hi];
+    }
+
+    store_be64(y, zh);
+    store_be64(y + 8, zl);
+}
+
+static void ghash(const aes_gcm* st, uint8_t* y, const uint8_t* in, size_t nblocks)
+{
+    if (st->clmul) {
+        gcm_clmul_ghash(st->htab, y, in, nblocks);
+        return;
+    }
+    for (; nblocks > 0; nblocks--, in += AES_BLOCK_SIZE) {
+        for (int i = 0; i < AES_BLOCK_SIZE; i++)
+            y[i] ^= in[i];
+        table_mult(st->htab, y);
+    }
+}
+
+/* ---------------- CTR with the GCM 32-bit counter ---------------- */
+
+static void inc32(uint8_t* ctr)
+{
+    for (int i = AES_BLOCK_SIZE - 1; i >= 12; i--)
+        if (++ctr[i] != 0) break;
+}
+
+/*
+ * The engine kernels count over all 128 bits, GCM only over the low 32.
+ * Split the run where the low word wraps and put back the upper 96 bits
+ * the kernel carried into.
+ */
+static void gcm_ctr(aes_gcm* st, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    const aes_engine* e = aes_engine_get();
+
+    while (nblocks > 0) {
+        uint64_t low = (uint64_t)st->ctr[12] << 24 | (uint64_t)st->ctr[13] << 16 |
+                       (uint64_t)st->ctr[14] << 8 | st->ctr[15];
+        uint64_t room = (1ULL << 32) - low;
+        size_t n = nblocks < room ? nblocks : (size_t)room;
+
+        e->ctr_encrypt(&st->ctx->key, st->ctr, in, out, n);
+        memcpy(st->ctr, st->j0, 12);
+        in += n * AES_BLOCK_SIZE;
+        out += n * AES_BLOCK_SIZE;
+        nblocks -= n;
+    }
+}
+
+/* ---------------- incremental API ---------------- */
+
+static int use_clmul(void)
+{
+    const cpu_features* f = cpu_get_features();
+    return aes_engine_get() == &aes_engine_aesni && f->pclmul && f->ssse3;
+}
+
+int aes_gcm_init(aes_gcm* st, const aes_ctx* ctx, const char* IV, size_t iv_len)
+{
+    uint8_t h[AES_BLOCK_SIZE] = {0};
+
+    if (ctx == NULL || iv_len == 0) return 1;
+
+    memset(st, 0, sizeof(*st));
+    st->ctx = ctx;
+    st->clmul = use_clmul();
+
+    aes_engine_get()->ecb_encrypt(&ctx->key, h, h, 1);
+    if (st->clmul)
+        gcm_clmul_init(st->htab, h);
+    else
+        table_init(st->htab, h);
+    secure_zero(h, sizeof(h));
+
+    if (iv_len == 12) {
+        memcpy(st->j0, IV, 12);
+        st->j0[15] = 1;
+    } else {
+        /* J0 = GHASH(IV || 0-pad || 0^64 || [len(IV)]_64) */
+        uint8_t last[AES_BLOCK_SIZE] = {0};
+        size_t full = iv_len / AES_BLOCK_SIZE, rem = iv_len % AES_BLOCK_SIZE;
+
+        ghash(st, st->j0, (const uint8_t*)IV, full);
+        if (rem != 0) {
+            memcpy(last, IV + full * AES_BLOCK_SIZE, rem);
+            ghash(st, st->j0, last, 1);
+            memset(last, 0, sizeof(last));
+        }
+        store_be64(last + 8, (uint64_t)iv_len * 8);
+        ghash(st, st->j0, last, 1);
+    }
+
+    memcpy(st->ctr, st->j0, AES_BLOCK_SIZE);
+    inc32(st->ctr);
+    return 0;
+}
+
+int aes_gcm_aad(aes_gcm* st, const void* aad, size_t len)
+{
+    const uint8_t* p = aad;
+    size_t pos = st->aad_len % AES_BLOCK_SIZE;
+    size_t nblocks;
+
+    if (st->phase != GCM_AAD || len > GCM_MAX_AAD - st->aad_len) return 1;
+    if (len == 0) return 0;
+    st->aad_len += len;
+
+    if (pos != 0) {
+        size_t n = AES_BLOCK_SIZE - pos < len ? AES_BLOCK_SIZE - pos : len;
+
+        memcpy(st->buf + pos, p, n);
+        p += n;
+        len -= n;
+        if (pos + n < AES_BLOCK_SIZE) return 0;
+        ghash(st, st->y, st->buf, 1);
+    }
+
+    nblocks = len / AES_BLOCK_SIZE;
+    ghash(st, st->y, p, nblocks);
+    p += nblocks * AES_BLOCK_SIZE;
+    len -= nblocks * AES_BLOCK_SIZE;
+
+    memcpy(st->buf, p, len);
+    return 0;
+}
+
+/* Hash a zero-padded partial block left in buf */
+static void flush_partial(aes_gcm* st, size_t pos)
+{
+    if (pos == 0) return;
+    memset(st->buf + pos, 0, AES_BLOCK_SIZE - pos);
+    ghash(st, st->y, st->buf, 1);
+}
+
+static int gcm_update(aes_gcm* st, const void* in, void* out, size_t len, int enc)
+{
+    const uint8_t* src = in;
+    uint8_t* dst = out;
+    size_t pos, nblocks;
+
+    if (st->phase == GCM_DONE || len > GCM_MAX_MSG - st->msg_len) return 1;
+    if (st->phase == GCM_AAD) {
+        flush_partial(st, st->aad_len % AES_BLOCK_SIZE);
+        st->phase = GCM_DATA;
+    }
+
+    pos = st->msg_len % AES_BLOCK_SIZE;
+    st->msg_len += len;
+
+    /* Finish the partial block left by the previous call */
+    if (pos != 0) {
+        size_t n = AES_BLOCK_SIZE - pos < len ? AES_BLOCK_SIZE - pos : len;
+
+        for (size_t i = 0; i < n; i++) {
+            uint8_t c = enc ? src[i] ^ st->ks[pos + i] : src[i];
+            dst[i] = src[i] ^ st->ks[pos + i];
+            st->buf[pos + i] = c;
+        }
+        src += n;
+        dst += n;
+        len -= n;
+        if (pos + n < AES_BLOCK_SIZE) return 0;
+        ghash(st, st->y, st->buf, 1);
+    }
+
+    nblocks = len / AES_BLOCK_SIZE;
+    if (st->clmul && nblocks >= 8) {
+        size_t done = gcm_clmul_aesni_crypt(&st->ctx->key, st->htab, st->ctr, st->y,
+                                            src, dst, nblocks, enc);
+        src += done * AES_BLOCK_SIZE;
+        dst += done * AES_BLOCK_SIZE;
+        nblocks -= done;
+    }
+    while (nblocks > 0) {
+        size_t n = nblocks < GCM_CHUNK_BLOCKS ? nblocks : GCM_CHUNK_BLOCKS;
+
+        /* Ciphertext is hashed while the chunk is still in cache */
+        if (!enc) ghash(st, st->y, src, n);
+        gcm_ctr(st, src, dst, n);
+        if (enc) ghash(st, st->y, dst, n);
+        src += n * AES_BLOCK_SIZE;
+        dst += n * AES_BLOCK_SIZE;
+        nblocks -= n;
+    }
+    len %= AES_BLOCK_SIZE;
+
+    /* Start a new partial block; its keystream is kept for next time */
+    if (len > 0) {
+        aes_engine_get()->ecb_encrypt(&st->ctx->key, st->ctr, st->ks, 1);
+        inc32(st->ctr);
+        for (size_t i = 0; i < len; i++) {
+            uint8_t c = enc ? src[i] ^ st->ks[i] : src[i];
+            dst[i] = src[i] ^ st->ks[i];
+            st->buf[i] = c;
+        }
+    }
+    return 0;
+}
+
+int aes_gcm_encrypt_update(aes_gcm* st, const void* in, void* out, size_t len)
+{
+    return gcm_update(st, in, out, len, 1);
+}
+
+int aes_gcm_decrypt_update(aes_gcm* st, const void* in, void* out, size_t len)
+{
+    return gcm_update(st, in, out, len, 0);
+}
+
+int aes_gcm_final(aes_gcm* st, char* tag)
+{
+    uint8_t lens[AES_BLOCK_SIZE], ek0[AES_BLOCK_SIZE];
+
+    if (st->phase == GCM_DONE) return 1;
+    if (st->phase == GCM_AAD)
+        flush_partial(st, st->aad_len % AES_BLOCK_SIZE);
+    else
+        flush_partial(st, st->msg_len % AES_BLOCK_SIZE);
+    st->phase = GCM_DONE;
+
+    store_be64(lens, st->aad_len * 8);
+    store_be64(lens + 8, st->msg_len * 8);
+    ghash(st, st->y, lens, 1);
+
+    aes_engine_get()->ecb_encrypt(&st->ctx->key, st->j0, ek0, 1);
+    for (int i = 0; i < AES_GCM_TAG_SIZE; i++)
+        tag[i] = (char)(st->y[i] ^ ek0[i]);
+
+    secure_zero(ek0, sizeof(ek0));
+    secure_zero(st->htab, sizeof(st->htab));
+    return 0;
+}
+
+int aes_gcm_verify(aes_gcm* st, const char* tag, size_t tag_len)
+{
+    char expect[AES_GCM_TAG_SIZE];
+    uint8_t diff = 0;
+
+    if (tag_len < 4 || tag_len > AES_GCM_TAG_SIZE) return 1;
+    if (aes_gcm_final(st, expect) != 0) return 1;
+
+    /* Constant time: every byte is compared whatever the outcome */
+    for (size_t i = 0; i < tag_len; i++)
+        diff |= (uint8_t)(expect[i] ^ tag[i]);
+
+    secure_zero(expect, sizeof(expect));
+    return diff != 0;
+}
+
+/* ---------------- one-shot API ---------------- */
+
+int aes_gcm_encrypt(aes_ctx* ctx, const char* IV, size_t iv_len,
+                    const void* aad, size_t aad_len,
+                    void* buffer, size_t buffer_len, char* tag)
+{
+    aes_gcm st;
+    int ret;
+
+    if (aes_gcm_init(&st, ctx, IV, iv_len) != 0) return 1;
+    ret = aes_gcm_aad(&st, aad, aad_len) != 0 ||
+          aes_gcm_encrypt_update(&st, buffer, buffer, buffer_len) != 0 ||
+          aes_gcm_final(&st, tag) != 0;
+
+    secure_zero(&st, sizeof(st));
+    return ret;
+}
+
+int aes_gcm_decrypt(aes_ctx* ctx, const char* IV, size_t iv_len,
+                    const void* aad, size_t aad_len,
+                    void* buffer, size_t buffer_len, const char* tag, size_t tag_len)
+{
+    aes_gcm st;
+    int ret;
+
+    if (aes_gcm_init(&st, ctx, IV, iv_len) != 0) return 1;
+    ret = aes_gcm_aad(&st, aad, aad_len) != 0 ||
+          aes_gcm_decrypt_update(&st, buffer, buffer, buffer_len) != 0 ||
+          aes_gcm_verify(&st, tag, tag_len) != 0;
+
+    if (ret) secure_zero(buffer, buffer_len);
+    secure_zero(&st, sizeof(st));
+    return ret;
+}
@@ -0,0 +1,247 @@
+/*********************************************************************
+ * Filename:   aes_gcm_clmul.c
+ * Description: GHASH with PCLMULQDQ, and an AES-NI GCM loop that
+ *              stitches the CTR keystream with GHASH so every block
+ *              is hashed while it is still in registers.
+ *
+ *              The field arithmetic follows Gueron and Kounavis,
+ *              "Intel Carry-Less Multiplication Instruction and its
+ *              Usage for Computing the GCM Mode": operands are byte
+ *              reversed, multiplied as 256-bit carry-less products,
+ *              shifted left by one and reduced. Four blocks share
+ *              one reduction by multiplying them with H^4..H^1.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include "aes_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+
+#define CLMUL_FN __attribute__((target("pclmul,ssse3,sse2")))
+#define GCM_FN   __attribute__((target("aes,pclmul,ssse3,sse2")))
+
+static CLMUL_FN inline __m128i bswap128(__m128i x)
+{
+    const __m128i mask = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    return _mm_shuffle_epi8(x, mask);
+}
+
+/* Accumulate the unreduced 256-bit product a * b into lo:mid:hi */
+static CLMUL_FN inline void clmul_acc(__m128i a, __m128i b, __m128i* lo, __m128i* mid, __m128i* hi)
+{
+    *lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, b, 0x00));
+    *hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, b, 0x11));
+    *mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(a, b, 0x10));
+    *mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(a, b, 0x01));
+}
+
+/* Shift the reflected 256-bit product left by one and reduce mod g(x) */
+static CLMUL_FN inline __m128i clmul_reduce(__m128i lo, __m128i mid, __m128i hi)
+{
+    __m128i t2, t3, t4, t5, t6, t7, t8, t9;
+
+    t3 = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    t6 = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    t7 = _mm_srli_epi32(t3, 31);
+    t8 = _mm_srli_epi32(t6, 31);
+    t3 = _mm_slli_epi32(t3, 1);
+    t6 = _mm_slli_epi32(t6, 1);
+    t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    t3 = _mm_or_si128(t3, t7);
+    t6 = _mm_or_si128(t6, t8);
+    t6 = _mm_or_si128(t6, t9);
+
+    t7 = _mm_slli_epi32(t3, 31);
+    t8 = _mm_slli_epi32(t3, 30);
+    t9 = _mm_slli_epi32(t3, 25);
+    t7 = _mm_xor_si128(t7, t8);
+    t7 = _mm_xor_si128(t7, t9);
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    t3 = _mm_xor_si128(t3, t7);
+
+    t2 = _mm_srli_epi32(t3, 1);
+    t4 = _mm_srli_epi32(t3, 2);
+    t5 = _mm_srli_epi32(t3, 7);
+    t2 = _mm_xor_si128(t2, t4);
+    t2 = _mm_xor_si128(t2, t5);
+    t2 = _mm_xor_si128(t2, t8);
+    t3 = _mm_xor_si128(t3, t2);
+    return _mm_xor_si128(t6, t3);
+}
+
+static CLMUL_FN inline __m128i gfmul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+    clmul_acc(a, b, &lo, &mid, &hi);
+    return clmul_reduce(lo, mid, hi);
+}
+
+/* y = (y ^ x[0]) * H^4 ^ x[1] * H^3 ^ x[2] * H^2 ^ x[3] * H, reduced once */
+static CLMUL_FN inline __m128i ghash4(const __m128i* hp, __m128i y, const __m128i* x)
+{
+    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+
+    clmul_acc(_mm_xor_si128(y, x[0]), hp[3], &lo, &mid, &hi);
+    clmul_acc(x[1], hp[2], &lo, &mid, &hi);
+    clmul_acc(x[2], hp[1], &lo, &mid, &hi);
+    clmul_acc(x[3], hp[0], &lo, &mid, &hi);
+    return clmul_reduce(lo, mid, hi);
+}
+
+static CLMUL_FN inline void load_powers(__m128i* hp, const unsigned long long* htab)
+{
+    for (int i = 0; i < 4; i++)
+        hp[i] = _mm_loadu_si128((const __m128i*)htab + i);
+}
+
+/* htab receives H, H^2, H^3, H^4 in byte-reversed form */
+CLMUL_FN void gcm_clmul_init(unsigned long long* htab, const uint8_t* h)
+{
+    __m128i hp[4];
+
+    hp[0] = bswap128(_mm_loadu_si128((const __m128i*)h));
+    for (int i = 1; i < 4; i++)
+        hp[i] = gfmul(hp[i - 1], hp[0]);
+    for (int i = 0; i < 4; i++)
+        _mm_storeu_si128((__m128i*)htab + i, hp[i]);
+}
+
+CLMUL_FN void gcm_clmul_ghash(const unsigned long long* htab, uint8_t* y, const uint8_t* in, size_t nblocks)
+{
+    __m128i hp[4], x[4];
+    __m128i acc = bswap128(_mm_loadu_si128((const __m128i*)y));
+
+    load_powers(hp, htab);
+
+    for (; nblocks >= 4; nblocks -= 4) {
+        for (int i = 0; i < 4; i++)
+            x[i] = bswap128(_mm_loadu_si128((const __m128i*)in + i));
+        acc = ghash4(hp, acc, x);
+        in += 4 * AES_BLOCK_SIZE;
+    }
+    for (; nblocks > 0; nblocks--) {
+        acc = gfmul(_mm_xor_si128(acc, bswap128(_mm_loadu_si128((const __m128i*)in))), hp[0]);
+        in += AES_BLOCK_SIZE;
+    }
+
+    _mm_storeu_si128((__m128i*)y, bswap128(acc));
+}
+
+#define AESENC8(b, k) do { \
+    (b)[0] = _mm_aesenc_si128((b)[0], k); (b)[1] = _mm_aesenc_si128((b)[1], k); \
+    (b)[2] = _mm_aesenc_si128((b)[2], k); (b)[3] = _mm_aesenc_si128((b)[3], k); \
+    (b)[4] = _mm_aesenc_si128((b)[4], k); (b)[5] = _mm_aesenc_si128((b)[5], k); \
+    (b)[6] = _mm_aesenc_si128((b)[6], k); (b)[7] = _mm_aesenc_si128((b)[7], k); \
+} while (0)
+
+/*
+ * Stitched GCM over whole multiples of 8 blocks; returns the number of
+ * blocks processed. ctr is the GCM counter block (32-bit increment).
+ * Each of the first eight AES rounds is paired with one block's GHASH
+ * multiply, reduced after every fourth. Decryption hashes the current
+ * pass's ciphertext, encryption the previous pass's output, so the AES
+ * and CLMUL chains are always independent and overlap.
+ */
+GCM_FN size_t gcm_clmul_aesni_crypt(const aes_key* k, const unsigned long long* htab, uint8_t* ctr, uint8_t* y,
+                                    const uint8_t* in, uint8_t* out, size_t nblocks, int enc)
+{
+    __m128i rk[AES_MAX_ROUNDS + 1], hp[4], b[8], c[8], lo, mid, hi;
+    __m128i acc = bswap128(_mm_loadu_si128((const __m128i*)y));
+    uint32_t w0, w1, w2, n32;
+    size_t done = nblocks & ~(size_t)7;
+    int rounds = k->rounds, pending = 0;
+
+    if (done == 0) return 0;
+
+    for (int r = 0; r <= rounds; r++)
+        rk[r] = _mm_loadu_si128((const __m128i*)(k->ek + r * AES_BLOCK_SIZE));
+    load_powers(hp, htab);
+
+    w0 = (uint32_t)ctr[0] | (uint32_t)ctr[1] << 8 | (uint32_t)ctr[2] << 16 | (uint32_t)ctr[3] << 24;
+    w1 = (uint32_t)ctr[4] | (uint32_t)ctr[5] << 8 | (uint32_t)ctr[6] << 16 | (uint32_t)ctr[7] << 24;
+    w2 = (uint32_t)ctr[8] | (uint32_t)ctr[9] << 8 | (uint32_t)ctr[10] << 16 | (uint32_t)ctr[11] << 24;
+    n32 = (uint32_t)ctr[12] << 24 | (uint32_t)ctr[13] << 16 | (uint32_t)ctr[14] << 8 | ctr[15];
+
+    for (size_t n = 0; n < done; n += 8) {
+        for (int i = 0; i < 8; i++)
+            b[i] = _mm_xor_si128(_mm_set_epi32((int)__builtin_bswap32(n32 + i), (int)w2, (int)w1, (int)w0), rk[0]);
+        n32 += 8;
+
+        if (!enc) {
+            for (int i = 0; i < 8; i++)
+                c[i] = bswap128(_mm_loadu_si128((const __m128i*)in + i));
+            pending = 1;
+        }
+
+        if (pending) {
+            lo = mid = hi = _mm_setzero_si128();
+            AESENC8(b, rk[1]); clmul_acc(_mm_xor_si128(acc, c[0]), hp[3], &lo, &mid, &hi);
+            AESENC8(b, rk[2]); clmul_acc(c[1], hp[2], &lo, &mid, &hi);
+            AESENC8(b, rk[3]); clmul_acc(c[2], hp[1], &lo, &mid, &hi);
+            AESENC8(b, rk[4]); clmul_acc(c[3], hp[0], &lo, &mid, &hi);
+            acc = clmul_reduce(lo, mid, hi);
+            lo = mid = hi = _mm_setzero_si128();
+            AESENC8(b, rk[5]); clmul_acc(_mm_xor_si128(acc, c[4]), hp[3], &lo, &mid, &hi);
+            AESENC8(b, rk[6]); clmul_acc(c[5], hp[2], &lo, &mid, &hi);
+            AESENC8(b, rk[7]); clmul_acc(c[6], hp[1], &lo, &mid, &hi);
+            AESENC8(b, rk[8]); clmul_acc(c[7], hp[0], &lo, &mid, &hi);
+            acc = clmul_reduce(lo, mid, hi);
+        } else {
+            for (int r = 1; r <= 8; r++)
+                AESENC8(b, rk[r]);
+        }
+        for (int r = 9; r < rounds; r++)
+            AESENC8(b, rk[r]);
+
+        for (int i = 0; i < 8; i++) {
+            __m128i x = _mm_loadu_si128((const __m128i*)in + i);
+            b[i] = _mm_xor_si128(_mm_aesenclast_si128(b[i], rk[rounds]), x);
+            _mm_storeu_si128((__m128i*)out + i, b[i]);
+        }
+        if (enc) {
+            for (int i = 0; i < 8; i++)
+                c[i] = bswap128(b[i]);
+            pending = 1;
+        }
+
+        in += 8 * AES_BLOCK_SIZE;
+        out += 8 * AES_BLOCK_SIZE;
+    }
+
+    if (enc) {
+        acc = ghash4(hp, acc, c);
+        acc = ghash4(hp, acc, c + 4);
+    }
+
+    _mm_storeu_si128((__m128i*)y, bswap128(acc));
+    ctr[12] = (uint8_t)(n32 >> 24);
+    ctr[13] = (uint8_t)(n32 >> 16);
+    ctr[14] = (uint8_t)(n32 >> 8);
+    ctr[15] = (uint8_t)n32;
+    return done;
+}
+
+#else
+
+/* Never reached: cpu_get_features() reports no PCLMULQDQ off x86 */
+void gcm_clmul_init(unsigned long long* htab, const uint8_t* h) { (void)htab; (void)h; }
+void gcm_clmul_ghash(const unsigned long long* htab, uint8_t* y, const uint8_t* in, size_t nblocks)
+{
+    (void)htab; (void)y; (void)in; (void)nblocks;
+}
+size_t gcm_clmul_aesni_crypt(const aes_key* k, const unsigned long long* htab, uint8_t* ctr, uint8_t* y,
+                             const uint8_t* in, uint8_t* out, size_t nblocks, int enc)
+{
+    (void)k; (void)htab; (void)ctr; (void)y; (void)in; (void)out; (void)nblocks; (void)enc;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*********************************************************************
+ * Filename:   aes_hash.c
+ * Description: Stitched CBC encryption and SHA-256 of the ciphertext.
+ *              The buffer is walked in small chunks and each chunk is
+ *              hashed straight after it is encrypted (or before it is
+ *              decrypted), while it is still in L1, instead of the
+ *              whole message being read from memory a second time.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <string.h>
+#include "aes_internal.h"
+#include "sha256.h"
+
+/* Well inside L1 together with the key schedule and hash state */
+#define HASH_CHUNK 4096
+
+int aes_ctx_encrypt_hash(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV,
+                         unsigned char digest[AES_HASH_SIZE])
+{
+    const aes_engine* e = aes_engine_get();
+    uint8_t* p = buffer;
+    uint8_t iv[AES_BLOCK_SIZE];
+    SHA256_CTX sha;
+
+    if (ctx == NULL || buffer_len % AES_BLOCK_SIZE != 0) return 1;
+
+    memcpy(iv, IV, AES_BLOCK_SIZE);
+    sha256_init(&sha);
+    for (size_t off = 0; off < buffer_len; off += HASH_CHUNK) {
+        size_t n = buffer_len - off < HASH_CHUNK ? buffer_len - off : HASH_CHUNK;
+
+        e->cbc_encrypt(&ctx->key, iv, p + off, p + off, n / AES_BLOCK_SIZE);
+        sha256_update(&sha, p + off, n);
+    }
+    sha256_final(&sha, digest);
+    return 0;
+}
+
+int aes_ctx_decrypt_verify(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV,
+                           const unsigned char digest[AES_HASH_SIZE])
+{
+    const aes_engine* e = aes_engine_get();
+    uint8_t* p = buffer;
+    uint8_t iv[AES_BLOCK_SIZE];
+    uint8_t got[AES_HASH_SIZE];
+    unsigned diff = 0;
+    SHA256_CTX sha;
+
+    if (ctx == NULL || buffer_len % AES_BLOCK_SIZE != 0) return 1;
+
+    memcpy(iv, IV, AES_BLOCK_SIZE);
+    sha256_init(&sha);
+    for (size_t off = 0; off < buffer_len; off += HASH_CHUNK) {
+        size_t n = buffer_len - off < HASH_CHUNK ? buffer_len - off : HASH_CHUNK;
+
+        sha256_update(&sha, p + off, n);
+        e->cbc_decrypt(&ctx->key, iv, p + off, p + off, n / AES_BLOCK_SIZE);
+    }
+    sha256_final(&sha, got);
+
+    for (int i = 0; i < AES_HASH_SIZE; i++) diff |= got[i] ^ digest[i];
+    if (diff != 0) {
+        /* Plaintext of a message that failed verification is not released */
+        secure_zero(buffer, buffer_len);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+#ifndef AES_INTERNAL_H
+#define AES_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "aes.h"
+#include "secure_zero.h"
+
+#define AES_MAX_ROUNDS 14
+#define AES_RK_BYTES   ((AES_MAX_ROUNDS + 1) * AES_BLOCK_SIZE)
+
+/*
+ * Expanded AES key. ek holds the round keys in FIPS-197 byte order,
+ * dk the round keys of the equivalent inverse cipher (reversed, with
+ * InvMixColumns applied), and sk the encryption round keys in the
+ * bitsliced layout used by the portable kernel.
+ */
+typedef struct {
+    uint8_t ek[AES_RK_BYTES];
+    uint8_t dk[AES_RK_BYTES];
+    uint64_t sk[(AES_MAX_ROUNDS + 1) * 8];
+    int rounds;
+} aes_key;
+
+/*
+ * A block cipher kernel. All functions take whole blocks and allow
+ * in == out; the CBC functions update iv to the last ciphertext block,
+ * ctr_encrypt XORs in E(ctr), E(ctr + 1), ... and advances ctr.
+ */
+typedef struct {
+    const char* name;
+    void (*ecb_encrypt)(const aes_key* k, const uint8_t* in, uint8_t* out, size_t nblocks);
+    void (*ecb_decrypt)(const aes_key* k, const uint8_t* in, uint8_t* out, size_t nblocks);
+    void (*cbc_encrypt)(const aes_key* k, uint8_t* iv, const uint8_t* in, uint8_t* out, size_t nblocks);
+    void (*cbc_decrypt)(const aes_key* k, uint8_t* iv, const uint8_t* in, uint8_t* out, size_t nblocks);
+    void (*ctr_encrypt)(const aes_key* k, uint8_t* ctr, const uint8_t* in, uint8_t* out, size_t nblocks);
+} aes_engine;
+
+extern const aes_engine aes_engine_portable;
+extern const aes_engine aes_engine_bitslice_sse2;
+extern const aes_engine aes_engine_bitslice_avx2;
+extern const aes_engine aes_engine_aesni;
+
+/* The counter block is one 128-bit big-endian integer */
+static inline void aes_ctr_increment(uint8_t* ctr)
+{
+    for (int i = AES_BLOCK_SIZE - 1; i >= 0; i--)
+        if (++ctr[i] != 0) break;
+}
+
+static inline void aes_ctr_add(uint8_t* ctr, uint64_t n)
+{
+    for (int i = AES_BLOCK_SIZE - 1; i >= 0 && n != 0; i--) {
+        n += ctr[i];
+        ctr[i] = (uint8_t)n;
+        n >>= 8;
+    }
+}
+
+/* Public handle around an expanded key (aes.h) */
+struct aes_ctx {
+    aes_key key;
+};
+
+/* Public XTS handle (aes.h): k1 encrypts data, k2 the tweaks */
+struct aes_xts {
+    aes_key k1;
+    aes_key k2;
+};
+
+/* IEEE 1619 caps a data unit at 2^20 blocks */
+#define XTS_MAX_UNIT ((size_t)1 << 24)
+
+/* Encrypted initial tweaks of n consecutive data units, and one data
+ * unit processed from its encrypted tweak (which is overwritten) */
+void aes_xts_unit_tweaks(const aes_xts* x, uint8_t* t, uint64_t unit, size_t n);
+void aes_xts_crypt_unit(const aes_xts* x, uint8_t* buf, size_t len, uint8_t* tweak, int enc);
+
+/* Returns 0 on success, 1 if key_len is not 16, 24 or 32 */
+int aes_key_setup(aes_key* k, const uint8_t* key, int key_len);
+void aes_key_wipe(aes_key* k);
+
+/* Bitsliced helpers from the portable kernel, shared with key setup
+ * and with the SIMD bitsliced kernels */
+void aes_ct64_bitslice_key(aes_key* k);
+uint32_t aes_ct64_sub_word(uint32_t w);
+void aes_ct64_cbc_encrypt(const aes_key* k, uint8_t* iv, const uint8_t* in, uint8_t* out, size_t nblocks);
+
+/*
+ * One CBC-encrypt stream of a batch. aes_ni_cbc_encrypt_lanes runs up to
+ * AES_MAX_LANES streams with the same round count in lockstep until the
+ * shortest ends, advancing each lane, and returns the blocks done.
+ */
+#define AES_MAX_LANES 8
+
+typedef struct {
+    const aes_key* k;
+    uint8_t iv[AES_BLOCK_SIZE];
+    uint8_t* buf;
+    size_t nblocks;
+} aes_cbc_lane;
+
+size_t aes_ni_cbc_encrypt_lanes(aes_cbc_lane* lanes, int nlanes);
+
+/* PCLMULQDQ GHASH and the stitched AES-NI GCM loop (aes_gcm_clmul.c);
+ * htab holds H^1..H^4, y is the accumulator in GCM byte order */
+void gcm_clmul_init(unsigned long long* htab, const uint8_t* h);
+void gcm_clmul_ghash(const unsigned long long* htab, uint8_t* y, const uint8_t* in, size_t nblocks);
+size_t gcm_clmul_aesni_crypt(const aes_key* k, const unsigned long long* htab, uint8_t* ctr, uint8_t* y,
+                             const uint8_t* in, uint8_t* out, size_t nblocks, int enc);
+
+/*
+ * One side of a re-encryption (aes_reencrypt.c): the CBC chaining value
+ * or the CTR stream position. aes_rekey_span decrypts len bytes with
+ * from and encrypts them with to, advancing both; the parallel path
+ * positions each chunk's states itself.
+ */
+typedef struct {
+    const aes_key* k;
+    int cbc;
+    uint8_t iv[AES_BLOCK_SIZE];
+    aes_ctr ctr;
+} aes_rekey_state;
+
+int aes_rekey_check(const aes_cipher_spec* from, const aes_cipher_spec* to, size_t len);
+void aes_rekey_init(aes_rekey_state* s, const aes_cipher_spec* spec);
+void aes_rekey_span(aes_rekey_state* from, aes_rekey_state* to, uint8_t* buf, size_t len);
+
+/* Kernel picked for this CPU, or the one forced by aes_engine_select */
+const aes_engine* aes_engine_get(void);
+
+#endif
@@ -0,0 +1,301 @@
+/*********************************************************************
+ * Filename:   aes_ni.c
+ * Description: AES kernel using the x86 AES-NI instructions. Modes
+ *              without a chaining dependency keep eight blocks in
+ *              flight to cover the AESENC/AESDEC latency.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include "aes_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <wmmintrin.h>
+
+/* Compiled for AES-NI regardless of -march; only reached after CPUID */
+#define AESNI_FN __attribute__((target("aes,sse2")))
+
+static AESNI_FN inline void load_round_keys(__m128i* rk, const uint8_t* src, int rounds)
+{
+    for (int r = 0; r <= rounds; r++)
+        rk[r] = _mm_loadu_si128((const __m128i*)(src + r * AES_BLOCK_SIZE));
+}
+
+static AESNI_FN inline __m128i encrypt1(const __m128i* rk, int rounds, __m128i b)
+{
+    b = _mm_xor_si128(b, rk[0]);
+    for (int r = 1; r < rounds; r++)
+        b = _mm_aesenc_si128(b, rk[r]);
+    return _mm_aesenclast_si128(b, rk[rounds]);
+}
+
+static AESNI_FN inline __m128i decrypt1(const __m128i* rk, int rounds, __m128i b)
+{
+    b = _mm_xor_si128(b, rk[0]);
+    for (int r = 1; r < rounds; r++)
+        b = _mm_aesdec_si128(b, rk[r]);
+    return _mm_aesdeclast_si128(b, rk[rounds]);
+}
+
+#define LOAD8(b, p) do { \
+    for (int i_ = 0; i_ < 8; i_++) \
+        (b)[i_] = _mm_loadu_si128((const __m128i*)(p) + i_); \
+} while (0)
+
+#define ROUND8(b, op, k) do { \
+    (b)[0] = op((b)[0], k); (b)[1] = op((b)[1], k); \
+    (b)[2] = op((b)[2], k); (b)[3] = op((b)[3], k); \
+    (b)[4] = op((b)[4], k); (b)[5] = op((b)[5], k); \
+    (b)[6] = op((b)[6], k); (b)[7] = op((b)[7], k); \
+} while (0)
+
+static AESNI_FN void aesni_ecb_encrypt(const aes_key* k, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    __m128i rk[AES_MAX_ROUNDS + 1], b[8];
+    int rounds = k->rounds;
+
+    load_round_keys(rk, k->ek, rounds);
+
+    for (; nblocks >= 8; nblocks -= 8) {
+        LOAD8(b, in);
+        ROUND8(b, _mm_xor_si128, rk[0]);
+        for (int r = 1; r < rounds; r++)
+            ROUND8(b, _mm_aesenc_si128, rk[r]);
+        ROUND8(b, _mm_aesenclast_si128, rk[rounds]);
+        for (int i = 0; i < 8; i++)
+            _mm_storeu_si128((__m128i*)out + i, b[i]);
+        in += 8 * AES_BLOCK_SIZE;
+        out += 8 * AES_BLOCK_SIZE;
+    }
+    for (; nblocks > 0; nblocks--) {
+        __m128i x = _mm_loadu_si128((const __m128i*)in);
+        _mm_storeu_si128((__m128i*)out, encrypt1(rk, rounds, x));
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+}
+
+static AESNI_FN void aesni_ecb_decrypt(const aes_key* k, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    __m128i rk[AES_MAX_ROUNDS + 1], b[8];
+    int rounds = k->rounds;
+
+    load_round_keys(rk, k->dk, rounds);
+
+    for (; nblocks >= 8; nblocks -= 8) {
+        LOAD8(b, in);
+        ROUND8(b, _mm_xor_si128, rk[0]);
+        for (int r = 1; r < rounds; r++)
+            ROUND8(b, _mm_aesdec_si128, rk[r]);
+        ROUND8(b, _mm_aesdeclast_si128, rk[rounds]);
+        for (int i = 0; i < 8; i++)
+            _mm_storeu_si128((__m128i*)out + i, b[i]);
+        in += 8 * AES_BLOCK_SIZE;
+        out += 8 * AES_BLOCK_SIZE;
+    }
+    for (; nblocks > 0; nblocks--) {
+        __m128i x = _mm_loadu_si128((const __m128i*)in);
+        _mm_storeu_si128((__m128i*)out, decrypt1(rk, rounds, x));
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+}
+
+static AESNI_FN void aesni_cbc_encrypt(const aes_key* k, uint8_t* iv, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    __m128i rk[AES_MAX_ROUNDS + 1];
+    __m128i chain = _mm_loadu_si128((const __m128i*)iv);
+    int rounds = k->rounds;
+
+    load_round_keys(rk, k->ek, rounds);
+
+    for (; nblocks > 0; nblocks--) {
+        __m128i x = _mm_loadu_si128((const __m128i*)in);
+        chain = encrypt1(rk, rounds, _mm_xor_si128(x, chain));
+        _mm_storeu_si128((__m128i*)out, chain);
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+    _mm_storeu_si128((__m128i*)iv, chain);
+}
+
+static AESNI_FN void aesni_cbc_decrypt(const aes_key* k, uint8_t* iv, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    __m128i rk[AES_MAX_ROUNDS + 1], b[8], c[8];
+    __m128i chain = _mm_loadu_si128((const __m128i*)iv);
+    int rounds = k->rounds;
+
+    load_round_keys(rk, k->dk, rounds);
+
+    /* All eight ciphertext blocks are loaded before anything is stored,
+     * so in-place operation is safe */
+    for (; nblocks >= 8; nblocks -= 8) {
+        LOAD8(c, in);
+        for (int i = 0; i < 8; i++)
+            b[i] = _mm_xor_si128(c[i], rk[0]);
+        for (int r = 1; r < rounds; r++)
+            ROUND8(b, _mm_aesdec_si128, rk[r]);
+        ROUND8(b, _mm_aesdeclast_si128, rk[rounds]);
+
+        _mm_storeu_si128((__m128i*)out, _mm_xor_si128(b[0], chain));
+        for (int i = 1; i < 8; i++)
+            _mm_storeu_si128((__m128i*)out + i, _mm_xor_si128(b[i], c[i - 1]));
+        chain = c[7];
+        in += 8 * AES_BLOCK_SIZE;
+        out += 8 * AES_BLOCK_SIZE;
+    }
+    for (; nblocks > 0; nblocks--) {
+        __m128i x = _mm_loadu_si128((const __m128i*)in);
+        _mm_storeu_si128((__m128i*)out, _mm_xor_si128(decrypt1(rk, rounds, x), chain));
+        chain = x;
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+    _mm_storeu_si128((__m128i*)iv, chain);
+}
+
+static inline uint64_t load_be64(const uint8_t* p)
+{
+    uint64_t x = 0;
+    for (int i = 0; i < 8; i++)
+        x = (x << 8) | p[i];
+    return x;
+}
+
+static inline void store_be64(uint8_t* p, uint64_t x)
+{
+    for (int i = 7; i >= 0; i--, x >>= 8)
+        p[i] = (uint8_t)x;
+}
+
+/* Counter block hi:lo in big-endian byte order */
+static AESNI_FN inline __m128i counter_block(uint64_t hi, uint64_t lo)
+{
+    return _mm_set_epi64x((long long)__builtin_bswap64(lo), (long long)__builtin_bswap64(hi));
+}
+
+/*
+ * The counter lives in two host-order 64-bit words, so building the
+ * eight counter blocks of a pass costs a few scalar ops each rather
+ * than a byte-wise increment through memory.
+ */
+static AESNI_FN void aesni_ctr_encrypt(const aes_key* k, uint8_t* ctr, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    __m128i rk[AES_MAX_ROUNDS + 1], b[8];
+    uint64_t hi = load_be64(ctr), lo = load_be64(ctr + 8);
+    int rounds = k->rounds;
+
+    load_round_keys(rk, k->ek, rounds);
+
+    for (; nblocks >= 8; nblocks -= 8) {
+        for (int i = 0; i < 8; i++) {
+            uint64_t l = lo + i;
+            b[i] = counter_block(hi + (l < lo), l);
+        }
+        hi += (lo + 8 < lo);
+        lo += 8;
+
+        ROUND8(b, _mm_xor_si128, rk[0]);
+        for (int r = 1; r < rounds; r++)
+            ROUND8(b, _mm_aesenc_si128, rk[r]);
+        ROUND8(b, _mm_aesenclast_si128, rk[rounds]);
+
+        for (int i = 0; i < 8; i++) {
+            __m128i x = _mm_loadu_si128((const __m128i*)in + i);
+            _mm_storeu_si128((__m128i*)out + i, _mm_xor_si128(x, b[i]));
+        }
+        in += 8 * AES_BLOCK_SIZE;
+        out += 8 * AES_BLOCK_SIZE;
+    }
+    for (; nblocks > 0; nblocks--) {
+        __m128i x = _mm_loadu_si128((const __m128i*)in);
+        __m128i ks = encrypt1(rk, rounds, counter_block(hi, lo));
+        _mm_storeu_si128((__m128i*)out, _mm_xor_si128(x, ks));
+        hi += (++lo == 0);
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+
+    store_be64(ctr, hi);
+    store_be64(ctr + 8, lo);
+}
+
+/*
+ * nlanes is a constant in every inlined copy below, so the lane loops
+ * unroll and each stream's block stays in its own register.
+ */
+static AESNI_FN inline __attribute__((always_inline))
+size_t cbc_encrypt_lanes_n(aes_cbc_lane* lanes, const int nlanes)
+{
+    __m128i chain[AES_MAX_LANES];
+    const uint8_t* ek[AES_MAX_LANES];
+    size_t steps = lanes[0].nblocks;
+    int rounds = lanes[0].k->rounds;
+
+    for (int l = 0; l < nlanes; l++) {
+        chain[l] = _mm_loadu_si128((const __m128i*)lanes[l].iv);
+        ek[l] = lanes[l].k->ek;
+        if (lanes[l].nblocks < steps) steps = lanes[l].nblocks;
+    }
+
+    for (size_t s = 0; s < steps; s++) {
+#pragma GCC unroll 8
+        for (int l = 0; l < nlanes; l++) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(lanes[l].buf + s * AES_BLOCK_SIZE));
+            chain[l] = _mm_xor_si128(_mm_xor_si128(x, chain[l]), _mm_loadu_si128((const __m128i*)ek[l]));
+        }
+        for (int r = 1; r < rounds; r++)
+#pragma GCC unroll 8
+            for (int l = 0; l < nlanes; l++)
+                chain[l] = _mm_aesenc_si128(chain[l], _mm_loadu_si128((const __m128i*)(ek[l] + r * AES_BLOCK_SIZE)));
+#pragma GCC unroll 8
+        for (int l = 0; l < nlanes; l++) {
+            chain[l] = _mm_aesenclast_si128(chain[l], _mm_loadu_si128((const __m128i*)(ek[l] + rounds * AES_BLOCK_SIZE)));
+            _mm_storeu_si128((__m128i*)(lanes[l].buf + s * AES_BLOCK_SIZE), chain[l]);
+        }
+    }
+
+    for (int l = 0; l < nlanes; l++) {
+        _mm_storeu_si128((__m128i*)lanes[l].iv, chain[l]);
+        lanes[l].buf += steps * AES_BLOCK_SIZE;
+        lanes[l].nblocks -= steps;
+    }
+    return steps;
+}
+
+AESNI_FN size_t aes_ni_cbc_encrypt_lanes(aes_cbc_lane* lanes, int nlanes)
+{
+    switch (nlanes) {
+    case 1: return cbc_encrypt_lanes_n(lanes, 1);
+    case 2: return cbc_encrypt_lanes_n(lanes, 2);
+    case 3: return cbc_encrypt_lanes_n(lanes, 3);
+    case 4: return cbc_encrypt_lanes_n(lanes, 4);
+    case 5: return cbc_encrypt_lanes_n(lanes, 5);
+    case 6: return cbc_encrypt_lanes_n(lanes, 6);
+    case 7: return cbc_encrypt_lanes_n(lanes, 7);
+    default: return cbc_encrypt_lanes_n(lanes, AES_MAX_LANES);
+    }
+}
+
+const aes_engine aes_engine_aesni = {
+    "aesni",
+    aesni_ecb_encrypt,
+    aesni_ecb_decrypt,
+    aesni_cbc_encrypt,
+    aesni_cbc_decrypt,
+    aesni_ctr_encrypt,
+};
+
+#else
+
+/* Never selected: cpu_get_features() reports no AES-NI off x86 */
+const aes_engine aes_engine_aesni = { "aesni", NULL, NULL, NULL, NULL, NULL };
+
+size_t aes_ni_cbc_encrypt_lanes(aes_cbc_lane* lanes, int nlanes)
+{
+    (void)lanes; (void)nlanes;
+    return 0;
+}
+
+#endif
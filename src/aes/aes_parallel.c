@@ -0,0 +1,266 @@
+/*********************************************************************
+ * Filename:   aes_parallel.c
+ * Description: Parallel bulk CBC decryption, CTR, XTS and CTR-target
+ *              re-encryption over the worker pool. The buffer is cut
+ *              into cache-sized chunks; each chunk only needs the
+ *              ciphertext block before it (CBC), its own counter
+ *              value (CTR) or its sector numbers (XTS), so chunks are
+ *              fully independent and the output matches the serial
+ *              path.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "aes_internal.h"
+#include "thread_pool.h"
+
+/* Sized to stay in a per-core L2 while a chunk is processed */
+#define PARALLEL_DEFAULT_CHUNK (256 * 1024)
+#define PARALLEL_MIN_CHUNK     (4 * 1024)
+
+static int par_threads;          /* 0: one per online CPU */
+static size_t par_chunk = PARALLEL_DEFAULT_CHUNK;
+
+int aes_parallel_config(int threads, size_t chunk_size)
+{
+    if (threads < 0) return 1;
+    if (chunk_size == 0) chunk_size = PARALLEL_DEFAULT_CHUNK;
+    if (chunk_size < PARALLEL_MIN_CHUNK || chunk_size % AES_BLOCK_SIZE != 0) return 1;
+
+    par_threads = threads;
+    par_chunk = chunk_size;
+    return 0;
+}
+
+static int threads_for(size_t nchunks)
+{
+    int t = par_threads > 0 ? par_threads : thread_pool_cpus();
+    return (size_t)t > nchunks ? (int)nchunks : t;
+}
+
+typedef struct {
+    const aes_ctx* ctx;
+    uint8_t* buf;
+    size_t len;
+    size_t chunk;
+    const uint8_t* ivs;           /* CBC: chaining value of each chunk */
+    const char* IV;               /* CTR: initial counter block */
+    unsigned long long offset;    /* CTR: stream offset of buf[0] */
+} par_job;
+
+static void cbc_chunk(void* arg, size_t i)
+{
+    const par_job* j = arg;
+    size_t start = i * j->chunk;
+    size_t n = j->len - start < j->chunk ? j->len - start : j->chunk;
+    uint8_t iv[AES_BLOCK_SIZE];
+
+    memcpy(iv, j->ivs + i * AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+    aes_engine_get()->cbc_decrypt(&j->ctx->key, iv, j->buf + start, j->buf + start, n / AES_BLOCK_SIZE);
+}
+
+static void ctr_chunk(void* arg, size_t i)
+{
+    const par_job* j = arg;
+    size_t start = i * j->chunk;
+    size_t n = j->len - start < j->chunk ? j->len - start : j->chunk;
+    aes_ctr st;
+
+    aes_ctr_init(&st, j->ctx, j->IV);
+    aes_ctr_seek(&st, j->offset + start);
+    aes_ctr_crypt(&st, j->buf + start, j->buf + start, n);
+    secure_zero(&st, sizeof(st));
+}
+
+int aes_ctx_decrypt_parallel(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV)
+{
+    par_job j = { 0 };
+    size_t nchunks;
+    uint8_t* ivs;
+
+    if (ctx == NULL || buffer_len % AES_BLOCK_SIZE != 0) return 1;
+    if (buffer_len == 0) return 0;
+
+    j.ctx = ctx;
+    j.buf = buffer;
+    j.len = buffer_len;
+    j.chunk = par_chunk;
+    nchunks = (buffer_len + j.chunk - 1) / j.chunk;
+    if (threads_for(nchunks) <= 1)
+        return aes_ctx_decrypt(ctx, buffer, buffer_len, IV);
+
+    /* Decryption is in place, so every chunk's chaining block is
+     * copied out before any chunk is overwritten */
+    ivs = malloc(nchunks * AES_BLOCK_SIZE);
+    if (ivs == NULL) return 1;
+    memcpy(ivs, IV, AES_BLOCK_SIZE);
+    for (size_t i = 1; i < nchunks; i++)
+        memcpy(ivs + i * AES_BLOCK_SIZE, j.buf + i * j.chunk - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+    j.ivs = ivs;
+
+    thread_pool_run(threads_for(nchunks), nchunks, cbc_chunk, &j);
+
+    free(ivs);
+    return 0;
+}
+
+int aes_ctx_ctr_parallel(aes_ctx* ctx, void* buffer, size_t buffer_len, const char* IV,
+                         unsigned long long offset)
+{
+    par_job j = { 0 };
+    size_t nchunks;
+
+    if (ctx == NULL) return 1;
+    if (buffer_len == 0) return 0;
+
+    j.ctx = ctx;
+    j.buf = buffer;
+    j.len = buffer_len;
+    j.chunk = par_chunk;
+    j.IV = IV;
+    j.offset = offset;
+    nchunks = (buffer_len + j.chunk - 1) / j.chunk;
+    if (threads_for(nchunks) <= 1)
+        return aes_ctx_ctr(ctx, buffer, buffer_len, IV, offset);
+
+    thread_pool_run(threads_for(nchunks), nchunks, ctr_chunk, &j);
+    return 0;
+}
+
+typedef struct {
+    const aes_cipher_spec* from;
+    const aes_cipher_spec* to;
+    uint8_t* buf;
+    size_t len;
+    size_t chunk;
+    const uint8_t* ivs;           /* CBC source: chaining value of each chunk */
+} rekey_job;
+
+static void rekey_chunk(void* arg, size_t i)
+{
+    const rekey_job* j = arg;
+    size_t start = i * j->chunk;
+    size_t n = j->len - start < j->chunk ? j->len - start : j->chunk;
+    aes_rekey_state f, t;
+
+    aes_rekey_init(&f, j->from);
+    aes_rekey_init(&t, j->to);
+    if (f.cbc)
+        memcpy(f.iv, j->ivs + i * AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+    else
+        aes_ctr_seek(&f.ctr, start);
+    aes_ctr_seek(&t.ctr, start);
+
+    aes_rekey_span(&f, &t, j->buf + start, n);
+    secure_zero(&f, sizeof(f));
+    secure_zero(&t, sizeof(t));
+}
+
+int aes_reencrypt_parallel(const aes_cipher_spec* from, const aes_cipher_spec* to,
+                           void* buffer, size_t buffer_len)
+{
+    rekey_job j = { 0 };
+    size_t nchunks;
+    uint8_t* ivs = NULL;
+
+    if (aes_rekey_check(from, to, buffer_len) != 0) return 1;
+    if (buffer_len == 0) return 0;
+
+    j.from = from;
+    j.to = to;
+    j.buf = buffer;
+    j.len = buffer_len;
+    j.chunk = par_chunk;
+    nchunks = (buffer_len + j.chunk - 1) / j.chunk;
+    /* A CBC target chains through the whole buffer */
+    if (to->mode != AES_STREAM_CTR || threads_for(nchunks) <= 1)
+        return aes_reencrypt(from, to, buffer, buffer_len);
+
+    /* As in aes_ctx_decrypt_parallel, chaining blocks are saved before
+     * any chunk is rewritten */
+    if (from->mode != AES_STREAM_CTR) {
+        ivs = malloc(nchunks * AES_BLOCK_SIZE);
+        if (ivs == NULL) return 1;
+        memcpy(ivs, from->IV, AES_BLOCK_SIZE);
+        for (size_t i = 1; i < nchunks; i++)
+            memcpy(ivs + i * AES_BLOCK_SIZE, j.buf + i * j.chunk - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        j.ivs = ivs;
+    }
+
+    thread_pool_run(threads_for(nchunks), nchunks, rekey_chunk, &j);
+
+    free(ivs);
+    return 0;
+}
+
+typedef struct {
+    const aes_xts* x;
+    uint8_t* buf;
+    size_t sector_size;
+    size_t nsectors;
+    size_t per_task;
+    unsigned long long first;
+    int enc;
+} xts_job;
+
+/* Sector tweaks of a task are encrypted together, XTS_TWEAK_BATCH at a
+ * time, so the tweak key also runs through the multi-block ECB path */
+#define XTS_TWEAK_BATCH 32
+
+static void xts_task(void* arg, size_t i)
+{
+    const xts_job* j = arg;
+    size_t s = i * j->per_task;
+    size_t end = j->nsectors - s < j->per_task ? j->nsectors : s + j->per_task;
+    uint8_t t[XTS_TWEAK_BATCH * AES_BLOCK_SIZE];
+
+    while (s < end) {
+        size_t n = end - s < XTS_TWEAK_BATCH ? end - s : XTS_TWEAK_BATCH;
+
+        aes_xts_unit_tweaks(j->x, t, j->first + s, n);
+        for (size_t k = 0; k < n; k++)
+            aes_xts_crypt_unit(j->x, j->buf + (s + k) * j->sector_size, j->sector_size,
+                               t + k * AES_BLOCK_SIZE, j->enc);
+        s += n;
+    }
+    secure_zero(t, sizeof(t));
+}
+
+static int xts_sectors(const aes_xts* x, void* buffer, size_t sector_size, size_t nsectors,
+                       unsigned long long first_sector, int enc)
+{
+    xts_job j;
+    size_t ntasks;
+
+    if (x == NULL || sector_size == 0 || sector_size % AES_BLOCK_SIZE != 0 ||
+        sector_size > XTS_MAX_UNIT)
+        return 1;
+    if (nsectors == 0) return 0;
+
+    j.x = x;
+    j.buf = buffer;
+    j.sector_size = sector_size;
+    j.nsectors = nsectors;
+    j.per_task = par_chunk / sector_size > 0 ? par_chunk / sector_size : 1;
+    j.first = first_sector;
+    j.enc = enc;
+    ntasks = (nsectors + j.per_task - 1) / j.per_task;
+
+    thread_pool_run(threads_for(ntasks), ntasks, xts_task, &j);
+    return 0;
+}
+
+int aes_xts_encrypt_sectors(const aes_xts* x, void* buffer, size_t sector_size, size_t nsectors,
+                            unsigned long long first_sector)
+{
+    return xts_sectors(x, buffer, sector_size, nsectors, first_sector, 1);
+}
+
+int aes_xts_decrypt_sectors(const aes_xts* x, void* buffer, size_t sector_size, size_t nsectors,
+                            unsigned long long first_sector)
+{
+    return xts_sectors(x, buffer, sector_size, nsectors, first_sector, 0);
+}
@@ -0,0 +1,77 @@
+/*********************************************************************
+ * Filename:   aes_reencrypt.c
+ * Description: Single-pass re-encryption for key rotation. A few
+ *              blocks at a time are decrypted under the old key into a
+ *              stack buffer and encrypted under the new key back into
+ *              place, so the data is read from memory once and the
+ *              caller's buffer only ever holds ciphertext.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <string.h>
+#include "aes_internal.h"
+
+/* Enough blocks for the widest kernels, small enough to stay in L1 */
+#define REKEY_CHUNK 4096
+
+static int mode_ok(const aes_cipher_spec* s)
+{
+    return s != NULL && s->ctx != NULL &&
+           (s->mode == AES_STREAM_CBC || s->mode == AES_STREAM_CBC_NOPAD ||
+            s->mode == AES_STREAM_CTR);
+}
+
+int aes_rekey_check(const aes_cipher_spec* from, const aes_cipher_spec* to, size_t len)
+{
+    if (!mode_ok(from) || !mode_ok(to)) return 1;
+    if ((from->mode != AES_STREAM_CTR || to->mode != AES_STREAM_CTR) && len % AES_BLOCK_SIZE != 0)
+        return 1;
+    return 0;
+}
+
+void aes_rekey_init(aes_rekey_state* s, const aes_cipher_spec* spec)
+{
+    s->k = &spec->ctx->key;
+    s->cbc = spec->mode != AES_STREAM_CTR;
+    if (s->cbc)
+        memcpy(s->iv, spec->IV, AES_BLOCK_SIZE);
+    else
+        aes_ctr_init(&s->ctr, spec->ctx, spec->IV);
+}
+
+void aes_rekey_span(aes_rekey_state* from, aes_rekey_state* to, uint8_t* buf, size_t len)
+{
+    const aes_engine* e = aes_engine_get();
+    uint8_t tmp[REKEY_CHUNK];
+
+    for (size_t off = 0; off < len; off += REKEY_CHUNK) {
+        size_t n = len - off < REKEY_CHUNK ? len - off : REKEY_CHUNK;
+
+        if (from->cbc)
+            e->cbc_decrypt(from->k, from->iv, buf + off, tmp, n / AES_BLOCK_SIZE);
+        else
+            aes_ctr_crypt(&from->ctr, buf + off, tmp, n);
+        if (to->cbc)
+            e->cbc_encrypt(to->k, to->iv, tmp, buf + off, n / AES_BLOCK_SIZE);
+        else
+            aes_ctr_crypt(&to->ctr, tmp, buf + off, n);
+    }
+    secure_zero(tmp, sizeof(tmp));
+}
+
+int aes_reencrypt(const aes_cipher_spec* from, const aes_cipher_spec* to,
+                  void* buffer, size_t buffer_len)
+{
+    aes_rekey_state f, t;
+
+    if (aes_rekey_check(from, to, buffer_len) != 0) return 1;
+
+    aes_rekey_init(&f, from);
+    aes_rekey_init(&t, to);
+    aes_rekey_span(&f, &t, buffer, buffer_len);
+    secure_zero(&f, sizeof(f));
+    secure_zero(&t, sizeof(t));
+    return 0;
+}
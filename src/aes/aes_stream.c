@@ -0,0 +1,172 @@
+/*********************************************************************
+ * Filename:   aes_stream.c
+ * Description: Streaming init/update/final interface with PKCS#7
+ *              padding. Whole blocks go straight from the caller's
+ *              input to its output; only a partial block (or, when
+ *              decrypting with padding, the last block) is held back.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "aes_internal.h"
+
+int aes_stream_init(aes_stream* st, const aes_ctx* ctx, int mode, int enc, const char* IV)
+{
+    if (ctx == NULL) return 1;
+    if (mode != AES_STREAM_CBC && mode != AES_STREAM_CBC_NOPAD && mode != AES_STREAM_CTR)
+        return 1;
+
+    memset(st, 0, sizeof(*st));
+    st->ctx = ctx;
+    st->mode = mode;
+    st->enc = enc != 0;
+    if (mode == AES_STREAM_CTR)
+        return aes_ctr_init(&st->ctr, ctx, IV);
+    memcpy(st->iv, IV, AES_BLOCK_SIZE);
+    return 0;
+}
+
+static void cbc_blocks(aes_stream* st, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    const aes_engine* e = aes_engine_get();
+
+    if (st->enc)
+        e->cbc_encrypt(&st->ctx->key, st->iv, in, out, nblocks);
+    else
+        e->cbc_decrypt(&st->ctx->key, st->iv, in, out, nblocks);
+}
+
+int aes_stream_update(aes_stream* st, const void* in, size_t len, void* out, size_t* out_len)
+{
+    const uint8_t* src = in;
+    uint8_t* dst = out;
+    size_t total, keep, nblocks;
+
+    *out_len = 0;
+    if (st->ctx == NULL) return 1;
+
+    if (st->mode == AES_STREAM_CTR) {
+        aes_ctr_crypt(&st->ctr, in, out, len);
+        *out_len = len;
+        return 0;
+    }
+
+    /* Padded decryption keeps the last whole block for final */
+    total = st->buf_len + len;
+    keep = total % AES_BLOCK_SIZE;
+    if (keep == 0 && total > 0 && !st->enc && st->mode == AES_STREAM_CBC)
+        keep = AES_BLOCK_SIZE;
+    nblocks = (total - keep) / AES_BLOCK_SIZE;
+
+    if (nblocks > 0 && st->buf_len > 0) {
+        size_t n = AES_BLOCK_SIZE - st->buf_len;
+
+        memcpy(st->buf + st->buf_len, src, n);
+        cbc_blocks(st, st->buf, dst, 1);
+        src += n;
+        len -= n;
+        dst += AES_BLOCK_SIZE;
+        nblocks--;
+        st->buf_len = 0;
+    }
+    if (nblocks > 0) {
+        cbc_blocks(st, src, dst, nblocks);
+        src += nblocks * AES_BLOCK_SIZE;
+        len -= nblocks * AES_BLOCK_SIZE;
+        dst += nblocks * AES_BLOCK_SIZE;
+    }
+    memcpy(st->buf + st->buf_len, src, len);
+    st->buf_len += len;
+
+    *out_len = (size_t)(dst - (uint8_t*)out);
+    return 0;
+}
+
+/* Pad length of a decrypted last block, or 0 if the padding is bad;
+ * every byte is examined whatever the pad length */
+static size_t pkcs7_check(const uint8_t* blk)
+{
+    unsigned pad = blk[AES_BLOCK_SIZE - 1];
+    unsigned bad = ((pad - 1) >> 8) | ((AES_BLOCK_SIZE - pad) >> 8);
+
+    for (unsigned i = 0; i < AES_BLOCK_SIZE; i++) {
+        /* Only the last pad bytes must equal pad */
+        unsigned in_pad = ((AES_BLOCK_SIZE - 1 - i) - pad) >> 8;
+        bad |= in_pad & (blk[i] ^ pad);
+    }
+    return bad == 0 ? pad : 0;
+}
+
+int aes_stream_final(aes_stream* st, void* out, size_t* out_len)
+{
+    int ret = 0;
+
+    *out_len = 0;
+    if (st->ctx == NULL) return 1;
+
+    if (st->mode == AES_STREAM_CBC && st->enc) {
+        size_t pad = AES_BLOCK_SIZE - st->buf_len;
+
+        memset(st->buf + st->buf_len, (int)pad, pad);
+        cbc_blocks(st, st->buf, out, 1);
+        *out_len = AES_BLOCK_SIZE;
+    } else if (st->mode == AES_STREAM_CBC) {
+        uint8_t blk[AES_BLOCK_SIZE];
+        size_t pad;
+
+        if (st->buf_len != AES_BLOCK_SIZE) {
+            ret = 1;
+        } else {
+            cbc_blocks(st, st->buf, blk, 1);
+            pad = pkcs7_check(blk);
+            if (pad == 0) {
+                ret = 1;
+            } else {
+                memcpy(out, blk, AES_BLOCK_SIZE - pad);
+                *out_len = AES_BLOCK_SIZE - pad;
+            }
+            secure_zero(blk, sizeof(blk));
+        }
+    } else if (st->mode == AES_STREAM_CBC_NOPAD && st->buf_len != 0) {
+        ret = 1;
+    }
+
+    secure_zero(st, sizeof(*st));
+    return ret;
+}
+
+int aes_stream_file(aes_stream* st, FILE* in, FILE* out)
+{
+    uint8_t* ibuf = malloc(AES_STREAM_CHUNK);
+    uint8_t* obuf = malloc(AES_STREAM_CHUNK + AES_BLOCK_SIZE);
+    size_t n, done;
+    int ret = 0;
+
+    if (ibuf == NULL || obuf == NULL) {
+        free(ibuf);
+        free(obuf);
+        secure_zero(st, sizeof(*st));
+        return 1;
+    }
+
+    while ((n = fread(ibuf, 1, AES_STREAM_CHUNK, in)) > 0) {
+        if (aes_stream_update(st, ibuf, n, obuf, &done) != 0 ||
+            fwrite(obuf, 1, done, out) != done) {
+            ret = 1;
+            break;
+        }
+    }
+    if (ferror(in)) ret = 1;
+
+    if (aes_stream_final(st, obuf, &done) != 0) ret = 1;
+    if (ret == 0 && fwrite(obuf, 1, done, out) != done) ret = 1;
+
+    secure_zero(ibuf, AES_STREAM_CHUNK);
+    secure_zero(obuf, AES_STREAM_CHUNK + AES_BLOCK_SIZE);
+    free(ibuf);
+    free(obuf);
+    return ret;
+}
@@ -0,0 +1,693 @@
+/*********************************************************************
+ * Filename:   aes_bench.c
+ * Description: Timing harness for the AES implementation: per-call
+ *              overhead of encrypt() against a reusable aes_ctx and
+ *              the key-schedule cache, bulk throughput of each kernel,
+ *              iovec against staged CBC, streaming against whole-buffer
+ *              CBC, the file pipeline against stdio streaming, fused
+ *              encrypt-and-hash and re-encryption against two passes,
+ *              and XTS sector throughput.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "aes.h"
+#include "sha256.h"
+#include "thread_pool.h"
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Per-call cost of encrypting many small messages under one key:
+ * with the key cache off encrypt() sets the cipher up on every call,
+ * aes_ctx only once.
+ */
+static void bench_ctx_overhead(void)
+{
+    static const size_t sizes[] = { 16, 64, 256, 1024, 4096 };
+    char key[] = "0123456789abcdef";
+    char IV[] = "AAAAAAAAAAAAAAAA";
+    unsigned char buf[4096];
+    aes_ctx* ctx = aes_ctx_create(key, 16);
+
+    if (ctx == NULL) {
+        printf("aes_ctx_create failed\n");
+        return;
+    }
+
+    memset(buf, 0x5a, sizeof(buf));
+    aes_key_cache_config(0);
+    printf("%-8s %14s %14s %8s\n", "bytes", "encrypt ns", "aes_ctx ns", "speedup");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int iters = (int)(4000000 / (sizes[s] + 64));
+        double t0, t1, t2;
+
+        t0 = now_ns();
+        for (int i = 0; i < iters; i++)
+            encrypt(buf, (int)sizes[s], IV, key, 16);
+        t1 = now_ns();
+        for (int i = 0; i < iters; i++)
+            aes_ctx_encrypt(ctx, buf, sizes[s], IV);
+        t2 = now_ns();
+
+        printf("%-8zu %14.1f %14.1f %7.2fx\n", sizes[s],
+               (t1 - t0) / iters, (t2 - t1) / iters, (t1 - t0) / (t2 - t1));
+    }
+
+    aes_key_cache_config(64);
+    aes_ctx_destroy(ctx);
+}
+
+/*
+ * encrypt() of 64-byte messages cycling over a working set of keys,
+ * with the key-schedule cache off and at 64 entries. Working sets
+ * larger than the cache miss on every call under LRU.
+ */
+static void bench_key_cache(void)
+{
+    static const int working_sets[] = { 1, 16, 64, 256 };
+    static char keys[256][32];
+    char IV[] = "AAAAAAAAAAAAAAAA";
+    unsigned char buf[64];
+    int iters = 200000;
+
+    for (int k = 0; k < 256; k++)
+        for (int i = 0; i < 32; i++) keys[k][i] = (char)(k * 37 + i);
+    memset(buf, 0x5a, sizeof(buf));
+    printf("%-8s %14s %14s %10s\n", "keys", "uncached ns", "cached ns", "hit rate");
+
+    for (size_t w = 0; w < sizeof(working_sets) / sizeof(working_sets[0]); w++) {
+        int n = working_sets[w];
+        key_cache_stats st0, st1;
+        double t0, t1, t2, t3;
+
+        aes_key_cache_config(0);
+        t0 = now_ns();
+        for (int i = 0; i < iters; i++)
+            encrypt(buf, 64, IV, keys[i % n], 32);
+        t1 = now_ns();
+
+        aes_key_cache_config(64);
+        aes_key_cache_flush();
+        aes_key_cache_stats(&st0);
+        t2 = now_ns();
+        for (int i = 0; i < iters; i++)
+            encrypt(buf, 64, IV, keys[i % n], 32);
+        t3 = now_ns();
+        aes_key_cache_stats(&st1);
+
+        printf("%-8d %14.1f %14.1f %9.1f%%\n", n, (t1 - t0) / iters, (t3 - t2) / iters,
+               100.0 * (st1.hits - st0.hits) / iters);
+    }
+}
+
+#define BULK_BYTES (64u << 20)
+
+static const char* engines[] = { "aesni", "bitslice-avx2", "bitslice-sse2", "portable" };
+
+static double mb_per_s(size_t bytes, double ns)
+{
+    return bytes / (ns / 1e9) / (1 << 20);
+}
+
+/*
+ * Throughput of every available kernel on one large buffer. CBC
+ * encryption is serial; CTR and CBC decryption fill all block slots.
+ */
+static void bench_bulk_throughput(void)
+{
+    char key[] = "0123456789abcdef0123456789abcdef";
+    char IV[] = "AAAAAAAAAAAAAAAA";
+    unsigned char* buf = malloc(BULK_BYTES);
+    aes_ctx* ctx = aes_ctx_create(key, 32);
+
+    if (buf == NULL || ctx == NULL) {
+        printf("allocation failed\n");
+        free(buf);
+        aes_ctx_destroy(ctx);
+        return;
+    }
+
+    memset(buf, 0xa5, BULK_BYTES);
+    printf("%-14s %14s %14s %14s %14s %14s\n", "kernel", "cbc-enc MiB/s", "cbc-dec MiB/s",
+           "ctr MiB/s", "gcm-enc MiB/s", "gcm-dec MiB/s");
+
+    for (int e = 0; e < 4; e++) {
+        char tag[AES_GCM_TAG_SIZE];
+        double t0, t1, t2, t3, t4, t5;
+
+        if (aes_engine_select(engines[e]) != 0) continue;
+
+        t0 = now_ns();
+        aes_ctx_encrypt(ctx, buf, BULK_BYTES, IV);
+        t1 = now_ns();
+        aes_ctx_decrypt(ctx, buf, BULK_BYTES, IV);
+        t2 = now_ns();
+        aes_ctx_ctr(ctx, buf, BULK_BYTES, IV, 0);
+        t3 = now_ns();
+        aes_gcm_encrypt(ctx, IV, 12, NULL, 0, buf, BULK_BYTES, tag);
+        t4 = now_ns();
+        if (aes_gcm_decrypt(ctx, IV, 12, NULL, 0, buf, BULK_BYTES, tag, sizeof(tag)) != 0)
+            printf("%s: gcm tag mismatch\n", engines[e]);
+        t5 = now_ns();
+
+        printf("%-14s %14.1f %14.1f %14.1f %14.1f %14.1f\n", engines[e], mb_per_s(BULK_BYTES, t1 - t0),
+               mb_per_s(BULK_BYTES, t2 - t1), mb_per_s(BULK_BYTES, t3 - t2),
+               mb_per_s(BULK_BYTES, t4 - t3), mb_per_s(BULK_BYTES, t5 - t4));
+    }
+
+    aes_ctx_destroy(ctx);
+    free(buf);
+}
+
+/*
+ * Many small records, each with its own key and IV: one encrypt() per
+ * record (key expanded every time), one aes_ctx_encrypt per record,
+ * and the batch API over the same records.
+ */
+static void bench_batch(void)
+{
+    enum { NKEYS = 64, NREC = 4096 };
+    static const size_t sizes[] = { 64, 256, 1024 };
+    char keys[NKEYS][32], IV[] = "AAAAAAAAAAAAAAAA";
+    aes_ctx* ctxs[NKEYS];
+    aes_cbc_job* jobs = malloc(NREC * sizeof(*jobs));
+    unsigned char* buf = malloc(NREC * 1024);
+
+    if (jobs == NULL || buf == NULL) {
+        printf("allocation failed\n");
+        free(jobs);
+        free(buf);
+        return;
+    }
+
+    for (int k = 0; k < NKEYS; k++) {
+        for (int i = 0; i < 32; i++) keys[k][i] = (char)(k * 31 + i);
+        ctxs[k] = aes_ctx_create(keys[k], 32);
+    }
+    memset(buf, 0x3c, NREC * 1024);
+    printf("%-8s %14s %14s %14s\n", "bytes", "encrypt MiB/s", "aes_ctx MiB/s", "batch MiB/s");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t total = NREC * sizes[s];
+        double t0, t1, t2, t3;
+
+        for (int r = 0; r < NREC; r++) {
+            jobs[r].ctx = ctxs[r % NKEYS];
+            jobs[r].IV = IV;
+            jobs[r].buffer = buf + r * sizes[s];
+            jobs[r].buffer_len = sizes[s];
+        }
+
+        t0 = now_ns();
+        for (int r = 0; r < NREC; r++)
+            encrypt(buf + r * sizes[s], (int)sizes[s], IV, keys[r % NKEYS], 32);
+        t1 = now_ns();
+        for (int r = 0; r < NREC; r++)
+            aes_ctx_encrypt(ctxs[r % NKEYS], buf + r * sizes[s], sizes[s], IV);
+        t2 = now_ns();
+        aes_cbc_encrypt_batch(jobs, NREC);
+        t3 = now_ns();
+
+        printf("%-8zu %14.1f %14.1f %14.1f\n", sizes[s], mb_per_s(total, t1 - t0),
+               mb_per_s(total, t2 - t1), mb_per_s(total, t3 - t2));
+    }
+
+    for (int k = 0; k < NKEYS; k++) aes_ctx_destroy(ctxs[k]);
+    free(jobs);
+    free(buf);
+}
+
+/*
+ * Parallel CBC-decrypt and CTR scaling from one thread up to one per
+ * CPU, then the effect of the chunk size with all CPUs in use.
+ */
+static void bench_parallel_scaling(void)
+{
+    static const size_t chunks[] = { 64 << 10, 256 << 10, 1 << 20, 4 << 20 };
+    /* Chunk for the thread-scaling rows, passed and printed alike */
+    const size_t scaling_chunk = 256 << 10;
+    char key[] = "0123456789abcdef0123456789abcdef";
+    char IV[] = "AAAAAAAAAAAAAAAA";
+    unsigned char* buf = malloc(BULK_BYTES);
+    aes_ctx* ctx = aes_ctx_create(key, 32);
+    int cpus = thread_pool_cpus();
+
+    if (buf == NULL || ctx == NULL) {
+        printf("allocation failed\n");
+        free(buf);
+        aes_ctx_destroy(ctx);
+        return;
+    }
+
+    memset(buf, 0xa5, BULK_BYTES);
+    printf("%-8s %10s %14s %14s\n", "threads", "chunk KiB", "cbc-dec MiB/s", "ctr MiB/s");
+
+    for (int t = 1; t <= cpus; t = t < cpus && t * 2 > cpus ? cpus : t * 2) {
+        double t0, t1, t2;
+
+        aes_parallel_config(t, scaling_chunk);
+        t0 = now_ns();
+        aes_ctx_decrypt_parallel(ctx, buf, BULK_BYTES, IV);
+        t1 = now_ns();
+        aes_ctx_ctr_parallel(ctx, buf, BULK_BYTES, IV, 0);
+        t2 = now_ns();
+
+        printf("%-8d %10zu %14.1f %14.1f\n", t, scaling_chunk >> 10,
+               mb_per_s(BULK_BYTES, t1 - t0), mb_per_s(BULK_BYTES, t2 - t1));
+    }
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        double t0, t1, t2;
+
+        aes_parallel_config(cpus, chunks[c]);
+        t0 = now_ns();
+        aes_ctx_decrypt_parallel(ctx, buf, BULK_BYTES, IV);
+        t1 = now_ns();
+        aes_ctx_ctr_parallel(ctx, buf, BULK_BYTES, IV, 0);
+        t2 = now_ns();
+
+        printf("%-8d %10zu %14.1f %14.1f\n", cpus, chunks[c] >> 10,
+               mb_per_s(BULK_BYTES, t1 - t0), mb_per_s(BULK_BYTES, t2 - t1));
+    }
+
+    aes_parallel_config(0, 0);
+    aes_ctx_destroy(ctx);
+    free(buf);
+}
+
+/*
+ * XTS-AES-256 over 4096-byte sectors: one aes_xts_encrypt call per
+ * sector against the sector-run entry point on the worker pool.
+ */
+static void bench_xts(void)
+{
+    enum { SECTOR = 4096 };
+    size_t nsectors = BULK_BYTES / SECTOR;
+    char key[64];
+    unsigned char* buf = malloc(BULK_BYTES);
+    aes_xts* x;
+    double t0, t1, t2, t3;
+
+    for (int i = 0; i < 64; i++) key[i] = (char)(i * 3 + 1);
+    x = aes_xts_create(key, 64);
+    if (buf == NULL || x == NULL) {
+        printf("allocation failed\n");
+        free(buf);
+        aes_xts_destroy(x);
+        return;
+    }
+
+    memset(buf, 0xa5, BULK_BYTES);
+    t0 = now_ns();
+    for (size_t s = 0; s < nsectors; s++)
+        aes_xts_encrypt(x, buf + s * SECTOR, SECTOR, s);
+    t1 = now_ns();
+    aes_xts_encrypt_sectors(x, buf, SECTOR, nsectors, 0);
+    t2 = now_ns();
+    aes_xts_decrypt_sectors(x, buf, SECTOR, nsectors, 0);
+    t3 = now_ns();
+
+    printf("%-14s %14s\n", "path", "MiB/s");
+    printf("%-14s %14.1f\n", "per-sector", mb_per_s(BULK_BYTES, t1 - t0));
+    printf("%-14s %14.1f\n", "sectors-enc", mb_per_s(BULK_BYTES, t2 - t1));
+    printf("%-14s %14.1f\n", "sectors-dec", mb_per_s(BULK_BYTES, t3 - t2));
+
+    aes_xts_destroy(x);
+    free(buf);
+}
+
+/*
+ * A 64 KiB message held as a chain of equal fragments: staging it into
+ * a contiguous buffer for aes_ctx_encrypt and back, against
+ * aes_encrypt_iov in place. Odd fragment sizes split blocks.
+ */
+static void bench_iov(void)
+{
+    enum { MSG = 64 << 10, ITERS = 2000 };
+    static const size_t frags[] = { 100, 1500, 9000 };
+    static struct iovec v[MSG / 100 + 1];
+    char key[] = "0123456789abcdef0123456789abcdef";
+    char IV[] = "AAAAAAAAAAAAAAAA";
+    unsigned char* chain = malloc(MSG);
+    unsigned char* staging = malloc(MSG);
+    aes_ctx* ctx = aes_ctx_create(key, 32);
+
+    if (chain == NULL || staging == NULL || ctx == NULL) {
+        printf("allocation failed\n");
+        free(chain);
+        free(staging);
+        aes_ctx_destroy(ctx);
+        return;
+    }
+
+    memset(chain, 0x3c, MSG);
+    printf("%-10s %10s %16s %12s %12s\n", "fragment", "direction", "staged MiB/s",
+           "iovec MiB/s", "speedup");
+
+    for (size_t f = 0; f < sizeof(frags) / sizeof(frags[0]); f++) {
+        int n = 0;
+
+        for (size_t off = 0; off < MSG; off += frags[f], n++) {
+            v[n].iov_base = chain + off;
+            v[n].iov_len = MSG - off < frags[f] ? MSG - off : frags[f];
+        }
+
+        for (int enc = 1; enc >= 0; enc--) {
+            double t0, t1, t2;
+
+            t0 = now_ns();
+            for (int it = 0; it < ITERS; it++) {
+                size_t off = 0;
+                for (int i = 0; i < n; off += v[i].iov_len, i++)
+                    memcpy(staging + off, v[i].iov_base, v[i].iov_len);
+                if (enc)
+                    aes_ctx_encrypt(ctx, staging, MSG, IV);
+                else
+                    aes_ctx_decrypt(ctx, staging, MSG, IV);
+                off = 0;
+                for (int i = 0; i < n; off += v[i].iov_len, i++)
+                    memcpy(v[i].iov_base, staging + off, v[i].iov_len);
+            }
+            t1 = now_ns();
+            for (int it = 0; it < ITERS; it++) {
+                if (enc)
+                    aes_encrypt_iov(ctx, v, n, NULL, 0, IV);
+                else
+                    aes_decrypt_iov(ctx, v, n, NULL, 0, IV);
+            }
+            t2 = now_ns();
+
+            printf("%-10zu %10s %16.1f %12.1f %11.2fx\n", frags[f], enc ? "encrypt" : "decrypt",
+                   mb_per_s((size_t)MSG * ITERS, t1 - t0), mb_per_s((size_t)MSG * ITERS, t2 - t1),
+                   (t1 - t0) / (t2 - t1));
+        }
+    }
+
+    aes_ctx_destroy(ctx);
+    free(chain);
+    free(staging);
+}
+
+/*
+ * Streaming CBC through one AES_STREAM_CHUNK buffer against a single
+ * aes_ctx call over the whole message held in memory.
+ */
+static void bench_stream(void)
+{
+    char key[] = "0123456789abcdef0123456789abcdef";
+    char IV[] = "AAAAAAAAAAAAAAAA";
+    unsigned char* whole = malloc(BULK_BYTES);
+    unsigned char* in = malloc(AES_STREAM_CHUNK);
+    unsigned char* out = malloc(AES_STREAM_CHUNK + AES_BLOCK_SIZE);
+    aes_ctx* ctx = aes_ctx_create(key, 32);
+
+    if (whole == NULL || in == NULL || out == NULL || ctx == NULL) {
+        printf("allocation failed\n");
+        free(whole);
+        free(in);
+        free(out);
+        aes_ctx_destroy(ctx);
+        return;
+    }
+
+    memset(whole, 0x77, BULK_BYTES);
+    memset(in, 0x77, AES_STREAM_CHUNK);
+    printf("%-10s %14s %14s %12s\n", "direction", "whole MiB/s", "stream MiB/s", "stream KiB");
+
+    for (int enc = 1; enc >= 0; enc--) {
+        aes_stream st;
+        size_t n;
+        double t0, t1, t2;
+
+        t0 = now_ns();
+        if (enc)
+            aes_ctx_encrypt(ctx, whole, BULK_BYTES, IV);
+        else
+            aes_ctx_decrypt(ctx, whole, BULK_BYTES, IV);
+        t1 = now_ns();
+        aes_stream_init(&st, ctx, AES_STREAM_CBC_NOPAD, enc, IV);
+        for (size_t off = 0; off < BULK_BYTES; off += AES_STREAM_CHUNK)
+            aes_stream_update(&st, in, AES_STREAM_CHUNK, out, &n);
+        aes_stream_final(&st, out, &n);
+        t2 = now_ns();
+
+        printf("%-10s %14.1f %14.1f %12d\n", enc ? "encrypt" : "decrypt",
+               mb_per_s(BULK_BYTES, t1 - t0), mb_per_s(BULK_BYTES, t2 - t1),
+               (2 * AES_STREAM_CHUNK + AES_BLOCK_SIZE) >> 10);
+    }
+
+    aes_ctx_destroy(ctx);
+    free(whole);
+    free(in);
+    free(out);
+}
+
+/*
+ * Encrypt then SHA-256 the ciphertext: two passes over the message
+ * against the stitched single pass, for a message that stays in L2 and
+ * one that has to come from DRAM. Decrypt-and-verify likewise.
+ */
+static void bench_hash(void)
+{
+    static const size_t sizes[] = { 64 << 10, BULK_BYTES };
+    char key[] = "0123456789abcdef0123456789abcdef";
+    char IV[] = "AAAAAAAAAAAAAAAA";
+    unsigned char* buf = malloc(BULK_BYTES);
+    unsigned char digest[AES_HASH_SIZE], check[SHA256_BLOCK_SIZE];
+    aes_ctx* ctx = aes_ctx_create(key, 32);
+    int ok = 1;
+
+    if (buf == NULL || ctx == NULL) {
+        printf("allocation failed\n");
+        free(buf);
+        aes_ctx_destroy(ctx);
+        return;
+    }
+
+    memset(buf, 0x3c, BULK_BYTES);
+    printf("%-10s %10s %14s %14s %8s\n", "direction", "size KiB", "2-pass MiB/s",
+           "fused MiB/s", "speedup");
+
+    for (int enc = 1; enc >= 0; enc--) {
+        for (int s = 0; s < 2; s++) {
+            size_t len = sizes[s];
+            int reps = (int)(BULK_BYTES / len);
+            double t0, t1, t2, two, fused;
+
+            two = fused = 0;
+            for (int r = 0; r < reps; r++) {
+                SHA256_CTX sha;
+
+                /* Decryption needs fresh ciphertext, made outside the timing */
+                if (!enc) aes_ctx_encrypt_hash(ctx, buf, len, IV, digest);
+                t0 = now_ns();
+                if (enc) aes_ctx_encrypt(ctx, buf, len, IV);
+                sha256_init(&sha);
+                sha256_update(&sha, buf, len);
+                sha256_final(&sha, check);
+                if (!enc) {
+                    ok &= memcmp(check, digest, sizeof(check)) == 0;
+                    aes_ctx_decrypt(ctx, buf, len, IV);
+                }
+                t1 = now_ns();
+
+                if (!enc) aes_ctx_encrypt_hash(ctx, buf, len, IV, digest);
+                t2 = now_ns();
+                if (enc)
+                    aes_ctx_encrypt_hash(ctx, buf, len, IV, digest);
+                else
+                    ok &= aes_ctx_decrypt_verify(ctx, buf, len, IV, digest) == 0;
+                two += t1 - t0;
+                fused += now_ns() - t2;
+            }
+
+            printf("%-10s %10zu %14.1f %14.1f %7.2fx\n", enc ? "encrypt" : "decrypt",
+                   len >> 10, mb_per_s(BULK_BYTES, two), mb_per_s(BULK_BYTES, fused),
+                   two / fused);
+        }
+    }
+    if (!ok) printf("verification failed\n");
+
+    aes_ctx_destroy(ctx);
+    free(buf);
+}
+
+/*
+ * Key rotation of a 64 MiB object: decrypt then encrypt as two passes,
+ * the fused single pass and its parallel variant, for each pair of
+ * modes.
+ */
+static void bench_reencrypt(void)
+{
+    static const char* names[] = { "cbc->cbc", "cbc->ctr", "ctr->cbc", "ctr->ctr" };
+    char k1[] = "0123456789abcdef0123456789abcdef";
+    char k2[] = "fedcba9876543210fedcba9876543210";
+    char iv1[] = "AAAAAAAAAAAAAAAA", iv2[] = "BBBBBBBBBBBBBBBB";
+    unsigned char* buf = malloc(BULK_BYTES);
+    aes_ctx* c1 = aes_ctx_create(k1, 32);
+    aes_ctx* c2 = aes_ctx_create(k2, 32);
+
+    if (buf == NULL || c1 == NULL || c2 == NULL) {
+        printf("allocation failed\n");
+        free(buf);
+        aes_ctx_destroy(c1);
+        aes_ctx_destroy(c2);
+        return;
+    }
+
+    memset(buf, 0x42, BULK_BYTES);
+    printf("%-10s %14s %14s %14s\n", "modes", "2-pass MiB/s", "fused MiB/s", "parallel MiB/s");
+
+    for (int m = 0; m < 4; m++) {
+        aes_cipher_spec from = { c1, m & 2 ? AES_STREAM_CTR : AES_STREAM_CBC, iv1 };
+        aes_cipher_spec to = { c2, m & 1 ? AES_STREAM_CTR : AES_STREAM_CBC, iv2 };
+        double t0, t1, t2, t3;
+
+        t0 = now_ns();
+        if (from.mode == AES_STREAM_CTR)
+            aes_ctx_ctr(c1, buf, BULK_BYTES, iv1, 0);
+        else
+            aes_ctx_decrypt(c1, buf, BULK_BYTES, iv1);
+        if (to.mode == AES_STREAM_CTR)
+            aes_ctx_ctr(c2, buf, BULK_BYTES, iv2, 0);
+        else
+            aes_ctx_encrypt(c2, buf, BULK_BYTES, iv2);
+        t1 = now_ns();
+        aes_reencrypt(&from, &to, buf, BULK_BYTES);
+        t2 = now_ns();
+        aes_reencrypt_parallel(&from, &to, buf, BULK_BYTES);
+        t3 = now_ns();
+
+        printf("%-10s %14.1f %14.1f %14.1f\n", names[m], mb_per_s(BULK_BYTES, t1 - t0),
+               mb_per_s(BULK_BYTES, t2 - t1), mb_per_s(BULK_BYTES, t3 - t2));
+    }
+
+    aes_ctx_destroy(c1);
+    aes_ctx_destroy(c2);
+    free(buf);
+}
+
+#define FILE_BYTES (64u << 20)
+
+/*
+ * File to file: aes_stream_file over stdio against the io_uring
+ * pipeline with a growing number of 1 MiB buffers. The input is read
+ * once first so every run starts from the page cache, unless O_DIRECT
+ * bypasses it.
+ */
+static void bench_file(void)
+{
+    char key[] = "0123456789abcdef0123456789abcdef";
+    char IV[] = "AAAAAAAAAAAAAAAA";
+    char in_path[] = "/tmp/aes_bench_XXXXXX", out_path[] = "/tmp/aes_bench_XXXXXX";
+    unsigned char* buf = malloc(1 << 20);
+    aes_ctx* ctx = aes_ctx_create(key, 32);
+    int fd_in = mkstemp(in_path), fd_out = mkstemp(out_path);
+    int ok = buf != NULL && ctx != NULL && fd_in >= 0 && fd_out >= 0;
+
+    if (ok) memset(buf, 0x5a, 1 << 20);
+    for (unsigned off = 0; ok && off < FILE_BYTES; off += 1 << 20)
+        ok = write(fd_in, buf, 1 << 20) == 1 << 20;
+    if (fd_in >= 0) close(fd_in);
+    if (fd_out >= 0) close(fd_out);
+    if (!ok) {
+        printf("setup failed\n");
+        goto done;
+    }
+
+    printf("%-6s %-10s %8s %10s %12s\n", "mode", "path", "buffers", "MiB/s", "io");
+    for (int m = 0; m < 2; m++) {
+        int mode = m == 0 ? AES_STREAM_CTR : AES_STREAM_CBC;
+        const char* name = m == 0 ? "ctr" : "cbc";
+        FILE* fi = fopen(in_path, "rb");
+        FILE* fo = fopen(out_path, "wb");
+        aes_stream st;
+        double t0, t1;
+
+        if (fi == NULL || fo == NULL) {
+            if (fi) fclose(fi);
+            if (fo) fclose(fo);
+            break;
+        }
+        aes_stream_init(&st, ctx, mode, 1, IV);
+        t0 = now_ns();
+        aes_stream_file(&st, fi, fo);
+        fflush(fo);
+        t1 = now_ns();
+        fclose(fi);
+        fclose(fo);
+        printf("%-6s %-10s %8d %10.1f %12s\n", name, "stdio", 1,
+               mb_per_s(FILE_BYTES, t1 - t0), "fread");
+
+        for (int direct = 0; direct < 2; direct++) {
+            for (int n = 2; n <= 16; n *= 2) {
+                aes_file_opts opts = { 1 << 20, n, direct };
+                aes_file_stats fs;
+
+                if (aes_file_crypt(ctx, mode, 1, IV, in_path, out_path, &opts, &fs) != 0) {
+                    printf("%-6s pipeline failed\n", name);
+                    continue;
+                }
+                printf("%-6s %-10s %8d %10.1f %12s\n", name,
+                       fs.direct_in ? "o_direct" : "pipeline", n,
+                       mb_per_s(FILE_BYTES, fs.seconds * 1e9),
+                       fs.uring ? "io_uring" : "pread");
+            }
+        }
+    }
+
+done:
+    unlink(in_path);
+    unlink(out_path);
+    aes_ctx_destroy(ctx);
+    free(buf);
+}
+
+int main(void)
+{
+    printf("== AES per-call overhead (%s) ==\n", aes_engine_name());
+    bench_ctx_overhead();
+    printf("\n== AES-256 key-schedule cache, 64-byte messages ==\n");
+    bench_key_cache();
+    printf("\n== AES-256 bulk throughput, %u MiB ==\n", BULK_BYTES >> 20);
+    bench_bulk_throughput();
+
+    /* The bulk run leaves the slowest kernel selected */
+    for (int e = 0; e < 4 && aes_engine_select(engines[e]) != 0; e++)
+        ;
+    printf("\n== AES-256 batch CBC encryption, %s ==\n", aes_engine_name());
+    bench_batch();
+    printf("\n== AES-256 parallel scaling, %s, %d CPUs ==\n", aes_engine_name(),
+           thread_pool_cpus());
+    bench_parallel_scaling();
+    printf("\n== AES-256 CBC over fragment chains, 64 KiB messages, %s ==\n",
+           aes_engine_name());
+    bench_iov();
+    printf("\n== AES-256 streaming CBC, %u MiB in 64 KiB updates, %s ==\n",
+           BULK_BYTES >> 20, aes_engine_name());
+    bench_stream();
+    printf("\n== AES-256 file encryption, %u MiB, %s ==\n", FILE_BYTES >> 20,
+           aes_engine_name());
+    bench_file();
+    printf("\n== AES-256-CBC with SHA-256 of the ciphertext, %s ==\n", aes_engine_name());
+    bench_hash();
+    printf("\n== AES-256 key rotation, %u MiB, %s, %d CPUs ==\n", BULK_BYTES >> 20,
+           aes_engine_name(), thread_pool_cpus());
+    bench_reencrypt();
+    printf("\n== XTS-AES-256, 4096-byte sectors, %s ==\n", aes_engine_name());
+    bench_xts();
+    return 0;
+}
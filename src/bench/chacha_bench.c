@@ -0,0 +1,159 @@
+/*********************************************************************
+ * Filename:   chacha_bench.c
+ * Description: Timing harness for ChaCha20-Poly1305: throughput of
+ *              each kernel across message sizes, Poly1305 on its own,
+ *              and AES-GCM on each AES kernel for comparison.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "aes.h"
+#include "chacha.h"
+
+/* Each size is repeated until this many bytes have been processed */
+#define TOTAL_BYTES (64u << 20)
+
+static const size_t sizes[] = { 64, 256, 1024, 8192, 65536, 1 << 20 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static const char* chacha_engines[] = { "avx2", "sse2", "portable" };
+static const char* aes_engines[] = { "aesni", "bitslice-avx2", "bitslice-sse2", "portable" };
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double mb_per_s(size_t bytes, double ns)
+{
+    return bytes / (ns / 1e9) / (1 << 20);
+}
+
+static void print_header(const char* first)
+{
+    printf("%-14s", first);
+    for (size_t s = 0; s < NSIZES; s++) {
+        char col[16];
+
+        if (sizes[s] >= 1 << 20)
+            snprintf(col, sizeof(col), "%zuM", sizes[s] >> 20);
+        else if (sizes[s] >= 1024)
+            snprintf(col, sizeof(col), "%zuK", sizes[s] >> 10);
+        else
+            snprintf(col, sizeof(col), "%zu", sizes[s]);
+        printf(" %9s", col);
+    }
+    printf("   (MiB/s)\n");
+}
+
+/* Raw ChaCha20 keystream and the AEAD, per kernel and message size */
+static void bench_chacha(unsigned char* buf, int aead)
+{
+    char key[CHACHA_KEY_SIZE], nonce[CHACHA_NONCE_SIZE] = { 0 }, tag[CHACHA_TAG_SIZE];
+    chacha_ctx* ctx;
+
+    memset(key, 0x2b, sizeof(key));
+    ctx = chacha_ctx_create(key, sizeof(key));
+    if (ctx == NULL) return;
+
+    print_header("kernel");
+    for (int e = 0; e < 3; e++) {
+        if (chacha_engine_select(chacha_engines[e]) != 0) continue;
+
+        printf("%-14s", chacha_engines[e]);
+        for (size_t s = 0; s < NSIZES; s++) {
+            size_t reps = TOTAL_BYTES / sizes[s];
+            double t0 = now_ns();
+
+            for (size_t r = 0; r < reps; r++) {
+                if (aead)
+                    chacha_aead_encrypt(ctx, nonce, NULL, 0, buf, sizes[s], tag);
+                else
+                    chacha_ctx_xor(ctx, buf, sizes[s], nonce, 1);
+            }
+            printf(" %9.1f", mb_per_s(reps * sizes[s], now_ns() - t0));
+        }
+        printf("\n");
+    }
+    chacha_ctx_destroy(ctx);
+}
+
+static void bench_poly1305(unsigned char* buf)
+{
+    unsigned char key[32], tag[CHACHA_TAG_SIZE];
+    chacha_poly1305 st;
+
+    memset(key, 0x17, sizeof(key));
+    print_header("");
+    printf("%-14s", "poly1305");
+    for (size_t s = 0; s < NSIZES; s++) {
+        size_t reps = TOTAL_BYTES / sizes[s];
+        double t0 = now_ns();
+
+        for (size_t r = 0; r < reps; r++) {
+            chacha_poly1305_init(&st, key);
+            chacha_poly1305_update(&st, buf, sizes[s]);
+            chacha_poly1305_final(&st, tag);
+        }
+        printf(" %9.1f", mb_per_s(reps * sizes[s], now_ns() - t0));
+    }
+    printf("\n");
+}
+
+/* AES-256-GCM on the same message sizes, for each AES kernel */
+static void bench_aes_gcm(unsigned char* buf)
+{
+    char key[32], IV[12] = { 0 }, tag[AES_GCM_TAG_SIZE];
+    aes_ctx* ctx;
+
+    memset(key, 0x2b, sizeof(key));
+    ctx = aes_ctx_create(key, sizeof(key));
+    if (ctx == NULL) return;
+
+    print_header("aes kernel");
+    for (int e = 0; e < 4; e++) {
+        if (aes_engine_select(aes_engines[e]) != 0) continue;
+
+        printf("%-14s", aes_engines[e]);
+        for (size_t s = 0; s < NSIZES; s++) {
+            size_t reps = TOTAL_BYTES / sizes[s];
+            double t0 = now_ns();
+
+            for (size_t r = 0; r < reps; r++)
+                aes_gcm_encrypt(ctx, IV, sizeof(IV), NULL, 0, buf, sizes[s], tag);
+            printf(" %9.1f", mb_per_s(reps * sizes[s], now_ns() - t0));
+        }
+        printf("\n");
+    }
+    aes_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    unsigned char* buf = malloc(1 << 20);
+
+    if (buf == NULL) {
+        printf("allocation failed\n");
+        return 1;
+    }
+    memset(buf, 0x5c, 1 << 20);
+
+    printf("== ChaCha20 keystream, %u MiB per size ==\n", TOTAL_BYTES >> 20);
+    bench_chacha(buf, 0);
+    printf("\n== ChaCha20-Poly1305 encryption, %u MiB per size ==\n", TOTAL_BYTES >> 20);
+    bench_chacha(buf, 1);
+    printf("\n== Poly1305 alone ==\n");
+    bench_poly1305(buf);
+    printf("\n== AES-256-GCM encryption, for comparison ==\n");
+    bench_aes_gcm(buf);
+
+    free(buf);
+    return 0;
+}
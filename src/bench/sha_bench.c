@@ -0,0 +1,602 @@
+/*********************************************************************
+ * Filename:   sha_bench.c
+ * Description: Timing harness for SHA-256 and SHA-1: throughput and
+ *              cycles per byte of each compression kernel across
+ *              message sizes, including init and final, of the
+ *              multi-buffer kernels on batches of objects, of the
+ *              HMAC on short messages, of PBKDF2 by kernel, of the
+ *              tree-hash mode by leaf size and thread count, of Merkle
+ *              index updates by the fraction of data changed, of
+ *              checkpointed streams by checkpoint interval, and of the
+ *              fixed-length 32- and 64-byte paths against the general
+ *              one.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sha256.h"
+#include "sha1.h"
+#include "sha256_tree.h"
+#include "sha256_index.h"
+#include "hmac.h"
+#include "pbkdf2.h"
+#include "sha_stream.h"
+#include "thread_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+/* Each size is repeated until this many bytes have been processed */
+#define TOTAL_BYTES (64u << 20)
+
+/* Input of the tree-hash runs */
+#define TREE_BYTES ((size_t)256 << 20)
+
+/* Input of the checkpointed stream runs */
+#define STREAM_BYTES (1ull << 30)
+
+static const size_t sizes[] = { 64, 256, 1024, 8192, 65536, 1 << 20 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static const char* engines[] = { "shani", "portable" };
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Time-stamp counter ticks; the nominal clock, not the boosted one */
+static unsigned long long cycles(void)
+{
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void print_header(const char* first, const char* unit, const size_t* sz, size_t n)
+{
+    printf("%-14s", first);
+    for (size_t s = 0; s < n; s++) {
+        char col[16];
+
+        if (sz[s] >= 1 << 20)
+            snprintf(col, sizeof(col), "%zuM", sz[s] >> 20);
+        else if (sz[s] >= 1024)
+            snprintf(col, sizeof(col), "%zuK", sz[s] >> 10);
+        else
+            snprintf(col, sizeof(col), "%zu", sz[s]);
+        printf(" %9s", col);
+    }
+    printf("   (%s)\n", unit);
+}
+
+/* One whole hash of len bytes */
+static void hash_once(int sha1, const BYTE* buf, size_t len, BYTE* out)
+{
+    if (sha1) {
+        SHA1_CTX ctx;
+
+        sha1_init(&ctx);
+        sha1_update(&ctx, buf, len);
+        sha1_final(&ctx, out);
+    } else {
+        SHA256_CTX ctx;
+
+        sha256_init(&ctx);
+        sha256_update(&ctx, buf, len);
+        sha256_final(&ctx, out);
+    }
+}
+
+static void bench_hash(int sha1, const BYTE* buf)
+{
+    double mbs[2][NSIZES], cpb[2][NSIZES];
+    int ran[2] = { 0, 0 };
+    BYTE out[SHA256_BLOCK_SIZE];
+
+    for (int e = 0; e < 2; e++) {
+        if ((sha1 ? sha1_engine_select(engines[e]) : sha256_engine_select(engines[e])) != 0)
+            continue;
+        ran[e] = 1;
+
+        for (size_t s = 0; s < NSIZES; s++) {
+            size_t reps = TOTAL_BYTES / sizes[s];
+            unsigned long long c0 = cycles();
+            double t0 = now_ns();
+
+            for (size_t r = 0; r < reps; r++)
+                hash_once(sha1, buf, sizes[s], out);
+            mbs[e][s] = reps * sizes[s] / ((now_ns() - t0) / 1e9) / (1 << 20);
+            cpb[e][s] = (double)(cycles() - c0) / (reps * sizes[s]);
+        }
+    }
+
+    print_header("kernel", "MiB/s", sizes, NSIZES);
+    for (int e = 0; e < 2; e++) {
+        if (!ran[e]) continue;
+        printf("%-14s", engines[e]);
+        for (size_t s = 0; s < NSIZES; s++)
+            printf(" %9.1f", mbs[e][s]);
+        printf("\n");
+    }
+
+    if (!HAVE_TSC) return;
+    print_header("", "cycles/byte", sizes, NSIZES);
+    for (int e = 0; e < 2; e++) {
+        if (!ran[e]) continue;
+        printf("%-14s", engines[e]);
+        for (size_t s = 0; s < NSIZES; s++)
+            printf(" %9.2f", cpb[e][s]);
+        printf("\n");
+    }
+}
+
+static int select_single(int sha1, const char* name)
+{
+    return sha1 ? sha1_engine_select(name) : sha256_engine_select(name);
+}
+
+static int select_mb(int sha1, const char* name)
+{
+    return sha1 ? sha1_mb_engine_select(name) : sha256_mb_engine_select(name);
+}
+
+/* Single-buffer rows are labelled "1x <kernel>", the others "mb <kernel>" */
+static void print_row(int r, const char* name)
+{
+    char label[32];
+
+    snprintf(label, sizeof(label), "%s %s", r < 2 ? "1x" : "mb", name);
+    printf("%-14s", label);
+}
+
+/* Batches of independent objects of one size, as a content-addressed
+ * store or a manifest check would see them: each single-buffer kernel
+ * one object at a time, then each multi-buffer kernel on the batch */
+static void bench_mb(int sha1, const BYTE* buf)
+{
+    static const size_t obj_sizes[] = { 64, 256, 1024, 4096, 16384, 65536 };
+    static const char* mb256[] = { "avx512", "avx2", "x1" };
+    static const char* mb1[] = { "avx2", "sse2", "x1" };
+    enum { NOBJ = 256, NOBJ_SIZES = sizeof(obj_sizes) / sizeof(obj_sizes[0]), NROWS = 5 };
+    static SHA256_JOB jobs[NOBJ];
+    static const BYTE* data[NOBJ];
+    static size_t len[NOBJ];
+    static BYTE digest[NOBJ][SHA1_BLOCK_SIZE];
+    const char* rows[NROWS];
+    double mbs[NROWS][NOBJ_SIZES], cpb[NROWS][NOBJ_SIZES];
+    int ran[NROWS] = { 0 };
+
+    for (int r = 0; r < NROWS; r++) {
+        /* Rows 0-1 are the single-buffer kernels, the rest multi-buffer */
+        int mb = r >= 2;
+
+        rows[r] = mb ? (sha1 ? mb1 : mb256)[r - 2] : engines[r];
+        if (mb) {
+            /* x1 runs on the best single-buffer kernel */
+            if (select_single(sha1, "shani") != 0)
+                select_single(sha1, "portable");
+            if (select_mb(sha1, rows[r]) != 0) continue;
+        } else if (select_single(sha1, rows[r]) != 0) {
+            continue;
+        }
+        ran[r] = 1;
+
+        for (size_t s = 0; s < NOBJ_SIZES; s++) {
+            size_t reps = TOTAL_BYTES / (obj_sizes[s] * NOBJ);
+            unsigned long long c0;
+            double t0;
+
+            /* Objects overlap in buf; only their lengths matter here */
+            for (int j = 0; j < NOBJ; j++) {
+                data[j] = buf + (size_t)j * 4096 % ((1 << 20) - obj_sizes[s]);
+                len[j] = obj_sizes[s];
+                jobs[j].data = data[j];
+                jobs[j].len = len[j];
+            }
+
+            c0 = cycles();
+            t0 = now_ns();
+            for (size_t i = 0; i < reps; i++) {
+                if (!mb) {
+                    for (int j = 0; j < NOBJ; j++)
+                        hash_once(sha1, data[j], len[j], digest[j]);
+                } else if (sha1) {
+                    sha1_hash_batch(data, len, digest, NOBJ);
+                } else {
+                    sha256_hash_batch(jobs, NOBJ);
+                }
+            }
+            mbs[r][s] = reps * NOBJ * obj_sizes[s] / ((now_ns() - t0) / 1e9) / (1 << 20);
+            cpb[r][s] = (double)(cycles() - c0) / (reps * NOBJ * obj_sizes[s]);
+        }
+    }
+
+    print_header("kernel", "MiB/s", obj_sizes, NOBJ_SIZES);
+    for (int r = 0; r < NROWS; r++) {
+        if (!ran[r]) continue;
+        print_row(r, rows[r]);
+        for (size_t s = 0; s < NOBJ_SIZES; s++)
+            printf(" %9.1f", mbs[r][s]);
+        printf("\n");
+    }
+
+    if (!HAVE_TSC) return;
+    print_header("", "cycles/byte", obj_sizes, NOBJ_SIZES);
+    for (int r = 0; r < NROWS; r++) {
+        if (!ran[r]) continue;
+        print_row(r, rows[r]);
+        for (size_t s = 0; s < NOBJ_SIZES; s++)
+            printf(" %9.2f", cpb[r][s]);
+        printf("\n");
+    }
+}
+
+/* MACs of short messages under one key: setting the key up for every
+ * message (the pads hashed each time), keyed states, and batches */
+static void bench_hmac(int sha1, const BYTE* buf)
+{
+    static const size_t msg_sizes[] = { 16, 64, 256, 1024 };
+    static const char* rows[] = { "rekeyed", "keyed", "batch" };
+    enum { NMSG = 256, NMSG_SIZES = sizeof(msg_sizes) / sizeof(msg_sizes[0]), NROWS = 3 };
+    static const BYTE* data[NMSG];
+    static size_t len[NMSG];
+    static BYTE mac[NMSG][SHA256_BLOCK_SIZE];
+    static BYTE mac1[NMSG][SHA1_BLOCK_SIZE];
+    const BYTE key[32] = { 1, 2, 3, 4 };
+    double rate[NROWS][NMSG_SIZES];
+    HMAC_SHA256_KEY k256;
+    HMAC_SHA1_KEY k1;
+
+    /* Best kernels */
+    if (select_single(sha1, "shani") != 0)
+        select_single(sha1, "portable");
+    if (select_mb(sha1, sha1 ? "avx2" : "avx512") != 0)
+        select_mb(sha1, "x1");
+    printf("batch on %s\n", sha1 ? sha1_mb_engine_name() : sha256_mb_engine_name());
+    hmac_sha256_key(&k256, key, sizeof(key));
+    hmac_sha1_key(&k1, key, sizeof(key));
+
+    for (size_t s = 0; s < NMSG_SIZES; s++) {
+        size_t reps = TOTAL_BYTES / 16 / (msg_sizes[s] * NMSG);
+
+        for (int j = 0; j < NMSG; j++) {
+            data[j] = buf + (size_t)j * 1024;
+            len[j] = msg_sizes[s];
+        }
+        for (int r = 0; r < NROWS; r++) {
+            double t0 = now_ns();
+
+            for (size_t i = 0; i < reps; i++) {
+                if (r == 2) {
+                    if (sha1)
+                        hmac_sha1_batch(&k1, data, len, mac1, NMSG);
+                    else
+                        hmac_sha256_batch(&k256, data, len, mac, NMSG);
+                    continue;
+                }
+                for (int j = 0; j < NMSG; j++) {
+                    if (r == 0 && sha1) hmac_sha1_key(&k1, key, sizeof(key));
+                    if (r == 0 && !sha1) hmac_sha256_key(&k256, key, sizeof(key));
+                    if (sha1)
+                        hmac_sha1(&k1, data[j], len[j], mac1[j]);
+                    else
+                        hmac_sha256(&k256, data[j], len[j], mac[j]);
+                }
+            }
+            rate[r][s] = reps * NMSG / ((now_ns() - t0) / 1e9) / 1e6;
+        }
+    }
+
+    print_header("", "million MACs/s", msg_sizes, NMSG_SIZES);
+    for (int r = 0; r < NROWS; r++) {
+        printf("%-14s", rows[r]);
+        for (size_t s = 0; s < NMSG_SIZES; s++)
+            printf(" %9.2f", rate[r][s]);
+        printf("\n");
+    }
+    hmac_sha256_key_clear(&k256);
+    hmac_sha1_key_clear(&k1);
+}
+
+/* PBKDF2-HMAC-SHA256 at a fixed iteration count on each multi-buffer
+ * kernel: one 32-byte key, one 256-byte key (8 blocks side by side),
+ * and a batch of candidate passwords; then the calibrated count */
+static void bench_pbkdf2(const BYTE* buf)
+{
+    static const char* mb256[] = { "avx512", "avx2", "x1" };
+    enum { ITER = 10000, NPASS = 64 };
+    static BYTE out[NPASS][32];
+    const BYTE* pass[NPASS];
+    const BYTE* salt[NPASS];
+    size_t pass_len[NPASS], salt_len[NPASS];
+    BYTE* outp[NPASS];
+    BYTE key[256];
+    double t0, one, eight, batch;
+
+    for (int i = 0; i < NPASS; i++) {
+        pass[i] = buf + i * 64;
+        pass_len[i] = 12;
+        salt[i] = buf + 8192 + i * 64;
+        salt_len[i] = 16;
+        outp[i] = out[i];
+    }
+    if (select_single(0, "shani") != 0)
+        select_single(0, "portable");
+
+    printf("%-14s %9s %9s %9s   (%d iterations)\n", "kernel", "32B ms", "256B ms", "pw/s", ITER);
+    for (int e = 0; e < 3; e++) {
+        if (sha256_mb_engine_select(mb256[e]) != 0) continue;
+
+        t0 = now_ns();
+        pbkdf2_hmac_sha256(buf, 12, buf + 8192, 16, ITER, key, 32);
+        one = (now_ns() - t0) / 1e6;
+        t0 = now_ns();
+        pbkdf2_hmac_sha256(buf, 12, buf + 8192, 16, ITER, key, 256);
+        eight = (now_ns() - t0) / 1e6;
+        t0 = now_ns();
+        pbkdf2_hmac_sha256_batch(pass, pass_len, salt, salt_len, ITER, outp, 32, NPASS);
+        batch = NPASS / ((now_ns() - t0) / 1e9);
+        printf("%-14s %9.2f %9.2f %9.1f\n", mb256[e], one, eight, batch);
+    }
+
+    sha256_mb_engine_select("avx512");
+    printf("calibrated for 100 ms on %s: %lu iterations\n",
+           sha256_mb_engine_name(), pbkdf2_hmac_sha256_calibrate(0.1, 32));
+}
+
+/* Tree hash of one large buffer against plain SHA-256 over it */
+static void bench_tree(void)
+{
+    static const size_t leaf_sizes[] = { 16384, 65536, 1 << 20 };
+    enum { NLEAF_SIZES = sizeof(leaf_sizes) / sizeof(leaf_sizes[0]) };
+    const size_t len = TREE_BYTES;
+    BYTE* big = malloc(len);
+    BYTE root[SHA256_BLOCK_SIZE];
+    double t0;
+
+    if (big == NULL) {
+        printf("allocation failed\n");
+        return;
+    }
+    memset(big, 0x3a, len);
+
+    /* Plain SHA-256 on the best single-buffer kernel */
+    if (sha256_engine_select("shani") != 0)
+        sha256_engine_select("portable");
+    t0 = now_ns();
+    hash_once(0, big, len, root);
+    printf("%-14s %9.1f MiB/s\n", "sha256", len / ((now_ns() - t0) / 1e9) / (1 << 20));
+
+    print_header("threads", "MiB/s by leaf size", leaf_sizes, NLEAF_SIZES);
+    for (int threads = 1; threads <= thread_pool_cpus() || threads == 1; threads *= 2) {
+        printf("%-14d", threads);
+        for (size_t s = 0; s < NLEAF_SIZES; s++) {
+            SHA256_TREE_PARAMS params = { leaf_sizes[s], 2, threads };
+
+            t0 = now_ns();
+            sha256_tree_hash(big, len, &params, root);
+            printf(" %9.1f", len / ((now_ns() - t0) / 1e9) / (1 << 20));
+        }
+        printf("\n");
+    }
+    free(big);
+}
+
+/* Incremental update of a Merkle index after scattered 4 KiB pages of
+ * a large buffer change, against building it again */
+static void bench_index(void)
+{
+    static const double fractions[] = { 0.0001, 0.001, 0.01, 0.1, 0.5, 1.0 };
+    enum { NFRACTIONS = sizeof(fractions) / sizeof(fractions[0]), PAGE = 4096 };
+    const size_t len = TREE_BYTES, npages = len / PAGE;
+    const char* side = "/tmp/sha_bench.idx";
+    SHA256_RANGE* dirty = malloc(npages * sizeof(*dirty));
+    BYTE* big = malloc(len);
+    BYTE* touched = calloc(len / SHA256_TREE_LEAF_DEFAULT, 1);
+    SHA256_INDEX idx;
+    double t0, build;
+
+    if (big != NULL) memset(big, 0x3a, len);
+    t0 = now_ns();
+    if (big == NULL || dirty == NULL || touched == NULL ||
+        sha256_index_build(&idx, big, len, NULL) != 0) {
+        printf("allocation failed\n");
+        free(big);
+        free(dirty);
+        free(touched);
+        return;
+    }
+    build = (now_ns() - t0) / 1e6;
+    printf("%-14s %9.2f ms\n", "build", build);
+    t0 = now_ns();
+    if (sha256_index_save(&idx, side) == 0)
+        printf("%-14s %9.2f ms (%zu nodes)\n", "sidecar save", (now_ns() - t0) / 1e6, idx.nodes);
+    unlink(side);
+
+    printf("%-14s %9s %9s %9s %9s\n", "changed", "pages", "leaves", "ms", "speedup");
+    for (int f = 0; f < NFRACTIONS; f++) {
+        size_t n = (size_t)(npages * fractions[f]);
+        size_t stride = npages / (n > 0 ? n : 1), leaves = 0;
+        char label[16];
+        double ms;
+
+        /* Evenly scattered pages, so each one lands in its own leaf
+         * for as long as there are fewer pages than leaves */
+        for (size_t i = 0; i < n; i++) {
+            dirty[i].offset = (i * stride + f) % npages * PAGE;
+            dirty[i].length = PAGE;
+            big[dirty[i].offset] ^= 1;
+            if (!touched[dirty[i].offset / SHA256_TREE_LEAF_DEFAULT]) {
+                touched[dirty[i].offset / SHA256_TREE_LEAF_DEFAULT] = 1;
+                leaves++;
+            }
+        }
+        memset(touched, 0, len / SHA256_TREE_LEAF_DEFAULT);
+        t0 = now_ns();
+        sha256_index_update(&idx, big, len, dirty, n);
+        ms = (now_ns() - t0) / 1e6;
+        snprintf(label, sizeof(label), "%g%%", fractions[f] * 100);
+        printf("%-14s %9zu %9zu %9.2f %8.0fx\n", label, n, leaves, ms, build / ms);
+    }
+    sha256_index_free(&idx);
+    free(touched);
+    free(dirty);
+    free(big);
+}
+
+static void bench_stream(const BYTE* buf)
+{
+    static const unsigned long long intervals[] = { 0, 256ull << 20, 64ull << 20, 16ull << 20, 1ull << 20 };
+    const char* ckpt = "/tmp/sha_bench.ckpt";
+    BYTE blob[SHA256_CTX_BLOB_SIZE], digest[SHA256_BLOCK_SIZE];
+    SHA256_CTX ctx;
+    double t0, base = 0;
+    int reps = 100000;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, buf, 100);
+    t0 = now_ns();
+    for (int r = 0; r < reps; r++) {
+        sha256_ctx_export(&ctx, blob);
+        sha256_ctx_import(&ctx, blob);
+    }
+    printf("%-14s %9.0f ns\n", "export+import", (now_ns() - t0) / reps);
+
+    printf("%-14s %9s %9s %9s\n", "interval", "saves", "MB/s", "overhead");
+    for (size_t i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+        SHA_STREAM s;
+        char label[32];
+        double ns;
+
+        if (sha_stream_init(&s, SHA_STREAM_SHA256, intervals[i] > 0 ? ckpt : NULL, intervals[i]) != 0) {
+            printf("cannot start a stream at %s\n", ckpt);
+            return;
+        }
+        t0 = now_ns();
+        for (unsigned long long off = 0; off < STREAM_BYTES; off += 1 << 20)
+            sha_stream_update(&s, buf, 1 << 20);
+        sha_stream_final(&s, digest);
+        ns = now_ns() - t0;
+        if (i == 0) base = ns;
+
+        if (intervals[i] == 0)
+            snprintf(label, sizeof(label), "none");
+        else
+            snprintf(label, sizeof(label), "%llu MiB", intervals[i] >> 20);
+        printf("%-14s %9llu %9.0f %8.1f%%\n", label,
+               intervals[i] > 0 ? STREAM_BYTES / intervals[i] : 0,
+               STREAM_BYTES / ns * 1e3, (ns / base - 1) * 100);
+    }
+}
+
+/* Hashes of 32- and 64-byte inputs: through init/update/final ("gen"),
+ * the fixed-length functions ("fix") on each single-buffer kernel, and
+ * their batches on each multi-buffer kernel ("mb") */
+static void bench_fixed(const BYTE* buf)
+{
+    static const size_t in_sizes[] = { 32, 64 };
+    static const char* mb256[] = { "avx512", "avx2", "x1" };
+    enum { NIN = 4096, REPS = 256 };
+    static BYTE out[NIN][SHA256_BLOCK_SIZE];
+    const BYTE (*in64)[64] = (const BYTE (*)[64])buf;
+    const BYTE (*in32)[32] = (const BYTE (*)[32])buf;
+
+    print_header("", "million hashes/s", in_sizes, 2);
+    for (int r = 0; r < 7; r++) {
+        const char* name = r < 4 ? engines[r / 2] : mb256[r - 4];
+        char label[32];
+
+        /* The batches take the best single-buffer kernel for spare lanes */
+        if (r == 4 && select_single(0, "shani") != 0) select_single(0, "portable");
+        if (r < 4 ? select_single(0, name) != 0 : select_mb(0, name) != 0) continue;
+        snprintf(label, sizeof(label), "%s %s", r < 4 ? (r % 2 ? "fix" : "gen") : "mb", name);
+        printf("%-14s", label);
+
+        for (int s = 0; s < 2; s++) {
+            double t0 = now_ns();
+
+            for (int i = 0; i < REPS; i++) {
+                if (r >= 4) {
+                    if (s == 0)
+                        sha256_32_batch(in32, out, NIN);
+                    else
+                        sha256_64_batch(in64, out, NIN);
+                    continue;
+                }
+                for (int j = 0; j < NIN; j++) {
+                    const BYTE* p = s == 0 ? in32[j] : in64[j];
+
+                    if (r % 2 == 0) {
+                        SHA256_CTX ctx;
+
+                        sha256_init(&ctx);
+                        sha256_update(&ctx, p, in_sizes[s]);
+                        sha256_final(&ctx, out[j]);
+                    } else if (s == 0) {
+                        sha256_32(p, out[j]);
+                    } else {
+                        sha256_64(p, out[j]);
+                    }
+                }
+            }
+            printf(" %9.2f", (double)REPS * NIN / ((now_ns() - t0) / 1e9) / 1e6);
+        }
+        printf("\n");
+    }
+
+    /* Back to the default */
+    if (select_mb(0, "avx512") != 0 && select_mb(0, "avx2") != 0) select_mb(0, "x1");
+}
+
+int main(void)
+{
+    BYTE* buf = malloc(1 << 20);
+
+    if (buf == NULL) {
+        printf("allocation failed\n");
+        return 1;
+    }
+    memset(buf, 0x5c, 1 << 20);
+
+    printf("== SHA-256, %u MiB per size ==\n", TOTAL_BYTES >> 20);
+    bench_hash(0, buf);
+    printf("\n== SHA-1, %u MiB per size ==\n", TOTAL_BYTES >> 20);
+    bench_hash(1, buf);
+    printf("\n== SHA-256 on batches of 256 objects ==\n");
+    bench_mb(0, buf);
+    printf("\n== SHA-1 on batches of 256 objects ==\n");
+    bench_mb(1, buf);
+    printf("\n== HMAC-SHA256, batches of 256 messages ==\n");
+    bench_hmac(0, buf);
+    printf("\n== HMAC-SHA1, batches of 256 messages ==\n");
+    bench_hmac(1, buf);
+    printf("\n== PBKDF2-HMAC-SHA256 ==\n");
+    bench_pbkdf2(buf);
+    printf("\n== SHA-256 tree hash, %zu MiB, fanout 2, %d CPUs ==\n",
+           TREE_BYTES >> 20, thread_pool_cpus());
+    bench_tree();
+    printf("\n== SHA-256 Merkle index, %zu MiB, 64K leaves ==\n", TREE_BYTES >> 20);
+    bench_index();
+    printf("\n== SHA-256 checkpointed stream, %llu MiB ==\n", STREAM_BYTES >> 20);
+    bench_stream(buf);
+    printf("\n== SHA-256 of 32- and 64-byte inputs ==\n");
+    bench_fixed(buf);
+
+    free(buf);
+    return 0;
+}
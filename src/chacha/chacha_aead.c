@@ -0,0 +1,181 @@
+/*********************************************************************
+ * Filename:   chacha_aead.c
+ * Description: ChaCha20-Poly1305 AEAD (RFC 8439 section 2.8). Bulk
+ *              data is encrypted and authenticated in chunks small
+ *              enough to stay in L1, so it is read from memory once.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <string.h>
+#include "chacha_internal.h"
+
+/* Bytes encrypted then authenticated per step */
+#define AEAD_CHUNK 4096
+
+/* The 32-bit block counter starts at 1: 2^32 - 1 blocks of message */
+#define AEAD_MAX_MSG (((1ULL << 32) - 1) * CHACHA_BLOCK_SIZE)
+
+enum { AEAD_AAD, AEAD_DATA, AEAD_DONE };
+
+static const uint8_t zeros[16];
+
+int chacha_aead_init(chacha_aead* st, const chacha_ctx* ctx, const char* nonce)
+{
+    uint8_t block0[CHACHA_BLOCK_SIZE] = {0};
+
+    if (ctx == NULL) return 1;
+
+    memset(st, 0, sizeof(*st));
+    st->ctx = ctx;
+    st->ks_pos = CHACHA_BLOCK_SIZE;
+
+    /* The one-time Poly1305 key is the first half of block 0 */
+    chacha_state_init(st->state, ctx, (const uint8_t*)nonce, 0);
+    chacha_engine_get()->xor_blocks(st->state, block0, block0, 1);
+    chacha_poly1305_init(&st->mac, block0);
+    secure_zero(block0, sizeof(block0));
+    return 0;
+}
+
+int chacha_aead_aad(chacha_aead* st, const void* aad, size_t len)
+{
+    if (st->phase != AEAD_AAD) return 1;
+
+    chacha_poly1305_update(&st->mac, aad, len);
+    st->aad_len += len;
+    return 0;
+}
+
+/* AAD and ciphertext are each zero-padded to a 16-byte boundary */
+static void pad16(chacha_aead* st, unsigned long long len)
+{
+    if (len % 16 != 0)
+        chacha_poly1305_update(&st->mac, zeros, 16 - len % 16);
+}
+
+static void keystream_xor(chacha_aead* st, const uint8_t* in, uint8_t* out, size_t len)
+{
+    /* Finish the partial block left by the previous call */
+    if (st->ks_pos < CHACHA_BLOCK_SIZE) {
+        size_t n = CHACHA_BLOCK_SIZE - st->ks_pos < len ? CHACHA_BLOCK_SIZE - st->ks_pos : len;
+
+        for (size_t i = 0; i < n; i++)
+            out[i] = in[i] ^ st->ks[st->ks_pos + i];
+        st->ks_pos += n;
+        in += n;
+        out += n;
+        len -= n;
+    }
+    if (len == 0) return;
+
+    chacha_xor(st->state, in, out, len, st->ks);
+    if (len % CHACHA_BLOCK_SIZE != 0)
+        st->ks_pos = len % CHACHA_BLOCK_SIZE;
+}
+
+static int aead_update(chacha_aead* st, const void* in, void* out, size_t len, int enc)
+{
+    const uint8_t* src = in;
+    uint8_t* dst = out;
+
+    if (st->phase == AEAD_DONE || len > AEAD_MAX_MSG - st->msg_len) return 1;
+    if (st->phase == AEAD_AAD) {
+        pad16(st, st->aad_len);
+        st->phase = AEAD_DATA;
+    }
+    st->msg_len += len;
+
+    /* The MAC always covers the ciphertext: after encrypting, before
+     * decrypting (in may equal out) */
+    for (size_t off = 0; off < len; off += AEAD_CHUNK) {
+        size_t n = len - off < AEAD_CHUNK ? len - off : AEAD_CHUNK;
+
+        if (!enc) chacha_poly1305_update(&st->mac, src + off, n);
+        keystream_xor(st, src + off, dst + off, n);
+        if (enc) chacha_poly1305_update(&st->mac, dst + off, n);
+    }
+    return 0;
+}
+
+int chacha_aead_encrypt_update(chacha_aead* st, const void* in, void* out, size_t len)
+{
+    return aead_update(st, in, out, len, 1);
+}
+
+int chacha_aead_decrypt_update(chacha_aead* st, const void* in, void* out, size_t len)
+{
+    return aead_update(st, in, out, len, 0);
+}
+
+int chacha_aead_final(chacha_aead* st, char* tag)
+{
+    uint8_t lens[16];
+
+    if (st->phase == AEAD_DONE) return 1;
+    if (st->phase == AEAD_AAD)
+        pad16(st, st->aad_len);
+    else
+        pad16(st, st->msg_len);
+    st->phase = AEAD_DONE;
+
+    for (int i = 0; i < 8; i++) {
+        lens[i] = (uint8_t)(st->aad_len >> (8 * i));
+        lens[8 + i] = (uint8_t)(st->msg_len >> (8 * i));
+    }
+    chacha_poly1305_update(&st->mac, lens, sizeof(lens));
+    chacha_poly1305_final(&st->mac, (unsigned char*)tag);
+
+    secure_zero(st->state, sizeof(st->state));
+    secure_zero(st->ks, sizeof(st->ks));
+    return 0;
+}
+
+int chacha_aead_verify(chacha_aead* st, const char* tag)
+{
+    char expect[CHACHA_TAG_SIZE];
+    uint8_t diff = 0;
+
+    if (chacha_aead_final(st, expect) != 0) return 1;
+
+    /* Constant time: every byte is compared whatever the outcome */
+    for (size_t i = 0; i < CHACHA_TAG_SIZE; i++)
+        diff |= (uint8_t)(expect[i] ^ tag[i]);
+
+    secure_zero(expect, sizeof(expect));
+    return diff != 0;
+}
+
+/* ---------------- one-shot API ---------------- */
+
+int chacha_aead_encrypt(chacha_ctx* ctx, const char* nonce, const void* aad, size_t aad_len,
+                        void* buffer, size_t buffer_len, char* tag)
+{
+    chacha_aead st;
+    int ret;
+
+    if (chacha_aead_init(&st, ctx, nonce) != 0) return 1;
+    ret = chacha_aead_aad(&st, aad, aad_len) != 0 ||
+          chacha_aead_encrypt_update(&st, buffer, buffer, buffer_len) != 0 ||
+          chacha_aead_final(&st, tag) != 0;
+
+    secure_zero(&st, sizeof(st));
+    return ret;
+}
+
+int chacha_aead_decrypt(chacha_ctx* ctx, const char* nonce, const void* aad, size_t aad_len,
+                        void* buffer, size_t buffer_len, const char* tag)
+{
+    chacha_aead st;
+    int ret;
+
+    if (chacha_aead_init(&st, ctx, nonce) != 0) return 1;
+    ret = chacha_aead_aad(&st, aad, aad_len) != 0 ||
+          chacha_aead_decrypt_update(&st, buffer, buffer, buffer_len) != 0 ||
+          chacha_aead_verify(&st, tag) != 0;
+
+    if (ret) secure_zero(buffer, buffer_len);
+    secure_zero(&st, sizeof(st));
+    return ret;
+}
@@ -0,0 +1,170 @@
+/*********************************************************************
+ * Filename:   chacha_core.c
+ * Description: ChaCha20 block function (RFC 8439), the portable
+ *              kernel, runtime selection of the SIMD kernels and the
+ *              raw keystream context.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "chacha_internal.h"
+#include "cpu_features.h"
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTER_ROUND(a, b, c, d) do {                  \
+        a += b; d ^= a; d = ROTL32(d, 16);              \
+        c += d; b ^= c; b = ROTL32(b, 12);              \
+        a += b; d ^= a; d = ROTL32(d, 8);               \
+        c += d; b ^= c; b = ROTL32(b, 7);               \
+    } while (0)
+
+void chacha_portable_xor_blocks(uint32_t* st, const uint8_t* in, uint8_t* out, size_t nblocks)
+{
+    uint32_t x[16];
+
+    while (nblocks-- > 0) {
+        memcpy(x, st, sizeof(x));
+        for (int i = 0; i < 10; i++) {
+            QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+            QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+            QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+            QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+            QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+            QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+            QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+            QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; i++)
+            chacha_store32(out + 4 * i, chacha_load32(in + 4 * i) ^ (x[i] + st[i]));
+        st[12]++;
+        in += CHACHA_BLOCK_SIZE;
+        out += CHACHA_BLOCK_SIZE;
+    }
+    secure_zero(x, sizeof(x));
+}
+
+const chacha_engine chacha_engine_portable = {
+    "portable",
+    chacha_portable_xor_blocks,
+};
+
+void chacha_state_init(uint32_t* st, const chacha_ctx* ctx, const uint8_t* nonce, uint32_t counter)
+{
+    /* "expand 32-byte k" */
+    st[0] = 0x61707865;
+    st[1] = 0x3320646e;
+    st[2] = 0x79622d32;
+    st[3] = 0x6b206574;
+    memcpy(st + 4, ctx->key, sizeof(ctx->key));
+    st[12] = counter;
+    st[13] = chacha_load32(nonce);
+    st[14] = chacha_load32(nonce + 4);
+    st[15] = chacha_load32(nonce + 8);
+}
+
+void chacha_xor(uint32_t* st, const uint8_t* in, uint8_t* out, size_t len, uint8_t* ks)
+{
+    size_t nblocks = len / CHACHA_BLOCK_SIZE;
+
+    if (nblocks > 0) {
+        chacha_engine_get()->xor_blocks(st, in, out, nblocks);
+        in += nblocks * CHACHA_BLOCK_SIZE;
+        out += nblocks * CHACHA_BLOCK_SIZE;
+        len -= nblocks * CHACHA_BLOCK_SIZE;
+    }
+    if (len > 0) {
+        memset(ks, 0, CHACHA_BLOCK_SIZE);
+        chacha_engine_get()->xor_blocks(st, ks, ks, 1);
+        for (size_t i = 0; i < len; i++)
+            out[i] = in[i] ^ ks[i];
+    }
+}
+
+/* Fastest first; each is usable only if the CPU has what it needs */
+static const chacha_engine* const engines[] = {
+    &chacha_engine_avx2,
+    &chacha_engine_sse2,
+    &chacha_engine_portable,
+};
+
+static int engine_usable(const chacha_engine* e)
+{
+    const cpu_features* f = cpu_get_features();
+
+    if (e == &chacha_engine_avx2) return f->avx2;
+    if (e == &chacha_engine_sse2) return f->sse2;
+    return 1;
+}
+
+static const chacha_engine* selected_engine = NULL;
+
+const chacha_engine* chacha_engine_get(void)
+{
+    const chacha_engine* e = __atomic_load_n(&selected_engine, __ATOMIC_ACQUIRE);
+
+    if (e == NULL) {
+        for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+            e = engines[i];
+            if (engine_usable(e)) break;
+        }
+        __atomic_store_n(&selected_engine, e, __ATOMIC_RELEASE);
+    }
+    return e;
+}
+
+const char* chacha_engine_name(void)
+{
+    return chacha_engine_get()->name;
+}
+
+int chacha_engine_select(const char* name)
+{
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (strcmp(name, engines[i]->name) == 0 && engine_usable(engines[i])) {
+            __atomic_store_n(&selected_engine, engines[i], __ATOMIC_RELEASE);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+chacha_ctx* chacha_ctx_create(const char* key, int key_len)
+{
+    chacha_ctx* ctx;
+
+    if (key_len != CHACHA_KEY_SIZE) return NULL;
+    ctx = malloc(sizeof(*ctx));
+    if (ctx == NULL) return NULL;
+
+    for (int i = 0; i < 8; i++)
+        ctx->key[i] = chacha_load32((const uint8_t*)key + 4 * i);
+    return ctx;
+}
+
+int chacha_ctx_xor(chacha_ctx* ctx, void* buffer, size_t buffer_len, const char* nonce,
+                   unsigned int counter)
+{
+    uint32_t st[16];
+    uint8_t ks[CHACHA_BLOCK_SIZE];
+
+    if (ctx == NULL) return 1;
+    /* The 32-bit block counter must not wrap back to reused keystream */
+    if ((unsigned long long)buffer_len > ((1ull << 32) - counter) * CHACHA_BLOCK_SIZE) return 1;
+
+    chacha_state_init(st, ctx, (const uint8_t*)nonce, counter);
+    chacha_xor(st, buffer, buffer, buffer_len, ks);
+    secure_zero(st, sizeof(st));
+    secure_zero(ks, sizeof(ks));
+    return 0;
+}
+
+void chacha_ctx_destroy(chacha_ctx* ctx)
+{
+    if (ctx == NULL) return;
+    secure_zero(ctx, sizeof(*ctx));
+    free(ctx);
+}
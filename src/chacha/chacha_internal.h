@@ -0,0 +1,57 @@
+#ifndef CHACHA_INTERNAL_H
+#define CHACHA_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chacha.h"
+#include "secure_zero.h"
+
+#define CHACHA_BLOCK_SIZE 64
+
+/* Public handle around the key words (chacha.h) */
+struct chacha_ctx {
+    uint32_t key[8];
+};
+
+/*
+ * A ChaCha20 kernel. xor_blocks XORs the keystream of nblocks whole
+ * blocks, starting from the input state st (constants, key, counter in
+ * word 12, nonce), into in and advances the 32-bit counter. in may
+ * equal out.
+ */
+typedef struct {
+    const char* name;
+    void (*xor_blocks)(uint32_t* st, const uint8_t* in, uint8_t* out, size_t nblocks);
+} chacha_engine;
+
+extern const chacha_engine chacha_engine_portable;
+extern const chacha_engine chacha_engine_sse2;
+extern const chacha_engine chacha_engine_avx2;
+
+static inline uint32_t chacha_load32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void chacha_store32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/* Portable block function, also used for the tail of the SIMD kernels */
+void chacha_portable_xor_blocks(uint32_t* st, const uint8_t* in, uint8_t* out, size_t nblocks);
+
+/* Initial state for a key, 96-bit nonce and block counter */
+void chacha_state_init(uint32_t* st, const chacha_ctx* ctx, const uint8_t* nonce, uint32_t counter);
+
+/* XORs len bytes of keystream, any length, starting from a block
+ * boundary at st; a partial last block's keystream is left in ks */
+void chacha_xor(uint32_t* st, const uint8_t* in, uint8_t* out, size_t len, uint8_t* ks);
+
+/* Kernel picked for this CPU, or the one forced by chacha_engine_select */
+const chacha_engine* chacha_engine_get(void);
+
+#endif
@@ -0,0 +1,158 @@
+/*********************************************************************
+ * Filename:   poly1305.c
+ * Description: Poly1305 one-time authenticator (RFC 8439 section 2.5)
+ *              with the accumulator in three 44/44/42-bit limbs, so a
+ *              block costs nine 64x64->128-bit multiplies.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <string.h>
+#include "chacha_internal.h"
+
+#define MASK44 0xfffffffffffull
+#define MASK42 0x3ffffffffffull
+
+typedef unsigned __int128 u128;
+
+static uint64_t load64(const uint8_t* p)
+{
+    return (uint64_t)chacha_load32(p) | ((uint64_t)chacha_load32(p + 4) << 32);
+}
+
+static void store64(uint8_t* p, uint64_t v)
+{
+    chacha_store32(p, (uint32_t)v);
+    chacha_store32(p + 4, (uint32_t)(v >> 32));
+}
+
+void chacha_poly1305_init(chacha_poly1305* st, const unsigned char key[32])
+{
+    uint64_t t0 = load64(key), t1 = load64(key + 8);
+
+    /* r is clamped as the RFC requires */
+    st->r[0] = t0 & 0xffc0fffffffull;
+    st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffull;
+    st->r[2] = (t1 >> 24) & 0x00ffffffc0full;
+    st->h[0] = st->h[1] = st->h[2] = 0;
+    st->pad[0] = load64(key + 16);
+    st->pad[1] = load64(key + 24);
+    st->buf_len = 0;
+}
+
+/* hibit is 2^128 in limb 2 for whole blocks, 0 for the padded last one */
+static void poly_blocks(chacha_poly1305* st, const uint8_t* m, size_t nblocks, uint64_t hibit)
+{
+    uint64_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2];
+    uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2];
+
+    while (nblocks-- > 0) {
+        uint64_t t0 = load64(m), t1 = load64(m + 8), c;
+        u128 d0, d1, d2;
+
+        h0 += t0 & MASK44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+        h2 += ((t1 >> 24) & MASK42) | hibit;
+
+        /* h *= r mod 2^130 - 5; limbs past 2^130 fold back times 5 */
+        d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+        d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+        d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+
+        c = (uint64_t)(d0 >> 44);
+        h0 = (uint64_t)d0 & MASK44;
+        d1 += c;
+        c = (uint64_t)(d1 >> 44);
+        h1 = (uint64_t)d1 & MASK44;
+        d2 += c;
+        c = (uint64_t)(d2 >> 42);
+        h2 = (uint64_t)d2 & MASK42;
+        h0 += c * 5;
+        c = h0 >> 44;
+        h0 &= MASK44;
+        h1 += c;
+
+        m += 16;
+    }
+
+    st->h[0] = h0;
+    st->h[1] = h1;
+    st->h[2] = h2;
+}
+
+void chacha_poly1305_update(chacha_poly1305* st, const void* data, size_t len)
+{
+    const uint8_t* m = data;
+    size_t nblocks;
+
+    if (len == 0) return;
+    if (st->buf_len > 0) {
+        size_t n = 16 - st->buf_len < len ? 16 - st->buf_len : len;
+
+        memcpy(st->buf + st->buf_len, m, n);
+        st->buf_len += n;
+        m += n;
+        len -= n;
+        if (st->buf_len < 16) return;
+        poly_blocks(st, st->buf, 1, 1ull << 40);
+        st->buf_len = 0;
+    }
+
+    nblocks = len / 16;
+    poly_blocks(st, m, nblocks, 1ull << 40);
+    m += nblocks * 16;
+    len -= nblocks * 16;
+
+    memcpy(st->buf, m, len);
+    st->buf_len = len;
+}
+
+void chacha_poly1305_final(chacha_poly1305* st, unsigned char tag[CHACHA_TAG_SIZE])
+{
+    uint64_t h0, h1, h2, g0, g1, g2, c, t0, t1;
+
+    if (st->buf_len > 0) {
+        st->buf[st->buf_len] = 1;
+        memset(st->buf + st->buf_len + 1, 0, 16 - st->buf_len - 1);
+        poly_blocks(st, st->buf, 1, 0);
+    }
+
+    /* Fully carry h */
+    h0 = st->h[0];
+    h1 = st->h[1];
+    h2 = st->h[2];
+    c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c; c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c;
+
+    /* g = h - p; keep it instead of h unless it went negative */
+    g0 = h0 + 5; c = g0 >> 44; g0 &= MASK44;
+    g1 = h1 + c; c = g1 >> 44; g1 &= MASK44;
+    g2 = h2 + c - (1ull << 42);
+    c = (g2 >> 63) - 1;
+    g0 &= c;
+    g1 &= c;
+    g2 &= c;
+    c = ~c;
+    h0 = (h0 & c) | g0;
+    h1 = (h1 & c) | g1;
+    h2 = (h2 & c) | g2;
+
+    /* tag = (h + pad) mod 2^128 */
+    t0 = st->pad[0];
+    t1 = st->pad[1];
+    h0 += t0 & MASK44; c = h0 >> 44; h0 &= MASK44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = h1 >> 44; h1 &= MASK44;
+    h2 += ((t1 >> 24) & MASK42) + c; h2 &= MASK42;
+
+    store64(tag, h0 | (h1 << 44));
+    store64(tag + 8, (h1 >> 20) | (h2 << 24));
+
+    secure_zero(st, sizeof(*st));
+}
@@ -0,0 +1,60 @@
+#include <pthread.h>
+#include <string.h>
+#include "cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+
+static unsigned long long read_xcr0(void){
+    unsigned int eax, edx;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+}
+
+static void detect(cpu_features* f){
+    unsigned int eax, ebx, ecx, edx, max_leaf;
+    unsigned long long xcr0 = 0;
+    int ymm_ok, zmm_ok;
+
+    max_leaf = __get_cpuid_max(0, NULL);
+    if (max_leaf < 1) return;
+
+    __cpuid(1, eax, ebx, ecx, edx);
+    f->sse2   = (edx >> 26) & 1;
+    f->ssse3  = (ecx >> 9) & 1;
+    f->sse41  = (ecx >> 19) & 1;
+    f->pclmul = (ecx >> 1) & 1;
+    f->aesni  = (ecx >> 25) & 1;
+
+    /* AVX state must be enabled by the OS, not just present */
+    if ((ecx >> 27) & 1) xcr0 = read_xcr0();
+    ymm_ok = (xcr0 & 0x06) == 0x06;
+    zmm_ok = (xcr0 & 0xe6) == 0xe6;
+    f->avx = ((ecx >> 28) & 1) && ymm_ok;
+
+    if (max_leaf >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        f->avx2    = ((ebx >> 5) & 1) && ymm_ok;
+        f->avx512f = ((ebx >> 16) & 1) && zmm_ok;
+        f->sha     = (ebx >> 29) & 1;
+    }
+}
+#else
+static void detect(cpu_features* f){
+    (void)f;
+}
+#endif
+
+static cpu_features features;
+static pthread_once_t features_once = PTHREAD_ONCE_INIT;
+
+static void detect_once(void){
+    memset(&features, 0, sizeof(features));
+    detect(&features);
+}
+
+/* pthread_once orders the detection before any caller reads the result */
+const cpu_features* cpu_get_features(void){
+    pthread_once(&features_once, detect_once);
+    return &features;
+}
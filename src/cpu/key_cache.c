@@ -0,0 +1,281 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+#include "key_cache.h"
+#include "secure_zero.h"
+
+/*
+ * An entry is in the hash table and on the LRU list while cached.
+ * Evicting an entry that is still acquired only unlinks it; the last
+ * release frees it. The schedule follows the entry header.
+ */
+typedef struct kc_entry {
+    struct kc_entry* chain;
+    struct kc_entry* newer;
+    struct kc_entry* older;
+    uint64_t fp;
+    int refs;
+    int cached;
+    int key_len;
+    unsigned char key[KEY_CACHE_MAX_KEY];
+    _Alignas(16) unsigned char sched[];
+} kc_entry;
+
+struct key_cache {
+    pthread_mutex_t lock;
+    int (*expand)(void* sched, const unsigned char* key, int key_len);
+    size_t sched_size;
+    size_t capacity;
+    size_t count;
+    kc_entry** table;
+    size_t mask;
+    kc_entry* newest;
+    kc_entry* oldest;
+    uint64_t secret[2];
+    unsigned long long hits, misses, evictions;
+};
+
+/* SipHash-2-4 */
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND do { \
+        v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+        v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+    } while (0)
+
+static uint64_t load64(const unsigned char* p){
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t siphash(const uint64_t k[2], const unsigned char* in, size_t len){
+    uint64_t v0 = k[0] ^ 0x736f6d6570736575ULL, v1 = k[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k[0] ^ 0x6c7967656e657261ULL, v3 = k[1] ^ 0x7465646279746573ULL;
+    uint64_t b = (uint64_t)len << 56;
+    size_t end = len & ~(size_t)7;
+
+    for (size_t i = 0; i < end; i += 8) {
+        uint64_t m = load64(in + i);
+        v3 ^= m; SIPROUND; SIPROUND; v0 ^= m;
+    }
+    for (size_t i = end; i < len; i++)
+        b |= (uint64_t)in[i] << (8 * (i - end));
+    v3 ^= b; SIPROUND; SIPROUND; v0 ^= b;
+    v2 ^= 0xff;
+    SIPROUND; SIPROUND; SIPROUND; SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static void make_secret(uint64_t secret[2]){
+    if (getrandom(secret, 2 * sizeof(uint64_t), 0) == (ssize_t)(2 * sizeof(uint64_t))) return;
+
+    /* No entropy source: still differs per process and per cache */
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    secret[0] = (uint64_t)ts.tv_nsec * 0x9e3779b97f4a7c15ULL ^ (uint64_t)ts.tv_sec;
+    secret[1] = (uint64_t)(uintptr_t)secret * 0xc2b2ae3d27d4eb4fULL ^ (uint64_t)clock();
+}
+
+static int key_equal(const kc_entry* e, const unsigned char* key, int key_len){
+    unsigned char diff = 0;
+    if (e->key_len != key_len) return 0;
+    for (int i = 0; i < key_len; i++) diff |= e->key[i] ^ key[i];
+    return diff == 0;
+}
+
+static size_t table_size(size_t capacity){
+    size_t n = 16;
+    while (n < 2 * capacity) n <<= 1;
+    return n;
+}
+
+/* Everything below is called with c->lock held */
+
+static kc_entry* lookup(key_cache* c, uint64_t fp, const unsigned char* key, int key_len){
+    for (kc_entry* e = c->table[fp & c->mask]; e != NULL; e = e->chain)
+        if (e->fp == fp && key_equal(e, key, key_len)) return e;
+    return NULL;
+}
+
+static void lru_unlink(key_cache* c, kc_entry* e){
+    if (e->newer) e->newer->older = e->older; else c->newest = e->older;
+    if (e->older) e->older->newer = e->newer; else c->oldest = e->newer;
+}
+
+static void lru_push(key_cache* c, kc_entry* e){
+    e->newer = NULL;
+    e->older = c->newest;
+    if (c->newest) c->newest->newer = e; else c->oldest = e;
+    c->newest = e;
+}
+
+static void free_entry(key_cache* c, kc_entry* e){
+    secure_zero(e, sizeof(*e) + c->sched_size);
+    free(e);
+}
+
+/* Returns the entry if it can be freed now, NULL if still acquired */
+static kc_entry* evict(key_cache* c, kc_entry* e){
+    kc_entry** p = &c->table[e->fp & c->mask];
+
+    while (*p != e) p = &(*p)->chain;
+    *p = e->chain;
+    lru_unlink(c, e);
+    e->cached = 0;
+    c->count--;
+    return e->refs == 0 ? e : NULL;
+}
+
+static void evict_to(key_cache* c, size_t keep){
+    while (c->count > keep) {
+        kc_entry* e = evict(c, c->oldest);
+        c->evictions++;
+        if (e) free_entry(c, e);
+    }
+}
+
+static void rehash(key_cache* c, kc_entry** table, size_t n){
+    for (kc_entry* e = c->oldest; e != NULL; e = e->newer) {
+        e->chain = table[e->fp & (n - 1)];
+        table[e->fp & (n - 1)] = e;
+    }
+    free(c->table);
+    c->table = table;
+    c->mask = n - 1;
+}
+
+key_cache* key_cache_create(size_t capacity, size_t sched_size,
+                            int (*expand)(void* sched, const unsigned char* key, int key_len)){
+    key_cache* c = calloc(1, sizeof(*c));
+    size_t n = table_size(capacity);
+
+    if (c == NULL) return NULL;
+    c->table = calloc(n, sizeof(kc_entry*));
+    if (c->table == NULL) {
+        free(c);
+        return NULL;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    c->expand = expand;
+    c->sched_size = sched_size;
+    c->capacity = capacity;
+    c->mask = n - 1;
+    make_secret(c->secret);
+    return c;
+}
+
+const void* key_cache_acquire(key_cache* c, const void* key, int key_len){
+    uint64_t fp;
+    kc_entry* e;
+    kc_entry* hit;
+
+    if (key_len <= 0 || key_len > KEY_CACHE_MAX_KEY) return NULL;
+    fp = siphash(c->secret, key, (size_t)key_len);
+
+    pthread_mutex_lock(&c->lock);
+    e = lookup(c, fp, key, key_len);
+    if (e != NULL) {
+        e->refs++;
+        lru_unlink(c, e);
+        lru_push(c, e);
+        c->hits++;
+        pthread_mutex_unlock(&c->lock);
+        return e->sched;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    /* Expand outside the lock so other keys are not held up */
+    e = malloc(sizeof(*e) + c->sched_size);
+    if (e == NULL) return NULL;
+    if (c->expand(e->sched, key, key_len) != 0) {
+        free_entry(c, e);
+        return NULL;
+    }
+    e->fp = fp;
+    e->refs = 1;
+    e->cached = 0;
+    e->key_len = key_len;
+    memcpy(e->key, key, (size_t)key_len);
+
+    pthread_mutex_lock(&c->lock);
+    c->misses++;
+    /* Another thread may have inserted the same key meanwhile */
+    hit = lookup(c, fp, key, key_len);
+    if (hit != NULL) {
+        hit->refs++;
+        lru_unlink(c, hit);
+        lru_push(c, hit);
+        pthread_mutex_unlock(&c->lock);
+        free_entry(c, e);
+        return hit->sched;
+    }
+    if (c->capacity > 0) {
+        evict_to(c, c->capacity - 1);
+        e->chain = c->table[fp & c->mask];
+        c->table[fp & c->mask] = e;
+        lru_push(c, e);
+        e->cached = 1;
+        c->count++;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return e->sched;
+}
+
+void key_cache_release(key_cache* c, const void* sched){
+    kc_entry* e;
+    int last;
+
+    if (sched == NULL) return;
+    e = (kc_entry*)((const unsigned char*)sched - offsetof(kc_entry, sched));
+
+    pthread_mutex_lock(&c->lock);
+    last = --e->refs == 0 && !e->cached;
+    pthread_mutex_unlock(&c->lock);
+    if (last) free_entry(c, e);
+}
+
+void key_cache_resize(key_cache* c, size_t capacity){
+    size_t n = table_size(capacity);
+    kc_entry** table = calloc(n, sizeof(kc_entry*));
+
+    pthread_mutex_lock(&c->lock);
+    evict_to(c, capacity);
+    c->capacity = capacity;
+    /* Tables only grow; without memory for one chains just get longer */
+    if (table != NULL && n > c->mask + 1) {
+        rehash(c, table, n);
+        table = NULL;
+    }
+    pthread_mutex_unlock(&c->lock);
+    free(table);
+}
+
+void key_cache_flush(key_cache* c){
+    pthread_mutex_lock(&c->lock);
+    evict_to(c, 0);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void key_cache_get_stats(key_cache* c, key_cache_stats* st){
+    pthread_mutex_lock(&c->lock);
+    st->hits = c->hits;
+    st->misses = c->misses;
+    st->evictions = c->evictions;
+    st->entries = c->count;
+    st->capacity = c->capacity;
+    pthread_mutex_unlock(&c->lock);
+}
+
+void key_cache_destroy(key_cache* c){
+    if (c == NULL) return;
+    key_cache_flush(c);
+    pthread_mutex_destroy(&c->lock);
+    secure_zero(c->secret, sizeof(c->secret));
+    free(c->table);
+    free(c);
+}
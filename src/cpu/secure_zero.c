@@ -0,0 +1,8 @@
+#include <string.h>
+#include "secure_zero.h"
+
+void secure_zero(void* p, size_t len){
+    memset(p, 0, len);
+    /* The barrier makes the stores observable, so they are kept */
+    __asm__ __volatile__ ("" : : "r"(p) : "memory");
+}
@@ -0,0 +1,122 @@
+#include <pthread.h>
+#include <unistd.h>
+#include "thread_pool.h"
+
+#define POOL_MAX_THREADS 256
+
+/*
+ * One job runs at a time. Starting a job bumps gen and wakes every
+ * worker; workers beyond the job's thread count acknowledge it without
+ * taking items. busy counts workers that have not acknowledged yet.
+ */
+typedef struct {
+    void (*fn)(void* arg, size_t i);
+    void* arg;
+    size_t n;
+    size_t next;
+    int active;
+} pool_job;
+
+static struct {
+    pthread_mutex_t run;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    unsigned long gen;
+    unsigned long spawn_gen;
+    pool_job* job;
+    int workers;
+    int busy;
+} pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    0, 0, NULL, 0, 0
+};
+
+static void take_items(pool_job* job){
+    size_t i;
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->n)
+        job->fn(job->arg, i);
+}
+
+static void* worker(void* p){
+    int id = (int)(size_t)p;
+    unsigned long seen;
+
+    /* The job that spawned this worker may already have been posted */
+    pthread_mutex_lock(&pool.lock);
+    seen = pool.spawn_gen;
+    for (;;) {
+        pool_job* job;
+
+        while (pool.gen == seen)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        seen = pool.gen;
+        job = pool.job;
+        pthread_mutex_unlock(&pool.lock);
+
+        /* Worker ids start at 1; the caller is thread 0 */
+        if (id < job->active) take_items(job);
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.busy == 0) pthread_cond_signal(&pool.idle);
+    }
+    return NULL;
+}
+
+/* Called with pool.lock held */
+static void grow(int want){
+    pthread_attr_t attr;
+
+    /* Every new worker still owes an acknowledgement for the next job, so
+     * no worker from an earlier grow can be unstarted at this point */
+    pool.spawn_gen = pool.gen;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (pool.workers < want) {
+        pthread_t tid;
+        if (pthread_create(&tid, &attr, worker, (void*)(size_t)(pool.workers + 1)) != 0) break;
+        pool.workers++;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+void thread_pool_run(int threads, size_t n, void (*fn)(void* arg, size_t i), void* arg){
+    pool_job job = { fn, arg, n, 0, threads };
+
+    if (threads > POOL_MAX_THREADS) threads = job.active = POOL_MAX_THREADS;
+    if (threads <= 1 || n <= 1) {
+        for (size_t i = 0; i < n; i++) fn(arg, i);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.run);
+    pthread_mutex_lock(&pool.lock);
+    grow(threads - 1);
+    if (pool.workers == 0) {
+        /* No threads could be started: run everything here */
+        pthread_mutex_unlock(&pool.lock);
+        take_items(&job);
+        pthread_mutex_unlock(&pool.run);
+        return;
+    }
+    pool.job = &job;
+    pool.busy = pool.workers;
+    pool.gen++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    take_items(&job);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.busy > 0)
+        pthread_cond_wait(&pool.idle, &pool.lock);
+    pool.job = NULL;
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.run);
+}
+
+int thread_pool_cpus(void){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
@@ -0,0 +1,316 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define URING_KERNEL 1
+#endif
+
+/* Marks cancel requests, whose completions uring_wait swallows */
+#define CANCEL_TAG (~0ull)
+
+/*
+ * Completions of the synchronous fallback wait in a ring of `entries`
+ * slots until uring_wait collects them. outstanding counts requests
+ * queued or in flight, so neither ring can overflow.
+ */
+typedef struct {
+    unsigned long long tag;
+    long res;
+} sync_cqe;
+
+struct uring {
+    unsigned entries;
+    unsigned outstanding;
+    int fd;
+#ifdef URING_KERNEL
+    unsigned pending;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_map;
+    size_t sq_map_len;
+    void* cq_map;
+    size_t cq_map_len;
+#endif
+    sync_cqe* done;
+    unsigned done_head, done_count;
+};
+
+#ifdef URING_KERNEL
+
+static int sys_setup(unsigned entries, struct io_uring_params* p){
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned wait, unsigned flags){
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned op, void* arg, unsigned nargs){
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nargs);
+}
+
+/*
+ * Kernels 5.1 to 5.5 set up a ring but reject IORING_OP_READ/WRITE, and
+ * the opcode probe arrived with them in 5.6: returns 1 unless the probe
+ * works and lists both.
+ */
+static int kernel_probe(int fd){
+    const unsigned nops = 256;
+    struct io_uring_probe* p = calloc(1, sizeof(*p) + nops * sizeof(struct io_uring_probe_op));
+    int ok;
+
+    if (p == NULL) return 1;
+    ok = sys_register(fd, IORING_REGISTER_PROBE, p, nops) == 0 &&
+         p->last_op >= IORING_OP_WRITE &&
+         (p->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+         (p->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) &&
+         (p->ops[IORING_OP_ASYNC_CANCEL].flags & IO_URING_OP_SUPPORTED);
+    free(p);
+    return !ok;
+}
+
+static void kernel_unmap(uring* u){
+    if (u->sqes != NULL && u->sqes != MAP_FAILED)
+        munmap(u->sqes, u->entries * sizeof(struct io_uring_sqe));
+    if (u->cq_map != NULL && u->cq_map != MAP_FAILED && u->cq_map != u->sq_map)
+        munmap(u->cq_map, u->cq_map_len);
+    if (u->sq_map != NULL && u->sq_map != MAP_FAILED)
+        munmap(u->sq_map, u->sq_map_len);
+}
+
+/* Returns 0 with the rings mapped, 1 if io_uring cannot be used */
+static int kernel_setup(uring* u, unsigned entries){
+    struct io_uring_params p;
+    unsigned char* sq;
+    unsigned char* cq;
+
+    memset(&p, 0, sizeof(p));
+    u->fd = sys_setup(entries, &p);
+    if (u->fd < 0) return 1;
+    if (kernel_probe(u->fd) != 0) {
+        close(u->fd);
+        u->fd = -1;
+        return 1;
+    }
+
+    u->entries = p.sq_entries;
+    u->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_map_len > u->sq_map_len) u->sq_map_len = u->cq_map_len;
+        u->cq_map_len = u->sq_map_len;
+    }
+
+    u->sq_map = mmap(NULL, u->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED) goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        u->cq_map = u->sq_map;
+    else
+        u->cq_map = mmap(NULL, u->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         u->fd, IORING_OFF_CQ_RING);
+    if (u->cq_map == MAP_FAILED) goto fail;
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) goto fail;
+
+    sq = u->sq_map;
+    cq = u->cq_map;
+    u->sq_head = (unsigned*)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*)(sq + p.sq_off.array);
+    u->cq_head = (unsigned*)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 0;
+
+fail:
+    kernel_unmap(u);
+    close(u->fd);
+    u->fd = -1;
+    u->sq_map = u->cq_map = NULL;
+    u->sqes = NULL;
+    return 1;
+}
+
+static void kernel_queue(uring* u, int op, int fd, const void* buf, size_t len, off_t off,
+                         unsigned long long tag){
+    unsigned tail = *u->sq_tail;
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe* sqe = &u->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)op;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(size_t)buf;
+    sqe->len = (unsigned)len;
+    sqe->off = (unsigned long long)off;
+    sqe->user_data = tag;
+    u->sq_array[idx] = idx;
+    /* The kernel may read the entry as soon as it sees the new tail */
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->pending++;
+}
+
+static int kernel_enter(uring* u, unsigned wait){
+    for (;;) {
+        int r = sys_enter(u->fd, u->pending, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+
+        if (r >= 0) {
+            u->pending -= (unsigned)r;
+            return 0;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return 1;
+    }
+}
+
+static int kernel_wait(uring* u, unsigned long long* tag, long* res){
+    for (;;) {
+        unsigned head = *u->cq_head;
+
+        if (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe = &u->cqes[head & *u->cq_mask];
+
+            *tag = cqe->user_data;
+            *res = cqe->res;
+            __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+            if (*tag == CANCEL_TAG) continue;
+            return 0;
+        }
+        if (kernel_enter(u, 1) != 0) return 1;
+    }
+}
+
+#endif
+
+static void sync_complete(uring* u, unsigned long long tag, long res){
+    sync_cqe* c = &u->done[(u->done_head + u->done_count) % u->entries];
+
+    c->tag = tag;
+    c->res = res;
+    u->done_count++;
+}
+
+uring* uring_create(unsigned entries){
+    uring* u = calloc(1, sizeof(*u));
+
+    if (u == NULL || entries == 0) {
+        free(u);
+        return NULL;
+    }
+    u->fd = -1;
+    u->entries = entries;
+#ifdef URING_KERNEL
+    if (kernel_setup(u, entries) == 0) return u;
+#endif
+    u->entries = entries;
+    u->done = malloc(entries * sizeof(sync_cqe));
+    if (u->done == NULL) {
+        free(u);
+        return NULL;
+    }
+    return u;
+}
+
+void uring_destroy(uring* u){
+    if (u == NULL) return;
+#ifdef URING_KERNEL
+    if (u->fd >= 0) {
+        kernel_unmap(u);
+        close(u->fd);
+    }
+#endif
+    free(u->done);
+    free(u);
+}
+
+int uring_async(const uring* u){
+    return u->fd >= 0;
+}
+
+int uring_read(uring* u, int fd, void* buf, size_t len, off_t off, unsigned long long tag){
+    ssize_t r;
+
+    if (u->outstanding == u->entries) return 1;
+    u->outstanding++;
+#ifdef URING_KERNEL
+    if (u->fd >= 0) {
+        kernel_queue(u, IORING_OP_READ, fd, buf, len, off, tag);
+        return 0;
+    }
+#endif
+    do r = pread(fd, buf, len, off); while (r < 0 && errno == EINTR);
+    sync_complete(u, tag, r < 0 ? -errno : (long)r);
+    return 0;
+}
+
+int uring_write(uring* u, int fd, const void* buf, size_t len, off_t off, unsigned long long tag){
+    ssize_t r;
+
+    if (u->outstanding == u->entries) return 1;
+    u->outstanding++;
+#ifdef URING_KERNEL
+    if (u->fd >= 0) {
+        kernel_queue(u, IORING_OP_WRITE, fd, buf, len, off, tag);
+        return 0;
+    }
+#endif
+    do r = pwrite(fd, buf, len, off); while (r < 0 && errno == EINTR);
+    sync_complete(u, tag, r < 0 ? -errno : (long)r);
+    return 0;
+}
+
+int uring_cancel(uring* u, unsigned long long tag){
+#ifdef URING_KERNEL
+    if (u->fd >= 0) {
+        /* Cancels are not counted as outstanding, so make room for one */
+        if (u->pending > 0 && kernel_enter(u, 0) != 0) return 1;
+        kernel_queue(u, IORING_OP_ASYNC_CANCEL, -1, (const void*)(size_t)tag, 0, 0, CANCEL_TAG);
+        return kernel_enter(u, 0);
+    }
+#endif
+    /* Synchronous requests have completed already */
+    (void)u;
+    (void)tag;
+    return 0;
+}
+
+int uring_submit(uring* u){
+#ifdef URING_KERNEL
+    if (u->fd >= 0 && u->pending > 0) return kernel_enter(u, 0);
+#endif
+    (void)u;
+    return 0;
+}
+
+int uring_wait(uring* u, unsigned long long* tag, long* res){
+    if (u->outstanding == 0) return 1;
+#ifdef URING_KERNEL
+    if (u->fd >= 0) {
+        if (kernel_wait(u, tag, res) != 0) return 1;
+        u->outstanding--;
+        return 0;
+    }
+#endif
+    *tag = u->done[u->done_head].tag;
+    *res = u->done[u->done_head].res;
+    u->done_head = (u->done_head + 1) % u->entries;
+    u->done_count--;
+    u->outstanding--;
+    return 0;
+}
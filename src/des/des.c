@@ -104,13 +104,45 @@ static void IP(WORD state[], const BYTE in[])
 /* Inverse initial permutation */
 static void InvIP(WORD state[], BYTE out[])
 {
-    for (int i = 0; i < 8; i++)
-        out[i] = 0;
-
     out[0] = BITNUMINTR(state[1],7,7)|BITNUMINTR(state[0],7,6)|
              BITNUMINTR(state[1],15,5)|BITNUMINTR(state[0],15,4)|
              BITNUMINTR(state[1],23,3)|BITNUMINTR(state[0],23,2)|
              BITNUMINTR(state[1],31,1)|BITNUMINTR(state[0],31,0);
+
+    out[1] = BITNUMINTR(state[1],6,7)|BITNUMINTR(state[0],6,6)|
+             BITNUMINTR(state[1],14,5)|BITNUMINTR(state[0],14,4)|
+             BITNUMINTR(state[1],22,3)|BITNUMINTR(state[0],22,2)|
+             BITNUMINTR(state[1],30,1)|BITNUMINTR(state[0],30,0);
+
+    out[2] = BITNUMINTR(state[1],5,7)|BITNUMINTR(state[0],5,6)|
+             BITNUMINTR(state[1],13,5)|BITNUMINTR(state[0],13,4)|
+             BITNUMINTR(state[1],21,3)|BITNUMINTR(state[0],21,2)|
+             BITNUMINTR(state[1],29,1)|BITNUMINTR(state[0],29,0);
+
+    out[3] = BITNUMINTR(state[1],4,7)|BITNUMINTR(state[0],4,6)|
+             BITNUMINTR(state[1],12,5)|BITNUMINTR(state[0],12,4)|
+             BITNUMINTR(state[1],20,3)|BITNUMINTR(state[0],20,2)|
+             BITNUMINTR(state[1],28,1)|BITNUMINTR(state[0],28,0);
+
+    out[4] = BITNUMINTR(state[1],3,7)|BITNUMINTR(state[0],3,6)|
+             BITNUMINTR(state[1],11,5)|BITNUMINTR(state[0],11,4)|
+             BITNUMINTR(state[1],19,3)|BITNUMINTR(state[0],19,2)|
+             BITNUMINTR(state[1],27,1)|BITNUMINTR(state[0],27,0);
+
+    out[5] = BITNUMINTR(state[1],2,7)|BITNUMINTR(state[0],2,6)|
+             BITNUMINTR(state[1],10,5)|BITNUMINTR(state[0],10,4)|
+             BITNUMINTR(state[1],18,3)|BITNUMINTR(state[0],18,2)|
+             BITNUMINTR(state[1],26,1)|BITNUMINTR(state[0],26,0);
+
+    out[6] = BITNUMINTR(state[1],1,7)|BITNUMINTR(state[0],1,6)|
+             BITNUMINTR(state[1],9,5)|BITNUMINTR(state[0],9,4)|
+             BITNUMINTR(state[1],17,3)|BITNUMINTR(state[0],17,2)|
+             BITNUMINTR(state[1],25,1)|BITNUMINTR(state[0],25,0);
+
+    out[7] = BITNUMINTR(state[1],0,7)|BITNUMINTR(state[0],0,6)|
+             BITNUMINTR(state[1],8,5)|BITNUMINTR(state[0],8,4)|
+             BITNUMINTR(state[1],16,3)|BITNUMINTR(state[0],16,2)|
+             BITNUMINTR(state[1],24,1)|BITNUMINTR(state[0],24,0);
 }
 
 /* DES round function */
@@ -144,6 +176,19 @@ static WORD f(WORD state, const BYTE key[])
         (sbox7[SBOXBIT(((e[4]&0xf)<<2)|(e[5]>>6))]<<4)|
          sbox8[SBOXBIT(e[5]&0x3f)];
 
+    /* P permutation */
+    state = BITNUMINTL(state,15,0)|BITNUMINTL(state,6,1)|BITNUMINTL(state,19,2)|
+            BITNUMINTL(state,20,3)|BITNUMINTL(state,28,4)|BITNUMINTL(state,11,5)|
+            BITNUMINTL(state,27,6)|BITNUMINTL(state,16,7)|BITNUMINTL(state,0,8)|
+            BITNUMINTL(state,14,9)|BITNUMINTL(state,22,10)|BITNUMINTL(state,25,11)|
+            BITNUMINTL(state,4,12)|BITNUMINTL(state,17,13)|BITNUMINTL(state,30,14)|
+            BITNUMINTL(state,9,15)|BITNUMINTL(state,1,16)|BITNUMINTL(state,7,17)|
+            BITNUMINTL(state,23,18)|BITNUMINTL(state,13,19)|BITNUMINTL(state,31,20)|
+            BITNUMINTL(state,26,21)|BITNUMINTL(state,2,22)|BITNUMINTL(state,8,23)|
+            BITNUMINTL(state,18,24)|BITNUMINTL(state,12,25)|BITNUMINTL(state,29,26)|
+            BITNUMINTL(state,5,27)|BITNUMINTL(state,21,28)|BITNUMINTL(state,10,29)|
+            BITNUMINTL(state,3,30)|BITNUMINTL(state,24,31);
+
     return state;
 }
 
@@ -152,12 +197,30 @@ void des_key_setup(const BYTE key[], BYTE schedule[][6], DES_MODE mode)
 {
     WORD i,j,C=0,D=0;
     const WORD shifts[16]={1,1,2,2,2,2,2,2,1,2,2,2,2,2,2,1};
+    /* Permuted choice 1, split into its C and D halves (parity bits dropped) */
+    const WORD pc1_c[28]={56,48,40,32,24,16,8,0,57,49,41,33,25,17,
+                          9,1,58,50,42,34,26,18,10,2,59,51,43,35};
+    const WORD pc1_d[28]={62,54,46,38,30,22,14,6,61,53,45,37,29,21,
+                          13,5,60,52,44,36,28,20,12,4,27,19,11,3};
+    /* Permuted choice 2, as bit positions in C (0-27) and D (28-55) */
+    const WORD pc2[48]={13,16,10,23,0,4,2,27,14,5,20,9,
+                        22,18,11,3,25,7,15,6,26,19,12,1,
+                        40,51,30,36,46,54,29,39,50,44,32,47,
+                        43,48,38,55,33,52,45,41,49,35,28,31};
+
+    for(i=0,j=31;i<28;i++,j--){
+        C|=BITNUM(key,pc1_c[i],j);
+        D|=BITNUM(key,pc1_d[i],j);
+    }
 
     for(i=0;i<16;i++){
         C=((C<<shifts[i])|(C>>(28-shifts[i])))&0xfffffff0;
         D=((D<<shifts[i])|(D>>(28-shifts[i])))&0xfffffff0;
+        /* Decryption uses the round keys in reverse order */
         int idx=(mode==DES_DECRYPT)?15-i:i;
         for(j=0;j<6;j++) schedule[idx][j]=0;
+        for(j=0;j<24;j++) schedule[idx][j/8]|=BITNUMINTR(C,pc2[j],7-(j%8));
+        for(;j<48;j++) schedule[idx][j/8]|=BITNUMINTR(D,pc2[j]-28,7-(j%8));
     }
 }
 
@@ -175,12 +238,15 @@ void des_crypt(const BYTE in[], BYTE out[], const BYTE key[][6])
     InvIP(state,out);
 }
 
-/* Triple DES */
+/* EDE: encryption is E(K1), D(K2), E(K3); decryption runs the keys
+ * backwards, D(K3), E(K2), D(K1) */
 void three_des_key_setup(const BYTE key[], BYTE schedule[][16][6], DES_MODE mode)
 {
-    des_key_setup(key,schedule[0],mode);
-    des_key_setup(key+8,schedule[1],!mode);
-    des_key_setup(key+16,schedule[2],mode);
+    DES_MODE inverse=(mode==DES_ENCRYPT)?DES_DECRYPT:DES_ENCRYPT;
+
+    des_key_setup(mode==DES_ENCRYPT?key:key+16,schedule[0],mode);
+    des_key_setup(key+8,schedule[1],inverse);
+    des_key_setup(mode==DES_ENCRYPT?key+16:key,schedule[2],mode);
 }
 
 void three_des_crypt(const BYTE in[], BYTE out[], const BYTE key[][16][6])
@@ -15,6 +15,7 @@
 #define DES_H
 
 #include <stddef.h>
+#include "key_cache.h"
 
 /* DES operates on 64-bit (8 byte) blocks */
 #define DES_BLOCK_SIZE 8
@@ -41,4 +42,18 @@ void three_des_key_setup(const BYTE key[], BYTE schedule[][16][6], DES_MODE mode
 /* Encrypt or decrypt a block using Triple-DES */
 void three_des_crypt(const BYTE in[], BYTE out[], const BYTE key[][16][6]);
 
+/*
+ * ECB over nblocks with the key schedule taken from a process-wide LRU
+ * cache keyed by the raw key (des_cache.c). key_len is 8 for DES or 24
+ * for Triple-DES; in may equal out. Returns 0, or 1 on a bad key length.
+ */
+int des_ecb_cached(const BYTE key[], int key_len, const BYTE in[], BYTE out[],
+                   size_t nblocks, DES_MODE mode);
+
+/* Cache capacity (0 disables caching; returns 1 if the cache could not
+ * be set up), wipe-and-evict of every entry, and hit/miss counters */
+int des_key_cache_config(size_t capacity);
+void des_key_cache_flush(void);
+void des_key_cache_stats(key_cache_stats* st);
+
 #endif /* DES_H */
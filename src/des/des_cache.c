@@ -0,0 +1,110 @@
+/*********************************************************************
+ * Filename:   des_cache.c
+ * Description: DES and Triple-DES with key schedules cached by raw
+ *              key, for callers that see the same keys repeatedly.
+ *              Both directions are expanded on a miss, so one entry
+ *              serves encryption and decryption.
+ *
+ * Disclaimer: This software is provided "as is" without any warranty.
+ *********************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+#include "des.h"
+#include "secure_zero.h"
+
+#define DES_KEY_CACHE_DEFAULT 64
+
+typedef struct {
+    BYTE enc[3][16][6];
+    BYTE dec[3][16][6];
+} des_schedules;
+
+static key_cache* cache;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+/* 8-byte keys use only the first schedule of each direction */
+static int expand_key(void* sched, const unsigned char* key, int key_len)
+{
+    des_schedules* s = sched;
+
+    if (key_len == DES_BLOCK_SIZE) {
+        des_key_setup(key,s->enc[0],DES_ENCRYPT);
+        des_key_setup(key,s->dec[0],DES_DECRYPT);
+        return 0;
+    }
+    if (key_len == 3 * DES_BLOCK_SIZE) {
+        three_des_key_setup(key,s->enc,DES_ENCRYPT);
+        three_des_key_setup(key,s->dec,DES_DECRYPT);
+        return 0;
+    }
+    return 1;
+}
+
+static void cache_init(void)
+{
+    cache=key_cache_create(DES_KEY_CACHE_DEFAULT,sizeof(des_schedules),expand_key);
+}
+
+static key_cache* des_key_cache(void)
+{
+    pthread_once(&cache_once,cache_init);
+    return cache;
+}
+
+int des_ecb_cached(const BYTE key[], int key_len, const BYTE in[], BYTE out[],
+                   size_t nblocks, DES_MODE mode)
+{
+    key_cache* c=des_key_cache();
+    des_schedules local;
+    const des_schedules* s;
+
+    if (key_len!=DES_BLOCK_SIZE && key_len!=3*DES_BLOCK_SIZE) return 1;
+    if (c!=NULL) {
+        s=key_cache_acquire(c,key,key_len);
+        if (s==NULL) return 1;
+    } else {
+        if (expand_key(&local,key,key_len)!=0) return 1;
+        s=&local;
+    }
+
+    for(size_t i=0;i<nblocks;i++){
+        const BYTE* src=in+i*DES_BLOCK_SIZE;
+        BYTE* dst=out+i*DES_BLOCK_SIZE;
+
+        if (key_len==DES_BLOCK_SIZE)
+            des_crypt(src,dst,mode==DES_ENCRYPT ? s->enc[0] : s->dec[0]);
+        else
+            three_des_crypt(src,dst,mode==DES_ENCRYPT ? s->enc : s->dec);
+    }
+
+    if (s==&local) secure_zero(&local,sizeof(local));
+    else key_cache_release(c,s);
+    return 0;
+}
+
+int des_key_cache_config(size_t capacity)
+{
+    key_cache* c=des_key_cache();
+
+    if (c==NULL) return 1;
+    key_cache_resize(c,capacity);
+    return 0;
+}
+
+void des_key_cache_flush(void)
+{
+    key_cache* c=des_key_cache();
+    if (c!=NULL) key_cache_flush(c);
+}
+
+void des_key_cache_stats(key_cache_stats* st)
+{
+    key_cache* c=des_key_cache();
+
+    if (c!=NULL) {
+        key_cache_get_stats(c,st);
+        return;
+    }
+    memset(st,0,sizeof(*st));
+}
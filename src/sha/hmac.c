@@ -0,0 +1,214 @@
+/*********************************************************************
+ * Filename:   hmac.c
+ * Description: HMAC-SHA256 and HMAC-SHA1 (RFC 2104) on keyed states.
+ *              The padded key blocks are hashed once when the key is
+ *              set up; a message costs its own blocks plus one outer
+ *              block, and batches of messages run on the multi-buffer
+ *              kernels from the keyed states.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "hmac.h"
+#include "sha_internal.h"
+
+/* Both hashes take 64-byte blocks */
+#define HMAC_BLOCK 64
+#define HMAC_IPAD  0x36
+#define HMAC_OPAD  0x5c
+
+static void xor_pad(BYTE block[HMAC_BLOCK], BYTE pad)
+{
+    for (int i = 0; i < HMAC_BLOCK; i++)
+        block[i] ^= pad;
+}
+
+/* ---------------- HMAC-SHA256 ---------------- */
+
+void hmac_sha256_key(HMAC_SHA256_KEY *key, const BYTE k[], size_t len)
+{
+    BYTE block[HMAC_BLOCK];
+    SHA256_CTX ctx;
+
+    memset(block, 0, sizeof(block));
+    if (len > HMAC_BLOCK) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, k, len);
+        sha256_final(&ctx, block);
+        secure_zero(&ctx, sizeof(ctx));
+    } else if (len > 0) {
+        memcpy(block, k, len);
+    }
+
+    xor_pad(block, HMAC_IPAD);
+    sha256_init(&key->inner);
+    sha256_update(&key->inner, block, HMAC_BLOCK);
+    xor_pad(block, HMAC_IPAD ^ HMAC_OPAD);
+    sha256_init(&key->outer);
+    sha256_update(&key->outer, block, HMAC_BLOCK);
+    secure_zero(block, sizeof(block));
+}
+
+void hmac_sha256_key_clear(HMAC_SHA256_KEY *key)
+{
+    secure_zero(key, sizeof(*key));
+}
+
+void hmac_sha256_init(HMAC_SHA256_CTX *ctx, const HMAC_SHA256_KEY *key)
+{
+    ctx->inner = key->inner;
+    ctx->outer = key->outer;
+}
+
+void hmac_sha256_update(HMAC_SHA256_CTX *ctx, const BYTE data[], size_t len)
+{
+    sha256_update(&ctx->inner, data, len);
+}
+
+void hmac_sha256_final(HMAC_SHA256_CTX *ctx, BYTE mac[SHA256_BLOCK_SIZE])
+{
+    BYTE inner[SHA256_BLOCK_SIZE];
+
+    sha256_final(&ctx->inner, inner);
+    sha256_update(&ctx->outer, inner, sizeof(inner));
+    sha256_final(&ctx->outer, mac);
+    secure_zero(ctx, sizeof(*ctx));
+}
+
+void hmac_sha256(const HMAC_SHA256_KEY *key, const BYTE data[], size_t len,
+                 BYTE mac[SHA256_BLOCK_SIZE])
+{
+    HMAC_SHA256_CTX ctx;
+
+    hmac_sha256_init(&ctx, key);
+    hmac_sha256_update(&ctx, data, len);
+    hmac_sha256_final(&ctx, mac);
+}
+
+void hmac_sha256_batch(const HMAC_SHA256_KEY *key, const BYTE *const data[], const size_t len[],
+                       BYTE mac[][SHA256_BLOCK_SIZE], size_t n)
+{
+    /* Inner jobs first, then the outer jobs over their digests */
+    SHA256_JOB *jobs = malloc(2 * n * sizeof(*jobs));
+
+    /* Without memory for the jobs, MAC one message at a time */
+    if (jobs == NULL) {
+        for (size_t i = 0; i < n; i++)
+            hmac_sha256(key, data[i], len[i], mac[i]);
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        jobs[i].data = data[i];
+        jobs[i].len = len[i];
+    }
+    sha256_hash_batch_from(jobs, n, &key->inner);
+
+    for (size_t i = 0; i < n; i++) {
+        jobs[n + i].data = jobs[i].digest;
+        jobs[n + i].len = SHA256_BLOCK_SIZE;
+    }
+    sha256_hash_batch_from(jobs + n, n, &key->outer);
+
+    for (size_t i = 0; i < n; i++)
+        memcpy(mac[i], jobs[n + i].digest, SHA256_BLOCK_SIZE);
+    /* The inner digests are as secret as the key */
+    secure_zero(jobs, 2 * n * sizeof(*jobs));
+    free(jobs);
+}
+
+/* ---------------- HMAC-SHA1 ---------------- */
+
+void hmac_sha1_key(HMAC_SHA1_KEY *key, const BYTE k[], size_t len)
+{
+    BYTE block[HMAC_BLOCK];
+    SHA1_CTX ctx;
+
+    memset(block, 0, sizeof(block));
+    if (len > HMAC_BLOCK) {
+        sha1_init(&ctx);
+        sha1_update(&ctx, k, len);
+        sha1_final(&ctx, block);
+        secure_zero(&ctx, sizeof(ctx));
+    } else if (len > 0) {
+        memcpy(block, k, len);
+    }
+
+    xor_pad(block, HMAC_IPAD);
+    sha1_init(&key->inner);
+    sha1_update(&key->inner, block, HMAC_BLOCK);
+    xor_pad(block, HMAC_IPAD ^ HMAC_OPAD);
+    sha1_init(&key->outer);
+    sha1_update(&key->outer, block, HMAC_BLOCK);
+    secure_zero(block, sizeof(block));
+}
+
+void hmac_sha1_key_clear(HMAC_SHA1_KEY *key)
+{
+    secure_zero(key, sizeof(*key));
+}
+
+void hmac_sha1_init(HMAC_SHA1_CTX *ctx, const HMAC_SHA1_KEY *key)
+{
+    ctx->inner = key->inner;
+    ctx->outer = key->outer;
+}
+
+void hmac_sha1_update(HMAC_SHA1_CTX *ctx, const BYTE data[], size_t len)
+{
+    sha1_update(&ctx->inner, data, len);
+}
+
+void hmac_sha1_final(HMAC_SHA1_CTX *ctx, BYTE mac[SHA1_BLOCK_SIZE])
+{
+    BYTE inner[SHA1_BLOCK_SIZE];
+
+    sha1_final(&ctx->inner, inner);
+    sha1_update(&ctx->outer, inner, sizeof(inner));
+    sha1_final(&ctx->outer, mac);
+    secure_zero(ctx, sizeof(*ctx));
+}
+
+void hmac_sha1(const HMAC_SHA1_KEY *key, const BYTE data[], size_t len,
+               BYTE mac[SHA1_BLOCK_SIZE])
+{
+    HMAC_SHA1_CTX ctx;
+
+    hmac_sha1_init(&ctx, key);
+    hmac_sha1_update(&ctx, data, len);
+    hmac_sha1_final(&ctx, mac);
+}
+
+void hmac_sha1_batch(const HMAC_SHA1_KEY *key, const BYTE *const data[], const size_t len[],
+                     BYTE mac[][SHA1_BLOCK_SIZE], size_t n)
+{
+    BYTE (*inner)[SHA1_BLOCK_SIZE] = malloc(n * sizeof(*inner));
+    const BYTE **ptr = malloc(n * sizeof(*ptr));
+    size_t *inner_len = malloc(n * sizeof(*inner_len));
+
+    /* Without memory for the inner digests, MAC one message at a time */
+    if (inner == NULL || ptr == NULL || inner_len == NULL) {
+        for (size_t i = 0; i < n; i++)
+            hmac_sha1(key, data[i], len[i], mac[i]);
+        free(inner);
+        free(ptr);
+        free(inner_len);
+        return;
+    }
+
+    sha1_hash_batch_from(data, len, inner, n, &key->inner);
+    for (size_t i = 0; i < n; i++) {
+        ptr[i] = inner[i];
+        inner_len[i] = SHA1_BLOCK_SIZE;
+    }
+    sha1_hash_batch_from(ptr, inner_len, mac, n, &key->outer);
+
+    /* The inner digests are as secret as the key */
+    secure_zero(inner, n * sizeof(*inner));
+    free(inner);
+    free(ptr);
+    free(inner_len);
+}
@@ -0,0 +1,76 @@
+/*********************************************************************
+ * Filename:   hmac.h
+ * Description: Public API for HMAC-SHA256 and HMAC-SHA1 (RFC 2104).
+ *              A key is set up once into the hash states after its
+ *              inner and outer padded blocks; each message starts from
+ *              copies of those, so the pads are never hashed again.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#ifndef HMAC_H
+#define HMAC_H
+
+#include <stddef.h>
+#include "sha256.h"
+#include "sha1.h"
+
+/* Keyed states: the hash after (key ^ ipad) and after (key ^ opad).
+ * They stand in for the key, so treat them as secret */
+typedef struct {
+    SHA256_CTX inner;
+    SHA256_CTX outer;
+} HMAC_SHA256_KEY;
+
+typedef struct {
+    SHA1_CTX inner;
+    SHA1_CTX outer;
+} HMAC_SHA1_KEY;
+
+/* One message being MACed */
+typedef struct {
+    SHA256_CTX inner;
+    SHA256_CTX outer;
+} HMAC_SHA256_CTX;
+
+typedef struct {
+    SHA1_CTX inner;
+    SHA1_CTX outer;
+} HMAC_SHA1_CTX;
+
+/* Set up a key of any length; keys longer than a block are hashed first */
+void hmac_sha256_key(HMAC_SHA256_KEY *key, const BYTE k[], size_t len);
+void hmac_sha1_key(HMAC_SHA1_KEY *key, const BYTE k[], size_t len);
+
+/* Wipe a key's states */
+void hmac_sha256_key_clear(HMAC_SHA256_KEY *key);
+void hmac_sha1_key_clear(HMAC_SHA1_KEY *key);
+
+/* Streaming MAC of one message under a key set up beforehand */
+void hmac_sha256_init(HMAC_SHA256_CTX *ctx, const HMAC_SHA256_KEY *key);
+void hmac_sha256_update(HMAC_SHA256_CTX *ctx, const BYTE data[], size_t len);
+void hmac_sha256_final(HMAC_SHA256_CTX *ctx, BYTE mac[SHA256_BLOCK_SIZE]);
+
+void hmac_sha1_init(HMAC_SHA1_CTX *ctx, const HMAC_SHA1_KEY *key);
+void hmac_sha1_update(HMAC_SHA1_CTX *ctx, const BYTE data[], size_t len);
+void hmac_sha1_final(HMAC_SHA1_CTX *ctx, BYTE mac[SHA1_BLOCK_SIZE]);
+
+/* One-shot MAC of a buffer */
+void hmac_sha256(const HMAC_SHA256_KEY *key, const BYTE data[], size_t len,
+                 BYTE mac[SHA256_BLOCK_SIZE]);
+void hmac_sha1(const HMAC_SHA1_KEY *key, const BYTE data[], size_t len,
+               BYTE mac[SHA1_BLOCK_SIZE]);
+
+/*
+ * MAC n messages, data[i] of len[i] bytes, into mac[i], all under one
+ * key. The inner hashes run side by side on the multi-buffer kernels
+ * from the inner keyed state, then the outer hashes of their digests
+ * from the outer one; for short messages that is most of the work.
+ */
+void hmac_sha256_batch(const HMAC_SHA256_KEY *key, const BYTE *const data[], const size_t len[],
+                       BYTE mac[][SHA256_BLOCK_SIZE], size_t n);
+void hmac_sha1_batch(const HMAC_SHA1_KEY *key, const BYTE *const data[], const size_t len[],
+                     BYTE mac[][SHA1_BLOCK_SIZE], size_t n);
+
+#endif /* HMAC_H */
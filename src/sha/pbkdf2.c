@@ -0,0 +1,193 @@
+/*********************************************************************
+ * Filename:   pbkdf2.c
+ * Description: PBKDF2-HMAC-SHA256 on the multi-buffer kernels. Every
+ *              iteration is two compressions of a single fixed-layout
+ *              block, the inner and the outer hash of the previous
+ *              32-byte result, started from the password's keyed HMAC
+ *              states; one output block runs in each lane.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "pbkdf2.h"
+#include "hmac.h"
+#include "sha_internal.h"
+
+/* Trial runs of the calibration last at least this long */
+#define CALIBRATE_MIN_SECONDS 0.02
+
+typedef struct {
+    const BYTE *const *pass;
+    const size_t *pass_len;
+    const BYTE *const *salt;
+    const size_t *salt_len;
+    unsigned long iterations;
+    BYTE *const *out;
+    size_t out_len;
+    size_t nblocks;             /* Output blocks per derivation */
+} pbkdf2_args;
+
+/* A 32-byte message after one keyed block: the message, then padding
+ * for 96 bytes in all */
+static void pad_block(BYTE block[64])
+{
+    memset(block + 32, 0, 32);
+    block[32] = 0x80;
+    block[62] = 0x03;
+}
+
+/* Lane l runs job first + l, derivation (first + l) / nblocks, output
+ * block (first + l) % nblocks + 1; lanes past count repeat lane 0 and
+ * are ignored */
+static void run_lanes(const sha_mb_engine *e, const pbkdf2_args *a, size_t first, int count)
+{
+    int lanes = e->lanes;
+    WORD inner[8 * SHA256_MAX_LANES], outer[8 * SHA256_MAX_LANES];
+    WORD state[8 * SHA256_MAX_LANES], acc[8 * SHA256_MAX_LANES];
+    BYTE block_in[SHA256_MAX_LANES][64], block_out[SHA256_MAX_LANES][64];
+    const BYTE *ptr_in[SHA256_MAX_LANES], *ptr_out[SHA256_MAX_LANES];
+    HMAC_SHA256_KEY key;
+    HMAC_SHA256_CTX ctx;
+
+    for (int l = 0; l < lanes; l++) {
+        size_t job = first + (l < count ? l : 0);
+        size_t d = job / a->nblocks;
+        uint32_t b = (uint32_t)(job % a->nblocks + 1);
+        BYTE index[4] = { (BYTE)(b >> 24), (BYTE)(b >> 16), (BYTE)(b >> 8), (BYTE)b };
+
+        /* U1 = HMAC(P, S || INT(b)) */
+        hmac_sha256_key(&key, a->pass[d], a->pass_len[d]);
+        hmac_sha256_init(&ctx, &key);
+        hmac_sha256_update(&ctx, a->salt[d], a->salt_len[d]);
+        hmac_sha256_update(&ctx, index, sizeof(index));
+        hmac_sha256_final(&ctx, block_in[l]);
+        pad_block(block_in[l]);
+        pad_block(block_out[l]);
+        ptr_in[l] = block_in[l];
+        ptr_out[l] = block_out[l];
+
+        for (int w = 0; w < 8; w++) {
+            const BYTE *u = block_in[l] + 4 * w;
+
+            inner[w * lanes + l] = key.inner.state[w];
+            outer[w * lanes + l] = key.outer.state[w];
+            acc[w * lanes + l] = (WORD)u[0] << 24 | (WORD)u[1] << 16 | (WORD)u[2] << 8 | u[3];
+        }
+    }
+    hmac_sha256_key_clear(&key);
+
+    /* U(j) = HMAC(P, U(j-1)), T = U1 ^ U2 ^ ... */
+    for (unsigned long it = 1; it < a->iterations; it++) {
+        memcpy(state, inner, sizeof(WORD) * 8 * lanes);
+        e->blocks(state, ptr_in, 1);
+        for (int l = 0; l < lanes; l++)
+            sha256_store_digest(block_out[l], state, lanes, l);
+
+        memcpy(state, outer, sizeof(WORD) * 8 * lanes);
+        e->blocks(state, ptr_out, 1);
+        for (int l = 0; l < lanes; l++)
+            sha256_store_digest(block_in[l], state, lanes, l);
+        for (int i = 0; i < 8 * lanes; i++)
+            acc[i] ^= state[i];
+    }
+
+    for (int l = 0; l < count; l++) {
+        size_t job = first + l;
+        size_t off = job % a->nblocks * SHA256_BLOCK_SIZE;
+        size_t n = a->out_len - off < SHA256_BLOCK_SIZE ? a->out_len - off : SHA256_BLOCK_SIZE;
+
+        sha256_store_digest(block_out[l], acc, lanes, l);
+        memcpy(a->out[job / a->nblocks] + off, block_out[l], n);
+    }
+
+    secure_zero(inner, sizeof(inner));
+    secure_zero(outer, sizeof(outer));
+    secure_zero(state, sizeof(state));
+    secure_zero(acc, sizeof(acc));
+    secure_zero(block_in, sizeof(block_in));
+    secure_zero(block_out, sizeof(block_out));
+}
+
+int pbkdf2_hmac_sha256_batch(const BYTE *const pass[], const size_t pass_len[],
+                             const BYTE *const salt[], const size_t salt_len[],
+                             unsigned long iterations, BYTE *const out[], size_t out_len, size_t n)
+{
+    const sha_mb_engine *e = sha256_mb_engine_get();
+    pbkdf2_args a;
+    size_t jobs;
+
+    if (iterations == 0) return 1;
+    if (out_len == 0) return 0;
+    /* At most 2^32 - 1 blocks of output */
+    if ((out_len - 1) / SHA256_BLOCK_SIZE >= 0xffffffffu) return 1;
+
+    a.pass = pass;
+    a.pass_len = pass_len;
+    a.salt = salt;
+    a.salt_len = salt_len;
+    a.iterations = iterations;
+    a.out = out;
+    a.out_len = out_len;
+    a.nblocks = (out_len + SHA256_BLOCK_SIZE - 1) / SHA256_BLOCK_SIZE;
+
+    jobs = n * a.nblocks;
+    for (size_t first = 0; first < jobs; ) {
+        size_t left = jobs - first;
+        const sha_mb_engine *pass_e = sha256_mb_pass_engine(e, left);
+        int count = left < (size_t)pass_e->lanes ? (int)left : pass_e->lanes;
+
+        run_lanes(pass_e, &a, first, count);
+        first += (size_t)count;
+    }
+    return 0;
+}
+
+int pbkdf2_hmac_sha256(const BYTE pass[], size_t pass_len, const BYTE salt[], size_t salt_len,
+                       unsigned long iterations, BYTE out[], size_t out_len)
+{
+    return pbkdf2_hmac_sha256_batch(&pass, &pass_len, &salt, &salt_len, iterations, &out, out_len, 1);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned long pbkdf2_hmac_sha256_calibrate(double seconds, size_t out_len)
+{
+    static const BYTE pass[] = "calibration", salt[16] = { 0 };
+    BYTE out[SHA256_MAX_LANES * SHA256_BLOCK_SIZE];
+    size_t lanes = (size_t)sha256_mb_engine_get()->lanes, blocks, trial_blocks;
+    unsigned long trial = 1024;
+    double t, estimate;
+
+    /* Time grows with the passes over the lanes the blocks need; the
+     * trial runs as many blocks as fit one pass */
+    blocks = out_len > 0 ? (out_len + SHA256_BLOCK_SIZE - 1) / SHA256_BLOCK_SIZE : 1;
+    trial_blocks = blocks < lanes ? blocks : lanes;
+
+    /* Double the trial until it is long enough to time */
+    for (;;) {
+        double t0 = now_s();
+
+        pbkdf2_hmac_sha256(pass, sizeof(pass) - 1, salt, sizeof(salt), trial,
+                           out, trial_blocks * SHA256_BLOCK_SIZE);
+        t = now_s() - t0;
+        if (t >= CALIBRATE_MIN_SECONDS || trial >= 1ul << 30) break;
+        trial *= 2;
+    }
+    secure_zero(out, sizeof(out));
+
+    estimate = seconds / (t / trial * ((blocks + lanes - 1) / lanes));
+    if (!(estimate >= 1)) return 1;
+    if (estimate >= (double)ULONG_MAX) return ULONG_MAX;
+    return (unsigned long)estimate;
+}
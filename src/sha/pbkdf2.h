@@ -0,0 +1,42 @@
+/*********************************************************************
+ * Filename:   pbkdf2.h
+ * Description: Public API for PBKDF2-HMAC-SHA256 (RFC 8018) passphrase
+ *              key derivation. Independent output blocks, and the
+ *              derivations of a batch of passwords, run side by side in
+ *              the lanes of the multi-buffer SHA-256 kernels.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#ifndef PBKDF2_H
+#define PBKDF2_H
+
+#include <stddef.h>
+#include "sha256.h"
+
+/*
+ * Derive out_len bytes from a passphrase and salt. Each 32-byte block
+ * of output is its own chain of iterations, so a key longer than one
+ * block takes no longer until there are more blocks than lanes.
+ * Returns 0 on success, 1 if iterations is 0 or out_len is more than
+ * RFC 8018 allows.
+ */
+int pbkdf2_hmac_sha256(const BYTE pass[], size_t pass_len, const BYTE salt[], size_t salt_len,
+                       unsigned long iterations, BYTE out[], size_t out_len);
+
+/*
+ * n derivations with one iteration count and output length, password
+ * pass[i] with salt salt[i] into out[i], as a verification service
+ * checking candidate passwords needs. Returns 0 on success, 1 as for
+ * pbkdf2_hmac_sha256.
+ */
+int pbkdf2_hmac_sha256_batch(const BYTE *const pass[], const size_t pass_len[],
+                             const BYTE *const salt[], const size_t salt_len[],
+                             unsigned long iterations, BYTE *const out[], size_t out_len, size_t n);
+
+/* Iteration count at which one derivation of out_len bytes takes about
+ * `seconds` on this machine, measured with short trial runs; at least 1 */
+unsigned long pbkdf2_hmac_sha256_calibrate(double seconds, size_t out_len);
+
+#endif /* PBKDF2_H */
@@ -13,57 +13,152 @@
 #include <stdlib.h>
 #include <string.h>
 #include "sha1.h"
+#include "sha_internal.h"
 
 /* Rotate left macro */
 #define ROTLEFT(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
 
+/* Round functions for rounds 0-19, 20-39/60-79 and 40-59 */
+#define F1(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define F2(b, c, d) ((b) ^ (c) ^ (d))
+#define F3(b, c, d) (((b) & (c)) | ((d) & ((b) | (c))))
+
+/* Round constants */
+#define K1 0x5A827999
+#define K2 0x6ED9EBA1
+#define K3 0x8F1BBCDC
+#define K4 0xCA62C1D6
+
+/* Schedule word i (16 and up) from the 16-word window m[] */
+#define SCHED(i) (m[(i) & 15] = ROTLEFT(m[((i) - 3) & 15] ^ m[((i) - 8) & 15] ^ \
+                                        m[((i) - 14) & 15] ^ m[(i) & 15], 1))
+#define LOADED(i) m[i]
+
+/* One round; the caller rotates the roles of a..e instead of moving
+ * the values, and b and e are updated in place */
+#define ROUND(a, b, c, d, e, F, k, w) do { \
+        e += ROTLEFT(a, 5) + F(b, c, d) + (k) + (w); \
+        b = ROTLEFT(b, 30); \
+    } while (0)
+
+#define ROUNDS5(i, F, k, w) do { \
+        ROUND(a, b, c, d, e, F, k, w((i) + 0)); \
+        ROUND(e, a, b, c, d, F, k, w((i) + 1)); \
+        ROUND(d, e, a, b, c, F, k, w((i) + 2)); \
+        ROUND(c, d, e, a, b, F, k, w((i) + 3)); \
+        ROUND(b, c, d, e, a, F, k, w((i) + 4)); \
+    } while (0)
+
 /*
- * SHA-1 compression function
- * Processes one 512-bit message block
+ * Portable SHA-1 compression function
+ * Processes nblocks consecutive 512-bit blocks with the schedule in a
+ * rolling 16-word window, keeping the state in local variables from
+ * one block to the next
  */
-static void sha1_transform(SHA1_CTX *ctx, const BYTE data[])
+static void sha1_portable_blocks(WORD *state, const BYTE data[], size_t nblocks)
 {
-    WORD a, b, c, d, e, i, j, t, m[80];
-
-    /* Prepare message schedule */
-    for (i = 0, j = 0; i < 16; ++i, j += 4)
-        m[i] = (data[j] << 24) | (data[j + 1] << 16) |
-               (data[j + 2] << 8) | (data[j + 3]);
-
-    for ( ; i < 80; ++i)
-        m[i] = ROTLEFT(m[i - 3] ^ m[i - 8] ^ m[i - 14] ^ m[i - 16], 1);
-
-    /* Initialize working variables */
-    a = ctx->state[0];
-    b = ctx->state[1];
-    c = ctx->state[2];
-    d = ctx->state[3];
-    e = ctx->state[4];
-
-    /* Main loop */
-    for (i = 0; i < 20; ++i) {
-        t = ROTLEFT(a, 5) + ((b & c) ^ (~b & d)) + e + ctx->k[0] + m[i];
-        e = d; d = c; c = ROTLEFT(b, 30); b = a; a = t;
-    }
-    for ( ; i < 40; ++i) {
-        t = ROTLEFT(a, 5) + (b ^ c ^ d) + e + ctx->k[1] + m[i];
-        e = d; d = c; c = ROTLEFT(b, 30); b = a; a = t;
+    WORD a, b, c, d, e, i, j, m[16];
+    WORD s0 = state[0], s1 = state[1], s2 = state[2];
+    WORD s3 = state[3], s4 = state[4];
+
+    for ( ; nblocks > 0; --nblocks, data += 64) {
+        /* Load the message block */
+        for (i = 0, j = 0; i < 16; ++i, j += 4)
+            m[i] = ((WORD)data[j] << 24) | (data[j + 1] << 16) |
+                   (data[j + 2] << 8) | (data[j + 3]);
+
+        /* Initialize working variables */
+        a = s0;
+        b = s1;
+        c = s2;
+        d = s3;
+        e = s4;
+
+        /* Main loop */
+        ROUNDS5(0, F1, K1, LOADED);
+        ROUNDS5(5, F1, K1, LOADED);
+        ROUNDS5(10, F1, K1, LOADED);
+        ROUND(a, b, c, d, e, F1, K1, m[15]);
+        ROUND(e, a, b, c, d, F1, K1, SCHED(16));
+        ROUND(d, e, a, b, c, F1, K1, SCHED(17));
+        ROUND(c, d, e, a, b, F1, K1, SCHED(18));
+        ROUND(b, c, d, e, a, F1, K1, SCHED(19));
+        for (i = 20; i < 40; i += 5)
+            ROUNDS5(i, F2, K2, SCHED);
+        for ( ; i < 60; i += 5)
+            ROUNDS5(i, F3, K3, SCHED);
+        for ( ; i < 80; i += 5)
+            ROUNDS5(i, F2, K4, SCHED);
+
+        /* Add results to state */
+        s0 += a;
+        s1 += b;
+        s2 += c;
+        s3 += d;
+        s4 += e;
     }
-    for ( ; i < 60; ++i) {
-        t = ROTLEFT(a, 5) + ((b & c) ^ (b & d) ^ (c & d)) + e + ctx->k[2] + m[i];
-        e = d; d = c; c = ROTLEFT(b, 30); b = a; a = t;
+
+    state[0] = s0;
+    state[1] = s1;
+    state[2] = s2;
+    state[3] = s3;
+    state[4] = s4;
+}
+
+const sha_engine sha1_engine_portable = {
+    "portable",
+    sha1_portable_blocks,
+    NULL,
+};
+
+/* Fastest first; each is usable only if the CPU has what it needs */
+static const sha_engine* const engines[] = {
+    &sha1_engine_shani,
+    &sha1_engine_portable,
+};
+
+static int engine_usable(const sha_engine* e)
+{
+    if (e == &sha1_engine_shani) return sha_shani_usable();
+    return 1;
+}
+
+static const sha_engine* selected_engine = NULL;
+
+const sha_engine* sha1_engine_get(void)
+{
+    const sha_engine* e = __atomic_load_n(&selected_engine, __ATOMIC_ACQUIRE);
+
+    if (e == NULL) {
+        for (size_t n = 0; n < sizeof(engines) / sizeof(engines[0]); n++) {
+            e = engines[n];
+            if (engine_usable(e)) break;
+        }
+        __atomic_store_n(&selected_engine, e, __ATOMIC_RELEASE);
     }
-    for ( ; i < 80; ++i) {
-        t = ROTLEFT(a, 5) + (b ^ c ^ d) + e + ctx->k[3] + m[i];
-        e = d; d = c; c = ROTLEFT(b, 30); b = a; a = t;
+    return e;
+}
+
+const char *sha1_engine_name(void)
+{
+    return sha1_engine_get()->name;
+}
+
+int sha1_engine_select(const char *name)
+{
+    for (size_t n = 0; n < sizeof(engines) / sizeof(engines[0]); n++) {
+        if (strcmp(name, engines[n]->name) == 0 && engine_usable(engines[n])) {
+            __atomic_store_n(&selected_engine, engines[n], __ATOMIC_RELEASE);
+            return 0;
+        }
     }
+    return 1;
+}
 
-    /* Add results to state */
-    ctx->state[0] += a;
-    ctx->state[1] += b;
-    ctx->state[2] += c;
-    ctx->state[3] += d;
-    ctx->state[4] += e;
+/* Process nblocks consecutive 512-bit blocks with the selected kernel */
+void sha1_transform_blocks(SHA1_CTX *ctx, const BYTE data[], size_t nblocks)
+{
+    sha1_engine_get()->blocks(ctx->state, data, nblocks);
 }
 
 /* Initialize SHA-1 context */
@@ -86,17 +181,37 @@ void sha1_init(SHA1_CTX *ctx)
     ctx->k[3] = 0xCA62C1D6;
 }
 
-/* Process input data */
+/*
+ * Process input data
+ * Tops up a partial block, hashes whole blocks straight from the
+ * caller's buffer, then keeps the tail
+ */
 void sha1_update(SHA1_CTX *ctx, const BYTE data[], size_t len)
 {
-    for (size_t i = 0; i < len; ++i) {
-        ctx->data[ctx->datalen++] = data[i];
-        if (ctx->datalen == 64) {
-            sha1_transform(ctx, ctx->data);
-            ctx->bitlen += 512;
-            ctx->datalen = 0;
-        }
+    size_t n, nblocks;
+
+    if (ctx->datalen > 0) {
+        n = 64 - ctx->datalen < len ? 64 - ctx->datalen : len;
+        memcpy(ctx->data + ctx->datalen, data, n);
+        ctx->datalen += n;
+        data += n;
+        len -= n;
+        if (ctx->datalen < 64) return;
+        sha1_transform_blocks(ctx, ctx->data, 1);
+        ctx->bitlen += 512;
+        ctx->datalen = 0;
+    }
+
+    nblocks = len / 64;
+    if (nblocks > 0) {
+        sha1_transform_blocks(ctx, data, nblocks);
+        ctx->bitlen += (unsigned long long)nblocks * 512;
+        data += nblocks * 64;
+        len -= nblocks * 64;
     }
+
+    memcpy(ctx->data, data, len);
+    ctx->datalen = len;
 }
 
 /* Finalize hash and output result */
@@ -108,7 +223,7 @@ void sha1_final(SHA1_CTX *ctx, BYTE hash[])
     ctx->data[i++] = 0x80;
     if (i > 56) {
         while (i < 64) ctx->data[i++] = 0x00;
-        sha1_transform(ctx, ctx->data);
+        sha1_transform_blocks(ctx, ctx->data, 1);
         memset(ctx->data, 0, 56);
     }
     while (i < 56) ctx->data[i++] = 0x00;
@@ -124,7 +239,7 @@ void sha1_final(SHA1_CTX *ctx, BYTE hash[])
     ctx->data[57] = ctx->bitlen >> 48;
     ctx->data[56] = ctx->bitlen >> 56;
 
-    sha1_transform(ctx, ctx->data);
+    sha1_transform_blocks(ctx, ctx->data, 1);
 
     /* Output hash (big-endian) */
     for (i = 0; i < 4; ++i) {
@@ -135,3 +250,66 @@ void sha1_final(SHA1_CTX *ctx, BYTE hash[])
         hash[i + 16] = (ctx->state[4] >> (24 - i * 8)) & 0xff;
     }
 }
+
+/* Context blob laid out as the SHA-256 one ("SHA1" and five state
+ * words), its check bytes taken from a SHA-1 */
+#define BLOB_STATE 16
+#define BLOB_DATA  36
+#define BLOB_CHECK 100
+
+static void blob_check(const BYTE blob[], BYTE check[8])
+{
+    BYTE sum[SHA1_BLOCK_SIZE];
+    SHA1_CTX ctx;
+
+    sha1_init(&ctx);
+    sha1_update(&ctx, blob, BLOB_CHECK);
+    sha1_final(&ctx, sum);
+    memcpy(check, sum, 8);
+}
+
+void sha1_ctx_export(const SHA1_CTX *ctx, BYTE blob[SHA1_CTX_BLOB_SIZE])
+{
+    memcpy(blob, "SHA1", 4);
+    blob[4] = SHA1_CTX_BLOB_VERSION;
+    blob[5] = (BYTE)ctx->datalen;
+    blob[6] = blob[7] = 0;
+    for (int i = 0; i < 8; i++)
+        blob[8 + i] = (BYTE)(ctx->bitlen >> (56 - 8 * i));
+    for (int w = 0; w < 5; w++)
+        for (int i = 0; i < 4; i++)
+            blob[BLOB_STATE + 4 * w + i] = (BYTE)(ctx->state[w] >> (24 - 8 * i));
+    memcpy(blob + BLOB_DATA, ctx->data, ctx->datalen);
+    memset(blob + BLOB_DATA + ctx->datalen, 0, 64 - ctx->datalen);
+    blob_check(blob, blob + BLOB_CHECK);
+}
+
+int sha1_ctx_import(SHA1_CTX *ctx, const BYTE blob[SHA1_CTX_BLOB_SIZE])
+{
+    BYTE check[8];
+    SHA1_CTX c;
+
+    blob_check(blob, check);
+    if (memcmp(check, blob + BLOB_CHECK, 8) != 0 || memcmp(blob, "SHA1", 4) != 0 ||
+        blob[4] != SHA1_CTX_BLOB_VERSION || blob[5] >= 64 || blob[6] != 0 || blob[7] != 0)
+        return 1;
+
+    /* The constants come from init */
+    sha1_init(&c);
+    c.datalen = blob[5];
+    for (int i = 0; i < 8; i++)
+        c.bitlen = c.bitlen << 8 | blob[8 + i];
+    /* Only whole blocks are counted until the final block */
+    if (c.bitlen % 512 != 0) return 1;
+    for (int w = 0; w < 5; w++) {
+        const BYTE *p = blob + BLOB_STATE + 4 * w;
+
+        c.state[w] = (WORD)p[0] << 24 | (WORD)p[1] << 16 | (WORD)p[2] << 8 | p[3];
+    }
+    memcpy(c.data, blob + BLOB_DATA, 64);
+    for (WORD i = c.datalen; i < 64; i++)
+        if (c.data[i] != 0) return 1;
+
+    *ctx = c;
+    return 0;
+}
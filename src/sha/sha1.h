@@ -32,7 +32,8 @@ typedef struct {
     WORD datalen;                  /* Length of data in buffer */
     unsigned long long bitlen;     /* Total message length in bits */
     WORD state[5];                 /* Hash state (A, B, C, D, E) */
-    WORD k[4];                     /* SHA-1 constants */
+    WORD k[4];                     /* SHA-1 constants, set by init; the kernels
+                                      use their own copies */
 } SHA1_CTX;
 
 /* Initialize SHA-1 context */
@@ -44,4 +45,93 @@ void sha1_update(SHA1_CTX *ctx, const BYTE data[], size_t len);
 /* Finalize SHA-1 and produce hash */
 void sha1_final(SHA1_CTX *ctx, BYTE hash[]);
 
+/* Kernel in use ("shani" or "portable"), and forcing one by name;
+ * select returns 0 on success, 1 if unknown or unsupported here */
+const char *sha1_engine_name(void);
+int sha1_engine_select(const char *name);
+
+/* Compress nblocks whole 64-byte blocks into ctx->state; the buffered
+ * data and the bit count are left alone */
+void sha1_transform_blocks(SHA1_CTX *ctx, const BYTE data[], size_t nblocks);
+
+/* Saved context in a fixed, machine-independent layout, as for
+ * sha256_ctx_export; import returns 0, or 1 without touching ctx if
+ * the blob is corrupt or not a SHA-1 context of this version */
+#define SHA1_CTX_BLOB_SIZE 108
+#define SHA1_CTX_BLOB_VERSION 1
+
+void sha1_ctx_export(const SHA1_CTX *ctx, BYTE blob[SHA1_CTX_BLOB_SIZE]);
+int sha1_ctx_import(SHA1_CTX *ctx, const BYTE blob[SHA1_CTX_BLOB_SIZE]);
+
+/*
+ * Multi-buffer SHA-1 for verifying many independent checksums. A job
+ * manager keeps one message in each lane (8 with AVX2, 4 with SSE2, 1
+ * otherwise) and compresses a block of every lane per step. Digests
+ * are identical to sha1_init/update/final.
+ */
+#define SHA1_MAX_LANES 8
+
+typedef struct {
+    const BYTE *data;               /* Message */
+    size_t len;                     /* Message length in bytes */
+    BYTE digest[SHA1_BLOCK_SIZE];   /* Filled in when the job completes */
+    void *user;                     /* Not used by the library */
+} SHA1_JOB;
+
+typedef struct {
+    WORD state[5 * SHA1_MAX_LANES];     /* Lane states, word-major */
+    SHA1_JOB *job[SHA1_MAX_LANES];      /* NULL for a free lane */
+    const BYTE *ptr[SHA1_MAX_LANES];    /* Next whole block of the message */
+    size_t blocks[SHA1_MAX_LANES];      /* Blocks left at ptr, or in the tail */
+    BYTE tail[SHA1_MAX_LANES][128];     /* Padded last one or two blocks */
+    int tail_blocks[SHA1_MAX_LANES];    /* Size of the tail in blocks */
+    int in_tail[SHA1_MAX_LANES];        /* Message done, hashing the tail */
+    const void *engine;                 /* Kernel chosen by sha1_mgr_init */
+    int lanes;                          /* Lanes of that kernel */
+    int busy;                           /* Lanes holding a job */
+    WORD start[5];                      /* State every job starts from */
+    unsigned long long start_bits;      /* Bits already hashed into it */
+} SHA1_MGR;
+
+/* Initialize a job manager */
+void sha1_mgr_init(SHA1_MGR *mgr);
+
+/*
+ * As sha1_mgr_init, but every job is hashed as the continuation of
+ * prefix, which must hold whole blocks only (datalen 0); HMAC starts
+ * each message from its keyed pad this way
+ */
+void sha1_mgr_init_from(SHA1_MGR *mgr, const SHA1_CTX *prefix);
+
+/*
+ * Queue a job; the data must stay valid until the job is returned.
+ * Work only runs once every lane is full, and then the first job to
+ * finish is returned (jobs finish out of order); NULL otherwise
+ */
+SHA1_JOB *sha1_mgr_submit(SHA1_MGR *mgr, SHA1_JOB *job);
+
+/* Run the busy lanes until one job finishes and return it, or NULL
+ * once the manager is empty */
+SHA1_JOB *sha1_mgr_flush(SHA1_MGR *mgr);
+
+/*
+ * Hash n messages, data[i] of len[i] bytes, into digest[i].
+ * Messages are scheduled longest first so that the lanes run messages
+ * of similar length side by side
+ */
+void sha1_hash_batch(const BYTE *const data[], const size_t len[],
+                     BYTE digest[][SHA1_BLOCK_SIZE], size_t n);
+
+/* The same with every message continuing from prefix, as for
+ * sha1_mgr_init_from */
+void sha1_hash_batch_from(const BYTE *const data[], const size_t len[],
+                          BYTE digest[][SHA1_BLOCK_SIZE], size_t n, const SHA1_CTX *prefix);
+
+/* Multi-buffer kernel in use ("avx2", "sse2" or "x1", one lane on the
+ * single-buffer kernel), and forcing one by name; select returns 0 on
+ * success, 1 if unknown or unsupported here. It applies to managers
+ * initialised afterwards */
+const char *sha1_mb_engine_name(void);
+int sha1_mb_engine_select(const char *name);
+
 #endif /* SHA1_H */
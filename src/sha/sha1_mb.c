@@ -0,0 +1,133 @@
+/*********************************************************************
+ * Filename:   sha1_mb.c
+ * Description: Multi-buffer SHA-1: kernel selection, and the job
+ *              manager of sha_mb_mgr.h instantiated for 5 state
+ *              words and up to 8 lanes.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_features.h"
+#include "sha1.h"
+#include "sha_internal.h"
+
+static const WORD iv[5] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
+/* One lane through whichever single-buffer kernel is selected */
+static void x1_blocks(uint32_t *state, const unsigned char *const *data, size_t nblocks)
+{
+    sha1_engine_get()->blocks(state, data[0], nblocks);
+}
+
+const sha_mb_engine sha1_mb_engine_x1 = {
+    "x1",
+    1,
+    x1_blocks,
+    NULL,
+};
+
+/* Fastest first; each is usable only if the CPU has what it needs */
+static const sha_mb_engine* const engines[] = {
+    &sha1_mb_engine_avx2,
+    &sha1_mb_engine_sse2,
+    &sha1_mb_engine_x1,
+};
+
+static int engine_usable(const sha_mb_engine* e)
+{
+    const cpu_features* f = cpu_get_features();
+
+    if (e == &sha1_mb_engine_avx2) return f->avx2;
+    if (e == &sha1_mb_engine_sse2) return f->sse2;
+    return 1;
+}
+
+static const sha_mb_engine* selected_engine = NULL;
+
+static const sha_mb_engine* engine_get(void)
+{
+    const sha_mb_engine* e = __atomic_load_n(&selected_engine, __ATOMIC_ACQUIRE);
+
+    if (e == NULL) {
+        for (size_t n = 0; n < sizeof(engines) / sizeof(engines[0]); n++) {
+            e = engines[n];
+            if (engine_usable(e)) break;
+        }
+        __atomic_store_n(&selected_engine, e, __ATOMIC_RELEASE);
+    }
+    return e;
+}
+
+const char *sha1_mb_engine_name(void)
+{
+    return engine_get()->name;
+}
+
+int sha1_mb_engine_select(const char *name)
+{
+    for (size_t n = 0; n < sizeof(engines) / sizeof(engines[0]); n++) {
+        if (strcmp(name, engines[n]->name) == 0 && engine_usable(engines[n])) {
+            __atomic_store_n(&selected_engine, engines[n], __ATOMIC_RELEASE);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#define MB_WORDS        5
+#define MB_DIGEST_SIZE  SHA1_BLOCK_SIZE
+#define MB_MAX_LANES    SHA1_MAX_LANES
+#define MB_MGR          SHA1_MGR
+#define MB_JOB          SHA1_JOB
+#define MB_CTX          SHA1_CTX
+#define MB_IV           iv
+#define MB_ENGINE_GET   engine_get
+#define MB_FN(x)        sha1_##x
+#include "sha_mb_mgr.h"
+
+void sha1_hash_batch_from(const BYTE *const data[], const size_t len[],
+                          BYTE digest[][SHA1_BLOCK_SIZE], size_t n, const SHA1_CTX *prefix)
+{
+    SHA1_JOB *jobs = malloc(n * sizeof(*jobs));
+    SHA1_MGR mgr;
+
+    /* Without memory for the jobs, hash one message at a time */
+    if (jobs == NULL) {
+        for (size_t i = 0; i < n; i++) {
+            SHA1_CTX ctx;
+
+            if (prefix != NULL)
+                ctx = *prefix;
+            else
+                sha1_init(&ctx);
+            sha1_update(&ctx, data[i], len[i]);
+            sha1_final(&ctx, digest[i]);
+            secure_zero(&ctx, sizeof(ctx));
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        jobs[i].data = data[i];
+        jobs[i].len = len[i];
+    }
+    sha1_mgr_init_from(&mgr, prefix);
+    batch_run(&mgr, jobs, n);
+
+    for (size_t i = 0; i < n; i++)
+        memcpy(digest[i], jobs[i].digest, SHA1_BLOCK_SIZE);
+    secure_zero(jobs, n * sizeof(*jobs));
+    free(jobs);
+}
+
+void sha1_hash_batch(const BYTE *const data[], const size_t len[],
+                     BYTE digest[][SHA1_BLOCK_SIZE], size_t n)
+{
+    sha1_hash_batch_from(data, len, digest, n, NULL);
+}
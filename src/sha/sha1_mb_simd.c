@@ -0,0 +1,203 @@
+/*********************************************************************
+ * Filename:   sha1_mb_simd.c
+ * Description: Multi-buffer SHA-1 kernels: 4 independent messages per
+ *              pass in SSE2 registers, 8 in AVX2 registers. Each state
+ *              and schedule word is one vector across the messages
+ *              (message l in lane l), so the rounds are plain vertical
+ *              SIMD; the message blocks are transposed into that layout
+ *              as they are loaded.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include "sha_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include "sha_mb_simd.h"
+
+/* Compiled for the extension regardless of -march; only reached after CPUID */
+#define SSE2_FN __attribute__((target("sse2")))
+#define AVX2_FN __attribute__((target("avx2")))
+
+/*
+ * The round and schedule are written once against a small set of
+ * vector operations; P selects the sse2_ or avx2_ versions.
+ */
+#define MB_ROUND(P, a, b, c, d, e, F, k, w) do {                                    \
+        e = P##_add(P##_add(e, P##_rotl(a, 5)), P##_add(P##_##F(b, c, d),           \
+                    P##_add(P##_set1(k), w)));                                      \
+        b = P##_rotl(b, 30);                                                        \
+    } while (0)
+
+#define MB_SCHED(P, i) (m[(i) & 15] = P##_rotl(P##_xor(P##_xor(m[((i) - 3) & 15], m[((i) - 8) & 15]), \
+                                                       P##_xor(m[((i) - 14) & 15], m[(i) & 15])), 1))
+#define MB_LOADED(P, i) m[i]
+
+#define MB_ROUNDS5(P, i, F, k, W) do {                                              \
+        MB_ROUND(P, a, b, c, d, e, F, k, W(P, (i) + 0));                            \
+        MB_ROUND(P, e, a, b, c, d, F, k, W(P, (i) + 1));                            \
+        MB_ROUND(P, d, e, a, b, c, F, k, W(P, (i) + 2));                            \
+        MB_ROUND(P, c, d, e, a, b, F, k, W(P, (i) + 3));                            \
+        MB_ROUND(P, b, c, d, e, a, F, k, W(P, (i) + 4));                            \
+    } while (0)
+
+/* All 80 rounds on the schedule in m[], added into s[] */
+#define MB_COMPRESS(P, V) do {                                                      \
+        V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4];                         \
+                                                                                    \
+        MB_ROUNDS5(P, 0, f1, 0x5A827999, MB_LOADED);                                \
+        MB_ROUNDS5(P, 5, f1, 0x5A827999, MB_LOADED);                                \
+        MB_ROUNDS5(P, 10, f1, 0x5A827999, MB_LOADED);                               \
+        MB_ROUND(P, a, b, c, d, e, f1, 0x5A827999, m[15]);                          \
+        MB_ROUND(P, e, a, b, c, d, f1, 0x5A827999, MB_SCHED(P, 16));                \
+        MB_ROUND(P, d, e, a, b, c, f1, 0x5A827999, MB_SCHED(P, 17));                \
+        MB_ROUND(P, c, d, e, a, b, f1, 0x5A827999, MB_SCHED(P, 18));                \
+        MB_ROUND(P, b, c, d, e, a, f1, 0x5A827999, MB_SCHED(P, 19));                \
+        for (int i = 20; i < 40; i += 5)                                            \
+            MB_ROUNDS5(P, i, f2, 0x6ED9EBA1, MB_SCHED);                             \
+        for (int i = 40; i < 60; i += 5)                                            \
+            MB_ROUNDS5(P, i, f3, 0x8F1BBCDC, MB_SCHED);                             \
+        for (int i = 60; i < 80; i += 5)                                            \
+            MB_ROUNDS5(P, i, f2, 0xCA62C1D6, MB_SCHED);                             \
+                                                                                    \
+        s[0] = P##_add(s[0], a); s[1] = P##_add(s[1], b);                           \
+        s[2] = P##_add(s[2], c); s[3] = P##_add(s[3], d);                           \
+        s[4] = P##_add(s[4], e);                                                    \
+    } while (0)
+
+/* ---------------- SSE2, 4 lanes ---------------- */
+
+static SSE2_FN inline __m128i sse2_add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+static SSE2_FN inline __m128i sse2_xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+static SSE2_FN inline __m128i sse2_set1(uint32_t x) { return _mm_set1_epi32((int)x); }
+
+static SSE2_FN inline __m128i sse2_rotl(__m128i x, int n)
+{
+    return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n));
+}
+
+static SSE2_FN inline __m128i sse2_f1(__m128i b, __m128i c, __m128i d)
+{
+    return _mm_xor_si128(d, _mm_and_si128(b, _mm_xor_si128(c, d)));
+}
+
+static SSE2_FN inline __m128i sse2_f2(__m128i b, __m128i c, __m128i d)
+{
+    return _mm_xor_si128(_mm_xor_si128(b, c), d);
+}
+
+static SSE2_FN inline __m128i sse2_f3(__m128i b, __m128i c, __m128i d)
+{
+    return _mm_or_si128(_mm_and_si128(b, c), _mm_and_si128(d, _mm_or_si128(b, c)));
+}
+
+/* Byte swap of each word without SSSE3: swap the bytes of each 16-bit
+ * half, then the halves */
+static SSE2_FN inline __m128i sse2_bswap(__m128i x)
+{
+    x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xb1), 0xb1);
+}
+
+/* r[l] holds four consecutive words of lane l; afterwards r[w] holds
+ * word w of all four lanes */
+static SSE2_FN inline void sse2_transpose4(__m128i* r)
+{
+    __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]), t1 = _mm_unpackhi_epi32(r[0], r[1]);
+    __m128i t2 = _mm_unpacklo_epi32(r[2], r[3]), t3 = _mm_unpackhi_epi32(r[2], r[3]);
+
+    r[0] = _mm_unpacklo_epi64(t0, t2);
+    r[1] = _mm_unpackhi_epi64(t0, t2);
+    r[2] = _mm_unpacklo_epi64(t1, t3);
+    r[3] = _mm_unpackhi_epi64(t1, t3);
+}
+
+static SSE2_FN void sha1_sse2_blocks(uint32_t* state, const unsigned char* const* data, size_t nblocks)
+{
+    __m128i s[5], m[16];
+
+    for (int w = 0; w < 5; w++)
+        s[w] = _mm_loadu_si128((const __m128i*)(state + 4 * w));
+
+    for (size_t off = 0; off < 64 * nblocks; off += 64) {
+        for (int q = 0; q < 4; q++) {
+            for (int l = 0; l < 4; l++)
+                m[4 * q + l] = _mm_loadu_si128((const __m128i*)(data[l] + off + 16 * q));
+            sse2_transpose4(m + 4 * q);
+        }
+        for (int w = 0; w < 16; w++)
+            m[w] = sse2_bswap(m[w]);
+
+        MB_COMPRESS(sse2, __m128i);
+    }
+
+    for (int w = 0; w < 5; w++)
+        _mm_storeu_si128((__m128i*)(state + 4 * w), s[w]);
+}
+
+/* ---------------- AVX2, 8 lanes ---------------- */
+
+static AVX2_FN inline __m256i avx2_add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+static AVX2_FN inline __m256i avx2_xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+static AVX2_FN inline __m256i avx2_set1(uint32_t x) { return _mm256_set1_epi32((int)x); }
+
+static AVX2_FN inline __m256i avx2_rotl(__m256i x, int n)
+{
+    return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+static AVX2_FN inline __m256i avx2_f1(__m256i b, __m256i c, __m256i d)
+{
+    return _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+}
+
+static AVX2_FN inline __m256i avx2_f2(__m256i b, __m256i c, __m256i d)
+{
+    return _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+}
+
+static AVX2_FN inline __m256i avx2_f3(__m256i b, __m256i c, __m256i d)
+{
+    return _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+}
+
+static AVX2_FN void sha1_avx2_blocks(uint32_t* state, const unsigned char* const* data, size_t nblocks)
+{
+    __m256i s[5], m[16];
+
+    for (int w = 0; w < 5; w++)
+        s[w] = _mm256_loadu_si256((const __m256i*)(state + 8 * w));
+
+    for (size_t off = 0; off < 64 * nblocks; off += 64) {
+        avx2_load_blocks8(m, data, off);
+
+        MB_COMPRESS(avx2, __m256i);
+    }
+
+    for (int w = 0; w < 5; w++)
+        _mm256_storeu_si256((__m256i*)(state + 8 * w), s[w]);
+}
+
+const sha_mb_engine sha1_mb_engine_sse2 = {
+    "sse2",
+    4,
+    sha1_sse2_blocks,
+    NULL,
+};
+
+const sha_mb_engine sha1_mb_engine_avx2 = {
+    "avx2",
+    8,
+    sha1_avx2_blocks,
+    NULL,
+};
+
+#else
+
+/* Never selected: cpu_get_features() reports no SIMD off x86 */
+const sha_mb_engine sha1_mb_engine_sse2 = { "sse2", 4, NULL, NULL };
+const sha_mb_engine sha1_mb_engine_avx2 = { "avx2", 8, NULL, NULL };
+
+#endif
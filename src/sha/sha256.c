@@ -14,14 +14,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include "sha256.h"
+#include "sha_internal.h"
 
 /* Bitwise rotation macros */
 #define ROTLEFT(a,b)  (((a) << (b)) | ((a) >> (32-(b))))
 #define ROTRIGHT(a,b) (((a) >> (b)) | ((a) << (32-(b))))
 
 /* SHA-256 logical functions */
-#define CH(x,y,z)  (((x) & (y)) ^ (~(x) & (z)))
-#define MAJ(x,y,z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define CH(x,y,z)  ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x,y,z) (((x) & (y)) | ((z) & ((x) | (y))))
 #define EP0(x) (ROTRIGHT(x,2) ^ ROTRIGHT(x,13) ^ ROTRIGHT(x,22))
 #define EP1(x) (ROTRIGHT(x,6) ^ ROTRIGHT(x,11) ^ ROTRIGHT(x,25))
 #define SIG0(x) (ROTRIGHT(x,7) ^ ROTRIGHT(x,18) ^ ((x) >> 3))
@@ -47,47 +48,165 @@ static const WORD k[64] = {
     0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
 };
 
-/* Process a single 512-bit block */
-static void sha256_transform(SHA256_CTX *ctx, const BYTE data[])
+/* One round; the caller rotates the roles of a..h instead of moving
+ * the values, and d and h are updated in place */
+#define ROUND(a,b,c,d,e,f,g,h,w,kk) do { \
+        WORD t1 = h + EP1(e) + CH(e,f,g) + (kk) + (w); \
+        d += t1; \
+        h = t1 + EP0(a) + MAJ(a,b,c); \
+    } while (0)
+
+/* Schedule word i (16 and up) from the 16-word window m[] */
+#define SCHED(i) (m[(i) & 15] += SIG1(m[((i) - 2) & 15]) + m[((i) - 7) & 15] + \
+                                 SIG0(m[((i) - 15) & 15]))
+
+#define ROUNDS8(i, w) do { \
+        ROUND(a,b,c,d,e,f,g,h, w((i) + 0), k[(i) + 0]); \
+        ROUND(h,a,b,c,d,e,f,g, w((i) + 1), k[(i) + 1]); \
+        ROUND(g,h,a,b,c,d,e,f, w((i) + 2), k[(i) + 2]); \
+        ROUND(f,g,h,a,b,c,d,e, w((i) + 3), k[(i) + 3]); \
+        ROUND(e,f,g,h,a,b,c,d, w((i) + 4), k[(i) + 4]); \
+        ROUND(d,e,f,g,h,a,b,c, w((i) + 5), k[(i) + 5]); \
+        ROUND(c,d,e,f,g,h,a,b, w((i) + 6), k[(i) + 6]); \
+        ROUND(b,c,d,e,f,g,h,a, w((i) + 7), k[(i) + 7]); \
+    } while (0)
+
+#define LOADED(i) m[i]
+
+/*
+ * Portable compression of nblocks consecutive 512-bit blocks. The
+ * schedule lives in a rolling 16-word window and the state stays in
+ * local variables from one block to the next.
+ */
+static void sha256_portable_blocks(WORD *state, const BYTE data[], size_t nblocks)
+{
+    WORD a,b,c,d,e,f,g,h,i,j,m[16];
+    WORD s0 = state[0], s1 = state[1], s2 = state[2], s3 = state[3];
+    WORD s4 = state[4], s5 = state[5], s6 = state[6], s7 = state[7];
+
+    for ( ; nblocks > 0; --nblocks, data += 64) {
+        for (i = 0, j = 0; i < 16; ++i, j += 4)
+            m[i] = ((WORD)data[j] << 24) | (data[j+1] << 16) |
+                   (data[j+2] << 8) | (data[j+3]);
+
+        a = s0;
+        b = s1;
+        c = s2;
+        d = s3;
+        e = s4;
+        f = s5;
+        g = s6;
+        h = s7;
+
+        ROUNDS8(0, LOADED);
+        ROUNDS8(8, LOADED);
+        for (i = 16; i < 64; i += 8)
+            ROUNDS8(i, SCHED);
+
+        s0 += a;
+        s1 += b;
+        s2 += c;
+        s3 += d;
+        s4 += e;
+        s5 += f;
+        s6 += g;
+        s7 += h;
+    }
+
+    state[0] = s0;
+    state[1] = s1;
+    state[2] = s2;
+    state[3] = s3;
+    state[4] = s4;
+    state[5] = s5;
+    state[6] = s6;
+    state[7] = s7;
+}
+
+#define ROUNDS8_WK(i) do { \
+        ROUND(a,b,c,d,e,f,g,h, wk[(i) + 0], 0); \
+        ROUND(h,a,b,c,d,e,f,g, wk[(i) + 1], 0); \
+        ROUND(g,h,a,b,c,d,e,f, wk[(i) + 2], 0); \
+        ROUND(f,g,h,a,b,c,d,e, wk[(i) + 3], 0); \
+        ROUND(e,f,g,h,a,b,c,d, wk[(i) + 4], 0); \
+        ROUND(d,e,f,g,h,a,b,c, wk[(i) + 5], 0); \
+        ROUND(c,d,e,f,g,h,a,b, wk[(i) + 6], 0); \
+        ROUND(b,c,d,e,f,g,h,a, wk[(i) + 7], 0); \
+    } while (0)
+
+/* One block with its schedule and round constants summed in wk[] */
+static void sha256_portable_rounds(WORD *state, const WORD *wk)
+{
+    WORD a = state[0], b = state[1], c = state[2], d = state[3];
+    WORD e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i += 8)
+        ROUNDS8_WK(i);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+const sha_engine sha256_engine_portable = {
+    "portable",
+    sha256_portable_blocks,
+    sha256_portable_rounds,
+};
+
+/* Fastest first; each is usable only if the CPU has what it needs */
+static const sha_engine* const engines[] = {
+    &sha256_engine_shani,
+    &sha256_engine_portable,
+};
+
+static int engine_usable(const sha_engine* e)
+{
+    if (e == &sha256_engine_shani) return sha_shani_usable();
+    return 1;
+}
+
+static const sha_engine* selected_engine = NULL;
+
+const sha_engine* sha256_engine_get(void)
+{
+    const sha_engine* e = __atomic_load_n(&selected_engine, __ATOMIC_ACQUIRE);
+
+    if (e == NULL) {
+        for (size_t n = 0; n < sizeof(engines) / sizeof(engines[0]); n++) {
+            e = engines[n];
+            if (engine_usable(e)) break;
+        }
+        __atomic_store_n(&selected_engine, e, __ATOMIC_RELEASE);
+    }
+    return e;
+}
+
+const char *sha256_engine_name(void)
+{
+    return sha256_engine_get()->name;
+}
+
+int sha256_engine_select(const char *name)
 {
-    WORD a,b,c,d,e,f,g,h,i,j,t1,t2,m[64];
-
-    for (i = 0, j = 0; i < 16; ++i, j += 4)
-        m[i] = (data[j] << 24) | (data[j+1] << 16) |
-               (data[j+2] << 8) | (data[j+3]);
-    for ( ; i < 64; ++i)
-        m[i] = SIG1(m[i-2]) + m[i-7] + SIG0(m[i-15]) + m[i-16];
-
-    a = ctx->state[0];
-    b = ctx->state[1];
-    c = ctx->state[2];
-    d = ctx->state[3];
-    e = ctx->state[4];
-    f = ctx->state[5];
-    g = ctx->state[6];
-    h = ctx->state[7];
-
-    for (i = 0; i < 64; ++i) {
-        t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i];
-        t2 = EP0(a) + MAJ(a,b,c);
-        h = g;
-        g = f;
-        f = e;
-        e = d + t1;
-        d = c;
-        c = b;
-        b = a;
-        a = t1 + t2;
+    for (size_t n = 0; n < sizeof(engines) / sizeof(engines[0]); n++) {
+        if (strcmp(name, engines[n]->name) == 0 && engine_usable(engines[n])) {
+            __atomic_store_n(&selected_engine, engines[n], __ATOMIC_RELEASE);
+            return 0;
+        }
     }
+    return 1;
+}
 
-    ctx->state[0] += a;
-    ctx->state[1] += b;
-    ctx->state[2] += c;
-    ctx->state[3] += d;
-    ctx->state[4] += e;
-    ctx->state[5] += f;
-    ctx->state[6] += g;
-    ctx->state[7] += h;
+/* Process nblocks consecutive 512-bit blocks with the selected kernel */
+void sha256_transform_blocks(SHA256_CTX *ctx, const BYTE data[], size_t nblocks)
+{
+    sha256_engine_get()->blocks(ctx->state, data, nblocks);
 }
 
 /* Initialize SHA-256 context */
@@ -105,17 +224,34 @@ void sha256_init(SHA256_CTX *ctx)
     ctx->state[7] = 0x5be0cd19;
 }
 
-/* Update hash with new input data */
+/* Update hash with new input data: top up a partial block, hash whole
+ * blocks straight from the caller's buffer, then keep the tail */
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len)
 {
-    for (WORD i = 0; i < len; ++i) {
-        ctx->data[ctx->datalen++] = data[i];
-        if (ctx->datalen == 64) {
-            sha256_transform(ctx, ctx->data);
-            ctx->bitlen += 512;
-            ctx->datalen = 0;
-        }
+    size_t n, nblocks;
+
+    if (ctx->datalen > 0) {
+        n = 64 - ctx->datalen < len ? 64 - ctx->datalen : len;
+        memcpy(ctx->data + ctx->datalen, data, n);
+        ctx->datalen += n;
+        data += n;
+        len -= n;
+        if (ctx->datalen < 64) return;
+        sha256_transform_blocks(ctx, ctx->data, 1);
+        ctx->bitlen += 512;
+        ctx->datalen = 0;
     }
+
+    nblocks = len / 64;
+    if (nblocks > 0) {
+        sha256_transform_blocks(ctx, data, nblocks);
+        ctx->bitlen += (unsigned long long)nblocks * 512;
+        data += nblocks * 64;
+        len -= nblocks * 64;
+    }
+
+    memcpy(ctx->data, data, len);
+    ctx->datalen = len;
 }
 
 /* Finalize hash and produce output */
@@ -130,7 +266,7 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
     } else {
         ctx->data[i++] = 0x80;
         while (i < 64) ctx->data[i++] = 0x00;
-        sha256_transform(ctx, ctx->data);
+        sha256_transform_blocks(ctx, ctx->data, 1);
         memset(ctx->data, 0, 56);
     }
 
@@ -144,7 +280,7 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
     ctx->data[58] = ctx->bitlen >> 40;
     ctx->data[57] = ctx->bitlen >> 48;
     ctx->data[56] = ctx->bitlen >> 56;
-    sha256_transform(ctx, ctx->data);
+    sha256_transform_blocks(ctx, ctx->data, 1);
 
     /* Output hash (big-endian) */
     for (i = 0; i < 4; ++i) {
@@ -158,3 +294,66 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
         hash[i + 28] = (ctx->state[7] >> (24 - i*8)) & 0xff;
     }
 }
+
+/* Context blob: "S256", version, datalen, two zero bytes, bitlen, the
+ * state words and the 64-byte buffer zero past datalen, then the first
+ * bytes of a SHA-256 of all that; integers big-endian */
+#define BLOB_STATE 16
+#define BLOB_DATA  48
+#define BLOB_CHECK 112
+
+static void blob_check(const BYTE blob[], BYTE check[8])
+{
+    BYTE sum[SHA256_BLOCK_SIZE];
+    SHA256_CTX ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, blob, BLOB_CHECK);
+    sha256_final(&ctx, sum);
+    memcpy(check, sum, 8);
+}
+
+void sha256_ctx_export(const SHA256_CTX *ctx, BYTE blob[SHA256_CTX_BLOB_SIZE])
+{
+    memcpy(blob, "S256", 4);
+    blob[4] = SHA256_CTX_BLOB_VERSION;
+    blob[5] = (BYTE)ctx->datalen;
+    blob[6] = blob[7] = 0;
+    for (int i = 0; i < 8; i++)
+        blob[8 + i] = (BYTE)(ctx->bitlen >> (56 - 8 * i));
+    for (int w = 0; w < 8; w++)
+        for (int i = 0; i < 4; i++)
+            blob[BLOB_STATE + 4 * w + i] = (BYTE)(ctx->state[w] >> (24 - 8 * i));
+    memcpy(blob + BLOB_DATA, ctx->data, ctx->datalen);
+    memset(blob + BLOB_DATA + ctx->datalen, 0, 64 - ctx->datalen);
+    blob_check(blob, blob + BLOB_CHECK);
+}
+
+int sha256_ctx_import(SHA256_CTX *ctx, const BYTE blob[SHA256_CTX_BLOB_SIZE])
+{
+    BYTE check[8];
+    SHA256_CTX c;
+
+    blob_check(blob, check);
+    if (memcmp(check, blob + BLOB_CHECK, 8) != 0 || memcmp(blob, "S256", 4) != 0 ||
+        blob[4] != SHA256_CTX_BLOB_VERSION || blob[5] >= 64 || blob[6] != 0 || blob[7] != 0)
+        return 1;
+
+    c.datalen = blob[5];
+    c.bitlen = 0;
+    for (int i = 0; i < 8; i++)
+        c.bitlen = c.bitlen << 8 | blob[8 + i];
+    /* Only whole blocks are counted until the final block */
+    if (c.bitlen % 512 != 0) return 1;
+    for (int w = 0; w < 8; w++) {
+        const BYTE *p = blob + BLOB_STATE + 4 * w;
+
+        c.state[w] = (WORD)p[0] << 24 | (WORD)p[1] << 16 | (WORD)p[2] << 8 | p[3];
+    }
+    memcpy(c.data, blob + BLOB_DATA, 64);
+    for (WORD i = c.datalen; i < 64; i++)
+        if (c.data[i] != 0) return 1;
+
+    *ctx = c;
+    return 0;
+}
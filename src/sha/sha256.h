@@ -35,4 +35,107 @@ void sha256_init(SHA256_CTX *ctx);
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len);
 void sha256_final(SHA256_CTX *ctx, BYTE hash[]);
 
+/* Kernel in use ("shani" or "portable"), and forcing one by name;
+ * select returns 0 on success, 1 if unknown or unsupported here */
+const char *sha256_engine_name(void);
+int sha256_engine_select(const char *name);
+
+/* Compress nblocks whole 64-byte blocks into ctx->state; the buffered
+ * data and the bit count are left alone */
+void sha256_transform_blocks(SHA256_CTX *ctx, const BYTE data[], size_t nblocks);
+
+/*
+ * A context saved as a versioned blob with a fixed byte layout, the
+ * same on every machine, so that a long hash can be resumed after a
+ * restart or carried on elsewhere with the next segment of the data.
+ * Import checks the blob and returns 0, or 1 without touching ctx if
+ * it is corrupt or not a SHA-256 context of this version.
+ */
+#define SHA256_CTX_BLOB_SIZE 120
+#define SHA256_CTX_BLOB_VERSION 1
+
+void sha256_ctx_export(const SHA256_CTX *ctx, BYTE blob[SHA256_CTX_BLOB_SIZE]);
+int sha256_ctx_import(SHA256_CTX *ctx, const BYTE blob[SHA256_CTX_BLOB_SIZE]);
+
+/*
+ * SHA-256 of fixed 32- and 64-byte inputs: double SHA-256 hashes a
+ * 32-byte digest again, and a binary Merkle node hashes its two child
+ * digests side by side. The padding is fixed in advance and the block
+ * after a 64-byte input runs on a precomputed schedule, so these skip
+ * the buffering of sha256_update and one schedule of sha256_final.
+ */
+void sha256_32(const BYTE in[32], BYTE out[SHA256_BLOCK_SIZE]);
+void sha256_64(const BYTE in[64], BYTE out[SHA256_BLOCK_SIZE]);
+
+/* Double SHA-256, SHA-256 of the SHA-256 of data */
+void sha256d(const BYTE data[], size_t len, BYTE out[SHA256_BLOCK_SIZE]);
+
+/* n fixed-length inputs on the multi-buffer kernels. A level of a
+ * binary Merkle tree, 2n digests in a row, is n 64-byte inputs whose
+ * digests are the n parents */
+void sha256_32_batch(const BYTE in[][32], BYTE out[][SHA256_BLOCK_SIZE], size_t n);
+void sha256_64_batch(const BYTE in[][64], BYTE out[][SHA256_BLOCK_SIZE], size_t n);
+
+/*
+ * Multi-buffer hashing of many independent messages. A job manager
+ * keeps one message in each lane (8 with AVX2, 16 with AVX-512, 1
+ * otherwise) and compresses a block of every lane per step, so the
+ * round dependency chain of one message no longer limits throughput.
+ * Digests are identical to sha256_init/update/final.
+ */
+#define SHA256_MAX_LANES 16
+
+typedef struct {
+    const BYTE *data;               /* Message */
+    size_t len;                     /* Message length in bytes */
+    BYTE digest[SHA256_BLOCK_SIZE]; /* Filled in when the job completes */
+    void *user;                     /* Not used by the library */
+} SHA256_JOB;
+
+typedef struct {
+    WORD state[8 * SHA256_MAX_LANES];   /* Lane states, word-major */
+    SHA256_JOB *job[SHA256_MAX_LANES];  /* NULL for a free lane */
+    const BYTE *ptr[SHA256_MAX_LANES];  /* Next whole block of the message */
+    size_t blocks[SHA256_MAX_LANES];    /* Blocks left at ptr, or in the tail */
+    BYTE tail[SHA256_MAX_LANES][128];   /* Padded last one or two blocks */
+    int tail_blocks[SHA256_MAX_LANES];  /* Size of the tail in blocks */
+    int in_tail[SHA256_MAX_LANES];      /* Message done, hashing the tail */
+    const void *engine;                 /* Kernel chosen by sha256_mgr_init */
+    int lanes;                          /* Lanes of that kernel */
+    int busy;                           /* Lanes holding a job */
+    WORD start[8];                      /* State every job starts from */
+    unsigned long long start_bits;      /* Bits already hashed into it */
+} SHA256_MGR;
+
+void sha256_mgr_init(SHA256_MGR *mgr);
+
+/* As sha256_mgr_init, but every job is hashed as the continuation of
+ * prefix, which must hold whole blocks only (datalen 0); HMAC starts
+ * each message from its keyed pad this way */
+void sha256_mgr_init_from(SHA256_MGR *mgr, const SHA256_CTX *prefix);
+
+/* Queue a job; the data must stay valid until the job is returned.
+ * Work only runs once every lane is full, and then the first job to
+ * finish is returned (jobs finish out of order); NULL otherwise */
+SHA256_JOB *sha256_mgr_submit(SHA256_MGR *mgr, SHA256_JOB *job);
+
+/* Run the lanes that are in use until one job finishes and return it,
+ * or NULL once the manager is empty */
+SHA256_JOB *sha256_mgr_flush(SHA256_MGR *mgr);
+
+/* Hash every job. Jobs are scheduled longest first so that the lanes
+ * run messages of similar length side by side */
+void sha256_hash_batch(SHA256_JOB jobs[], size_t njobs);
+
+/* The same with every job continuing from prefix, as for
+ * sha256_mgr_init_from */
+void sha256_hash_batch_from(SHA256_JOB jobs[], size_t njobs, const SHA256_CTX *prefix);
+
+/* Multi-buffer kernel in use ("avx512", "avx2" or "x1", one lane on the
+ * single-buffer kernel), and forcing one by name; select returns 0 on
+ * success, 1 if unknown or unsupported here. It applies to managers
+ * initialised afterwards */
+const char *sha256_mb_engine_name(void);
+int sha256_mb_engine_select(const char *name);
+
 #endif /* SHA256_H */
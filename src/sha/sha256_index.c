@@ -0,0 +1,396 @@
+/*********************************************************************
+ * Filename:   sha256_index.c
+ * Description: SHA-256 Merkle index. The whole tree is kept, one array
+ *              of nodes per level, so a change to a few ranges costs the
+ *              leaves under them plus one node per level for each, and
+ *              the tree is saved as a checksummed sidecar file that is
+ *              replaced atomically.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sha256_index.h"
+#include "thread_pool.h"
+#include "sha_internal.h"
+
+#define INDEX_HEADER_BYTES 40
+
+/* Leaf input per work item, as in the tree hash */
+#define INDEX_TASK_BYTES (1u << 20)
+
+static const BYTE index_magic[8] = { 'S', '2', '5', '6', 'M', 'I', 'D', 'X' };
+
+static BYTE *node_at(const SHA256_INDEX *idx, int level, size_t i)
+{
+    return idx->node + (idx->first[level] + i) * SHA256_BLOCK_SIZE;
+}
+
+/* Node counts and positions of every level for len bytes of data */
+static int layout(SHA256_INDEX *idx, size_t len)
+{
+    size_t leaf_size = idx->params.leaf_size, fanout = (size_t)idx->params.fanout;
+    size_t n = len == 0 ? 1 : len / leaf_size + (len % leaf_size != 0);
+    size_t total = 0;
+    int level = 0;
+
+    for (;;) {
+        if (level == SHA256_INDEX_MAX_LEVELS) return 1;
+        idx->count[level] = n;
+        idx->first[level] = total;
+        total += n;
+        level++;
+        if (n == 1) break;
+        n = n / fanout + (n % fanout != 0);
+    }
+    idx->levels = level;
+    idx->nodes = total;
+    idx->length = len;
+    return 0;
+}
+
+/* Node i of a level from its run of children; a run of one is carried
+ * up unchanged */
+static void hash_node(SHA256_INDEX *idx, int level, size_t i)
+{
+    size_t fanout = (size_t)idx->params.fanout, below = idx->count[level - 1];
+    size_t n = below - i * fanout < fanout ? below - i * fanout : fanout;
+    const BYTE *children = node_at(idx, level - 1, i * fanout);
+
+    if (n == 1)
+        memcpy(node_at(idx, level, i), children, SHA256_BLOCK_SIZE);
+    else
+        sha256_tree_node(children, (int)n, node_at(idx, level, i));
+}
+
+typedef struct {
+    SHA256_INDEX *idx;
+    const BYTE *data;
+    const size_t *which;        /* Leaves to hash, or NULL for all */
+    size_t n;
+    size_t per_task;
+} leaf_job;
+
+static void leaf_task(void *arg, size_t t)
+{
+    const leaf_job *j = arg;
+    size_t leaf_size = j->idx->params.leaf_size;
+    size_t first = t * j->per_task;
+    size_t last = first + j->per_task < j->n ? first + j->per_task : j->n;
+
+    for (size_t k = first; k < last; k++) {
+        size_t leaf = j->which != NULL ? j->which[k] : k;
+        size_t off = leaf * leaf_size;
+        size_t len = j->idx->length - off < leaf_size ? j->idx->length - off : leaf_size;
+
+        sha256_tree_leaf(j->data + off, len, node_at(j->idx, 0, leaf));
+    }
+}
+
+static void hash_leaves(SHA256_INDEX *idx, const BYTE *data, const size_t *which, size_t n)
+{
+    leaf_job j;
+
+    j.idx = idx;
+    j.data = data;
+    j.which = which;
+    j.n = n;
+    j.per_task = INDEX_TASK_BYTES / idx->params.leaf_size > 0 ?
+                 INDEX_TASK_BYTES / idx->params.leaf_size : 1;
+    thread_pool_run(idx->params.threads, (n + j.per_task - 1) / j.per_task, leaf_task, &j);
+}
+
+int sha256_index_build(SHA256_INDEX *idx, const BYTE data[], size_t len,
+                       const SHA256_TREE_PARAMS *params)
+{
+    SHA256_TREE_PARAMS p = { 0, 0, 0 };
+
+    if (params != NULL) p = *params;
+    if (p.leaf_size == 0) p.leaf_size = SHA256_TREE_LEAF_DEFAULT;
+    if (p.fanout == 0) p.fanout = SHA256_TREE_FANOUT_DEFAULT;
+    if (p.threads <= 0) p.threads = thread_pool_cpus();
+    if (p.fanout < 2 || p.fanout > SHA256_TREE_FANOUT_MAX) return 1;
+
+    idx->params = p;
+    idx->node = NULL;
+    if (layout(idx, len) != 0) return 1;
+    idx->node = malloc(idx->nodes * SHA256_BLOCK_SIZE);
+    if (idx->node == NULL) return 1;
+
+    hash_leaves(idx, data, NULL, idx->count[0]);
+    for (int level = 1; level < idx->levels; level++)
+        for (size_t i = 0; i < idx->count[level]; i++)
+            hash_node(idx, level, i);
+    return 0;
+}
+
+/* Lay the index out for a new length, keeping the nodes both layouts
+ * have; those that changed are under the dirty last leaf */
+static int resize(SHA256_INDEX *idx, size_t len)
+{
+    SHA256_INDEX old = *idx;
+
+    if (layout(idx, len) != 0 || (idx->node = malloc(idx->nodes * SHA256_BLOCK_SIZE)) == NULL) {
+        *idx = old;
+        return 1;
+    }
+    for (int level = 0; level < idx->levels && level < old.levels; level++) {
+        size_t n = idx->count[level] < old.count[level] ? idx->count[level] : old.count[level];
+
+        memcpy(node_at(idx, level, 0), node_at(&old, level, 0), n * SHA256_BLOCK_SIZE);
+    }
+    free(old.node);
+    return 0;
+}
+
+typedef struct {
+    size_t first, last;
+} leaf_span;
+
+static int span_order(const void *a, const void *b)
+{
+    size_t fa = ((const leaf_span *)a)->first, fb = ((const leaf_span *)b)->first;
+
+    return fa < fb ? -1 : fa > fb ? 1 : 0;
+}
+
+int sha256_index_update(SHA256_INDEX *idx, const BYTE data[], size_t len,
+                        const SHA256_RANGE dirty[], size_t ndirty)
+{
+    size_t leaf_size = idx->params.leaf_size, fanout = (size_t)idx->params.fanout;
+    size_t old_len = idx->length, nspans = 0, m = 0, nleaves = 0, *list;
+    leaf_span *spans;
+
+    if (len != old_len && resize(idx, len) != 0) return 1;
+
+    /* Dirty ranges as sorted, disjoint spans of leaves */
+    spans = malloc((ndirty + 1) * sizeof(*spans));
+    if (spans == NULL) return 1;
+    for (size_t r = 0; r < ndirty; r++) {
+        size_t off = dirty[r].offset;
+
+        if (dirty[r].length == 0 || off >= len) continue;
+        spans[nspans].first = off / leaf_size;
+        spans[nspans].last = (dirty[r].length > len - off ? len - 1 : off + dirty[r].length - 1) / leaf_size;
+        nspans++;
+    }
+    /* A new length changes the last leaf and every node on its path */
+    if (len != old_len) {
+        size_t common = len < old_len ? len : old_len;
+
+        spans[nspans].first = (common > 0 ? common - 1 : 0) / leaf_size;
+        spans[nspans].last = idx->count[0] - 1;
+        nspans++;
+    }
+    qsort(spans, nspans, sizeof(*spans), span_order);
+    for (size_t s = 0; s < nspans; s++) {
+        if (m > 0 && spans[s].first <= spans[m - 1].last + 1) {
+            if (spans[s].last > spans[m - 1].last) spans[m - 1].last = spans[s].last;
+        } else {
+            spans[m++] = spans[s];
+        }
+    }
+    for (size_t s = 0; s < m; s++)
+        nleaves += spans[s].last - spans[s].first + 1;
+
+    list = malloc((nleaves > 0 ? nleaves : 1) * sizeof(*list));
+    if (list == NULL) {
+        free(spans);
+        return 1;
+    }
+    for (size_t s = 0, k = 0; s < m; s++)
+        for (size_t leaf = spans[s].first; leaf <= spans[s].last; leaf++)
+            list[k++] = leaf;
+    free(spans);
+
+    hash_leaves(idx, data, list, nleaves);
+
+    /* Each level's dirty nodes are the parents of the level below's,
+     * still in order, so duplicates are neighbours */
+    for (int level = 1; level < idx->levels; level++) {
+        m = 0;
+        for (size_t k = 0; k < nleaves; k++) {
+            size_t parent = list[k] / fanout;
+
+            if (m > 0 && list[m - 1] == parent) continue;
+            list[m++] = parent;
+            hash_node(idx, level, parent);
+        }
+        nleaves = m;
+    }
+    free(list);
+    return 0;
+}
+
+/* Map a file read-only; an empty one gives data NULL */
+static int map_file(const char *path, const BYTE **data, size_t *len)
+{
+    struct stat sb;
+    void *p;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return 1;
+    if (fstat(fd, &sb) != 0 || (unsigned long long)sb.st_size > SIZE_MAX) {
+        close(fd);
+        return 1;
+    }
+    *len = (size_t)sb.st_size;
+    *data = NULL;
+    if (*len > 0) {
+        p = mmap(NULL, *len, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            return 1;
+        }
+        *data = p;
+    }
+    close(fd);
+    return 0;
+}
+
+int sha256_index_build_file(SHA256_INDEX *idx, const char *path,
+                            const SHA256_TREE_PARAMS *params)
+{
+    const BYTE *data;
+    size_t len;
+    int failed;
+
+    if (map_file(path, &data, &len) != 0) return 1;
+    failed = sha256_index_build(idx, data, len, params);
+    if (data != NULL) munmap((void *)data, len);
+    return failed;
+}
+
+int sha256_index_update_file(SHA256_INDEX *idx, const char *path,
+                             const SHA256_RANGE dirty[], size_t ndirty)
+{
+    const BYTE *data;
+    size_t len;
+    int failed;
+
+    if (map_file(path, &data, &len) != 0) return 1;
+    failed = sha256_index_update(idx, data, len, dirty, ndirty);
+    if (data != NULL) munmap((void *)data, len);
+    return failed;
+}
+
+void sha256_index_root(const SHA256_INDEX *idx, BYTE root[SHA256_BLOCK_SIZE])
+{
+    memcpy(root, node_at(idx, idx->levels - 1, 0), SHA256_BLOCK_SIZE);
+}
+
+static void put_le(BYTE *p, unsigned long long v, int n)
+{
+    for (int i = 0; i < n; i++)
+        p[i] = (BYTE)(v >> (8 * i));
+}
+
+static unsigned long long get_le(const BYTE *p, int n)
+{
+    unsigned long long v = 0;
+
+    for (int i = n - 1; i >= 0; i--)
+        v = v << 8 | p[i];
+    return v;
+}
+
+static int read_all(int fd, BYTE *p, size_t n, off_t off)
+{
+    while (n > 0) {
+        ssize_t r = pread(fd, p, n, off);
+
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return 1;
+        p += r;
+        n -= (size_t)r;
+        off += r;
+    }
+    return 0;
+}
+
+static void index_checksum(const BYTE *header, const SHA256_INDEX *idx, BYTE sum[SHA256_BLOCK_SIZE])
+{
+    SHA256_CTX ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, header, INDEX_HEADER_BYTES);
+    sha256_update(&ctx, idx->node, idx->nodes * SHA256_BLOCK_SIZE);
+    sha256_final(&ctx, sum);
+}
+
+int sha256_index_save(const SHA256_INDEX *idx, const char *path)
+{
+    BYTE header[INDEX_HEADER_BYTES], sum[SHA256_BLOCK_SIZE];
+    const void *part[3] = { header, idx->node, sum };
+    size_t len[3] = { sizeof(header), idx->nodes * SHA256_BLOCK_SIZE, sizeof(sum) };
+
+    memcpy(header, index_magic, 8);
+    put_le(header + 8, SHA256_INDEX_VERSION, 4);
+    put_le(header + 12, (unsigned long long)idx->params.fanout, 4);
+    put_le(header + 16, idx->params.leaf_size, 8);
+    put_le(header + 24, idx->length, 8);
+    put_le(header + 32, idx->nodes, 8);
+    index_checksum(header, idx, sum);
+
+    return sha_file_replace(path, part, len, 3);
+}
+
+int sha256_index_load(SHA256_INDEX *idx, const char *path)
+{
+    BYTE header[INDEX_HEADER_BYTES], sum[SHA256_BLOCK_SIZE], want[SHA256_BLOCK_SIZE];
+    unsigned long long fanout, leaf_size, length;
+    struct stat sb;
+    int fd = open(path, O_RDONLY);
+
+    idx->node = NULL;
+    if (fd < 0) return 1;
+    if (fstat(fd, &sb) != 0 || read_all(fd, header, sizeof(header), 0) != 0) goto fail;
+
+    fanout = get_le(header + 12, 4);
+    leaf_size = get_le(header + 16, 8);
+    length = get_le(header + 24, 8);
+    if (memcmp(header, index_magic, 8) != 0 || get_le(header + 8, 4) != SHA256_INDEX_VERSION ||
+        fanout < 2 || fanout > SHA256_TREE_FANOUT_MAX ||
+        leaf_size == 0 || leaf_size > SIZE_MAX || length > SIZE_MAX)
+        goto fail;
+
+    idx->params.leaf_size = (size_t)leaf_size;
+    idx->params.fanout = (int)fanout;
+    idx->params.threads = thread_pool_cpus();
+    /* The node count follows from the rest, and so does the file size */
+    if (layout(idx, (size_t)length) != 0 || get_le(header + 32, 8) != idx->nodes ||
+        idx->nodes > (SIZE_MAX - sizeof(header) - sizeof(sum)) / SHA256_BLOCK_SIZE ||
+        (unsigned long long)sb.st_size != sizeof(header) + idx->nodes * SHA256_BLOCK_SIZE + sizeof(sum))
+        goto fail;
+
+    idx->node = malloc(idx->nodes * SHA256_BLOCK_SIZE);
+    if (idx->node == NULL ||
+        read_all(fd, idx->node, idx->nodes * SHA256_BLOCK_SIZE, sizeof(header)) != 0 ||
+        read_all(fd, sum, sizeof(sum), (off_t)(sizeof(header) + idx->nodes * SHA256_BLOCK_SIZE)) != 0)
+        goto fail;
+    index_checksum(header, idx, want);
+    if (memcmp(sum, want, sizeof(sum)) != 0) goto fail;
+
+    close(fd);
+    return 0;
+
+fail:
+    free(idx->node);
+    idx->node = NULL;
+    close(fd);
+    return 1;
+}
+
+void sha256_index_free(SHA256_INDEX *idx)
+{
+    free(idx->node);
+    idx->node = NULL;
+}
@@ -0,0 +1,85 @@
+/*********************************************************************
+ * Filename:   sha256_index.h
+ * Description: Public API for the SHA-256 Merkle index: every node of a
+ *              sha256_tree.h tree kept in memory and in a sidecar file,
+ *              so that after a few ranges of the data change only their
+ *              leaves and the paths above them are hashed again.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#ifndef SHA256_INDEX_H
+#define SHA256_INDEX_H
+
+#include <stddef.h>
+#include "sha256.h"
+#include "sha256_tree.h"
+
+#define SHA256_INDEX_MAX_LEVELS 64
+
+/*
+ * Sidecar file, all integers little-endian
+ *   0   magic "S256MIDX"
+ *   8   version (1), 4 bytes
+ *   12  fanout, 4 bytes
+ *   16  leaf size, 8 bytes
+ *   24  data length, 8 bytes
+ *   32  node count, 8 bytes
+ *   40  nodes, 32 bytes each: the leaves, then each level above in
+ *       turn, the root last
+ *   end SHA-256 of everything before it
+ * It is written to "<path>.tmp", synced and renamed over <path>, so a
+ * reader sees the old index or the new one, never a mix.
+ */
+#define SHA256_INDEX_VERSION 1
+
+typedef struct {
+    size_t offset;
+    size_t length;
+} SHA256_RANGE;
+
+typedef struct {
+    SHA256_TREE_PARAMS params;                    /* With the defaults filled in */
+    size_t length;                                /* Bytes of data covered */
+    int levels;                                   /* Level 0 is the leaves */
+    size_t count[SHA256_INDEX_MAX_LEVELS];        /* Nodes on each level */
+    size_t first[SHA256_INDEX_MAX_LEVELS];        /* Index of its first node */
+    size_t nodes;                                 /* Nodes on all levels */
+    BYTE *node;                                   /* nodes * 32 bytes */
+} SHA256_INDEX;
+
+/* Hash data into a new index; params as for sha256_tree_init. The root
+ * equals sha256_tree_hash of the same data. Returns 0 on success, 1 for
+ * invalid parameters or if memory runs out */
+int sha256_index_build(SHA256_INDEX *idx, const BYTE data[], size_t len,
+                       const SHA256_TREE_PARAMS *params);
+
+/* Bring the index up to date with data, the whole current contents, of
+ * which only the given ranges changed since the index was last built or
+ * updated. Only the leaves touching them are read. A change of length
+ * needs no range of its own. Returns 0 on success, 1 if memory runs out
+ * (the index must then be built again) */
+int sha256_index_update(SHA256_INDEX *idx, const BYTE data[], size_t len,
+                        const SHA256_RANGE dirty[], size_t ndirty);
+
+/* The same over a file, mapped rather than read, so an update touches
+ * only the dirty leaves' pages. Return 0 on success, 1 on I/O errors */
+int sha256_index_build_file(SHA256_INDEX *idx, const char *path,
+                            const SHA256_TREE_PARAMS *params);
+int sha256_index_update_file(SHA256_INDEX *idx, const char *path,
+                             const SHA256_RANGE dirty[], size_t ndirty);
+
+void sha256_index_root(const SHA256_INDEX *idx, BYTE root[SHA256_BLOCK_SIZE]);
+
+/* Write the sidecar atomically; returns 0 on success, 1 on I/O errors */
+int sha256_index_save(const SHA256_INDEX *idx, const char *path);
+
+/* Read a sidecar into a new index, hashing with one thread per CPU.
+ * Returns 0 on success, 1 if the file is missing, malformed, of another
+ * version or fails its checksum */
+int sha256_index_load(SHA256_INDEX *idx, const char *path);
+
+void sha256_index_free(SHA256_INDEX *idx);
+
+#endif /* SHA256_INDEX_H */
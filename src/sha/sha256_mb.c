@@ -0,0 +1,123 @@
+/*********************************************************************
+ * Filename:   sha256_mb.c
+ * Description: Multi-buffer SHA-256: kernel selection, and the job
+ *              manager of sha_mb_mgr.h instantiated for 8 state
+ *              words and up to 16 lanes.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_features.h"
+#include "sha256.h"
+#include "sha_internal.h"
+
+static const WORD iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/* One lane through whichever single-buffer kernel is selected */
+static void x1_blocks(uint32_t *state, const unsigned char *const *data, size_t nblocks)
+{
+    sha256_engine_get()->blocks(state, data[0], nblocks);
+}
+
+static void x1_rounds(uint32_t *state, const uint32_t *wk)
+{
+    sha256_engine_get()->rounds(state, wk);
+}
+
+const sha_mb_engine sha256_mb_engine_x1 = {
+    "x1",
+    1,
+    x1_blocks,
+    x1_rounds,
+};
+
+/* Fastest first; each is usable only if the CPU has what it needs */
+static const sha_mb_engine* const engines[] = {
+    &sha256_mb_engine_avx512,
+    &sha256_mb_engine_avx2,
+    &sha256_mb_engine_x1,
+};
+
+static int engine_usable(const sha_mb_engine* e)
+{
+    const cpu_features* f = cpu_get_features();
+
+    if (e == &sha256_mb_engine_avx512) return f->avx512f;
+    if (e == &sha256_mb_engine_avx2) return f->avx2;
+    return 1;
+}
+
+/* One lane on the SHA extensions outruns eight AVX2 lanes, so AVX2 is
+ * only picked by default on CPUs without them */
+static int engine_preferred(const sha_mb_engine* e)
+{
+    return engine_usable(e) && (e != &sha256_mb_engine_avx2 || !sha_shani_usable());
+}
+
+static const sha_mb_engine* selected_engine = NULL;
+
+const sha_mb_engine* sha256_mb_engine_get(void)
+{
+    const sha_mb_engine* e = __atomic_load_n(&selected_engine, __ATOMIC_ACQUIRE);
+
+    if (e == NULL) {
+        for (size_t n = 0; n < sizeof(engines) / sizeof(engines[0]); n++) {
+            e = engines[n];
+            if (engine_preferred(e)) break;
+        }
+        __atomic_store_n(&selected_engine, e, __ATOMIC_RELEASE);
+    }
+    return e;
+}
+
+const char *sha256_mb_engine_name(void)
+{
+    return sha256_mb_engine_get()->name;
+}
+
+int sha256_mb_engine_select(const char *name)
+{
+    for (size_t n = 0; n < sizeof(engines) / sizeof(engines[0]); n++) {
+        if (strcmp(name, engines[n]->name) == 0 && engine_usable(engines[n])) {
+            __atomic_store_n(&selected_engine, engines[n], __ATOMIC_RELEASE);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const sha_mb_engine* sha256_mb_pass_engine(const sha_mb_engine* e, size_t left)
+{
+    return left * 2 <= (size_t)e->lanes && sha_shani_usable() ? &sha256_mb_engine_x1 : e;
+}
+
+#define MB_WORDS        8
+#define MB_DIGEST_SIZE  SHA256_BLOCK_SIZE
+#define MB_MAX_LANES    SHA256_MAX_LANES
+#define MB_MGR          SHA256_MGR
+#define MB_JOB          SHA256_JOB
+#define MB_CTX          SHA256_CTX
+#define MB_IV           iv
+#define MB_ENGINE_GET   sha256_mb_engine_get
+#define MB_FN(x)        sha256_##x
+#include "sha_mb_mgr.h"
+
+void sha256_hash_batch_from(SHA256_JOB jobs[], size_t njobs, const SHA256_CTX *prefix)
+{
+    SHA256_MGR mgr;
+
+    sha256_mgr_init_from(&mgr, prefix);
+    batch_run(&mgr, jobs, njobs);
+}
+
+void sha256_hash_batch(SHA256_JOB jobs[], size_t njobs)
+{
+    sha256_hash_batch_from(jobs, njobs, NULL);
+}
@@ -0,0 +1,262 @@
+/*********************************************************************
+ * Filename:   sha256_mb_simd.c
+ * Description: Multi-buffer SHA-256 kernels: 8 independent messages
+ *              per pass in AVX2 registers, 16 in AVX-512 registers.
+ *              Each state and schedule word is one vector across the
+ *              messages (message l in lane l), so the rounds are plain
+ *              vertical SIMD; the message blocks are transposed into
+ *              that layout as they are loaded.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include "sha_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include "sha_mb_simd.h"
+
+/* Compiled for the extension regardless of -march; only reached after CPUID */
+#define AVX2_FN __attribute__((target("avx2")))
+#define AVX512_FN __attribute__((target("avx512f")))
+
+static const uint32_t k256[64] = {
+    0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+    0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+    0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+    0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+    0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+    0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+    0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+    0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+/*
+ * The round and schedule are written once against a small set of
+ * vector operations; P selects the avx2_ or avx512_ versions. The
+ * round takes K + W for all lanes as one vector, kw.
+ */
+#define MB_ROUND(P, a,b,c,d,e,f,g,h, kw) do {                                     \
+        t1 = P##_add(P##_add(h, P##_ep1(e)), P##_add(P##_ch(e,f,g), kw));           \
+        d = P##_add(d, t1);                                                         \
+        h = P##_add(t1, P##_add(P##_ep0(a), P##_maj(a,b,c)));                       \
+    } while (0)
+
+#define MB_SCHED(P, i) P##_add(P##_set1(k256[i]),                                   \
+        (m[(i) & 15] = P##_add(P##_add(m[(i) & 15], P##_sig0(m[((i) - 15) & 15])),  \
+                               P##_add(m[((i) - 7) & 15], P##_sig1(m[((i) - 2) & 15])))))
+#define MB_LOADED(P, i) P##_add(P##_set1(k256[i]), m[i])
+
+/* A block known in advance: one word of wk[] for every lane */
+#define MB_PRESET(P, i) P##_set1(wk[i])
+
+#define MB_ROUNDS8(P, i, W) do {                                                    \
+        MB_ROUND(P, a,b,c,d,e,f,g,h, W(P, (i) + 0));                                \
+        MB_ROUND(P, h,a,b,c,d,e,f,g, W(P, (i) + 1));                                \
+        MB_ROUND(P, g,h,a,b,c,d,e,f, W(P, (i) + 2));                                \
+        MB_ROUND(P, f,g,h,a,b,c,d,e, W(P, (i) + 3));                                \
+        MB_ROUND(P, e,f,g,h,a,b,c,d, W(P, (i) + 4));                                \
+        MB_ROUND(P, d,e,f,g,h,a,b,c, W(P, (i) + 5));                                \
+        MB_ROUND(P, c,d,e,f,g,h,a,b, W(P, (i) + 6));                                \
+        MB_ROUND(P, b,c,d,e,f,g,h,a, W(P, (i) + 7));                                \
+    } while (0)
+
+/* All 64 rounds, the first 16 on words W0 and the rest on W, added
+ * into s[] */
+#define MB_COMPRESS(P, V, W0, W) do {                                               \
+        V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7], t1; \
+                                                                                    \
+        MB_ROUNDS8(P, 0, W0);                                                       \
+        MB_ROUNDS8(P, 8, W0);                                                       \
+        for (int i = 16; i < 64; i += 8)                                            \
+            MB_ROUNDS8(P, i, W);                                                    \
+                                                                                    \
+        s[0] = P##_add(s[0], a); s[1] = P##_add(s[1], b);                           \
+        s[2] = P##_add(s[2], c); s[3] = P##_add(s[3], d);                           \
+        s[4] = P##_add(s[4], e); s[5] = P##_add(s[5], f);                           \
+        s[6] = P##_add(s[6], g); s[7] = P##_add(s[7], h);                           \
+    } while (0)
+
+/* ---------------- AVX2, 8 lanes ---------------- */
+
+static AVX2_FN inline __m256i avx2_add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+static AVX2_FN inline __m256i avx2_set1(uint32_t x) { return _mm256_set1_epi32((int)x); }
+
+static AVX2_FN inline __m256i avx2_ror(__m256i x, int n)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+static AVX2_FN inline __m256i avx2_xor3(__m256i x, __m256i y, __m256i z)
+{
+    return _mm256_xor_si256(_mm256_xor_si256(x, y), z);
+}
+
+static AVX2_FN inline __m256i avx2_ch(__m256i e, __m256i f, __m256i g)
+{
+    return _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+}
+
+static AVX2_FN inline __m256i avx2_maj(__m256i a, __m256i b, __m256i c)
+{
+    return _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+}
+
+static AVX2_FN inline __m256i avx2_ep0(__m256i x) { return avx2_xor3(avx2_ror(x, 2), avx2_ror(x, 13), avx2_ror(x, 22)); }
+static AVX2_FN inline __m256i avx2_ep1(__m256i x) { return avx2_xor3(avx2_ror(x, 6), avx2_ror(x, 11), avx2_ror(x, 25)); }
+static AVX2_FN inline __m256i avx2_sig0(__m256i x) { return avx2_xor3(avx2_ror(x, 7), avx2_ror(x, 18), _mm256_srli_epi32(x, 3)); }
+static AVX2_FN inline __m256i avx2_sig1(__m256i x) { return avx2_xor3(avx2_ror(x, 17), avx2_ror(x, 19), _mm256_srli_epi32(x, 10)); }
+
+static AVX2_FN void sha256_avx2_blocks(uint32_t* state, const unsigned char* const* data, size_t nblocks)
+{
+    __m256i s[8], m[16];
+
+    for (int w = 0; w < 8; w++)
+        s[w] = _mm256_loadu_si256((const __m256i*)(state + 8 * w));
+
+    for (size_t off = 0; off < 64 * nblocks; off += 64) {
+        avx2_load_blocks8(m, data, off);
+
+        MB_COMPRESS(avx2, __m256i, MB_LOADED, MB_SCHED);
+    }
+
+    for (int w = 0; w < 8; w++)
+        _mm256_storeu_si256((__m256i*)(state + 8 * w), s[w]);
+}
+
+static AVX2_FN void sha256_avx2_rounds(uint32_t* state, const uint32_t* wk)
+{
+    __m256i s[8];
+
+    for (int w = 0; w < 8; w++)
+        s[w] = _mm256_loadu_si256((const __m256i*)(state + 8 * w));
+    MB_COMPRESS(avx2, __m256i, MB_PRESET, MB_PRESET);
+    for (int w = 0; w < 8; w++)
+        _mm256_storeu_si256((__m256i*)(state + 8 * w), s[w]);
+}
+
+/* ---------------- AVX-512, 16 lanes ---------------- */
+
+/* Three-input logic in one instruction: 0x96 is x ^ y ^ z, 0xca is
+ * x ? y : z and 0xe8 the majority */
+static AVX512_FN inline __m512i avx512_add(__m512i x, __m512i y) { return _mm512_add_epi32(x, y); }
+static AVX512_FN inline __m512i avx512_set1(uint32_t x) { return _mm512_set1_epi32((int)x); }
+static AVX512_FN inline __m512i avx512_xor3(__m512i x, __m512i y, __m512i z) { return _mm512_ternarylogic_epi32(x, y, z, 0x96); }
+static AVX512_FN inline __m512i avx512_ch(__m512i e, __m512i f, __m512i g) { return _mm512_ternarylogic_epi32(e, f, g, 0xca); }
+static AVX512_FN inline __m512i avx512_maj(__m512i a, __m512i b, __m512i c) { return _mm512_ternarylogic_epi32(a, b, c, 0xe8); }
+
+static AVX512_FN inline __m512i avx512_ep0(__m512i x)
+{
+    return avx512_xor3(_mm512_ror_epi32(x, 2), _mm512_ror_epi32(x, 13), _mm512_ror_epi32(x, 22));
+}
+
+static AVX512_FN inline __m512i avx512_ep1(__m512i x)
+{
+    return avx512_xor3(_mm512_ror_epi32(x, 6), _mm512_ror_epi32(x, 11), _mm512_ror_epi32(x, 25));
+}
+
+static AVX512_FN inline __m512i avx512_sig0(__m512i x)
+{
+    return avx512_xor3(_mm512_ror_epi32(x, 7), _mm512_ror_epi32(x, 18), _mm512_srli_epi32(x, 3));
+}
+
+static AVX512_FN inline __m512i avx512_sig1(__m512i x)
+{
+    return avx512_xor3(_mm512_ror_epi32(x, 17), _mm512_ror_epi32(x, 19), _mm512_srli_epi32(x, 10));
+}
+
+/* Byte swap of each word without AVX512BW: the rotations by 8 each put
+ * two of the four bytes in place */
+static AVX512_FN inline __m512i avx512_bswap(__m512i x)
+{
+    return _mm512_ternarylogic_epi32(_mm512_set1_epi32((int)0xff00ff00), _mm512_ror_epi32(x, 8),
+                                     _mm512_rol_epi32(x, 8), 0xca);
+}
+
+/* r[l] holds the whole block of lane l; afterwards r[w] holds word w of
+ * all sixteen lanes */
+static AVX512_FN inline void avx512_transpose16(__m512i* r)
+{
+    __m512i t[16], u[16];
+
+    /* Within each 128-bit quarter, as for AVX2 */
+    for (int i = 0; i < 16; i += 2) {
+        t[i] = _mm512_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm512_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 16; i += 4) {
+        u[i] = _mm512_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm512_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm512_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm512_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+
+    /* u[4g + j] quarter q is word 4q + j of lanes 4g..4g+3; a 4x4
+     * transpose of quarters gathers each word's four lane groups */
+    for (int j = 0; j < 4; j++) {
+        __m512i v0 = _mm512_shuffle_i32x4(u[j], u[4 + j], 0x44);
+        __m512i v1 = _mm512_shuffle_i32x4(u[j], u[4 + j], 0xee);
+        __m512i v2 = _mm512_shuffle_i32x4(u[8 + j], u[12 + j], 0x44);
+        __m512i v3 = _mm512_shuffle_i32x4(u[8 + j], u[12 + j], 0xee);
+
+        r[j] = _mm512_shuffle_i32x4(v0, v2, 0x88);
+        r[4 + j] = _mm512_shuffle_i32x4(v0, v2, 0xdd);
+        r[8 + j] = _mm512_shuffle_i32x4(v1, v3, 0x88);
+        r[12 + j] = _mm512_shuffle_i32x4(v1, v3, 0xdd);
+    }
+}
+
+static AVX512_FN void sha256_avx512_blocks(uint32_t* state, const unsigned char* const* data, size_t nblocks)
+{
+    __m512i s[8], m[16];
+
+    for (int w = 0; w < 8; w++)
+        s[w] = _mm512_loadu_si512(state + 16 * w);
+
+    for (size_t off = 0; off < 64 * nblocks; off += 64) {
+        for (int l = 0; l < 16; l++)
+            m[l] = _mm512_loadu_si512(data[l] + off);
+        avx512_transpose16(m);
+        for (int w = 0; w < 16; w++)
+            m[w] = avx512_bswap(m[w]);
+
+        MB_COMPRESS(avx512, __m512i, MB_LOADED, MB_SCHED);
+    }
+
+    for (int w = 0; w < 8; w++)
+        _mm512_storeu_si512(state + 16 * w, s[w]);
+}
+
+static AVX512_FN void sha256_avx512_rounds(uint32_t* state, const uint32_t* wk)
+{
+    __m512i s[8];
+
+    for (int w = 0; w < 8; w++)
+        s[w] = _mm512_loadu_si512(state + 16 * w);
+    MB_COMPRESS(avx512, __m512i, MB_PRESET, MB_PRESET);
+    for (int w = 0; w < 8; w++)
+        _mm512_storeu_si512(state + 16 * w, s[w]);
+}
+
+const sha_mb_engine sha256_mb_engine_avx2 = {
+    "avx2",
+    8,
+    sha256_avx2_blocks,
+    sha256_avx2_rounds,
+};
+
+const sha_mb_engine sha256_mb_engine_avx512 = {
+    "avx512",
+    16,
+    sha256_avx512_blocks,
+    sha256_avx512_rounds,
+};
+
+#else
+
+/* Never selected: cpu_get_features() reports no SIMD off x86 */
+const sha_mb_engine sha256_mb_engine_avx2 = { "avx2", 8, NULL, NULL };
+const sha_mb_engine sha256_mb_engine_avx512 = { "avx512", 16, NULL, NULL };
+
+#endif
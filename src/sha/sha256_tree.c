@@ -0,0 +1,228 @@
+/*********************************************************************
+ * Filename:   sha256_tree.c
+ * Description: SHA-256 tree-hash (Merkle) mode. Whole leaves are hashed
+ *              straight from the caller's buffer on the thread pool,
+ *              a round of leaves at a time; their hashes are folded
+ *              into the levels above as they arrive, so memory stays
+ *              at fanout nodes per level however large the input.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "sha256_tree.h"
+#include "thread_pool.h"
+
+/* Enough for fanout 2 and 2^63 leaves */
+#define TREE_MAX_LEVELS 64
+
+/* Input hashed per parallel round, and per work item within it */
+#define TREE_ROUND_BYTES (64u << 20)
+#define TREE_TASK_BYTES  (1u << 20)
+#define TREE_ROUND_MAX   16384
+
+static const BYTE leaf_tag = 0x00, node_tag = 0x01;
+
+static void leaf_start(SHA256_CTX *ctx)
+{
+    sha256_init(ctx);
+    sha256_update(ctx, &leaf_tag, 1);
+}
+
+void sha256_tree_leaf(const BYTE data[], size_t len, BYTE out[SHA256_BLOCK_SIZE])
+{
+    SHA256_CTX ctx;
+
+    leaf_start(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, out);
+}
+
+void sha256_tree_node(const BYTE children[], int n, BYTE out[SHA256_BLOCK_SIZE])
+{
+    SHA256_CTX ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, &node_tag, 1);
+    sha256_update(&ctx, children, (size_t)n * SHA256_BLOCK_SIZE);
+    sha256_final(&ctx, out);
+}
+
+/* Append a node to a level; a level that fills up is hashed into one
+ * node of the level above */
+static void push_node(SHA256_TREE *t, int level, const BYTE node[SHA256_BLOCK_SIZE])
+{
+    BYTE parent[SHA256_BLOCK_SIZE];
+    int fanout = t->params.fanout;
+
+    for (;;) {
+        BYTE *slots = t->levels + (size_t)level * fanout * SHA256_BLOCK_SIZE;
+
+        memcpy(slots + (size_t)t->pending[level] * SHA256_BLOCK_SIZE, node, SHA256_BLOCK_SIZE);
+        if (level > t->top) t->top = level;
+        if (++t->pending[level] < fanout) return;
+
+        sha256_tree_node(slots, fanout, parent);
+        t->pending[level] = 0;
+        node = parent;
+        level++;
+    }
+}
+
+int sha256_tree_init(SHA256_TREE *tree, const SHA256_TREE_PARAMS *params)
+{
+    SHA256_TREE_PARAMS p = { 0, 0, 0 };
+    size_t level_bytes, round;
+
+    if (params != NULL) p = *params;
+    if (p.leaf_size == 0) p.leaf_size = SHA256_TREE_LEAF_DEFAULT;
+    if (p.fanout == 0) p.fanout = SHA256_TREE_FANOUT_DEFAULT;
+    if (p.threads <= 0) p.threads = thread_pool_cpus();
+    if (p.fanout < 2 || p.fanout > SHA256_TREE_FANOUT_MAX) return 1;
+
+    round = TREE_ROUND_BYTES / p.leaf_size;
+    if (round < 1) round = 1;
+    if (round > TREE_ROUND_MAX) round = TREE_ROUND_MAX;
+
+    /* Levels, pending counts and the round's leaf hashes in one block */
+    level_bytes = (size_t)TREE_MAX_LEVELS * p.fanout * SHA256_BLOCK_SIZE;
+    tree->levels = malloc(level_bytes + round * SHA256_BLOCK_SIZE +
+                          TREE_MAX_LEVELS * sizeof(int));
+    if (tree->levels == NULL) return 1;
+    tree->batch = tree->levels + level_bytes;
+    tree->pending = (int *)(tree->batch + round * SHA256_BLOCK_SIZE);
+    memset(tree->pending, 0, TREE_MAX_LEVELS * sizeof(int));
+
+    tree->params = p;
+    tree->batch_leaves = round;
+    tree->leaf_fill = 0;
+    tree->leaves = 0;
+    tree->top = 0;
+    return 0;
+}
+
+typedef struct {
+    const BYTE *data;
+    size_t leaf_size;
+    size_t nleaves;
+    size_t per_task;
+    BYTE *out;
+} leaf_job;
+
+static void leaf_task(void *arg, size_t i)
+{
+    const leaf_job *j = arg;
+    size_t first = i * j->per_task;
+    size_t last = first + j->per_task < j->nleaves ? first + j->per_task : j->nleaves;
+
+    for (size_t k = first; k < last; k++)
+        sha256_tree_leaf(j->data + k * j->leaf_size, j->leaf_size, j->out + k * SHA256_BLOCK_SIZE);
+}
+
+/* Hash nleaves whole leaves at data on the pool, then fold them in */
+static void hash_leaves(SHA256_TREE *t, const BYTE *data, size_t nleaves)
+{
+    leaf_job j;
+    size_t ntasks;
+
+    j.data = data;
+    j.leaf_size = t->params.leaf_size;
+    j.nleaves = nleaves;
+    j.per_task = TREE_TASK_BYTES / j.leaf_size > 0 ? TREE_TASK_BYTES / j.leaf_size : 1;
+    j.out = t->batch;
+    ntasks = (nleaves + j.per_task - 1) / j.per_task;
+
+    thread_pool_run(t->params.threads, ntasks, leaf_task, &j);
+
+    for (size_t k = 0; k < nleaves; k++)
+        push_node(t, 0, t->batch + k * SHA256_BLOCK_SIZE);
+    t->leaves += nleaves;
+}
+
+static void leaf_finish(SHA256_TREE *t)
+{
+    BYTE node[SHA256_BLOCK_SIZE];
+
+    sha256_final(&t->leaf, node);
+    push_node(t, 0, node);
+    t->leaves++;
+    t->leaf_fill = 0;
+}
+
+void sha256_tree_update(SHA256_TREE *tree, const BYTE data[], size_t len)
+{
+    size_t leaf_size = tree->params.leaf_size;
+
+    /* Complete the leaf left open by the previous call */
+    if (tree->leaf_fill > 0) {
+        size_t n = leaf_size - tree->leaf_fill < len ? leaf_size - tree->leaf_fill : len;
+
+        sha256_update(&tree->leaf, data, n);
+        tree->leaf_fill += n;
+        data += n;
+        len -= n;
+        if (tree->leaf_fill < leaf_size) return;
+        leaf_finish(tree);
+    }
+
+    while (len >= leaf_size) {
+        size_t n = len / leaf_size < tree->batch_leaves ? len / leaf_size : tree->batch_leaves;
+
+        hash_leaves(tree, data, n);
+        data += n * leaf_size;
+        len -= n * leaf_size;
+    }
+
+    if (len > 0) {
+        leaf_start(&tree->leaf);
+        sha256_update(&tree->leaf, data, len);
+        tree->leaf_fill = len;
+    }
+}
+
+void sha256_tree_final(SHA256_TREE *tree, BYTE root[SHA256_BLOCK_SIZE])
+{
+    int fanout = tree->params.fanout;
+
+    if (tree->leaf_fill > 0) {
+        leaf_finish(tree);
+    } else if (tree->leaves == 0) {
+        leaf_start(&tree->leaf);
+        leaf_finish(tree);
+    }
+
+    /* Close the short last run of every level, bottom up */
+    for (int level = 0; ; level++) {
+        BYTE *slots = tree->levels + (size_t)level * fanout * SHA256_BLOCK_SIZE;
+        BYTE node[SHA256_BLOCK_SIZE];
+        int n = tree->pending[level];
+
+        if (level == tree->top && n == 1) {
+            memcpy(root, slots, SHA256_BLOCK_SIZE);
+            break;
+        }
+        tree->pending[level] = 0;
+        if (n == 1) {
+            push_node(tree, level + 1, slots);
+        } else if (n > 1) {
+            sha256_tree_node(slots, n, node);
+            push_node(tree, level + 1, node);
+        }
+    }
+
+    free(tree->levels);
+    tree->levels = NULL;
+}
+
+int sha256_tree_hash(const BYTE data[], size_t len, const SHA256_TREE_PARAMS *params,
+                     BYTE root[SHA256_BLOCK_SIZE])
+{
+    SHA256_TREE tree;
+
+    if (sha256_tree_init(&tree, params) != 0) return 1;
+    sha256_tree_update(&tree, data, len);
+    sha256_tree_final(&tree, root);
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*********************************************************************
+ * Filename:   sha256_tree.h
+ * Description: Public API for the SHA-256 tree-hash (Merkle) mode.
+ *              The input is cut into fixed-size leaves that are hashed
+ *              in parallel, and the leaf hashes are combined up to a
+ *              single root.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#ifndef SHA256_TREE_H
+#define SHA256_TREE_H
+
+#include <stddef.h>
+#include "sha256.h"
+
+/*
+ * Tree shape
+ *   leaf  = SHA-256(0x00 || leaf bytes), every leaf leaf_size bytes
+ *           except the last (an empty input has one empty leaf)
+ *   node  = SHA-256(0x01 || child || child ...), over each run of
+ *           fanout consecutive nodes of the level below; the last run
+ *           may be shorter, and a last run of one node is carried up
+ *           unchanged
+ *   root  = the only node of the top level
+ * The tags keep a leaf from ever being read as an interior node.
+ */
+#define SHA256_TREE_LEAF_DEFAULT   (64 * 1024)
+#define SHA256_TREE_FANOUT_DEFAULT 2
+#define SHA256_TREE_FANOUT_MAX     256
+
+typedef struct {
+    size_t leaf_size;   /* Bytes per leaf; 0 for the default */
+    int fanout;         /* Children per node, 2..256; 0 for the default */
+    int threads;        /* Threads hashing leaves; 0 for one per CPU */
+} SHA256_TREE_PARAMS;
+
+/* Streaming state */
+typedef struct {
+    SHA256_TREE_PARAMS params;   /* With the defaults filled in */
+    SHA256_CTX leaf;             /* Leaf being filled */
+    size_t leaf_fill;            /* Bytes in it so far */
+    unsigned long long leaves;   /* Leaves finished */
+    BYTE *levels;                /* Up to fanout pending nodes per level */
+    int *pending;                /* Nodes pending on each level */
+    int top;                     /* Highest level holding a node */
+    BYTE *batch;                 /* Leaf hashes of one parallel round */
+    size_t batch_leaves;         /* Leaves per parallel round */
+} SHA256_TREE;
+
+/* Set up a tree hash; params may be NULL for all defaults. Returns 0
+ * on success, 1 for invalid parameters or if memory runs out */
+int sha256_tree_init(SHA256_TREE *tree, const SHA256_TREE_PARAMS *params);
+
+/* Add data; whole leaves are hashed straight from data, in parallel */
+void sha256_tree_update(SHA256_TREE *tree, const BYTE data[], size_t len);
+
+/* Write the root and release the tree's memory */
+void sha256_tree_final(SHA256_TREE *tree, BYTE root[SHA256_BLOCK_SIZE]);
+
+/* One-shot tree hash of a buffer; returns 0 on success, 1 as for init */
+int sha256_tree_hash(const BYTE data[], size_t len, const SHA256_TREE_PARAMS *params,
+                     BYTE root[SHA256_BLOCK_SIZE]);
+
+/* A single leaf or interior node (of n children) as the tree hashes it,
+ * for code that keeps or checks parts of a tree itself */
+void sha256_tree_leaf(const BYTE data[], size_t len, BYTE out[SHA256_BLOCK_SIZE]);
+void sha256_tree_node(const BYTE children[], int n, BYTE out[SHA256_BLOCK_SIZE]);
+
+#endif /* SHA256_TREE_H */
@@ -0,0 +1,81 @@
+/*********************************************************************
+ * Filename:   sha_file.c
+ * Description: Crash-safe replacement of the small state files the
+ *              hashing code keeps next to its data (the Merkle index
+ *              sidecar, stream checkpoints): a reader finds either the
+ *              old file or the complete new one, never a torn write.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sha_internal.h"
+
+static int write_all(int fd, const unsigned char* p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return 1;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* Make the rename itself durable; file systems that cannot sync a
+ * directory still renamed atomically, so that is not an error */
+static void sync_dir(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    char* dir;
+    int fd;
+
+    if (slash == NULL) {
+        dir = strdup(".");
+    } else {
+        dir = strndup(path, slash == path ? 1 : (size_t)(slash - path));
+    }
+    if (dir == NULL) return;
+    fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+}
+
+int sha_file_replace(const char* path, const void* const* part, const size_t* len, int nparts)
+{
+    size_t tmp_len = strlen(path) + 5;
+    char* tmp = malloc(tmp_len);
+    int fd, failed = 0;
+
+    if (tmp == NULL) return 1;
+    snprintf(tmp, tmp_len, "%s.tmp", path);
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmp);
+        return 1;
+    }
+    for (int i = 0; i < nparts && !failed; i++)
+        failed = write_all(fd, part[i], len[i]);
+    failed |= fsync(fd) != 0;
+    failed |= close(fd) != 0;
+    if (!failed) failed = rename(tmp, path) != 0;
+
+    if (failed)
+        unlink(tmp);
+    else
+        sync_dir(path);
+    free(tmp);
+    return failed;
+}
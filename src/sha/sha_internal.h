@@ -0,0 +1,71 @@
+#ifndef SHA_INTERNAL_H
+#define SHA_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "secure_zero.h"
+
+/*
+ * A compression kernel. blocks folds nblocks whole 64-byte blocks into
+ * the chaining state (8 words for SHA-256, 5 for SHA-1), in the same
+ * word order as the context structures keep it. rounds (SHA-256 only)
+ * folds in a block known in advance, such as a padding block: wk[i] is
+ * round constant i plus schedule word i, so no schedule is computed.
+ */
+typedef struct {
+    const char* name;
+    void (*blocks)(uint32_t* state, const unsigned char* data, size_t nblocks);
+    void (*rounds)(uint32_t* state, const uint32_t* wk);
+} sha_engine;
+
+extern const sha_engine sha256_engine_portable;
+extern const sha_engine sha256_engine_shani;
+extern const sha_engine sha1_engine_portable;
+extern const sha_engine sha1_engine_shani;
+
+/* Nonzero if the SHA extensions kernels can run on this CPU */
+int sha_shani_usable(void);
+
+/* Kernels picked for this CPU, or the ones forced by *_engine_select */
+const sha_engine* sha256_engine_get(void);
+const sha_engine* sha1_engine_get(void);
+
+/*
+ * A multi-buffer kernel. blocks advances `lanes` independent chaining
+ * states by nblocks blocks each, lane l reading from data[l]. The
+ * states are stored transposed, word w of lane l at
+ * state[w * lanes + l], so that each word is one vector across lanes.
+ */
+typedef struct {
+    const char* name;
+    int lanes;
+    void (*blocks)(uint32_t* state, const unsigned char* const* data, size_t nblocks);
+    void (*rounds)(uint32_t* state, const uint32_t* wk);  /* As for sha_engine, every lane */
+} sha_mb_engine;
+
+extern const sha_mb_engine sha256_mb_engine_x1;
+extern const sha_mb_engine sha256_mb_engine_avx2;
+extern const sha_mb_engine sha256_mb_engine_avx512;
+extern const sha_mb_engine sha1_mb_engine_x1;
+extern const sha_mb_engine sha1_mb_engine_sse2;
+extern const sha_mb_engine sha1_mb_engine_avx2;
+
+/* Multi-buffer kernel picked for this CPU, or the one forced by
+ * sha256_mb_engine_select */
+const sha_mb_engine* sha256_mb_engine_get(void);
+
+/* Kernel for a pass with `left` jobs still to run on e: a pass with
+ * most lanes idle loses to the SHA extensions running its jobs one at
+ * a time, so it goes to the one-lane kernel when they are usable */
+const sha_mb_engine* sha256_mb_pass_engine(const sha_mb_engine* e, size_t left);
+
+/* Writes lane l of a transposed SHA-256 state (lanes wide) to out as
+ * the big-endian digest (sha256_fixed.c) */
+void sha256_store_digest(unsigned char* out, const uint32_t* state, int lanes, int l);
+
+/* Replace path with the nparts buffers written one after another: they
+ * go to path.tmp, which is synced and renamed over path (sha_file.c).
+ * Returns 0 on success, 1 with path left as it was on failure */
+int sha_file_replace(const char* path, const void* const* part, const size_t* len, int nparts);
+
+#endif
@@ -0,0 +1,181 @@
+/*********************************************************************
+ * Filename:   sha_mb_mgr.h
+ * Description: Multi-buffer job manager, written once for SHA-256 and
+ *              SHA-1 and instantiated by the file including it. Each
+ *              lane holds one message; all lanes are compressed
+ *              together for as many blocks as the shortest one has
+ *              left, then finished lanes switch to their padded tail
+ *              or hand back their job and take the next one.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+/*
+ * Define before including:
+ *   MB_WORDS        chaining state words (8 for SHA-256, 5 for SHA-1)
+ *   MB_DIGEST_SIZE  digest bytes written back to the job
+ *   MB_MAX_LANES    lanes the manager structure has room for
+ *   MB_MGR, MB_JOB  manager and job types
+ *   MB_CTX          context type a manager may start from
+ *   MB_IV           initial chaining state, MB_WORDS words
+ *   MB_ENGINE_GET   function returning the multi-buffer kernel to use
+ *   MB_FN(x)        name of the public function x (x_mgr_submit, ...)
+ *
+ * The manager and job types have the fields of SHA256_MGR/SHA256_JOB.
+ * Instantiates MB_FN(mgr_init_from), MB_FN(mgr_init), MB_FN(mgr_submit),
+ * MB_FN(mgr_flush), and the static batch_run used by the batch calls.
+ */
+
+void MB_FN(mgr_init_from)(MB_MGR *mgr, const MB_CTX *prefix)
+{
+    const sha_mb_engine *e = MB_ENGINE_GET();
+
+    memset(mgr->job, 0, sizeof(mgr->job));
+    mgr->engine = e;
+    mgr->lanes = e->lanes;
+    mgr->busy = 0;
+    memcpy(mgr->start, prefix != NULL ? prefix->state : MB_IV, sizeof(mgr->start));
+    mgr->start_bits = prefix != NULL ? prefix->bitlen : 0;
+}
+
+void MB_FN(mgr_init)(MB_MGR *mgr)
+{
+    MB_FN(mgr_init_from)(mgr, NULL);
+}
+
+/* Whole blocks are hashed from the caller's buffer; the rest of the
+ * message, the padding and the length go into the lane's tail */
+static void lane_start(MB_MGR *mgr, int l, MB_JOB *job)
+{
+    size_t rem = job->len % 64;
+    unsigned long long bitlen = mgr->start_bits + (unsigned long long)job->len * 8;
+    BYTE *tail = mgr->tail[l];
+    int n = rem < 56 ? 1 : 2;
+
+    for (int w = 0; w < MB_WORDS; w++)
+        mgr->state[w * mgr->lanes + l] = mgr->start[w];
+
+    if (rem > 0) memcpy(tail, job->data + (job->len - rem), rem);
+    tail[rem] = 0x80;
+    memset(tail + rem + 1, 0, 64 * n - rem - 1);
+    for (int i = 0; i < 8; i++)
+        tail[64 * n - 1 - i] = (BYTE)(bitlen >> (8 * i));
+
+    mgr->job[l] = job;
+    mgr->ptr[l] = job->data;
+    mgr->blocks[l] = job->len / 64;
+    mgr->tail_blocks[l] = n;
+    mgr->in_tail[l] = 0;
+}
+
+static MB_JOB *lane_finish(MB_MGR *mgr, int l)
+{
+    MB_JOB *job = mgr->job[l];
+
+    for (int w = 0; w < MB_DIGEST_SIZE / 4; w++) {
+        WORD v = mgr->state[w * mgr->lanes + l];
+
+        job->digest[4 * w]     = (BYTE)(v >> 24);
+        job->digest[4 * w + 1] = (BYTE)(v >> 16);
+        job->digest[4 * w + 2] = (BYTE)(v >> 8);
+        job->digest[4 * w + 3] = (BYTE)v;
+    }
+    mgr->job[l] = NULL;
+    mgr->busy--;
+    return job;
+}
+
+static const BYTE *lane_ptr(const MB_MGR *mgr, int l)
+{
+    if (mgr->in_tail[l])
+        return mgr->tail[l] + 64 * (mgr->tail_blocks[l] - mgr->blocks[l]);
+    return mgr->ptr[l];
+}
+
+/* Step the busy lanes until one of them finishes */
+static MB_JOB *mgr_run(MB_MGR *mgr)
+{
+    const sha_mb_engine *e = mgr->engine;
+    const BYTE *ptr[MB_MAX_LANES];
+
+    for (;;) {
+        size_t n = SIZE_MAX;
+        int any = -1;
+
+        for (int l = 0; l < mgr->lanes; l++) {
+            if (mgr->job[l] == NULL) continue;
+            if (mgr->blocks[l] == 0) {
+                if (mgr->in_tail[l]) return lane_finish(mgr, l);
+                mgr->in_tail[l] = 1;
+                mgr->blocks[l] = mgr->tail_blocks[l];
+            }
+            if (mgr->blocks[l] < n) n = mgr->blocks[l];
+            any = l;
+        }
+        if (any < 0) return NULL;
+
+        /* Free lanes hash a copy of a busy lane's input and are ignored */
+        for (int l = 0; l < mgr->lanes; l++)
+            ptr[l] = lane_ptr(mgr, mgr->job[l] != NULL ? l : any);
+        e->blocks(mgr->state, ptr, n);
+
+        for (int l = 0; l < mgr->lanes; l++) {
+            if (mgr->job[l] == NULL) continue;
+            if (!mgr->in_tail[l]) mgr->ptr[l] += 64 * n;
+            mgr->blocks[l] -= n;
+        }
+    }
+}
+
+MB_JOB *MB_FN(mgr_submit)(MB_MGR *mgr, MB_JOB *job)
+{
+    for (int l = 0; l < mgr->lanes; l++) {
+        if (mgr->job[l] == NULL) {
+            lane_start(mgr, l, job);
+            mgr->busy++;
+            break;
+        }
+    }
+    return mgr->busy < mgr->lanes ? NULL : mgr_run(mgr);
+}
+
+MB_JOB *MB_FN(mgr_flush)(MB_MGR *mgr)
+{
+    return mgr->busy == 0 ? NULL : mgr_run(mgr);
+}
+
+static int longer_first(const void *a, const void *b)
+{
+    size_t la = (*(MB_JOB *const *)a)->len, lb = (*(MB_JOB *const *)b)->len;
+
+    return la < lb ? 1 : la > lb ? -1 : 0;
+}
+
+/* Runs every job through an initialised manager, longest first, then
+ * wipes it: for HMAC its start state and lane states are keyed */
+static void batch_run(MB_MGR *mgr, MB_JOB jobs[], size_t njobs)
+{
+    MB_JOB **order = malloc(njobs * sizeof(*order));
+
+    /* Without memory for the schedule the jobs still run, in order */
+    if (order == NULL) {
+        for (size_t i = 0; i < njobs; i++)
+            MB_FN(mgr_submit)(mgr, &jobs[i]);
+    } else {
+        int sorted = 1;
+
+        for (size_t i = 0; i < njobs; i++) {
+            order[i] = &jobs[i];
+            if (i > 0 && jobs[i].len > jobs[i - 1].len) sorted = 0;
+        }
+        /* Equal lengths, as for the outer hashes of HMAC, need no sort */
+        if (!sorted) qsort(order, njobs, sizeof(*order), longer_first);
+        for (size_t i = 0; i < njobs; i++)
+            MB_FN(mgr_submit)(mgr, order[i]);
+        free(order);
+    }
+    while (MB_FN(mgr_flush)(mgr) != NULL)
+        ;
+    secure_zero(mgr, sizeof(*mgr));
+}
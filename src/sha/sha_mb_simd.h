@@ -0,0 +1,56 @@
+/*********************************************************************
+ * Filename:   sha_mb_simd.h
+ * Description: Message loading shared by the multi-buffer SHA-256 and
+ *              SHA-1 AVX2 kernels: one 64-byte block from each of 8
+ *              messages, transposed so that vector w holds big-endian
+ *              word w of every message.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#ifndef SHA_MB_SIMD_H
+#define SHA_MB_SIMD_H
+
+#include <immintrin.h>
+
+/* r[l] holds eight consecutive words of lane l; afterwards r[w] holds
+ * word w of all eight lanes */
+static __attribute__((target("avx2"))) inline void avx2_transpose8(__m256i* r)
+{
+    __m256i t[8], u[8];
+
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int i = 0; i < 4; i++) {
+        r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+}
+
+/* The block at offset off of each data[l] into m[0..15] */
+static __attribute__((target("avx2"))) inline void avx2_load_blocks8(__m256i* m,
+                                                                    const unsigned char* const* data,
+                                                                    size_t off)
+{
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    for (int half = 0; half < 2; half++) {
+        for (int l = 0; l < 8; l++)
+            m[8 * half + l] = _mm256_loadu_si256((const __m256i*)(data[l] + off + 32 * half));
+        avx2_transpose8(m + 8 * half);
+    }
+    for (int w = 0; w < 16; w++)
+        m[w] = _mm256_shuffle_epi8(m[w], bswap);
+}
+
+#endif
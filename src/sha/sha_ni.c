@@ -0,0 +1,196 @@
+/*********************************************************************
+ * Filename:   sha_ni.c
+ * Description: SHA-256 and SHA-1 compression with the x86 SHA
+ *              extensions. SHA256RNDS2 does two rounds and SHA1RNDS4
+ *              four, with the message schedule computed alongside by
+ *              SHA256MSG1/2 and SHA1MSG1/2, so a block never touches
+ *              memory beyond its own 64 bytes.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include "cpu_features.h"
+#include "sha_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/* Compiled for the extension regardless of -march; only reached after CPUID */
+#define SHA_FN __attribute__((target("sha,sse4.1,ssse3")))
+
+static const uint32_t k256[64] __attribute__((aligned(16))) = {
+    0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+    0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+    0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+    0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+    0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+    0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+    0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+    0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+/*
+ * Four rounds on message words 4g..4g+3, held in w[g % 4]. From g = 4
+ * on the words are first derived from the four groups before them,
+ * which occupy the same four slots.
+ */
+#define SHA256_SCHEDULE(g) \
+    w[(g) & 3] = _mm_sha256msg2_epu32(                                              \
+        _mm_add_epi32(_mm_sha256msg1_epu32(w[(g) & 3], w[((g) + 1) & 3]),           \
+                      _mm_alignr_epi8(w[((g) + 3) & 3], w[((g) + 2) & 3], 4)),      \
+        w[((g) + 3) & 3])
+
+#define SHA256_ROUNDS(g) do {                                                       \
+        __m128i m = _mm_add_epi32(w[(g) & 3], _mm_load_si128((const __m128i*)(k256 + 4 * (g)))); \
+        cdgh = _mm_sha256rnds2_epu32(cdgh, abef, m);                                \
+        abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(m, 0x0e));       \
+    } while (0)
+
+#define SHA256_GROUP(g) do { SHA256_SCHEDULE(g); SHA256_ROUNDS(g); } while (0)
+
+/* The instructions want the state as ABEF and CDGH */
+static SHA_FN inline void sha256_shani_load(const uint32_t* state, __m128i* abef, __m128i* cdgh)
+{
+    __m128i t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0xb1);
+
+    *cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(state + 4)), 0x1b);
+    *abef = _mm_alignr_epi8(t, *cdgh, 8);
+    *cdgh = _mm_blend_epi16(*cdgh, t, 0xf0);
+}
+
+/* Back to ABCD and EFGH */
+static SHA_FN inline void sha256_shani_store(uint32_t* state, __m128i abef, __m128i cdgh)
+{
+    __m128i t = _mm_shuffle_epi32(abef, 0x1b);
+
+    cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128((__m128i*)state, _mm_blend_epi16(t, cdgh, 0xf0));
+    _mm_storeu_si128((__m128i*)(state + 4), _mm_alignr_epi8(cdgh, t, 8));
+}
+
+static SHA_FN void sha256_shani_blocks(uint32_t* state, const unsigned char* data, size_t nblocks)
+{
+    /* Big-endian message words */
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i abef, cdgh, w[4];
+
+    sha256_shani_load(state, &abef, &cdgh);
+
+    for ( ; nblocks > 0; --nblocks, data += 64) {
+        __m128i abef_in = abef, cdgh_in = cdgh;
+
+        for (int i = 0; i < 4; i++)
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)), bswap);
+
+        SHA256_ROUNDS(0);  SHA256_ROUNDS(1);  SHA256_ROUNDS(2);  SHA256_ROUNDS(3);
+        SHA256_GROUP(4);   SHA256_GROUP(5);   SHA256_GROUP(6);   SHA256_GROUP(7);
+        SHA256_GROUP(8);   SHA256_GROUP(9);   SHA256_GROUP(10);  SHA256_GROUP(11);
+        SHA256_GROUP(12);  SHA256_GROUP(13);  SHA256_GROUP(14);  SHA256_GROUP(15);
+
+        abef = _mm_add_epi32(abef, abef_in);
+        cdgh = _mm_add_epi32(cdgh, cdgh_in);
+    }
+
+    sha256_shani_store(state, abef, cdgh);
+}
+
+/* A block known in advance: the message instructions drop out and
+ * only the round pairs remain */
+static SHA_FN void sha256_shani_rounds(uint32_t* state, const uint32_t* wk)
+{
+    __m128i abef, cdgh, abef_in, cdgh_in;
+
+    sha256_shani_load(state, &abef, &cdgh);
+    abef_in = abef;
+    cdgh_in = cdgh;
+    for (int g = 0; g < 16; g++) {
+        __m128i m = _mm_loadu_si128((const __m128i*)(wk + 4 * g));
+
+        cdgh = _mm_sha256rnds2_epu32(cdgh, abef, m);
+        abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(m, 0x0e));
+    }
+    sha256_shani_store(state, _mm_add_epi32(abef, abef_in), _mm_add_epi32(cdgh, cdgh_in));
+}
+
+/*
+ * Four rounds on message words 4g..4g+3 in w[g % 4], with round
+ * function f. SHA1NEXTE derives this group's E from the A of the
+ * state before the previous group, kept in prev.
+ */
+#define SHA1_SCHEDULE(g) \
+    w[(g) & 3] = _mm_sha1msg2_epu32(                                                \
+        _mm_xor_si128(_mm_sha1msg1_epu32(w[(g) & 3], w[((g) + 1) & 3]), w[((g) + 2) & 3]), \
+        w[((g) + 3) & 3])
+
+#define SHA1_ROUNDS(g, f) do {                                                      \
+        __m128i e = _mm_sha1nexte_epu32(prev, w[(g) & 3]);                          \
+        prev = abcd;                                                                \
+        abcd = _mm_sha1rnds4_epu32(abcd, e, f);                                     \
+    } while (0)
+
+#define SHA1_GROUP(g, f) do { SHA1_SCHEDULE(g); SHA1_ROUNDS(g, f); } while (0)
+
+static SHA_FN void sha1_shani_blocks(uint32_t* state, const unsigned char* data, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd, e0, prev, w[4];
+
+    /* A in the top lane, E on its own in the top lane of e0 */
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1b);
+    e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+    for ( ; nblocks > 0; --nblocks, data += 64) {
+        __m128i abcd_in = abcd;
+
+        for (int i = 0; i < 4; i++)
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)), bswap);
+
+        /* The first group adds E directly; there is no earlier A */
+        prev = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, _mm_add_epi32(e0, w[0]), 0);
+        SHA1_ROUNDS(1, 0);   SHA1_ROUNDS(2, 0);   SHA1_ROUNDS(3, 0);   SHA1_GROUP(4, 0);
+        SHA1_GROUP(5, 1);    SHA1_GROUP(6, 1);    SHA1_GROUP(7, 1);    SHA1_GROUP(8, 1);
+        SHA1_GROUP(9, 1);    SHA1_GROUP(10, 2);   SHA1_GROUP(11, 2);   SHA1_GROUP(12, 2);
+        SHA1_GROUP(13, 2);   SHA1_GROUP(14, 2);   SHA1_GROUP(15, 3);   SHA1_GROUP(16, 3);
+        SHA1_GROUP(17, 3);   SHA1_GROUP(18, 3);   SHA1_GROUP(19, 3);
+
+        e0 = _mm_sha1nexte_epu32(prev, e0);
+        abcd = _mm_add_epi32(abcd, abcd_in);
+    }
+
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+const sha_engine sha256_engine_shani = {
+    "shani",
+    sha256_shani_blocks,
+    sha256_shani_rounds,
+};
+
+const sha_engine sha1_engine_shani = {
+    "shani",
+    sha1_shani_blocks,
+    NULL,
+};
+
+int sha_shani_usable(void)
+{
+    const cpu_features* f = cpu_get_features();
+
+    return f->sha && f->sse41 && f->ssse3;
+}
+
+#else
+
+/* Never selected: cpu_get_features() reports no SHA extensions off x86 */
+const sha_engine sha256_engine_shani = { "shani", NULL, NULL };
+const sha_engine sha1_engine_shani = { "shani", NULL, NULL };
+
+int sha_shani_usable(void)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,201 @@
+/*********************************************************************
+ * Filename:   sha_stream.c
+ * Description: Checkpointed streaming SHA-256 and SHA-1. Updates are
+ *              cut at each checkpoint offset, where the context blob is
+ *              written over the previous checkpoint, so a checkpoint
+ *              always marks an exact byte offset of the input.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sha_stream.h"
+#include "sha_internal.h"
+
+/* Read size for sha_stream_file */
+#define STREAM_READ_BYTES (1u << 20)
+
+/* Room for either blob */
+#define STREAM_BLOB_MAX SHA256_CTX_BLOB_SIZE
+
+static size_t blob_size(int alg)
+{
+    return alg == SHA_STREAM_SHA1 ? SHA1_CTX_BLOB_SIZE : SHA256_CTX_BLOB_SIZE;
+}
+
+/* 0 if the file holds exactly size bytes, 2 if it does not exist, 1 if
+ * it cannot be read or has another size */
+static int read_blob(const char *path, BYTE blob[], size_t size)
+{
+    BYTE extra;
+    size_t got = 0;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return errno == ENOENT ? 2 : 1;
+    while (got < size) {
+        ssize_t r = read(fd, blob + got, size - got);
+
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    if (got == size && read(fd, &extra, 1) != 0) got = 0;
+    close(fd);
+    return got == size ? 0 : 1;
+}
+
+static int save(const SHA_STREAM *s)
+{
+    BYTE blob[STREAM_BLOB_MAX];
+    const void *part[1] = { blob };
+    size_t len[1] = { blob_size(s->alg) };
+
+    if (s->alg == SHA_STREAM_SHA1)
+        sha1_ctx_export(&s->ctx.sha1, blob);
+    else
+        sha256_ctx_export(&s->ctx.sha256, blob);
+    return sha_file_replace(s->checkpoint, part, len, 1);
+}
+
+static void release(SHA_STREAM *s)
+{
+    free(s->checkpoint);
+    s->checkpoint = NULL;
+}
+
+int sha_stream_init(SHA_STREAM *s, int alg, const char *checkpoint, unsigned long long interval)
+{
+    BYTE blob[STREAM_BLOB_MAX];
+    int found;
+
+    if (alg != SHA_STREAM_SHA256 && alg != SHA_STREAM_SHA1) return 1;
+    s->alg = alg;
+    s->offset = 0;
+    s->interval = checkpoint != NULL ? interval : 0;
+    s->checkpoint = NULL;
+    if (alg == SHA_STREAM_SHA1)
+        sha1_init(&s->ctx.sha1);
+    else
+        sha256_init(&s->ctx.sha256);
+
+    if (checkpoint != NULL) {
+        s->checkpoint = strdup(checkpoint);
+        if (s->checkpoint == NULL) return 1;
+
+        found = read_blob(checkpoint, blob, blob_size(alg));
+        if (found == 0) {
+            int bad = alg == SHA_STREAM_SHA1 ? sha1_ctx_import(&s->ctx.sha1, blob)
+                                             : sha256_ctx_import(&s->ctx.sha256, blob);
+            if (bad) found = 1;
+        }
+        if (found == 1) {
+            release(s);
+            return 1;
+        }
+        if (alg == SHA_STREAM_SHA1)
+            s->offset = s->ctx.sha1.bitlen / 8 + s->ctx.sha1.datalen;
+        else
+            s->offset = s->ctx.sha256.bitlen / 8 + s->ctx.sha256.datalen;
+    }
+
+    s->next = s->interval > 0 ? (s->offset / s->interval + 1) * s->interval : 0;
+    return 0;
+}
+
+int sha_stream_update(SHA_STREAM *s, const BYTE data[], size_t len)
+{
+    int failed = 0;
+
+    while (len > 0) {
+        size_t n = len;
+
+        if (s->interval > 0 && s->next - s->offset < n)
+            n = (size_t)(s->next - s->offset);
+
+        if (s->alg == SHA_STREAM_SHA1)
+            sha1_update(&s->ctx.sha1, data, n);
+        else
+            sha256_update(&s->ctx.sha256, data, n);
+        s->offset += n;
+        data += n;
+        len -= n;
+
+        if (s->interval > 0 && s->offset == s->next) {
+            s->next += s->interval;
+            failed |= save(s);
+        }
+    }
+    return failed;
+}
+
+int sha_stream_suspend(SHA_STREAM *s)
+{
+    int failed = s->checkpoint == NULL || save(s) != 0;
+
+    release(s);
+    return failed;
+}
+
+void sha_stream_final(SHA_STREAM *s, BYTE hash[])
+{
+    if (s->alg == SHA_STREAM_SHA1)
+        sha1_final(&s->ctx.sha1, hash);
+    else
+        sha256_final(&s->ctx.sha256, hash);
+    if (s->checkpoint != NULL)
+        unlink(s->checkpoint);
+    release(s);
+}
+
+int sha_stream_file(int alg, const char *path, const char *checkpoint,
+                    unsigned long long interval, BYTE hash[])
+{
+    SHA_STREAM s;
+    struct stat sb;
+    BYTE *buf;
+    int lost = 0;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return 1;
+    if (sha_stream_init(&s, alg, checkpoint, interval) != 0) {
+        close(fd);
+        return 1;
+    }
+
+    buf = malloc(STREAM_READ_BYTES);
+    if (buf == NULL || fstat(fd, &sb) != 0 ||
+        (S_ISREG(sb.st_mode) && (unsigned long long)sb.st_size < s.offset) ||
+        (s.offset > 0 && lseek(fd, (off_t)s.offset, SEEK_SET) < 0)) {
+        free(buf);
+        release(&s);
+        close(fd);
+        return 1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (;;) {
+        ssize_t r = read(fd, buf, STREAM_READ_BYTES);
+
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) {
+            /* Keep what was hashed for the next attempt */
+            sha_stream_suspend(&s);
+            free(buf);
+            close(fd);
+            return 1;
+        }
+        if (r == 0) break;
+        lost |= sha_stream_update(&s, buf, (size_t)r);
+    }
+
+    sha_stream_final(&s, hash);
+    free(buf);
+    close(fd);
+    return lost ? 2 : 0;
+}
@@ -0,0 +1,66 @@
+/*********************************************************************
+ * Filename:   sha_stream.h
+ * Description: Public API for checkpointed streaming hashes. Every
+ *              interval bytes the running context is saved to a file
+ *              as its sha256_ctx_export / sha1_ctx_export blob, so that
+ *              a long job picks up where it stopped, and one machine
+ *              can hash a segment and hand the file to the next.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#ifndef SHA_STREAM_H
+#define SHA_STREAM_H
+
+#include <stddef.h>
+#include "sha256.h"
+#include "sha1.h"
+
+#define SHA_STREAM_SHA256 1
+#define SHA_STREAM_SHA1   2
+
+typedef struct {
+    int alg;                        /* SHA_STREAM_SHA256 or SHA_STREAM_SHA1 */
+    union {
+        SHA256_CTX sha256;
+        SHA1_CTX sha1;
+    } ctx;
+    unsigned long long offset;      /* Bytes hashed so far */
+    unsigned long long interval;    /* Bytes between checkpoints, 0 for none */
+    unsigned long long next;        /* Offset of the next checkpoint */
+    char *checkpoint;               /* Checkpoint file, NULL for none */
+} SHA_STREAM;
+
+/*
+ * Start a stream, or resume it if the checkpoint file exists; offset
+ * then says where in the data to carry on. The file is the context
+ * blob alone, so nothing ties it to one input: give each input its own
+ * checkpoint path. Returns 0 on success, 1 if the file exists but is
+ * not a valid checkpoint of this hash, or memory runs out.
+ */
+int sha_stream_init(SHA_STREAM *s, int alg, const char *checkpoint, unsigned long long interval);
+
+/* Hash the next len bytes, saving a checkpoint at every multiple of
+ * the interval they cross. Returns 0, or 1 if a checkpoint could not
+ * be written; the hash itself is unaffected */
+int sha_stream_update(SHA_STREAM *s, const BYTE data[], size_t len);
+
+/* Save a checkpoint at the current offset and release the stream, to
+ * resume later or on another machine; returns 0, or 1 if it could not
+ * be written */
+int sha_stream_suspend(SHA_STREAM *s);
+
+/* Finish the hash, remove the checkpoint and release the stream */
+void sha_stream_final(SHA_STREAM *s, BYTE hash[]);
+
+/* Hash a whole file through a stream, seeking past what a checkpoint
+ * already covers. Returns 0 on success, 1 if the file cannot be read,
+ * is shorter than the checkpoint, or the checkpoint is invalid; the
+ * checkpoint is kept then, to resume from. Returns 2 if the hash is
+ * complete but a checkpoint could not be written on the way, so an
+ * interrupted run would have had less to resume from */
+int sha_stream_file(int alg, const char *path, const char *checkpoint,
+                    unsigned long long interval, BYTE hash[]);
+
+#endif /* SHA_STREAM_H */
@@ -0,0 +1,920 @@
+/*********************************************************************
+ * Filename:   aes_test.c
+ * Description: Known-answer tests (KATs) for the AES implementation,
+ *              run against every kernel usable on this CPU.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aes.h"
+#include "sha256.h"
+
+typedef unsigned char BYTE;
+
+/* FIPS-197 Appendix C: single block, key 00 01 .. 1f truncated */
+static int aes_block_test(void)
+{
+    BYTE key[32], pt[16], buf[16];
+    BYTE zero_iv[16] = { 0 };
+    BYTE ct128[16] = {
+        0x69,0xc4,0xe0,0xd8,0x6a,0x7b,0x04,0x30,
+        0xd8,0xcd,0xb7,0x80,0x70,0xb4,0xc5,0x5a
+    };
+    BYTE ct192[16] = {
+        0xdd,0xa9,0x7c,0xa4,0x86,0x4c,0xdf,0xe0,
+        0x6e,0xaf,0x70,0xa0,0xec,0x0d,0x71,0x91
+    };
+    BYTE ct256[16] = {
+        0x8e,0xa2,0xb7,0xca,0x51,0x67,0x45,0xbf,
+        0xea,0xfc,0x49,0x90,0x4b,0x49,0x60,0x89
+    };
+    BYTE* expected[3] = { ct128, ct192, ct256 };
+    int pass = 1;
+
+    for (int i = 0; i < 32; i++) key[i] = (BYTE)i;
+    for (int i = 0; i < 16; i++) pt[i] = (BYTE)(i * 0x11);
+
+    /* With a zero IV one CBC block is the raw block cipher */
+    for (int v = 0; v < 3; v++) {
+        memcpy(buf, pt, 16);
+        pass &= encrypt(buf, 16, (char*)zero_iv, (char*)key, 16 + 8 * v) == 0;
+        pass &= memcmp(buf, expected[v], 16) == 0;
+        pass &= decrypt(buf, 16, (char*)zero_iv, (char*)key, 16 + 8 * v) == 0;
+        pass &= memcmp(buf, pt, 16) == 0;
+    }
+
+    return pass;
+}
+
+/* SP 800-38A F.2.1 and F.2.5: CBC-AES128 and CBC-AES256 */
+static int aes_cbc_test(void)
+{
+    BYTE key128[16] = {
+        0x2b,0x7e,0x15,0x16,0x28,0xae,0xd2,0xa6,
+        0xab,0xf7,0x15,0x88,0x09,0xcf,0x4f,0x3c
+    };
+    BYTE key256[32] = {
+        0x60,0x3d,0xeb,0x10,0x15,0xca,0x71,0xbe,
+        0x2b,0x73,0xae,0xf0,0x85,0x7d,0x77,0x81,
+        0x1f,0x35,0x2c,0x07,0x3b,0x61,0x08,0xd7,
+        0x2d,0x98,0x10,0xa3,0x09,0x14,0xdf,0xf4
+    };
+    BYTE iv[16] = {
+        0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,
+        0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f
+    };
+    BYTE pt[64] = {
+        0x6b,0xc1,0xbe,0xe2,0x2e,0x40,0x9f,0x96,0xe9,0x3d,0x7e,0x11,0x73,0x93,0x17,0x2a,
+        0xae,0x2d,0x8a,0x57,0x1e,0x03,0xac,0x9c,0x9e,0xb7,0x6f,0xac,0x45,0xaf,0x8e,0x51,
+        0x30,0xc8,0x1c,0x46,0xa3,0x5c,0xe4,0x11,0xe5,0xfb,0xc1,0x19,0x1a,0x0a,0x52,0xef,
+        0xf6,0x9f,0x24,0x45,0xdf,0x4f,0x9b,0x17,0xad,0x2b,0x41,0x7b,0xe6,0x6c,0x37,0x10
+    };
+    BYTE ct128[64] = {
+        0x76,0x49,0xab,0xac,0x81,0x19,0xb2,0x46,0xce,0xe9,0x8e,0x9b,0x12,0xe9,0x19,0x7d,
+        0x50,0x86,0xcb,0x9b,0x50,0x72,0x19,0xee,0x95,0xdb,0x11,0x3a,0x91,0x76,0x78,0xb2,
+        0x73,0xbe,0xd6,0xb8,0xe3,0xc1,0x74,0x3b,0x71,0x16,0xe6,0x9e,0x22,0x22,0x95,0x16,
+        0x3f,0xf1,0xca,0xa1,0x68,0x1f,0xac,0x09,0x12,0x0e,0xca,0x30,0x75,0x86,0xe1,0xa7
+    };
+    BYTE ct256[64] = {
+        0xf5,0x8c,0x4c,0x04,0xd6,0xe5,0xf1,0xba,0x77,0x9e,0xab,0xfb,0x5f,0x7b,0xfb,0xd6,
+        0x9c,0xfc,0x4e,0x96,0x7e,0xdb,0x80,0x8d,0x67,0x9f,0x77,0x7b,0xc6,0x70,0x2c,0x7d,
+        0x39,0xf2,0x33,0x69,0xa9,0xd9,0xba,0xcf,0xa5,0x30,0xe2,0x63,0x04,0x23,0x14,0x61,
+        0xb2,0xeb,0x05,0xe2,0xc3,0x9b,0xe9,0xfc,0xda,0x6c,0x19,0x07,0x8c,0x6a,0x9d,0x1b
+    };
+    BYTE buf[64];
+    aes_ctx* ctx;
+    int pass = 1;
+
+    memcpy(buf, pt, 64);
+    pass &= encrypt(buf, 64, (char*)iv, (char*)key128, 16) == 0;
+    pass &= memcmp(buf, ct128, 64) == 0;
+    pass &= decrypt(buf, 64, (char*)iv, (char*)key128, 16) == 0;
+    pass &= memcmp(buf, pt, 64) == 0;
+
+    ctx = aes_ctx_create((char*)key256, 32);
+    if (ctx == NULL) return 0;
+    memcpy(buf, pt, 64);
+    pass &= aes_ctx_encrypt(ctx, buf, 64, (char*)iv) == 0;
+    pass &= memcmp(buf, ct256, 64) == 0;
+    pass &= aes_ctx_decrypt(ctx, buf, 64, (char*)iv) == 0;
+    pass &= memcmp(buf, pt, 64) == 0;
+
+    /* Partial blocks and bad key sizes are rejected */
+    pass &= aes_ctx_encrypt(ctx, buf, 15, (char*)iv) == 1;
+    pass &= encrypt(buf, 16, (char*)iv, (char*)key128, 20) == 1;
+    aes_ctx_destroy(ctx);
+
+    return pass;
+}
+
+/*
+ * Long CBC runs exercise the multi-block paths of each kernel. The
+ * ciphertext is returned so the kernels can be compared with each other.
+ */
+static int aes_cbc_long_test(BYTE out[1040])
+{
+    BYTE key[32], iv[16], pt[1040], buf[1040];
+    int pass = 1;
+
+    for (int i = 0; i < 32; i++) key[i] = (BYTE)(i * 7 + 3);
+    for (int i = 0; i < 16; i++) iv[i] = (BYTE)(0xf0 - i);
+    for (int i = 0; i < (int)sizeof(pt); i++) pt[i] = (BYTE)(i * 31);
+
+    memcpy(out, pt, sizeof(pt));
+    pass &= encrypt(out, sizeof(pt), (char*)iv, (char*)key, 32) == 0;
+
+    /* Decrypt each prefix, so the tail paths see every length mod 8 */
+    for (int n = 16; n <= (int)sizeof(pt); n += 16) {
+        memcpy(buf, out, n);
+        decrypt(buf, n, (char*)iv, (char*)key, 32);
+        pass &= memcmp(buf, pt, n) == 0;
+    }
+
+    return pass;
+}
+
+/* SP 800-38A F.5.1 (CTR-AES128), plus split and seek consistency */
+static int aes_ctr_test(void)
+{
+    BYTE key[16] = {
+        0x2b,0x7e,0x15,0x16,0x28,0xae,0xd2,0xa6,
+        0xab,0xf7,0x15,0x88,0x09,0xcf,0x4f,0x3c
+    };
+    BYTE ctr0[16] = {
+        0xf0,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,
+        0xf8,0xf9,0xfa,0xfb,0xfc,0xfd,0xfe,0xff
+    };
+    BYTE pt[64] = {
+        0x6b,0xc1,0xbe,0xe2,0x2e,0x40,0x9f,0x96,0xe9,0x3d,0x7e,0x11,0x73,0x93,0x17,0x2a,
+        0xae,0x2d,0x8a,0x57,0x1e,0x03,0xac,0x9c,0x9e,0xb7,0x6f,0xac,0x45,0xaf,0x8e,0x51,
+        0x30,0xc8,0x1c,0x46,0xa3,0x5c,0xe4,0x11,0xe5,0xfb,0xc1,0x19,0x1a,0x0a,0x52,0xef,
+        0xf6,0x9f,0x24,0x45,0xdf,0x4f,0x9b,0x17,0xad,0x2b,0x41,0x7b,0xe6,0x6c,0x37,0x10
+    };
+    BYTE ct[64] = {
+        0x87,0x4d,0x61,0x91,0xb6,0x20,0xe3,0x26,0x1b,0xef,0x68,0x64,0x99,0x0d,0xb6,0xce,
+        0x98,0x06,0xf6,0x6b,0x79,0x70,0xfd,0xff,0x86,0x17,0x18,0x7b,0xb9,0xff,0xfd,0xff,
+        0x5a,0xe4,0xdf,0x3e,0xdb,0xd5,0xd3,0x5e,0x5b,0x4f,0x09,0x02,0x0d,0xb0,0x3e,0xab,
+        0x1e,0x03,0x1d,0xda,0x2f,0xbe,0x03,0xd1,0x79,0x21,0x70,0xa0,0xf3,0x00,0x9c,0xee
+    };
+    BYTE big[1000], ref[1000], buf[1000];
+    aes_ctx* ctx = aes_ctx_create((char*)key, 16);
+    aes_ctr st;
+    int pass = 1;
+
+    if (ctx == NULL) return 0;
+
+    memcpy(buf, pt, 64);
+    pass &= aes_ctx_ctr(ctx, buf, 64, (char*)ctr0, 0) == 0;
+    pass &= memcmp(buf, ct, 64) == 0;
+
+    /* Odd lengths and a seek into the middle of a block */
+    memcpy(buf, pt, 64);
+    aes_ctx_ctr(ctx, buf + 21, 43, (char*)ctr0, 21);
+    pass &= memcmp(buf + 21, ct + 21, 43) == 0;
+
+    for (int i = 0; i < (int)sizeof(big); i++) big[i] = (BYTE)(i * 13 + 5);
+    memcpy(ref, big, sizeof(big));
+    aes_ctx_ctr(ctx, ref, sizeof(ref), (char*)ctr0, 0);
+
+    /* Feeding the stream in uneven pieces gives the same output */
+    aes_ctr_init(&st, ctx, (char*)ctr0);
+    for (int off = 0, step = 1; off < (int)sizeof(big); off += step, step = step * 3 % 37 + 1) {
+        int n = off + step > (int)sizeof(big) ? (int)sizeof(big) - off : step;
+        aes_ctr_crypt(&st, big + off, buf + off, n);
+    }
+    pass &= memcmp(buf, ref, sizeof(buf)) == 0;
+
+    /* Resume from arbitrary offsets */
+    for (int off = 0; off < (int)sizeof(big); off += 97) {
+        aes_ctr_seek(&st, off);
+        aes_ctr_crypt(&st, ref + off, buf, sizeof(big) - off);
+        pass &= memcmp(buf, big + off, sizeof(big) - off) == 0;
+    }
+
+    aes_ctx_destroy(ctx);
+    return pass;
+}
+
+/* McGrew and Viega GCM test cases 2, 4 and 6, plus streaming and tamper checks */
+static int aes_gcm_test(void)
+{
+    BYTE zero[16] = { 0 };
+    BYTE ct2[16] = {
+        0x03,0x88,0xda,0xce,0x60,0xb6,0xa3,0x92,0xf3,0x28,0xc2,0xb9,0x71,0xb2,0xfe,0x78
+    };
+    BYTE tag2[16] = {
+        0xab,0x6e,0x47,0xd4,0x2c,0xec,0x13,0xbd,0xf5,0x3a,0x67,0xb2,0x12,0x57,0xbd,0xdf
+    };
+    BYTE key[16] = {
+        0xfe,0xff,0xe9,0x92,0x86,0x65,0x73,0x1c,0x6d,0x6a,0x8f,0x94,0x67,0x30,0x83,0x08
+    };
+    BYTE pt[60] = {
+        0xd9,0x31,0x32,0x25,0xf8,0x84,0x06,0xe5,0xa5,0x59,0x09,0xc5,0xaf,0xf5,0x26,0x9a,
+        0x86,0xa7,0xa9,0x53,0x15,0x34,0xf7,0xda,0x2e,0x4c,0x30,0x3d,0x8a,0x31,0x8a,0x72,
+        0x1c,0x3c,0x0c,0x95,0x95,0x68,0x09,0x53,0x2f,0xcf,0x0e,0x24,0x49,0xa6,0xb5,0x25,
+        0xb1,0x6a,0xed,0xf5,0xaa,0x0d,0xe6,0x57,0xba,0x63,0x7b,0x39
+    };
+    BYTE aad[20] = {
+        0xfe,0xed,0xfa,0xce,0xde,0xad,0xbe,0xef,0xfe,0xed,0xfa,0xce,0xde,0xad,0xbe,0xef,
+        0xab,0xad,0xda,0xd2
+    };
+    BYTE iv4[12] = {
+        0xca,0xfe,0xba,0xbe,0xfa,0xce,0xdb,0xad,0xde,0xca,0xf8,0x88
+    };
+    BYTE ct4[60] = {
+        0x42,0x83,0x1e,0xc2,0x21,0x77,0x74,0x24,0x4b,0x72,0x21,0xb7,0x84,0xd0,0xd4,0x9c,
+        0xe3,0xaa,0x21,0x2f,0x2c,0x02,0xa4,0xe0,0x35,0xc1,0x7e,0x23,0x29,0xac,0xa1,0x2e,
+        0x21,0xd5,0x14,0xb2,0x54,0x66,0x93,0x1c,0x7d,0x8f,0x6a,0x5a,0xac,0x84,0xaa,0x05,
+        0x1b,0xa3,0x0b,0x39,0x6a,0x0a,0xac,0x97,0x3d,0x58,0xe0,0x91
+    };
+    BYTE tag4[16] = {
+        0x5b,0xc9,0x4f,0xbc,0x32,0x21,0xa5,0xdb,0x94,0xfa,0xe9,0x5a,0xe7,0x12,0x1a,0x47
+    };
+    BYTE iv6[60] = {
+        0x93,0x13,0x22,0x5d,0xf8,0x84,0x06,0xe5,0x55,0x90,0x9c,0x5a,0xff,0x52,0x69,0xaa,
+        0x6a,0x7a,0x95,0x38,0x53,0x4f,0x7d,0xa1,0xe4,0xc3,0x03,0xd2,0xa3,0x18,0xa7,0x28,
+        0xc3,0xc0,0xc9,0x51,0x56,0x80,0x95,0x39,0xfc,0xf0,0xe2,0x42,0x9a,0x6b,0x52,0x54,
+        0x16,0xae,0xdb,0xf5,0xa0,0xde,0x6a,0x57,0xa6,0x37,0xb3,0x9b
+    };
+    BYTE ct6[60] = {
+        0x8c,0xe2,0x49,0x98,0x62,0x56,0x15,0xb6,0x03,0xa0,0x33,0xac,0xa1,0x3f,0xb8,0x94,
+        0xbe,0x91,0x12,0xa5,0xc3,0xa2,0x11,0xa8,0xba,0x26,0x2a,0x3c,0xca,0x7e,0x2c,0xa7,
+        0x01,0xe4,0xa9,0xa4,0xfb,0xa4,0x3c,0x90,0xcc,0xdc,0xb2,0x81,0xd4,0x8c,0x7c,0x6f,
+        0xd6,0x28,0x75,0xd2,0xac,0xa4,0x17,0x03,0x4c,0x34,0xae,0xe5
+    };
+    BYTE tag6[16] = {
+        0x61,0x9c,0xc5,0xae,0xff,0xfe,0x0b,0xfa,0x46,0x2a,0xf4,0x3c,0x16,0x99,0xd0,0x50
+    };
+    BYTE big[1000], ref[1000], buf[1000], tag[16], tag_ref[16];
+    aes_ctx* z = aes_ctx_create((char*)zero, 16);
+    aes_ctx* ctx = aes_ctx_create((char*)key, 16);
+    aes_gcm st;
+    int pass = 1;
+
+    if (z == NULL || ctx == NULL) {
+        aes_ctx_destroy(z);
+        aes_ctx_destroy(ctx);
+        return 0;
+    }
+
+    memcpy(buf, zero, 16);
+    pass &= aes_gcm_encrypt(z, (char*)zero, 12, NULL, 0, buf, 16, (char*)tag) == 0;
+    pass &= memcmp(buf, ct2, 16) == 0 && memcmp(tag, tag2, 16) == 0;
+
+    memcpy(buf, pt, 60);
+    pass &= aes_gcm_encrypt(ctx, (char*)iv4, 12, aad, 20, buf, 60, (char*)tag) == 0;
+    pass &= memcmp(buf, ct4, 60) == 0 && memcmp(tag, tag4, 16) == 0;
+    pass &= aes_gcm_decrypt(ctx, (char*)iv4, 12, aad, 20, buf, 60, (char*)tag4, 16) == 0;
+    pass &= memcmp(buf, pt, 60) == 0;
+
+    memcpy(buf, pt, 60);
+    pass &= aes_gcm_encrypt(ctx, (char*)iv6, 60, aad, 20, buf, 60, (char*)tag) == 0;
+    pass &= memcmp(buf, ct6, 60) == 0 && memcmp(tag, tag6, 16) == 0;
+
+    /* A flipped bit anywhere fails, and the plaintext is not released */
+    memcpy(buf, ct4, 60);
+    buf[59] ^= 0x01;
+    pass &= aes_gcm_decrypt(ctx, (char*)iv4, 12, aad, 20, buf, 60, (char*)tag4, 16) == 1;
+    pass &= memcmp(buf, zero, 16) == 0;
+    memcpy(buf, ct4, 60);
+    pass &= aes_gcm_decrypt(ctx, (char*)iv4, 12, aad, 19, buf, 60, (char*)tag4, 16) == 1;
+    memcpy(buf, ct4, 60);
+    pass &= aes_gcm_decrypt(ctx, (char*)iv4, 12, aad, 20, buf, 60, (char*)tag4, 12) == 0;
+    pass &= aes_gcm_decrypt(ctx, (char*)iv4, 0, aad, 20, buf, 60, (char*)tag4, 16) == 1;
+
+    /* Uneven pieces of AAD and data give the same ciphertext and tag */
+    for (int i = 0; i < (int)sizeof(big); i++) big[i] = (BYTE)(i * 13 + 5);
+    memcpy(ref, big, sizeof(big));
+    aes_gcm_encrypt(ctx, (char*)iv6, 60, big, 77, ref, sizeof(ref), (char*)tag_ref);
+
+    aes_gcm_init(&st, ctx, (char*)iv6, 60);
+    aes_gcm_aad(&st, big, 5);
+    aes_gcm_aad(&st, big + 5, 72);
+    for (int off = 0, step = 1; off < (int)sizeof(big); off += step, step = step * 3 % 211 + 1) {
+        int n = off + step > (int)sizeof(big) ? (int)sizeof(big) - off : step;
+        aes_gcm_encrypt_update(&st, big + off, buf + off, n);
+    }
+    pass &= aes_gcm_final(&st, (char*)tag) == 0;
+    pass &= memcmp(buf, ref, sizeof(buf)) == 0 && memcmp(tag, tag_ref, 16) == 0;
+    pass &= aes_gcm_aad(&st, big, 1) == 1 && aes_gcm_final(&st, (char*)tag) == 1;
+
+    aes_gcm_init(&st, ctx, (char*)iv6, 60);
+    aes_gcm_aad(&st, big, 77);
+    aes_gcm_decrypt_update(&st, ref, ref, 333);
+    aes_gcm_decrypt_update(&st, ref + 333, ref + 333, sizeof(ref) - 333);
+    pass &= aes_gcm_verify(&st, (char*)tag_ref, 16) == 0;
+    pass &= memcmp(ref, big, sizeof(big)) == 0;
+
+    aes_ctx_destroy(z);
+    aes_ctx_destroy(ctx);
+    return pass;
+}
+
+/* Parallel CBC-decrypt and CTR match the serial path for any thread count */
+static int aes_parallel_test(void)
+{
+    enum { LEN = 150000 - 150000 % 16 };
+    static BYTE pt[LEN], ref[LEN], buf[LEN];
+    char key[] = "0123456789abcdef01234567";
+    char IV[] = "AAAAAAAAAAAAAAAA";
+    aes_ctx* ctx = aes_ctx_create(key, 24);
+    int pass = 1;
+
+    if (ctx == NULL) return 0;
+    for (int i = 0; i < LEN; i++) pt[i] = (BYTE)(i * 29 + 1);
+
+    for (int t = 1; t <= 5; t++) {
+        /* Small chunks so even a short buffer spans many of them */
+        pass &= aes_parallel_config(t, 4096 + 16 * t) == 0;
+
+        memcpy(ref, pt, LEN);
+        aes_ctx_encrypt(ctx, ref, LEN, IV);
+        memcpy(buf, ref, LEN);
+        pass &= aes_ctx_decrypt_parallel(ctx, buf, LEN, IV) == 0;
+        pass &= memcmp(buf, pt, LEN) == 0;
+
+        memcpy(ref, pt, LEN);
+        aes_ctx_ctr(ctx, ref, LEN - 7, IV, 1000 + t);
+        memcpy(buf, pt, LEN);
+        pass &= aes_ctx_ctr_parallel(ctx, buf, LEN - 7, IV, 1000 + t) == 0;
+        pass &= memcmp(buf, ref, LEN) == 0;
+    }
+
+    pass &= aes_ctx_decrypt_parallel(ctx, buf, LEN - 1, IV) == 1;
+    pass &= aes_parallel_config(2, 4000) == 1 && aes_parallel_config(-1, 0) == 1;
+    pass &= aes_parallel_config(0, 0) == 0;
+
+    aes_ctx_destroy(ctx);
+    return pass;
+}
+
+/* Batch CBC encryption matches one aes_ctx_encrypt per message */
+static int aes_batch_test(void)
+{
+    enum { NJOBS = 37 };
+    static BYTE bufs[NJOBS][512], refs[NJOBS][512];
+    BYTE key[32], iv[NJOBS][16];
+    aes_ctx* ctxs[3];
+    aes_cbc_job jobs[NJOBS];
+    int pass = 1;
+
+    for (int i = 0; i < 32; i++) key[i] = (BYTE)(i * 5 + 1);
+    for (int k = 0; k < 3; k++) ctxs[k] = aes_ctx_create((char*)key, 16 + 8 * k);
+
+    /* Mixed key sizes and lengths, so lanes end and refill unevenly */
+    for (int j = 0; j < NJOBS; j++) {
+        size_t len = (size_t)(j * 53 % 33) * 16;
+
+        for (int i = 0; i < 16; i++) iv[j][i] = (BYTE)(j + i);
+        for (int i = 0; i < 512; i++) bufs[j][i] = refs[j][i] = (BYTE)(i * j + 3);
+        jobs[j].ctx = ctxs[j % 3];
+        jobs[j].IV = (char*)iv[j];
+        jobs[j].buffer = bufs[j];
+        jobs[j].buffer_len = len;
+        if (len > 0) aes_ctx_encrypt(ctxs[j % 3], refs[j], len, (char*)iv[j]);
+    }
+    jobs[5].buffer_len = 40;
+    jobs[9].ctx = NULL;
+
+    pass &= aes_cbc_encrypt_batch(jobs, NJOBS) == 1;
+    for (int j = 0; j < NJOBS; j++) {
+        int bad = j == 5 || j == 9;
+        pass &= jobs[j].status == bad;
+        if (!bad) pass &= memcmp(bufs[j], refs[j], sizeof(bufs[j])) == 0;
+    }
+
+    jobs[5].buffer_len = 48;
+    jobs[9].ctx = ctxs[0];
+    pass &= aes_cbc_encrypt_batch(jobs, 0) == 0;
+    pass &= aes_cbc_encrypt_batch(jobs + 5, 1) == 0 && jobs[5].status == 0;
+
+    for (int k = 0; k < 3; k++) aes_ctx_destroy(ctxs[k]);
+    return pass;
+}
+
+/* IEEE 1619 XTS-AES-128 vectors 2 and 15 (ciphertext stealing), plus
+ * round trips and the parallel sector path against per-unit calls */
+static int aes_xts_test(void)
+{
+    BYTE ct2[32] = {
+        0xc4,0x54,0x18,0x5e,0x6a,0x16,0x93,0x6e,0x39,0x33,0x40,0x38,0xac,0xef,0x83,0x8b,
+        0xfb,0x18,0x6f,0xff,0x74,0x80,0xad,0xc4,0x28,0x93,0x82,0xec,0xd6,0xd3,0x94,0xf0
+    };
+    BYTE ct15[17] = {
+        0x6c,0x16,0x25,0xdb,0x46,0x71,0x52,0x2d,0x3d,0x75,0x99,0x60,0x1d,0xe7,0xca,0x09,
+        0xed
+    };
+    static BYTE big[64 * 528], ref[64 * 528];
+    BYTE key[64], buf[1000];
+    aes_xts* x;
+    int pass = 1;
+
+    for (int i = 0; i < 16; i++) { key[i] = 0x11; key[16 + i] = 0x22; }
+    x = aes_xts_create((char*)key, 32);
+    if (x == NULL) return 0;
+    memset(buf, 0x44, 32);
+    pass &= aes_xts_encrypt(x, buf, 32, 0x3333333333ULL) == 0;
+    pass &= memcmp(buf, ct2, 32) == 0;
+    aes_xts_destroy(x);
+
+    for (int i = 0; i < 16; i++) { key[i] = (BYTE)(0xff - i); key[16 + i] = (BYTE)(0xbf - i); }
+    x = aes_xts_create((char*)key, 32);
+    if (x == NULL) return 0;
+    for (int i = 0; i < 17; i++) buf[i] = (BYTE)i;
+    aes_xts_encrypt(x, buf, 17, 0x123456789aULL);
+    pass &= memcmp(buf, ct15, 17) == 0;
+    aes_xts_decrypt(x, buf, 17, 0x123456789aULL);
+    for (int i = 0; i < 17; i++) pass &= buf[i] == i;
+    aes_xts_destroy(x);
+
+    for (int i = 0; i < 64; i++) key[i] = (BYTE)(i * 7 + 3);
+    x = aes_xts_create((char*)key, 64);
+    if (x == NULL) return 0;
+
+    for (int len = 16; len <= (int)sizeof(buf); len += len < 64 ? 1 : 37) {
+        for (int i = 0; i < len; i++) big[i] = buf[i] = (BYTE)(i * 11 + len);
+        aes_xts_encrypt(x, buf, len, len);
+        pass &= memcmp(buf, big, len) != 0;
+        aes_xts_decrypt(x, buf, len, len);
+        pass &= memcmp(buf, big, len) == 0;
+    }
+
+    /* Odd sector size so tasks split unevenly across threads */
+    for (int i = 0; i < (int)sizeof(big); i++) big[i] = ref[i] = (BYTE)(i * 29 + 1);
+    aes_parallel_config(3, 4096);
+    pass &= aes_xts_encrypt_sectors(x, big, 528, 64, 1000) == 0;
+    for (int s = 0; s < 64; s++) aes_xts_encrypt(x, ref + s * 528, 528, 1000 + s);
+    pass &= memcmp(big, ref, sizeof(big)) == 0;
+    pass &= aes_xts_decrypt_sectors(x, big, 528, 64, 1000) == 0;
+    for (int i = 0; i < (int)sizeof(big); i++) pass &= big[i] == (BYTE)(i * 29 + 1);
+    aes_parallel_config(0, 0);
+
+    pass &= aes_xts_encrypt(x, buf, 15, 0) == 1;
+    pass &= aes_xts_encrypt_sectors(x, big, 520, 4, 0) == 1;
+    /* Past the 16 MiB data unit limit; refused before the buffer is touched */
+    pass &= aes_xts_encrypt_sectors(x, big, ((size_t)1 << 24) + 16, 1, 0) == 1;
+    aes_xts_destroy(x);
+
+    /* SP 800-38E: equal data and tweak keys are refused */
+    memset(key, 0x5a, 64);
+    pass &= aes_xts_create((char*)key, 64) == NULL;
+    pass &= aes_xts_create((char*)key + 1, 48) == NULL;
+    return pass;
+}
+
+/* Lays len bytes of data out as fragments of the given sizes (cycled),
+ * with gaps between them, and returns the fragment count */
+static int make_iov(struct iovec* v, BYTE* store, const BYTE* data, size_t len,
+                    const int* sizes, int nsizes)
+{
+    int n = 0;
+
+    for (size_t off = 0; off < len; n++) {
+        size_t f = (size_t)sizes[n % nsizes];
+
+        if (f > len - off) f = len - off;
+        v[n].iov_base = store;
+        v[n].iov_len = f;
+        if (data != NULL) memcpy(store, data + off, f);
+        store += f + 3;
+        off += f;
+    }
+    return n;
+}
+
+static void read_iov(const struct iovec* v, int n, BYTE* out)
+{
+    for (int i = 0; i < n; i++) {
+        memcpy(out, v[i].iov_base, v[i].iov_len);
+        out += v[i].iov_len;
+    }
+}
+
+/* iovec CBC against contiguous aes_ctx, with blocks split across
+ * fragments, empty fragments and differently split output */
+static int aes_iov_test(void)
+{
+    static const int split_a[] = { 1, 0, 7, 15, 16, 33, 200, 2, 64, 9 };
+    static const int split_b[] = { 48, 5, 0, 11, 130, 16, 3 };
+    static BYTE store_a[2048], store_b[2048];
+    BYTE key[32], iv[16], pt[1024], ref[1024], buf[1024];
+    struct iovec va[256], vb[256];
+    aes_ctx* ctx;
+    int na, nb, pass = 1;
+
+    for (int i = 0; i < 32; i++) key[i] = (BYTE)(i * 3 + 7);
+    for (int i = 0; i < 16; i++) iv[i] = (BYTE)(i * 17);
+    for (int i = 0; i < (int)sizeof(pt); i++) pt[i] = (BYTE)(i * 13 + 1);
+    ctx = aes_ctx_create((char*)key, 32);
+    if (ctx == NULL) return 0;
+    memcpy(ref, pt, sizeof(pt));
+    aes_ctx_encrypt(ctx, ref, sizeof(ref), (char*)iv);
+
+    /* In place */
+    na = make_iov(va, store_a, pt, sizeof(pt), split_a, 10);
+    pass &= aes_encrypt_iov(ctx, va, na, NULL, 0, (char*)iv) == 0;
+    read_iov(va, na, buf);
+    pass &= memcmp(buf, ref, sizeof(ref)) == 0;
+    pass &= aes_decrypt_iov(ctx, va, na, NULL, 0, (char*)iv) == 0;
+    read_iov(va, na, buf);
+    pass &= memcmp(buf, pt, sizeof(pt)) == 0;
+
+    /* Separate output with different fragment boundaries */
+    nb = make_iov(vb, store_b, NULL, sizeof(pt), split_b, 7);
+    pass &= aes_encrypt_iov(ctx, va, na, vb, nb, (char*)iv) == 0;
+    read_iov(vb, nb, buf);
+    pass &= memcmp(buf, ref, sizeof(ref)) == 0;
+    pass &= aes_decrypt_iov(ctx, vb, nb, va, na, (char*)iv) == 0;
+    read_iov(va, na, buf);
+    pass &= memcmp(buf, pt, sizeof(pt)) == 0;
+
+    /* Partial total length, short output */
+    na = make_iov(va, store_a, pt, 1000, split_a, 10);
+    pass &= aes_encrypt_iov(ctx, va, na, NULL, 0, (char*)iv) == 1;
+    na = make_iov(va, store_a, pt, 512, split_a, 10);
+    nb = make_iov(vb, store_b, NULL, 496, split_b, 7);
+    pass &= aes_encrypt_iov(ctx, va, na, vb, nb, (char*)iv) == 1;
+    pass &= aes_encrypt_iov(ctx, va, 0, NULL, 0, (char*)iv) == 0;
+
+    aes_ctx_destroy(ctx);
+    return pass;
+}
+
+/* Feeds len bytes through st in pieces of 1..37 bytes, then final */
+static size_t stream_all(aes_stream* st, const BYTE* in, size_t len, BYTE* out, int* ret)
+{
+    size_t o = 0, n;
+
+    for (size_t off = 0, step = 1; off < len; off += step, step = step * 5 % 37 + 1) {
+        if (step > len - off) step = len - off;
+        *ret |= aes_stream_update(st, in + off, step, out + o, &n);
+        o += n;
+    }
+    *ret |= aes_stream_final(st, out + o, &n);
+    return o + n;
+}
+
+/* Streaming CBC with PKCS#7 against padding by hand, CTR streaming,
+ * bad padding, and a file larger than the stream chunk */
+static int aes_stream_test(void)
+{
+    static BYTE data[200000], back[200016];
+    BYTE key[24], iv[16], pt[80], padded[96], out[112], ct[112];
+    aes_ctx* ctx;
+    aes_stream st;
+    FILE* f1;
+    FILE* f2;
+    int ret = 0, pass = 1;
+
+    for (int i = 0; i < 24; i++) key[i] = (BYTE)(i * 9 + 2);
+    for (int i = 0; i < 16; i++) iv[i] = (BYTE)(0x80 + i);
+    for (int i = 0; i < 80; i++) pt[i] = (BYTE)(i * 7);
+    ctx = aes_ctx_create((char*)key, 24);
+    if (ctx == NULL) return 0;
+
+    for (size_t len = 0; len <= 80; len += 1 + len / 8) {
+        size_t pad = 16 - len % 16, n;
+
+        memcpy(padded, pt, len);
+        memset(padded + len, (int)pad, pad);
+        aes_ctx_encrypt(ctx, padded, len + pad, (char*)iv);
+
+        aes_stream_init(&st, ctx, AES_STREAM_CBC, 1, (char*)iv);
+        n = stream_all(&st, pt, len, ct, &ret);
+        pass &= n == len + pad && memcmp(ct, padded, n) == 0;
+
+        aes_stream_init(&st, ctx, AES_STREAM_CBC, 0, (char*)iv);
+        pass &= stream_all(&st, ct, n, out, &ret) == len && memcmp(out, pt, len) == 0;
+    }
+    pass &= ret == 0;
+
+    /* A last block of 0x00 or 0x11 is not valid padding */
+    for (int bad = 0; bad < 2; bad++) {
+        memset(padded, bad ? 0x11 : 0, 32);
+        aes_stream_init(&st, ctx, AES_STREAM_CBC_NOPAD, 1, (char*)iv);
+        ret = 0;
+        pass &= stream_all(&st, padded, 32, ct, &ret) == 32 && ret == 0;
+        aes_stream_init(&st, ctx, AES_STREAM_CBC, 0, (char*)iv);
+        stream_all(&st, ct, 32, out, &ret);
+        pass &= ret == 1;
+    }
+
+    /* Unpadded CBC rejects a trailing partial block */
+    aes_stream_init(&st, ctx, AES_STREAM_CBC_NOPAD, 1, (char*)iv);
+    ret = 0;
+    stream_all(&st, pt, 40, ct, &ret);
+    pass &= ret == 1;
+
+    /* CTR streams are length-preserving */
+    memcpy(ct, pt, 75);
+    aes_ctx_ctr(ctx, ct, 75, (char*)iv, 0);
+    aes_stream_init(&st, ctx, AES_STREAM_CTR, 1, (char*)iv);
+    ret = 0;
+    pass &= stream_all(&st, pt, 75, out, &ret) == 75 && ret == 0;
+    pass &= memcmp(out, ct, 75) == 0;
+
+    /* Round trip through files, several chunks long */
+    for (int i = 0; i < (int)sizeof(data); i++) data[i] = (BYTE)(i * 31 + i / 256);
+    f1 = tmpfile();
+    f2 = tmpfile();
+    if (f1 == NULL || f2 == NULL) return 0;
+    fwrite(data, 1, sizeof(data), f1);
+    rewind(f1);
+    aes_stream_init(&st, ctx, AES_STREAM_CBC, 1, (char*)iv);
+    pass &= aes_stream_file(&st, f1, f2) == 0;
+    pass &= ftell(f2) == (long)sizeof(data) + 16;
+    rewind(f1);
+    rewind(f2);
+    aes_stream_init(&st, ctx, AES_STREAM_CBC, 0, (char*)iv);
+    pass &= aes_stream_file(&st, f2, f1) == 0;
+    rewind(f1);
+    pass &= fread(back, 1, sizeof(back), f1) >= sizeof(data);
+    pass &= memcmp(back, data, sizeof(data)) == 0;
+    fclose(f1);
+    fclose(f2);
+
+    aes_ctx_destroy(ctx);
+    return pass;
+}
+
+/* Fused encrypt-and-hash gives the CBC ciphertext and its SHA-256;
+ * verification decrypts it back and refuses a tampered message */
+static int aes_hash_test(void)
+{
+    static const size_t lens[] = { 0, 16, 4096, 4096 + 48, 12288, 20000 };
+    static BYTE data[20000], buf[20000], ref[20000];
+    BYTE key[32], iv[16], digest[AES_HASH_SIZE], want[SHA256_BLOCK_SIZE];
+    aes_ctx* ctx;
+    int pass = 1;
+
+    for (int i = 0; i < 32; i++) key[i] = (BYTE)(i * 3 + 7);
+    for (int i = 0; i < 16; i++) iv[i] = (BYTE)(i * 17);
+    for (int i = 0; i < (int)sizeof(data); i++) data[i] = (BYTE)(i * 11 + i / 199);
+    ctx = aes_ctx_create((char*)key, 32);
+    if (ctx == NULL) return 0;
+
+    for (size_t t = 0; t < sizeof(lens) / sizeof(lens[0]); t++) {
+        size_t len = lens[t];
+        SHA256_CTX sha;
+
+        memcpy(ref, data, len);
+        aes_ctx_encrypt(ctx, ref, len, (char*)iv);
+        sha256_init(&sha);
+        sha256_update(&sha, ref, len);
+        sha256_final(&sha, want);
+
+        memcpy(buf, data, len);
+        pass &= aes_ctx_encrypt_hash(ctx, buf, len, (char*)iv, digest) == 0;
+        pass &= memcmp(buf, ref, len) == 0 && memcmp(digest, want, sizeof(want)) == 0;
+        pass &= aes_ctx_decrypt_verify(ctx, buf, len, (char*)iv, digest) == 0;
+        pass &= memcmp(buf, data, len) == 0;
+    }
+
+    /* One flipped ciphertext bit fails verification and wipes the buffer */
+    memcpy(buf, ref, 20000);
+    buf[9000] ^= 4;
+    pass &= aes_ctx_decrypt_verify(ctx, buf, 20000, (char*)iv, want) == 1;
+    for (int i = 0; i < 20000; i++) pass &= buf[i] == 0;
+
+    pass &= aes_ctx_encrypt_hash(ctx, buf, 40, (char*)iv, digest) == 1;
+    aes_ctx_destroy(ctx);
+    return pass;
+}
+
+/* Re-encryption between every pair of modes matches decrypting with
+ * the old context and encrypting with the new one */
+static int aes_reencrypt_test(void)
+{
+    enum { LEN = 50000 };
+    static BYTE pt[LEN], ct[LEN], ref[LEN], buf[LEN];
+    char k1[] = "0123456789abcdef", k2[] = "fedcba9876543210fedcba9876543210";
+    char iv1[] = "AAAAAAAAAAAAAAAA", iv2[] = "BBBBBBBBBBBBBBBB";
+    aes_ctx* c1 = aes_ctx_create(k1, 16);
+    aes_ctx* c2 = aes_ctx_create(k2, 32);
+    int pass = 1;
+
+    if (c1 == NULL || c2 == NULL) return 0;
+    for (int i = 0; i < LEN; i++) pt[i] = (BYTE)(i * 19 + i / 97);
+
+    for (int m = 0; m < 4; m++) {
+        aes_cipher_spec from = { c1, m & 1 ? AES_STREAM_CTR : AES_STREAM_CBC, iv1 };
+        aes_cipher_spec to = { c2, m & 2 ? AES_STREAM_CTR : AES_STREAM_CBC, iv2 };
+        /* Only CTR to CTR takes a partial last block */
+        size_t len = m == 3 ? LEN - 5 : LEN;
+
+        memcpy(ct, pt, len);
+        memcpy(ref, pt, len);
+        if (from.mode == AES_STREAM_CTR)
+            aes_ctx_ctr(c1, ct, len, iv1, 0);
+        else
+            aes_ctx_encrypt(c1, ct, len, iv1);
+        if (to.mode == AES_STREAM_CTR)
+            aes_ctx_ctr(c2, ref, len, iv2, 0);
+        else
+            aes_ctx_encrypt(c2, ref, len, iv2);
+
+        memcpy(buf, ct, len);
+        pass &= aes_reencrypt(&from, &to, buf, len) == 0;
+        pass &= memcmp(buf, ref, len) == 0;
+
+        for (int t = 1; t <= 3; t += 2) {
+            aes_parallel_config(t, 4096);
+            memcpy(buf, ct, len);
+            pass &= aes_reencrypt_parallel(&from, &to, buf, len) == 0;
+            pass &= memcmp(buf, ref, len) == 0;
+        }
+        aes_parallel_config(0, 0);
+
+        if (m != 3) pass &= aes_reencrypt(&from, &to, buf, LEN - 5) == 1;
+    }
+
+    {
+        aes_cipher_spec bad = { NULL, AES_STREAM_CTR, iv1 }, ok = { c1, AES_STREAM_CTR, iv1 };
+
+        pass &= aes_reencrypt(&bad, &ok, buf, 64) == 1;
+        pass &= aes_reencrypt_parallel(&ok, &bad, buf, 64) == 1;
+    }
+
+    aes_ctx_destroy(c1);
+    aes_ctx_destroy(c2);
+    return pass;
+}
+
+static long read_file(const char* path, BYTE* buf, size_t cap)
+{
+    FILE* f = fopen(path, "rb");
+    long n;
+
+    if (f == NULL) return -1;
+    n = (long)fread(buf, 1, cap, f);
+    fclose(f);
+    return n;
+}
+
+/* File pipeline with a few small buffers, so reads, cipher and writes
+ * wrap the ring many times; output matches the in-memory calls */
+static int aes_file_test(void)
+{
+    static BYTE data[50001], ref[50032], back[50032];
+    char p1[] = "/tmp/aes_test_XXXXXX", p2[] = "/tmp/aes_test_XXXXXX";
+    BYTE key[32], iv[16];
+    aes_file_opts opts = { 4096, 3, 0 };
+    aes_file_stats fs;
+    aes_ctx* ctx;
+    aes_stream st;
+    int fd1, fd2, ret = 0, pass = 1;
+    size_t n, fin;
+
+    for (int i = 0; i < 32; i++) key[i] = (BYTE)(i * 5 + 1);
+    for (int i = 0; i < 16; i++) iv[i] = (BYTE)(0xf0 + i);
+    for (int i = 0; i < (int)sizeof(data); i++) data[i] = (BYTE)(i * 13 + i / 251);
+    fd1 = mkstemp(p1);
+    fd2 = mkstemp(p2);
+    if (fd1 < 0 || fd2 < 0) return 0;
+    pass &= write(fd1, data, sizeof(data)) == (ssize_t)sizeof(data);
+    close(fd1);
+    close(fd2);
+    ctx = aes_ctx_create((char*)key, 32);
+    if (ctx == NULL) return 0;
+
+    /* CTR, through the page cache and with O_DIRECT where supported */
+    memcpy(ref, data, sizeof(data));
+    aes_ctx_ctr(ctx, ref, sizeof(data), (char*)iv, 0);
+    for (int direct = 0; direct < 2; direct++) {
+        opts.direct = direct;
+        pass &= aes_file_crypt(ctx, AES_STREAM_CTR, 1, (char*)iv, p1, p2, &opts, &fs) == 0;
+        pass &= fs.bytes_in == sizeof(data) && fs.bytes_out == sizeof(data);
+        pass &= read_file(p2, back, sizeof(back)) == (long)sizeof(data);
+        pass &= memcmp(back, ref, sizeof(data)) == 0;
+    }
+
+    /* Padded CBC: one extra block out, and back again; the input may be
+     * read directly, the output never is */
+    opts.direct = 1;
+    aes_stream_init(&st, ctx, AES_STREAM_CBC, 1, (char*)iv);
+    aes_stream_update(&st, data, sizeof(data), ref, &n);
+    aes_stream_final(&st, ref + n, &fin);
+    n += fin;
+    pass &= aes_file_crypt(ctx, AES_STREAM_CBC, 1, (char*)iv, p1, p2, &opts, &fs) == 0;
+    pass &= fs.bytes_out == n && read_file(p2, back, sizeof(back)) == (long)n;
+    pass &= memcmp(back, ref, n) == 0 && fs.direct_out == 0;
+    opts.direct = 0;
+    pass &= aes_file_crypt(ctx, AES_STREAM_CBC, 0, (char*)iv, p2, p1, &opts, &fs) == 0;
+    pass &= read_file(p1, back, sizeof(back)) == (long)sizeof(data);
+    pass &= memcmp(back, data, sizeof(data)) == 0;
+
+    /* An empty file still encrypts to one padding block */
+    fd1 = open(p1, O_WRONLY | O_TRUNC);
+    if (fd1 >= 0) close(fd1);
+    pass &= aes_file_crypt(ctx, AES_STREAM_CBC, 1, (char*)iv, p1, p2, &opts, &fs) == 0;
+    pass &= fs.bytes_out == 16 && read_file(p2, back, sizeof(back)) == 16;
+
+    /* Corrupt padding is reported */
+    back[15] ^= 1;
+    fd2 = open(p2, O_WRONLY | O_TRUNC);
+    if (fd2 >= 0) {
+        pass &= write(fd2, back, 16) == 16;
+        close(fd2);
+    }
+    ret = aes_file_crypt(ctx, AES_STREAM_CBC, 0, (char*)iv, p2, p1, &opts, &fs);
+    pass &= ret == 1;
+
+    /* Buffers past 1 GiB are refused */
+    opts.buffer_size = ((size_t)1 << 30) + 4096;
+    pass &= aes_file_crypt(ctx, AES_STREAM_CTR, 1, (char*)iv, p1, p2, &opts, &fs) == 1;
+
+    unlink(p1);
+    unlink(p2);
+    aes_ctx_destroy(ctx);
+    return pass;
+}
+
+/* Cached schedules give the same output as aes_ctx; counters track
+ * hits, misses and LRU evictions */
+static int aes_key_cache_test(void)
+{
+    BYTE keys[6][32], iv[16], buf[64], ref[64];
+    key_cache_stats st0, st;
+    int pass = 1;
+
+    for (int k = 0; k < 6; k++)
+        for (int i = 0; i < 32; i++) keys[k][i] = (BYTE)(k * 41 + i);
+    for (int i = 0; i < 16; i++) iv[i] = (BYTE)i;
+
+    pass &= aes_key_cache_config(4) == 0;
+    aes_key_cache_flush();
+    aes_key_cache_stats(&st0);
+
+    for (int k = 0; k < 6; k++) {
+        aes_ctx* ctx = aes_ctx_create((char*)keys[k], 16 + 8 * (k % 3));
+
+        for (int i = 0; i < 64; i++) buf[i] = ref[i] = (BYTE)(i + k);
+        aes_ctx_encrypt(ctx, ref, 64, (char*)iv);
+        aes_ctx_destroy(ctx);
+
+        /* Miss, then hit */
+        for (int r = 0; r < 2; r++) {
+            pass &= encrypt(buf, 64, (char*)iv, (char*)keys[k], 16 + 8 * (k % 3)) == 0;
+            pass &= decrypt(buf, 64, (char*)iv, (char*)keys[k], 16 + 8 * (k % 3)) == 0;
+        }
+        pass &= encrypt(buf, 64, (char*)iv, (char*)keys[k], 16 + 8 * (k % 3)) == 0;
+        pass &= memcmp(buf, ref, 64) == 0;
+    }
+
+    aes_key_cache_stats(&st);
+    pass &= st.misses - st0.misses == 6 && st.hits - st0.hits == 24;
+    pass &= st.evictions - st0.evictions == 2 && st.entries == 4;
+
+    /* keys[0] was evicted, keys[5] is still cached */
+    encrypt(buf, 64, (char*)iv, (char*)keys[5], 32);
+    encrypt(buf, 64, (char*)iv, (char*)keys[0], 16);
+    pass &= encrypt(buf, 64, (char*)iv, (char*)keys[0], 20) == 1;
+    aes_key_cache_stats(&st0);
+    pass &= st0.misses - st.misses == 1 && st0.hits - st.hits == 1;
+
+    /* Disabled: still correct, nothing kept */
+    pass &= aes_key_cache_config(0) == 0;
+    memcpy(buf, ref, 64);
+    decrypt(buf, 64, (char*)iv, (char*)keys[5], 32);
+    encrypt(buf, 64, (char*)iv, (char*)keys[5], 32);
+    pass &= memcmp(buf, ref, 64) == 0;
+    aes_key_cache_stats(&st);
+    pass &= st.entries == 0 && st.capacity == 0;
+
+    aes_key_cache_config(64);
+    return pass;
+}
+
+static const char* engines[] = { "aesni", "bitslice-avx2", "bitslice-sse2", "portable" };
+
+int main(void)
+{
+    BYTE ct[4][1040];
+    int pass = 1, ran = 0;
+
+    for (int e = 0; e < 4; e++) {
+        int ok;
+
+        if (aes_engine_select(engines[e]) != 0) {
+            printf("AES %s: not available\n", engines[e]);
+            continue;
+        }
+        ok = aes_block_test() && aes_cbc_test() && aes_cbc_long_test(ct[ran]) &&
+             aes_ctr_test() && aes_gcm_test() && aes_parallel_test() &&
+             aes_batch_test() && aes_xts_test() && aes_key_cache_test() &&
+             aes_iov_test() && aes_stream_test() && aes_file_test() &&
+             aes_hash_test() && aes_reencrypt_test();
+        if (ran > 0) ok &= memcmp(ct[0], ct[ran], sizeof(ct[0])) == 0;
+        ran++;
+        printf("AES %s tests: %s\n", engines[e], ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+/*********************************************************************
+ * Filename:   chacha_test.c
+ * Description: Known-answer tests (RFC 8439) for ChaCha20, Poly1305
+ *              and ChaCha20-Poly1305, run against every kernel usable
+ *              on this CPU.
+ *
+ * Disclaimer: This software is provided "as is", without any express
+ * or implied warranty. Use at your own risk.
+ *********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "chacha.h"
+
+typedef unsigned char BYTE;
+
+static const char sunscreen[] =
+    "Ladies and Gentlemen of the class of '99: If I could offer you only one "
+    "tip for the future, sunscreen would be it.";
+
+/* RFC 8439 2.4.2: key 00..1f, block counter 1 */
+static int chacha20_test(void)
+{
+    BYTE nonce[12] = { 0, 0, 0, 0, 0, 0, 0, 0x4a, 0, 0, 0, 0 };
+    BYTE ct[114] = {
+        0x6e,0x2e,0x35,0x9a,0x25,0x68,0xf9,0x80,0x41,0xba,0x07,0x28,0xdd,0x0d,0x69,0x81,
+        0xe9,0x7e,0x7a,0xec,0x1d,0x43,0x60,0xc2,0x0a,0x27,0xaf,0xcc,0xfd,0x9f,0xae,0x0b,
+        0xf9,0x1b,0x65,0xc5,0x52,0x47,0x33,0xab,0x8f,0x59,0x3d,0xab,0xcd,0x62,0xb3,0x57,
+        0x16,0x39,0xd6,0x24,0xe6,0x51,0x52,0xab,0x8f,0x53,0x0c,0x35,0x9f,0x08,0x61,0xd8,
+        0x07,0xca,0x0d,0xbf,0x50,0x0d,0x6a,0x61,0x56,0xa3,0x8e,0x08,0x8a,0x22,0xb6,0x5e,
+        0x52,0xbc,0x51,0x4d,0x16,0xcc,0xf8,0x06,0x81,0x8c,0xe9,0x1a,0xb7,0x79,0x37,0x36,
+        0x5a,0xf9,0x0b,0xbf,0x74,0xa3,0x5b,0xe6,0xb4,0x0b,0x8e,0xed,0xf2,0x78,0x5e,0x42,
+        0x87,0x4d
+    };
+    BYTE key[32], buf[114];
+    chacha_ctx* ctx;
+    int pass = 1;
+
+    for (int i = 0; i < 32; i++) key[i] = (BYTE)i;
+    ctx = chacha_ctx_create((char*)key, 32);
+    if (ctx == NULL) return 0;
+
+    memcpy(buf, sunscreen, 114);
+    pass &= chacha_ctx_xor(ctx, buf, 114, (char*)nonce, 1) == 0;
+    pass &= memcmp(buf, ct, 114) == 0;
+    pass &= chacha_ctx_xor(ctx, buf, 114, (char*)nonce, 1) == 0;
+    pass &= memcmp(buf, sunscreen, 114) == 0;
+
+    pass &= chacha_ctx_create((char*)key, 16) == NULL;
+    chacha_ctx_destroy(ctx);
+    return pass;
+}
+
+/* RFC 8439 2.5.2, fed whole and a byte at a time */
+static int poly1305_test(void)
+{
+    BYTE key[32] = {
+        0x85,0xd6,0xbe,0x78,0x57,0x55,0x6d,0x33,0x7f,0x44,0x52,0xfe,0x42,0xd5,0x06,0xa8,
+        0x01,0x03,0x80,0x8a,0xfb,0x0d,0xb2,0xfd,0x4a,0xbf,0xf6,0xaf,0x41,0x49,0xf5,0x1b
+    };
+    BYTE want[16] = {
+        0xa8,0x06,0x1d,0xc1,0x30,0x51,0x36,0xc6,0xc2,0x2b,0x8b,0xaf,0x0c,0x01,0x27,0xa9
+    };
+    const char msg[] = "Cryptographic Forum Research Group";
+    chacha_poly1305 st;
+    BYTE tag[16];
+    int pass = 1;
+
+    chacha_poly1305_init(&st, key);
+    chacha_poly1305_update(&st, msg, 34);
+    chacha_poly1305_final(&st, tag);
+    pass &= memcmp(tag, want, 16) == 0;
+
+    chacha_poly1305_init(&st, key);
+    for (int i = 0; i < 34; i++)
+        chacha_poly1305_update(&st, msg + i, 1);
+    chacha_poly1305_final(&st, tag);
+    pass &= memcmp(tag, want, 16) == 0;
+    return pass;
+}
+
+/* RFC 8439 2.8.2, then tampering with the tag, AAD and ciphertext */
+static int aead_test(void)
+{
+    BYTE nonce[12] = { 0x07,0x00,0x00,0x00,0x40,0x41,0x42,0x43,0x44,0x45,0x46,0x47 };
+    BYTE aad[12] = { 0x50,0x51,0x52,0x53,0xc0,0xc1,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7 };
+    BYTE ct[114] = {
+        0xd3,0x1a,0x8d,0x34,0x64,0x8e,0x60,0xdb,0x7b,0x86,0xaf,0xbc,0x53,0xef,0x7e,0xc2,
+        0xa4,0xad,0xed,0x51,0x29,0x6e,0x08,0xfe,0xa9,0xe2,0xb5,0xa7,0x36,0xee,0x62,0xd6,
+        0x3d,0xbe,0xa4,0x5e,0x8c,0xa9,0x67,0x12,0x82,0xfa,0xfb,0x69,0xda,0x92,0x72,0x8b,
+        0x1a,0x71,0xde,0x0a,0x9e,0x06,0x0b,0x29,0x05,0xd6,0xa5,0xb6,0x7e,0xcd,0x3b,0x36,
+        0x92,0xdd,0xbd,0x7f,0x2d,0x77,0x8b,0x8c,0x98,0x03,0xae,0xe3,0x28,0x09,0x1b,0x58,
+        0xfa,0xb3,0x24,0xe4,0xfa,0xd6,0x75,0x94,0x55,0x85,0x80,0x8b,0x48,0x31,0xd7,0xbc,
+        0x3f,0xf4,0xde,0xf0,0x8e,0x4b,0x7a,0x9d,0xe5,0x76,0xd2,0x65,0x86,0xce,0xc6,0x4b,
+        0x61,0x16
+    };
+    BYTE want[16] = {
+        0x1a,0xe1,0x0b,0x59,0x4f,0x09,0xe2,0x6a,0x7e,0x90,0x2e,0xcb,0xd0,0x60,0x06,0x91
+    };
+    BYTE key[32], buf[114], tag[16];
+    chacha_ctx* ctx;
+    int pass = 1;
+
+    for (int i = 0; i < 32; i++) key[i] = (BYTE)(0x80 + i);
+    ctx = chacha_ctx_create((char*)key, 32);
+    if (ctx == NULL) return 0;
+
+    memcpy(buf, sunscreen, 114);
+    pass &= chacha_aead_encrypt(ctx, (char*)nonce, aad, 12, buf, 114, (char*)tag) == 0;
+    pass &= memcmp(buf, ct, 114) == 0 && memcmp(tag, want, 16) == 0;
+    pass &= chacha_aead_decrypt(ctx, (char*)nonce, aad, 12, buf, 114, (char*)tag) == 0;
+    pass &= memcmp(buf, sunscreen, 114) == 0;
+
+    tag[15] ^= 1;
+    memcpy(buf, ct, 114);
+    pass &= chacha_aead_decrypt(ctx, (char*)nonce, aad, 12, buf, 114, (char*)tag) == 1;
+    for (int i = 0; i < 114; i++) pass &= buf[i] == 0;
+    tag[15] ^= 1;
+    memcpy(buf, ct, 114);
+    pass &= chacha_aead_decrypt(ctx, (char*)nonce, aad, 11, buf, 114, (char*)tag) == 1;
+    memcpy(buf, ct, 114);
+    buf[100] ^= 0x80;
+    pass &= chacha_aead_decrypt(ctx, (char*)nonce, aad, 12, buf, 114, (char*)tag) == 1;
+
+    chacha_ctx_destroy(ctx);
+    return pass;
+}
+
+/*
+ * Long messages through the multi-block paths, one-shot and streamed
+ * in uneven pieces; the first kernel's output is kept in ref so every
+ * later kernel is compared against it.
+ */
+static int aead_stream_test(BYTE* ref, BYTE* ref_tag, int first)
+{
+    enum { LEN = 5000 };
+    static BYTE pt[LEN], buf[LEN], out[LEN];
+    static const size_t steps[] = { 1, 63, 64, 65, 511, 512, 1000 };
+    BYTE key[32], nonce[12], aad[37], tag[16];
+    chacha_ctx* ctx;
+    chacha_aead st;
+    int pass = 1;
+
+    for (int i = 0; i < 32; i++) key[i] = (BYTE)(i * 7 + 3);
+    for (int i = 0; i < 12; i++) nonce[i] = (BYTE)(0xa0 + i);
+    for (int i = 0; i < 37; i++) aad[i] = (BYTE)i;
+    for (int i = 0; i < LEN; i++) pt[i] = (BYTE)(i * 13 + i / 255);
+    ctx = chacha_ctx_create((char*)key, 32);
+    if (ctx == NULL) return 0;
+
+    memcpy(buf, pt, LEN);
+    pass &= chacha_aead_encrypt(ctx, (char*)nonce, aad, 37, buf, LEN, (char*)tag) == 0;
+    if (first) {
+        memcpy(ref, buf, LEN);
+        memcpy(ref_tag, tag, 16);
+    }
+    pass &= memcmp(buf, ref, LEN) == 0 && memcmp(tag, ref_tag, 16) == 0;
+
+    for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+        pass &= chacha_aead_init(&st, ctx, (char*)nonce) == 0;
+        chacha_aead_aad(&st, aad, 10);
+        chacha_aead_aad(&st, aad + 10, 27);
+        for (size_t off = 0; off < LEN; off += steps[s]) {
+            size_t n = LEN - off < steps[s] ? LEN - off : steps[s];
+            pass &= chacha_aead_encrypt_update(&st, pt + off, out + off, n) == 0;
+        }
+        pass &= chacha_aead_aad(&st, aad, 1) == 1;
+        pass &= chacha_aead_final(&st, (char*)tag) == 0;
+        pass &= memcmp(out, ref, LEN) == 0 && memcmp(tag, ref_tag, 16) == 0;
+
+        chacha_aead_init(&st, ctx, (char*)nonce);
+        chacha_aead_aad(&st, aad, 37);
+        for (size_t off = 0; off < LEN; off += steps[s]) {
+            size_t n = LEN - off < steps[s] ? LEN - off : steps[s];
+            chacha_aead_decrypt_update(&st, out + off, out + off, n);
+        }
+        pass &= chacha_aead_verify(&st, (char*)tag) == 0;
+        pass &= memcmp(out, pt, LEN) == 0;
+    }
+
+    /* Raw keystream running up to the last counter value */
+    memcpy(buf, pt, LEN);
+    pass &= chacha_ctx_xor(ctx, buf, LEN, (char*)nonce, 0xffffffb0u) == 0;
+    if (first) memcpy(ref + LEN, buf, LEN);
+    pass &= memcmp(buf, ref + LEN, LEN) == 0;
+
+    /* One byte past it is refused, as the counter would wrap back to
+     * keystream already used; the buffer is left alone */
+    memcpy(buf, pt, LEN);
+    pass &= chacha_ctx_xor(ctx, buf, 65, (char*)nonce, 0xffffffffu) == 1;
+    pass &= chacha_ctx_xor(ctx, buf, 4097, (char*)nonce, 0xffffffc0u) == 1;
+    pass &= memcmp(buf, pt, LEN) == 0;
+    pass &= chacha_ctx_xor(ctx, buf, 4096, (char*)nonce, 0xffffffc0u) == 0;
+    for (int i = 0; i < LEN - 1024; i++)
+        pass &= (buf[i] ^ pt[i]) == (ref[LEN + 1024 + i] ^ pt[1024 + i]);
+    pass &= chacha_ctx_xor(ctx, buf, 64, (char*)nonce, 0xffffffffu) == 0;
+
+    chacha_ctx_destroy(ctx);
+    return pass;
+}
+
+static const char* engines[] = { "avx2", "sse2", "portable" };
+
+int main(void)
+{
+    static BYTE ref[10000];
+    BYTE ref_tag[16];
+    int pass = 1, ran = 0;
+
+    for (int e = 0; e < 3; e++) {
+        int ok;
+
+        if (chacha_engine_select(engines[e]) != 0) {
+            printf("ChaCha20 %s: not available\n", engines[e]);
+            continue;
+        }
+        ok = chacha20_test() && poly1305_test() && aead_test() &&
+             aead_stream_test(ref, ref_tag, ran == 0);
+        ran++;
+        printf("ChaCha20 %s tests: %s\n", engines[e], ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    return pass ? 0 : 1;
+}
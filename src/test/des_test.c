@@ -1,6 +1,7 @@
 /*********************************************************************
  * Filename:   des_test.c
- * Description: Known-answer tests for DES and Triple-DES.
+ * Description: Known-answer tests for DES and Triple-DES, and for the
+ *              key-schedule cache in front of them.
  *
  * Author:     Suman Kafle
  * Date:       2023/04/31
@@ -13,24 +14,186 @@
 #include <string.h>
 #include "des.h"
 
+/*
+ * Single DES: the FIPS 46 worked example, and its decryption.
+ * Returns 1 on success, 0 on failure.
+ */
 int des_test(void)
 {
     BYTE pt[DES_BLOCK_SIZE]={0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF};
     BYTE key[DES_BLOCK_SIZE]={0x13,0x34,0x57,0x79,0x9B,0xBC,0xDF,0xF1};
+    BYTE ct[DES_BLOCK_SIZE]={0x85,0xE8,0x13,0x54,0x0F,0x0A,0xB4,0x05};
     BYTE out[DES_BLOCK_SIZE],back[DES_BLOCK_SIZE];
     BYTE schedule[16][6];
+    int pass=1;
 
     des_key_setup(key,schedule,DES_ENCRYPT);
     des_crypt(pt,out,schedule);
+    pass&=memcmp(out,ct,DES_BLOCK_SIZE)==0;
 
     des_key_setup(key,schedule,DES_DECRYPT);
     des_crypt(out,back,schedule);
+    pass&=memcmp(pt,back,DES_BLOCK_SIZE)==0;
 
-    return memcmp(pt,back,DES_BLOCK_SIZE)==0;
+    return pass;
+}
+
+/*
+ * Triple-DES (EDE, three keys), checked against OpenSSL des-ede3-ecb,
+ * and its decryption. Returns 1 on success, 0 on failure.
+ */
+int three_des_test(void)
+{
+    BYTE pt[DES_BLOCK_SIZE]={'T','h','e',' ','q','u','f','c'};
+    BYTE key[3*DES_BLOCK_SIZE]={0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,
+                                0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,0x01,
+                                0x45,0x67,0x89,0xAB,0xCD,0xEF,0x01,0x23};
+    BYTE ct[DES_BLOCK_SIZE]={0xA8,0x26,0xFD,0x8C,0xE5,0x3B,0x85,0x5F};
+    BYTE out[DES_BLOCK_SIZE],back[DES_BLOCK_SIZE];
+    BYTE schedule[3][16][6];
+    int pass=1;
+
+    three_des_key_setup(key,schedule,DES_ENCRYPT);
+    three_des_crypt(pt,out,schedule);
+    pass&=memcmp(out,ct,DES_BLOCK_SIZE)==0;
+
+    three_des_key_setup(key,schedule,DES_DECRYPT);
+    three_des_crypt(out,back,schedule);
+    pass&=memcmp(pt,back,DES_BLOCK_SIZE)==0;
+
+    return pass;
+}
+
+/* ECB through the uncached API, for comparison */
+static void ecb_uncached(const BYTE key[], int key_len, const BYTE in[], BYTE out[],
+                         size_t nblocks, DES_MODE mode)
+{
+    BYTE schedule[3][16][6];
+
+    if (key_len==DES_BLOCK_SIZE) des_key_setup(key,schedule[0],mode);
+    else three_des_key_setup(key,schedule,mode);
+    for(size_t i=0;i<nblocks;i++){
+        if (key_len==DES_BLOCK_SIZE)
+            des_crypt(in+i*DES_BLOCK_SIZE,out+i*DES_BLOCK_SIZE,schedule[0]);
+        else
+            three_des_crypt(in+i*DES_BLOCK_SIZE,out+i*DES_BLOCK_SIZE,schedule);
+    }
+}
+
+/*
+ * Cached ECB: the KATs through des_ecb_cached, output equal to the
+ * uncached path for DES and 3DES in both directions (in place too), one
+ * entry serving both directions, hits, misses and evictions counted as
+ * keys come and go, bad key lengths refused, and caching switched off.
+ * Returns 1 on success, 0 on failure.
+ */
+int des_cache_test(void)
+{
+    BYTE key8[DES_BLOCK_SIZE]={0x13,0x34,0x57,0x79,0x9B,0xBC,0xDF,0xF1};
+    BYTE kat8[DES_BLOCK_SIZE]={0x85,0xE8,0x13,0x54,0x0F,0x0A,0xB4,0x05};
+    BYTE key24[3*DES_BLOCK_SIZE]={0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,
+                                  0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,0x01,
+                                  0x45,0x67,0x89,0xAB,0xCD,0xEF,0x01,0x23};
+    BYTE kat24[DES_BLOCK_SIZE]={0xA8,0x26,0xFD,0x8C,0xE5,0x3B,0x85,0x5F};
+    BYTE pt[4*DES_BLOCK_SIZE],out[4*DES_BLOCK_SIZE],want[4*DES_BLOCK_SIZE];
+    BYTE keys[6][DES_BLOCK_SIZE];
+    key_cache_stats st0,st;
+    int pass=1;
+
+    for(int i=0;i<(int)sizeof(pt);i++) pt[i]=(BYTE)(i*37+11);
+    memcpy(pt,"\x01\x23\x45\x67\x89\xAB\xCD\xEF",DES_BLOCK_SIZE);
+
+    pass&=des_key_cache_config(4)==0;
+    des_key_cache_flush();
+    des_key_cache_stats(&st0);
+    pass&=st0.entries==0 && st0.capacity==4;
+
+    /* DES: a miss, then the decryption hits the same entry */
+    pass&=des_ecb_cached(key8,DES_BLOCK_SIZE,pt,out,4,DES_ENCRYPT)==0;
+    pass&=memcmp(out,kat8,DES_BLOCK_SIZE)==0;
+    ecb_uncached(key8,DES_BLOCK_SIZE,pt,want,4,DES_ENCRYPT);
+    pass&=memcmp(out,want,sizeof(out))==0;
+    pass&=des_ecb_cached(key8,DES_BLOCK_SIZE,out,out,4,DES_DECRYPT)==0;
+    pass&=memcmp(out,pt,sizeof(pt))==0;
+    des_key_cache_stats(&st);
+    pass&=st.misses==st0.misses+1 && st.hits==st0.hits+1 && st.entries==1;
+
+    /* 3DES: its own entry */
+    memcpy(pt,"The qufc",DES_BLOCK_SIZE);
+    pass&=des_ecb_cached(key24,3*DES_BLOCK_SIZE,pt,out,4,DES_ENCRYPT)==0;
+    pass&=memcmp(out,kat24,DES_BLOCK_SIZE)==0;
+    ecb_uncached(key24,3*DES_BLOCK_SIZE,pt,want,4,DES_ENCRYPT);
+    pass&=memcmp(out,want,sizeof(out))==0;
+    pass&=des_ecb_cached(key24,3*DES_BLOCK_SIZE,out,out,4,DES_DECRYPT)==0;
+    pass&=memcmp(out,pt,sizeof(pt))==0;
+    des_key_cache_stats(&st);
+    pass&=st.misses==st0.misses+2 && st.hits==st0.hits+2 && st.entries==2;
+
+    /* Six more keys through four slots: each is a miss, and the
+     * oldest entries make way */
+    for(int k=0;k<6;k++){
+        memcpy(keys[k],key8,DES_BLOCK_SIZE);
+        keys[k][0]^=(BYTE)(2*(k+1));
+        pass&=des_ecb_cached(keys[k],DES_BLOCK_SIZE,pt,out,4,DES_ENCRYPT)==0;
+        ecb_uncached(keys[k],DES_BLOCK_SIZE,pt,want,4,DES_ENCRYPT);
+        pass&=memcmp(out,want,sizeof(out))==0;
+    }
+    des_key_cache_stats(&st);
+    pass&=st.misses==st0.misses+8 && st.evictions==st0.evictions+4 && st.entries==4;
+
+    /* The most recent key is still cached, the first one is not */
+    pass&=des_ecb_cached(keys[5],DES_BLOCK_SIZE,pt,out,1,DES_ENCRYPT)==0;
+    pass&=des_ecb_cached(key8,DES_BLOCK_SIZE,pt,out,1,DES_ENCRYPT)==0;
+    des_key_cache_stats(&st);
+    pass&=st.hits==st0.hits+3 && st.misses==st0.misses+9;
+
+    /* Bad lengths are refused and not counted */
+    pass&=des_ecb_cached(key24,16,pt,out,1,DES_ENCRYPT)==1;
+    pass&=des_ecb_cached(key24,0,pt,out,1,DES_ENCRYPT)==1;
+    des_key_cache_stats(&st0);
+    pass&=st0.hits==st.hits && st0.misses==st.misses;
+
+    /* Flush empties the cache; with capacity 0 nothing is kept but the
+     * output is unchanged */
+    des_key_cache_flush();
+    des_key_cache_stats(&st);
+    pass&=st.entries==0;
+    pass&=des_key_cache_config(0)==0;
+    pass&=des_ecb_cached(key24,3*DES_BLOCK_SIZE,pt,out,4,DES_ENCRYPT)==0;
+    pass&=des_ecb_cached(key24,3*DES_BLOCK_SIZE,pt,out,4,DES_ENCRYPT)==0;
+    ecb_uncached(key24,3*DES_BLOCK_SIZE,pt,want,4,DES_ENCRYPT);
+    pass&=memcmp(out,want,sizeof(out))==0;
+    des_key_cache_stats(&st);
+    pass&=st.entries==0 && st.hits==st0.hits;
+
+    des_key_cache_config(64);
+    return pass;
 }
 
 int main(void)
 {
-    printf("DES test: %s\n", des_test() ? "PASSED" : "FAILED");
-    return 0;
+    int pass=1;
+
+    {
+        int ok=des_test();
+
+        printf("DES tests: %s\n", ok ? "SUCCEEDED" : "FAILED");
+        pass&=ok;
+    }
+
+    {
+        int ok=three_des_test();
+
+        printf("Triple-DES tests: %s\n", ok ? "SUCCEEDED" : "FAILED");
+        pass&=ok;
+    }
+
+    {
+        int ok=des_cache_test();
+
+        printf("DES key cache tests: %s\n", ok ? "SUCCEEDED" : "FAILED");
+        pass&=ok;
+    }
+
+    return pass ? 0 : 1;
 }
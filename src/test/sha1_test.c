@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "sha1.h"
+#include "hmac.h"
 
 /*
  * Runs known-answer tests (KATs) for SHA-1.
@@ -23,6 +24,8 @@ int sha1_test(void)
     BYTE text1[] = "abc";
     BYTE text2[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
     BYTE text3[] = "aaaaaaaaaa";
+    BYTE text4[] = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+                   "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
 
     BYTE hash1[SHA1_BLOCK_SIZE] = {
         0xa9,0x99,0x3e,0x36,0x47,0x06,0x81,0x6a,0xba,0x3e,
@@ -37,7 +40,13 @@ int sha1_test(void)
         0xeb,0x2b,0xdb,0xad,0x27,0x31,0x65,0x34,0x01,0x6f
     };
 
+    BYTE hash4[SHA1_BLOCK_SIZE] = {
+        0xa4,0x9b,0x24,0x46,0xa0,0x2c,0x64,0x5b,0xf4,0x19,
+        0xf9,0x95,0xb6,0x70,0x91,0x25,0x3a,0x04,0xa2,0x59
+    };
+
     BYTE buf[SHA1_BLOCK_SIZE];
+    static BYTE million[1000000];
     SHA1_CTX ctx;
     int pass = 1;
 
@@ -60,11 +69,265 @@ int sha1_test(void)
     sha1_final(&ctx, buf);
     pass &= (memcmp(hash3, buf, SHA1_BLOCK_SIZE) == 0);
 
+    /* Test vector 4: the same million bytes in one call, then in
+     * uneven pieces that straddle block boundaries */
+    memset(million, 'a', sizeof(million));
+    sha1_init(&ctx);
+    sha1_update(&ctx, million, sizeof(million));
+    sha1_final(&ctx, buf);
+    pass &= (memcmp(hash3, buf, SHA1_BLOCK_SIZE) == 0);
+
+    sha1_init(&ctx);
+    for (size_t off = 0, step = 1; off < sizeof(million); off += step, step = step % 150 + 7)
+        sha1_update(&ctx, million + off, sizeof(million) - off < step ? sizeof(million) - off : step);
+    sha1_final(&ctx, buf);
+    pass &= (memcmp(hash3, buf, SHA1_BLOCK_SIZE) == 0);
+
+    /* Test vector 5: two blocks of varied text */
+    sha1_init(&ctx);
+    sha1_update(&ctx, text4, strlen((char *)text4));
+    sha1_final(&ctx, buf);
+    pass &= (memcmp(hash4, buf, SHA1_BLOCK_SIZE) == 0);
+
     return pass;
 }
 
+/*
+ * Multi-buffer hashing of messages of many lengths, through the batch
+ * call and through the job manager directly, against sha1_final.
+ * Returns 1 if all digests match, otherwise 0.
+ */
+int sha1_mb_test(void)
+{
+    enum { NJOBS = 100 };
+    static BYTE msg[20000];
+    const BYTE *data[NJOBS];
+    size_t len[NJOBS];
+    BYTE want[NJOBS][SHA1_BLOCK_SIZE], got[NJOBS][SHA1_BLOCK_SIZE];
+    SHA1_JOB jobs[NJOBS], *done;
+    SHA1_MGR mgr;
+    SHA1_CTX ctx, prefix;
+    int pass = 1, finished = 0;
+
+    for (size_t i = 0; i < sizeof(msg); ++i)
+        msg[i] = (BYTE)(i * 31 + i / 251);
+
+    /* Lengths around the padding boundaries, then a spread up to 20000 */
+    for (int i = 0; i < NJOBS; ++i) {
+        static const size_t edge[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128 };
+
+        data[i] = msg + i;
+        len[i] = i < 10 ? edge[i] : (size_t)(i * 7919) % (sizeof(msg) - NJOBS);
+        sha1_init(&ctx);
+        sha1_update(&ctx, data[i], len[i]);
+        sha1_final(&ctx, want[i]);
+    }
+
+    sha1_hash_batch(data, len, got, NJOBS);
+    pass &= (memcmp(got, want, sizeof(want)) == 0);
+
+    /* Each job comes back exactly once, whatever the order */
+    sha1_mgr_init(&mgr);
+    for (int i = 0; i < NJOBS; ++i) {
+        jobs[i].data = data[i];
+        jobs[i].len = len[i];
+        jobs[i].user = want[i];
+        if ((done = sha1_mgr_submit(&mgr, &jobs[i])) != NULL) {
+            pass &= (memcmp(done->digest, done->user, SHA1_BLOCK_SIZE) == 0);
+            finished++;
+        }
+    }
+    while ((done = sha1_mgr_flush(&mgr)) != NULL) {
+        pass &= (memcmp(done->digest, done->user, SHA1_BLOCK_SIZE) == 0);
+        finished++;
+    }
+    pass &= (finished == NJOBS);
+
+    /* Messages continuing from a context that has taken two blocks */
+    sha1_init(&prefix);
+    sha1_update(&prefix, msg, 128);
+    for (int i = 0; i < NJOBS; ++i) {
+        ctx = prefix;
+        sha1_update(&ctx, data[i], len[i]);
+        sha1_final(&ctx, want[i]);
+    }
+    sha1_hash_batch_from(data, len, got, NJOBS, &prefix);
+    pass &= (memcmp(got, want, sizeof(want)) == 0);
+
+    return pass;
+}
+
+/* Compare bytes against a hex string */
+static int hex_equal(const BYTE *bytes, const char *hex, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        unsigned int v;
+
+        if (sscanf(hex + 2 * i, "%2x", &v) != 1 || bytes[i] != v) return 0;
+    }
+    return 1;
+}
+
+/*
+ * HMAC-SHA1 on the RFC 2202 cases (all but 5, which truncates),
+ * one-shot and fed a byte at a time, then a batch of short messages
+ * against one-shot MACs. Returns 1 if all pass, otherwise 0.
+ */
+int hmac_sha1_test(void)
+{
+    static const char *want[] = {
+        "b617318655057264e28bc0b6fb378c8ef146be00",
+        "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79",
+        "125d7342b9ac11cd91a39af48aa17b4f63f175d3",
+        "4c9007f4026250c6bc8414f9bf50c86c2d7235da",
+        "aa4ae5e15272d00e95705637ce8a3b55ed402112",
+        "e8e99d0f45237d786d6bbaa7965c7808bbff1a91",
+    };
+    static const char *text[] = {
+        "Hi There",
+        "what do ya want for nothing?",
+        NULL,
+        NULL,
+        "Test Using Larger Than Block-Size Key - Hash Key First",
+        "Test Using Larger Than Block-Size Key and Larger Than One Block-Size Data",
+    };
+    enum { NMSG = 100 };
+    static BYTE msg[NMSG + 300];
+    const BYTE *data[NMSG];
+    size_t len[NMSG];
+    BYTE key[80], buf[160], mac[SHA1_BLOCK_SIZE], batch[NMSG][SHA1_BLOCK_SIZE];
+    HMAC_SHA1_KEY k;
+    HMAC_SHA1_CTX ctx;
+    int pass = 1;
+
+    for (int c = 0; c < 6; ++c) {
+        size_t key_len = c == 1 ? 4 : c == 3 ? 25 : c < 4 ? 20 : 80;
+        size_t data_len = text[c] != NULL ? strlen(text[c]) : 50;
+
+        for (size_t i = 0; i < key_len; ++i)
+            key[i] = c == 0 ? 0x0b : c == 3 ? (BYTE)(i + 1) : 0xaa;
+        if (c == 1) memcpy(key, "Jefe", 4);
+        if (text[c] != NULL)
+            memcpy(buf, text[c], data_len);
+        else
+            memset(buf, c == 2 ? 0xdd : 0xcd, data_len);
+
+        hmac_sha1_key(&k, key, key_len);
+        hmac_sha1(&k, buf, data_len, mac);
+        pass &= hex_equal(mac, want[c], SHA1_BLOCK_SIZE);
+
+        hmac_sha1_init(&ctx, &k);
+        for (size_t i = 0; i < data_len; ++i)
+            hmac_sha1_update(&ctx, buf + i, 1);
+        hmac_sha1_final(&ctx, mac);
+        pass &= hex_equal(mac, want[c], SHA1_BLOCK_SIZE);
+    }
+
+    /* Short messages of every length up to two blocks, and a few more */
+    for (size_t i = 0; i < sizeof(msg); ++i)
+        msg[i] = (BYTE)(i * 71 + i / 13);
+    for (int i = 0; i < NMSG; ++i) {
+        data[i] = msg + i;
+        len[i] = i < 80 ? (size_t)i * 129 / 80 : (size_t)i * 3;
+    }
+    hmac_sha1_batch(&k, data, len, batch, NMSG);
+    for (int i = 0; i < NMSG; ++i) {
+        hmac_sha1(&k, data[i], len[i], mac);
+        pass &= (memcmp(batch[i], mac, SHA1_BLOCK_SIZE) == 0);
+    }
+    hmac_sha1_key_clear(&k);
+
+    return pass;
+}
+
+/*
+ * Context blobs: the documented layout, resuming at any split point
+ * gives the one-shot digest, and damaged blobs are refused. Returns 1
+ * if all pass, otherwise 0.
+ */
+int sha1_ctx_blob_test(void)
+{
+    static const size_t splits[] = { 0, 1, 55, 63, 64, 65, 200 };
+    BYTE msg[1000], blob[SHA1_CTX_BLOB_SIZE], want[SHA1_BLOCK_SIZE], got[SHA1_BLOCK_SIZE];
+    SHA1_CTX ctx, resumed;
+    int pass = 1;
+
+    for (size_t i = 0; i < sizeof(msg); ++i)
+        msg[i] = (BYTE)(i * 13 + 5);
+    sha1_init(&ctx);
+    sha1_update(&ctx, msg, sizeof(msg));
+    sha1_final(&ctx, want);
+
+    sha1_init(&ctx);
+    sha1_update(&ctx, (const BYTE *)"abc", 3);
+    sha1_ctx_export(&ctx, blob);
+    pass &= hex_equal(blob, "5348413101030000" "0000000000000000"
+                      "67452301efcdab8998badcfe10325476c3d2e1f0" "61626300", 40);
+
+    for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); ++i) {
+        sha1_init(&ctx);
+        sha1_update(&ctx, msg, splits[i]);
+        sha1_ctx_export(&ctx, blob);
+        memset(&resumed, 0xa5, sizeof(resumed));
+        pass &= (sha1_ctx_import(&resumed, blob) == 0);
+        sha1_update(&resumed, msg + splits[i], sizeof(msg) - splits[i]);
+        sha1_final(&resumed, got);
+        pass &= (memcmp(got, want, SHA1_BLOCK_SIZE) == 0);
+    }
+
+    for (size_t i = 0; i < sizeof(blob); i += 11) {
+        blob[i] ^= 0x01;
+        pass &= (sha1_ctx_import(&resumed, blob) == 1);
+        blob[i] ^= 0x01;
+    }
+    return pass;
+}
+
+static const char *engines[] = { "shani", "portable" };
+static const char *mb_engines[] = { "avx2", "sse2", "x1" };
+
 int main(void)
 {
-    printf("SHA1 tests: %s\n", sha1_test() ? "SUCCEEDED" : "FAILED");
-    return 0;
+    int pass = 1;
+
+    /* Every kernel this CPU can run must give the same answers */
+    for (int e = 0; e < 2; e++) {
+        int ok;
+
+        if (sha1_engine_select(engines[e]) != 0) {
+            printf("SHA1 %s: not available\n", engines[e]);
+            continue;
+        }
+        ok = sha1_test();
+        printf("SHA1 %s tests: %s\n", engines[e], ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    {
+        int ok = hmac_sha1_test();
+
+        printf("HMAC-SHA1 tests: %s\n", ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    {
+        int ok = sha1_ctx_blob_test();
+
+        printf("SHA1 context blob tests: %s\n", ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    for (int e = 0; e < 3; e++) {
+        int ok;
+
+        if (sha1_mb_engine_select(mb_engines[e]) != 0) {
+            printf("SHA1 multi-buffer %s: not available\n", mb_engines[e]);
+            continue;
+        }
+        ok = sha1_mb_test();
+        printf("SHA1 multi-buffer %s tests: %s\n", mb_engines[e], ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    return pass ? 0 : 1;
 }
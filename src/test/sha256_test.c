@@ -13,9 +13,18 @@
  * or implied warranty. Use at your own risk.
  *********************************************************************/
 
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "sha256.h"
+#include "sha256_tree.h"
+#include "sha256_index.h"
+#include "hmac.h"
+#include "pbkdf2.h"
+#include "sha_stream.h"
 
 /*
  * Runs known-answer tests for SHA-256.
@@ -26,6 +35,8 @@ int sha256_test(void)
     BYTE text1[] = "abc";
     BYTE text2[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
     BYTE text3[] = "aaaaaaaaaa";
+    BYTE text4[] = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+                   "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
 
     BYTE hash1[SHA256_BLOCK_SIZE] = {
         0xba,0x78,0x16,0xbf,0x8f,0x01,0xcf,0xea,
@@ -48,7 +59,15 @@ int sha256_test(void)
         0x04,0x6d,0x39,0xcc,0xc7,0x11,0x2c,0xd0
     };
 
+    BYTE hash4[SHA256_BLOCK_SIZE] = {
+        0xcf,0x5b,0x16,0xa7,0x78,0xaf,0x83,0x80,
+        0x03,0x6c,0xe5,0x9e,0x7b,0x04,0x92,0x37,
+        0x0b,0x24,0x9b,0x11,0xe8,0xf0,0x7a,0x51,
+        0xaf,0xac,0x45,0x03,0x7a,0xfe,0xe9,0xd1
+    };
+
     BYTE buf[SHA256_BLOCK_SIZE];
+    static BYTE million[1000000];
     SHA256_CTX ctx;
     int pass = 1;
 
@@ -71,11 +90,721 @@ int sha256_test(void)
     sha256_final(&ctx, buf);
     pass &= (memcmp(hash3, buf, SHA256_BLOCK_SIZE) == 0);
 
+    /* Test vector 4: the same million bytes in one call, then in
+     * uneven pieces that straddle block boundaries */
+    memset(million, 'a', sizeof(million));
+    sha256_init(&ctx);
+    sha256_update(&ctx, million, sizeof(million));
+    sha256_final(&ctx, buf);
+    pass &= (memcmp(hash3, buf, SHA256_BLOCK_SIZE) == 0);
+
+    sha256_init(&ctx);
+    for (size_t off = 0, step = 1; off < sizeof(million); off += step, step = step % 150 + 7)
+        sha256_update(&ctx, million + off, sizeof(million) - off < step ? sizeof(million) - off : step);
+    sha256_final(&ctx, buf);
+    pass &= (memcmp(hash3, buf, SHA256_BLOCK_SIZE) == 0);
+
+    /* Test vector 5: two blocks of varied text */
+    sha256_init(&ctx);
+    sha256_update(&ctx, text4, strlen((char *)text4));
+    sha256_final(&ctx, buf);
+    pass &= (memcmp(hash4, buf, SHA256_BLOCK_SIZE) == 0);
+
+    return pass;
+}
+
+/*
+ * Multi-buffer hashing of messages of many lengths, through the batch
+ * call and through the job manager directly, against sha256_final.
+ * Returns 1 if all digests match, otherwise 0.
+ */
+int sha256_mb_test(void)
+{
+    enum { NJOBS = 100 };
+    static BYTE msg[20000];
+    SHA256_JOB jobs[NJOBS], *done;
+    SHA256_MGR mgr;
+    BYTE want[NJOBS][SHA256_BLOCK_SIZE];
+    SHA256_CTX ctx, prefix;
+    int pass = 1, finished = 0;
+
+    for (size_t i = 0; i < sizeof(msg); ++i)
+        msg[i] = (BYTE)(i * 31 + i / 251);
+
+    /* Lengths around the padding boundaries, then a spread up to 20000 */
+    for (int i = 0; i < NJOBS; ++i) {
+        static const size_t edge[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128 };
+
+        jobs[i].data = msg + i;
+        jobs[i].len = i < 10 ? edge[i] : (size_t)(i * 7919) % (sizeof(msg) - NJOBS);
+        jobs[i].user = &want[i];
+        sha256_init(&ctx);
+        sha256_update(&ctx, jobs[i].data, jobs[i].len);
+        sha256_final(&ctx, want[i]);
+    }
+
+    sha256_hash_batch(jobs, NJOBS);
+    for (int i = 0; i < NJOBS; ++i)
+        pass &= (memcmp(jobs[i].digest, want[i], SHA256_BLOCK_SIZE) == 0);
+
+    /* Each job comes back exactly once, whatever the order */
+    memset(jobs[0].digest, 0, SHA256_BLOCK_SIZE);
+    sha256_mgr_init(&mgr);
+    for (int i = 0; i < NJOBS; ++i) {
+        if ((done = sha256_mgr_submit(&mgr, &jobs[i])) != NULL) {
+            pass &= (memcmp(done->digest, done->user, SHA256_BLOCK_SIZE) == 0);
+            finished++;
+        }
+    }
+    while ((done = sha256_mgr_flush(&mgr)) != NULL) {
+        pass &= (memcmp(done->digest, done->user, SHA256_BLOCK_SIZE) == 0);
+        finished++;
+    }
+    pass &= (finished == NJOBS);
+
+    /* Jobs continuing from a context that has taken two blocks */
+    sha256_init(&prefix);
+    sha256_update(&prefix, msg, 128);
+    for (int i = 0; i < NJOBS; ++i) {
+        ctx = prefix;
+        sha256_update(&ctx, jobs[i].data, jobs[i].len);
+        sha256_final(&ctx, want[i]);
+    }
+    sha256_hash_batch_from(jobs, NJOBS, &prefix);
+    for (int i = 0; i < NJOBS; ++i)
+        pass &= (memcmp(jobs[i].digest, want[i], SHA256_BLOCK_SIZE) == 0);
+
+    return pass;
+}
+
+/* Tree root built level by level, the way sha256_tree.h defines it */
+static void tree_reference(const BYTE *data, size_t len, size_t leaf_size, int fanout,
+                           BYTE root[SHA256_BLOCK_SIZE])
+{
+    static BYTE nodes[2][64][SHA256_BLOCK_SIZE];
+    BYTE tag = 0x00;
+    SHA256_CTX ctx;
+    size_t count = 0, next;
+    int cur = 0;
+
+    do {
+        size_t n = len - count * leaf_size < leaf_size ? len - count * leaf_size : leaf_size;
+
+        sha256_init(&ctx);
+        sha256_update(&ctx, &tag, 1);
+        sha256_update(&ctx, data + count * leaf_size, n);
+        sha256_final(&ctx, nodes[cur][count++]);
+    } while (count * leaf_size < len);
+
+    tag = 0x01;
+    while (count > 1) {
+        next = 0;
+        for (size_t i = 0; i < count; i += fanout, next++) {
+            size_t n = count - i < (size_t)fanout ? count - i : (size_t)fanout;
+
+            if (n == 1) {
+                memcpy(nodes[!cur][next], nodes[cur][i], SHA256_BLOCK_SIZE);
+                continue;
+            }
+            sha256_init(&ctx);
+            sha256_update(&ctx, &tag, 1);
+            sha256_update(&ctx, nodes[cur][i], n * SHA256_BLOCK_SIZE);
+            sha256_final(&ctx, nodes[!cur][next]);
+        }
+        cur = !cur;
+        count = next;
+    }
+    memcpy(root, nodes[cur][0], SHA256_BLOCK_SIZE);
+}
+
+/*
+ * Tree hash against the reference over leaf counts that leave short
+ * runs on several levels, one-shot and streamed in uneven pieces, on
+ * one thread and four. Returns 1 if all roots match, otherwise 0.
+ */
+int sha256_tree_test(void)
+{
+    /* SHA-256 of the single byte 0x00: the root of an empty input */
+    BYTE empty[SHA256_BLOCK_SIZE] = {
+        0x6e,0x34,0x0b,0x9c,0xff,0xb3,0x7a,0x98,
+        0x9c,0xa5,0x44,0xe6,0xbb,0x78,0x0a,0x2c,
+        0x78,0x90,0x1d,0x3f,0xb3,0x37,0x38,0x76,
+        0x85,0x11,0xa3,0x06,0x17,0xaf,0xa0,0x1d
+    };
+    static const size_t lens[] = { 0, 1, 999, 1000, 1001, 5003, 16000, 37000, 63999 };
+    static const int fanouts[] = { 2, 3, 16 };
+    static BYTE msg[64000];
+    SHA256_TREE_PARAMS params;
+    SHA256_TREE tree;
+    BYTE want[SHA256_BLOCK_SIZE], got[SHA256_BLOCK_SIZE];
+    int pass = 1;
+
+    for (size_t i = 0; i < sizeof(msg); ++i)
+        msg[i] = (BYTE)(i * 131 + i / 997);
+
+    pass &= (sha256_tree_hash(msg, 0, NULL, got) == 0);
+    pass &= (memcmp(got, empty, SHA256_BLOCK_SIZE) == 0);
+
+    params.leaf_size = 1000;
+    params.fanout = 1;
+    pass &= (sha256_tree_init(&tree, &params) == 1);
+
+    for (size_t f = 0; f < sizeof(fanouts) / sizeof(fanouts[0]); ++f) {
+        for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); ++l) {
+            params.fanout = fanouts[f];
+            tree_reference(msg, lens[l], params.leaf_size, params.fanout, want);
+
+            for (params.threads = 1; params.threads <= 4; params.threads += 3) {
+                pass &= (sha256_tree_hash(msg, lens[l], &params, got) == 0);
+                pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+
+                sha256_tree_init(&tree, &params);
+                for (size_t off = 0, step = 1; off < lens[l]; off += step, step = step * 3 % 2500 + 1)
+                    sha256_tree_update(&tree, msg + off, lens[l] - off < step ? lens[l] - off : step);
+                sha256_tree_final(&tree, got);
+                pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+            }
+        }
+    }
+
+    return pass;
+}
+
+/* Same layout and nodes as a fresh build over data */
+static int index_matches(const SHA256_INDEX *idx, const BYTE *data, size_t len)
+{
+    SHA256_INDEX fresh;
+    int same;
+
+    if (sha256_index_build(&fresh, data, len, &idx->params) != 0) return 0;
+    same = fresh.nodes == idx->nodes && fresh.levels == idx->levels &&
+           memcmp(fresh.node, idx->node, fresh.nodes * SHA256_BLOCK_SIZE) == 0;
+    sha256_index_free(&fresh);
+    return same;
+}
+
+/*
+ * Merkle index: the root matches the tree hash, incremental updates for
+ * scattered edits and changes of length leave every node as a rebuild
+ * would, and the sidecar survives a save and load (through a file too)
+ * but not a flipped byte. Returns 1 if all pass, otherwise 0.
+ */
+int sha256_index_test(void)
+{
+    static const int fanouts[] = { 2, 3, 16 };
+    static const size_t lens[] = { 37000, 64000, 64000, 999, 0, 1000, 52001 };
+    static BYTE msg[64000];
+    char path[] = "/tmp/sha256_index_XXXXXX", side[64], tmp[80];
+    SHA256_TREE_PARAMS params = { 1000, 2, 2 };
+    SHA256_INDEX idx, loaded;
+    SHA256_RANGE dirty[4];
+    BYTE want[SHA256_BLOCK_SIZE], got[SHA256_BLOCK_SIZE];
+    size_t len = 37000;
+    int fd, pass = 1;
+
+    for (size_t i = 0; i < sizeof(msg); ++i)
+        msg[i] = (BYTE)(i * 131 + i / 997);
+
+    for (size_t f = 0; f < sizeof(fanouts) / sizeof(fanouts[0]); ++f) {
+        params.fanout = fanouts[f];
+        len = lens[0];
+        pass &= (sha256_index_build(&idx, msg, len, &params) == 0);
+        sha256_tree_hash(msg, len, &params, want);
+        sha256_index_root(&idx, got);
+        pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+
+        /* Overlapping, unsorted and out-of-range edits, then new lengths */
+        for (size_t l = 1; l < sizeof(lens) / sizeof(lens[0]); ++l) {
+            size_t step = 1000 * l + 7 * f;
+
+            for (int d = 0; d < 4; ++d) {
+                dirty[d].offset = (step * (5 - d) * 7) % 66000;
+                dirty[d].length = d == 3 ? 0 : step / (d + 1);
+                for (size_t i = dirty[d].offset; i < dirty[d].offset + dirty[d].length && i < sizeof(msg); ++i)
+                    msg[i] ^= (BYTE)(l + d + 1);
+            }
+            len = lens[l];
+            pass &= (sha256_index_update(&idx, msg, len, dirty, 4) == 0);
+            pass &= index_matches(&idx, msg, len);
+            sha256_tree_hash(msg, len, &params, want);
+            sha256_index_root(&idx, got);
+            pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+        }
+        sha256_index_free(&idx);
+    }
+
+    /* Sidecar round trip over a file edited in place */
+    fd = mkstemp(path);
+    if (fd < 0) return 0;
+    pass &= (write(fd, msg, sizeof(msg)) == (ssize_t)sizeof(msg));
+    snprintf(side, sizeof(side), "%s.idx", path);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", side);
+
+    pass &= (sha256_index_build_file(&idx, path, &params) == 0);
+    pass &= (sha256_index_save(&idx, side) == 0);
+    pass &= (access(tmp, F_OK) != 0);
+    sha256_index_free(&idx);
+
+    pass &= (sha256_index_load(&loaded, side) == 0);
+    pass &= (loaded.params.leaf_size == 1000 && loaded.params.fanout == params.fanout);
+    msg[12345] ^= 0x40;
+    msg[50000] ^= 0x40;
+    pass &= (pwrite(fd, msg + 12345, 1, 12345) == 1 && pwrite(fd, msg + 50000, 1, 50000) == 1);
+    dirty[0].offset = 12345;
+    dirty[0].length = 1;
+    dirty[1].offset = 50000;
+    dirty[1].length = 1;
+    pass &= (sha256_index_update_file(&loaded, path, dirty, 2) == 0);
+    pass &= (sha256_index_save(&loaded, side) == 0);
+    sha256_index_free(&loaded);
+
+    pass &= (sha256_index_load(&loaded, side) == 0);
+    pass &= index_matches(&loaded, msg, sizeof(msg));
+    sha256_index_free(&loaded);
+
+    /* A damaged sidecar is refused */
+    close(fd);
+    fd = open(side, O_WRONLY);
+    if (fd >= 0) {
+        pass &= (pwrite(fd, "\xff", 1, 100) == 1);
+        close(fd);
+    }
+    pass &= (sha256_index_load(&loaded, side) == 1);
+    pass &= (sha256_index_load(&loaded, "/nonexistent/sha256.idx") == 1);
+
+    unlink(side);
+    unlink(path);
+    return pass;
+}
+
+/* Compare bytes against a hex string */
+static int hex_equal(const BYTE *bytes, const char *hex, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        unsigned int v;
+
+        if (sscanf(hex + 2 * i, "%2x", &v) != 1 || bytes[i] != v) return 0;
+    }
+    return 1;
+}
+
+/*
+ * HMAC-SHA256 on the RFC 4231 cases (all but 5, which truncates),
+ * one-shot and fed a byte at a time, then a batch of short messages
+ * against one-shot MACs. Returns 1 if all pass, otherwise 0.
+ */
+int hmac_sha256_test(void)
+{
+    static const char *want[] = {
+        "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7",
+        "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843",
+        "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe",
+        "82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b",
+        "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54",
+        "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2",
+    };
+    static const char *text[] = {
+        "Hi There",
+        "what do ya want for nothing?",
+        NULL,
+        NULL,
+        "Test Using Larger Than Block-Size Key - Hash Key First",
+        "This is a test using a larger than block-size key and a larger than block-size data. "
+        "The key needs to be hashed before being used by the HMAC algorithm.",
+    };
+    enum { NMSG = 100 };
+    static BYTE msg[NMSG + 300];
+    const BYTE *data[NMSG];
+    size_t len[NMSG];
+    BYTE key[131], buf[160], mac[SHA256_BLOCK_SIZE], batch[NMSG][SHA256_BLOCK_SIZE];
+    HMAC_SHA256_KEY k;
+    HMAC_SHA256_CTX ctx;
+    int pass = 1;
+
+    for (int c = 0; c < 6; ++c) {
+        size_t key_len = c == 1 ? 4 : c == 3 ? 25 : c < 4 ? 20 : 131;
+        size_t data_len = text[c] != NULL ? strlen(text[c]) : 50;
+
+        for (size_t i = 0; i < key_len; ++i)
+            key[i] = c == 0 ? 0x0b : c == 3 ? (BYTE)(i + 1) : 0xaa;
+        if (c == 1) memcpy(key, "Jefe", 4);
+        if (text[c] != NULL)
+            memcpy(buf, text[c], data_len);
+        else
+            memset(buf, c == 2 ? 0xdd : 0xcd, data_len);
+
+        hmac_sha256_key(&k, key, key_len);
+        hmac_sha256(&k, buf, data_len, mac);
+        pass &= hex_equal(mac, want[c], SHA256_BLOCK_SIZE);
+
+        hmac_sha256_init(&ctx, &k);
+        for (size_t i = 0; i < data_len; ++i)
+            hmac_sha256_update(&ctx, buf + i, 1);
+        hmac_sha256_final(&ctx, mac);
+        pass &= hex_equal(mac, want[c], SHA256_BLOCK_SIZE);
+    }
+
+    /* Short messages of every length up to two blocks, and a few more */
+    for (size_t i = 0; i < sizeof(msg); ++i)
+        msg[i] = (BYTE)(i * 71 + i / 13);
+    for (int i = 0; i < NMSG; ++i) {
+        data[i] = msg + i;
+        len[i] = i < 80 ? (size_t)i * 129 / 80 : (size_t)i * 3;
+    }
+    hmac_sha256_batch(&k, data, len, batch, NMSG);
+    for (int i = 0; i < NMSG; ++i) {
+        hmac_sha256(&k, data[i], len[i], mac);
+        pass &= (memcmp(batch[i], mac, SHA256_BLOCK_SIZE) == 0);
+    }
+    hmac_sha256_key_clear(&k);
+
     return pass;
 }
 
+/* PBKDF2 written out on one-shot HMAC calls */
+static void pbkdf2_reference(const BYTE *pass, size_t pass_len, const BYTE *salt, size_t salt_len,
+                             unsigned long iterations, BYTE *out, size_t out_len)
+{
+    HMAC_SHA256_KEY k;
+    HMAC_SHA256_CTX ctx;
+    BYTE u[SHA256_BLOCK_SIZE], t[SHA256_BLOCK_SIZE];
+
+    hmac_sha256_key(&k, pass, pass_len);
+    for (uint32_t b = 1; (b - 1) * SHA256_BLOCK_SIZE < out_len; ++b) {
+        BYTE index[4] = { (BYTE)(b >> 24), (BYTE)(b >> 16), (BYTE)(b >> 8), (BYTE)b };
+        size_t off = (b - 1) * SHA256_BLOCK_SIZE;
+
+        hmac_sha256_init(&ctx, &k);
+        hmac_sha256_update(&ctx, salt, salt_len);
+        hmac_sha256_update(&ctx, index, 4);
+        hmac_sha256_final(&ctx, u);
+        memcpy(t, u, sizeof(t));
+        for (unsigned long i = 1; i < iterations; ++i) {
+            hmac_sha256(&k, u, sizeof(u), u);
+            for (int j = 0; j < SHA256_BLOCK_SIZE; ++j)
+                t[j] ^= u[j];
+        }
+        memcpy(out + off, t, out_len - off < sizeof(t) ? out_len - off : sizeof(t));
+    }
+}
+
+/*
+ * PBKDF2-HMAC-SHA256 on published vectors (RFC 7914 section 11 and the
+ * RFC 6070 cases carried over to SHA-256), then batches of passwords
+ * and salts of many lengths, with keys of one to several blocks, and
+ * the argument checks. Returns 1 if all pass, otherwise 0.
+ */
+int pbkdf2_test(void)
+{
+    static const struct {
+        const char *pass;
+        size_t pass_len;
+        const char *salt;
+        size_t salt_len;
+        unsigned long iterations;
+        size_t out_len;
+        const char *want;
+    } kat[] = {
+        { "password", 8, "salt", 4, 1, 32,
+          "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b" },
+        { "password", 8, "salt", 4, 2, 32,
+          "ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43" },
+        { "password", 8, "salt", 4, 4096, 32,
+          "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a" },
+        { "passwordPASSWORDpassword", 24, "saltSALTsaltSALTsaltSALTsaltSALTsalt", 36, 4096, 40,
+          "348c89dbcbd32b2f32d814b8116e84cf2b17347ebc1800181c4e2a1fb8dd53e1c635518c7dac47e9" },
+        { "pass\0word", 9, "sa\0lt", 5, 4096, 16,
+          "89b69d0516f829893c696226650a8687" },
+        { "passwd", 6, "salt", 4, 1, 64,
+          "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"
+          "49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783" },
+    };
+    enum { NPASS = 21, OUT_MAX = 200 };
+    static BYTE text[400];
+    static BYTE out[NPASS][OUT_MAX], want[OUT_MAX];
+    const BYTE *pass[NPASS], *salt[NPASS];
+    size_t pass_len[NPASS], salt_len[NPASS];
+    BYTE *outp[NPASS];
+    int pass_ok = 1;
+
+    for (size_t c = 0; c < sizeof(kat) / sizeof(kat[0]); ++c) {
+        pass_ok &= (pbkdf2_hmac_sha256((const BYTE *)kat[c].pass, kat[c].pass_len,
+                                       (const BYTE *)kat[c].salt, kat[c].salt_len,
+                                       kat[c].iterations, out[0], kat[c].out_len) == 0);
+        pass_ok &= hex_equal(out[0], kat[c].want, kat[c].out_len);
+    }
+
+    for (size_t i = 0; i < sizeof(text); ++i)
+        text[i] = (BYTE)(i * 29 + i / 7);
+    for (int i = 0; i < NPASS; ++i) {
+        pass[i] = text + i;
+        pass_len[i] = (size_t)i * 7;
+        salt[i] = text + 200 + i;
+        salt_len[i] = (size_t)(i * 13) % 90;
+        outp[i] = out[i];
+    }
+    for (size_t out_len = 1; out_len <= OUT_MAX; out_len += 99) {
+        pass_ok &= (pbkdf2_hmac_sha256_batch(pass, pass_len, salt, salt_len, 3, outp, out_len, NPASS) == 0);
+        for (int i = 0; i < NPASS; ++i) {
+            pbkdf2_reference(pass[i], pass_len[i], salt[i], salt_len[i], 3, want, out_len);
+            pass_ok &= (memcmp(out[i], want, out_len) == 0);
+        }
+    }
+
+    pass_ok &= (pbkdf2_hmac_sha256(text, 8, text, 8, 0, out[0], 32) == 1);
+    pass_ok &= (pbkdf2_hmac_sha256_calibrate(0.001, 32) >= 1);
+
+    return pass_ok;
+}
+
+/*
+ * Context blobs and checkpointed streams: the blob has its documented
+ * layout, a hash split at any point and resumed from the blob matches
+ * the one-shot digest, damaged or foreign blobs are refused, and a
+ * stream picks up from its last checkpoint or from a suspend, also
+ * through sha_stream_file, which reports checkpoints it could not
+ * write. Returns 1 if all pass, otherwise 0.
+ */
+int sha256_checkpoint_test(void)
+{
+    static const size_t splits[] = { 0, 1, 55, 63, 64, 65, 127, 200, 1000 };
+    static BYTE msg[10000];
+    char path[] = "/tmp/sha_stream_XXXXXX", ckpt[64], bad[64];
+    BYTE blob[SHA256_CTX_BLOB_SIZE], sum[SHA256_BLOCK_SIZE];
+    BYTE want[SHA256_BLOCK_SIZE], got[SHA256_BLOCK_SIZE], want1[SHA1_BLOCK_SIZE], got1[SHA1_BLOCK_SIZE];
+    SHA256_CTX ctx, resumed;
+    SHA1_CTX ctx1;
+    SHA_STREAM s, s2;
+    int fd, pass = 1;
+
+    for (size_t i = 0; i < sizeof(msg); ++i)
+        msg[i] = (BYTE)(i * 7 + i / 251);
+    sha256_init(&ctx);
+    sha256_update(&ctx, msg, sizeof(msg));
+    sha256_final(&ctx, want);
+    sha1_init(&ctx1);
+    sha1_update(&ctx1, msg, sizeof(msg));
+    sha1_final(&ctx1, want1);
+
+    /* Layout: header, bit count of whole blocks, state, buffered bytes */
+    sha256_init(&ctx);
+    sha256_update(&ctx, (const BYTE *)"abc", 3);
+    sha256_ctx_export(&ctx, blob);
+    pass &= hex_equal(blob, "5332353601030000" "0000000000000000"
+                      "6a09e667bb67ae853c6ef372a54ff53a510e527f9b05688c1f83d9ab5be0cd19"
+                      "61626300", 52);
+    for (size_t i = 52; i < 112; ++i)
+        pass &= (blob[i] == 0);
+    sha256_update(&ctx, msg, 97);
+    sha256_ctx_export(&ctx, blob);
+    pass &= hex_equal(blob + 4, "012400000000000000000200", 12);
+
+    for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); ++i) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, msg, splits[i]);
+        sha256_ctx_export(&ctx, blob);
+        memset(&resumed, 0xa5, sizeof(resumed));
+        pass &= (sha256_ctx_import(&resumed, blob) == 0);
+        sha256_update(&resumed, msg + splits[i], sizeof(msg) - splits[i]);
+        sha256_final(&resumed, got);
+        pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+    }
+
+    /* Damage anywhere fails the check; a newer version with a valid
+     * check is refused too, and ctx is left alone */
+    sha256_init(&ctx);
+    sha256_update(&ctx, msg, 100);
+    sha256_ctx_export(&ctx, blob);
+    for (size_t i = 0; i < sizeof(blob); i += 13) {
+        blob[i] ^= 0x10;
+        pass &= (sha256_ctx_import(&resumed, blob) == 1);
+        blob[i] ^= 0x10;
+    }
+    blob[4] = SHA256_CTX_BLOB_VERSION + 1;
+    sha256_init(&resumed);
+    sha256_update(&resumed, blob, 112);
+    sha256_final(&resumed, sum);
+    memcpy(blob + 112, sum, 8);
+    sha256_init(&resumed);
+    pass &= (sha256_ctx_import(&resumed, blob) == 1);
+    pass &= (resumed.bitlen == 0 && resumed.datalen == 0 && resumed.state[0] == 0x6a09e667);
+
+    /* A checkpoint every 1000 bytes; a second stream resumes from the
+     * last one as after a crash */
+    fd = mkstemp(path);
+    if (fd < 0) return 0;
+    pass &= (write(fd, msg, sizeof(msg)) == (ssize_t)sizeof(msg));
+    close(fd);
+    snprintf(ckpt, sizeof(ckpt), "%s.ckpt", path);
+
+    pass &= (sha_stream_init(&s, SHA_STREAM_SHA256, ckpt, 1000) == 0 && s.offset == 0);
+    for (size_t off = 0; off < 5500; off += 777)
+        pass &= (sha_stream_update(&s, msg + off, off + 777 < 5500 ? 777 : 5500 - off) == 0);
+    pass &= (sha_stream_init(&s2, SHA_STREAM_SHA256, ckpt, 1000) == 0 && s2.offset == 5000);
+    pass &= (sha_stream_update(&s2, msg + 5000, sizeof(msg) - 5000) == 0);
+    sha_stream_final(&s2, got);
+    pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+    pass &= (access(ckpt, F_OK) != 0);
+    sha_stream_update(&s, msg + 5500, sizeof(msg) - 5500);
+    sha_stream_final(&s, got);
+    pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+
+    /* One machine hashes a segment and suspends, the file finishes it */
+    pass &= (sha_stream_init(&s, SHA_STREAM_SHA1, ckpt, 0) == 0);
+    sha_stream_update(&s, msg, 2500);
+    pass &= (sha_stream_suspend(&s) == 0);
+    pass &= (sha_stream_init(&s, SHA_STREAM_SHA256, ckpt, 0) == 1);
+    pass &= (sha_stream_file(SHA_STREAM_SHA1, path, ckpt, 4096, got1) == 0);
+    pass &= (memcmp(got1, want1, SHA1_BLOCK_SIZE) == 0);
+    pass &= (access(ckpt, F_OK) != 0);
+    pass &= (sha_stream_file(SHA_STREAM_SHA256, path, NULL, 0, got) == 0);
+    pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+
+    /* Checkpoints that cannot be written are reported, the hash is not
+     * affected */
+    snprintf(bad, sizeof(bad), "%s.missing/ckpt", path);
+    pass &= (sha_stream_file(SHA_STREAM_SHA256, path, bad, 4096, got) == 2);
+    pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+
+    /* A checkpoint past the end of the file is refused and kept */
+    pass &= (sha_stream_init(&s, SHA_STREAM_SHA256, ckpt, 0) == 0);
+    sha_stream_update(&s, msg, sizeof(msg));
+    sha_stream_update(&s, msg, 1);
+    pass &= (sha_stream_suspend(&s) == 0);
+    pass &= (sha_stream_file(SHA_STREAM_SHA256, path, ckpt, 0, got) == 1);
+    pass &= (access(ckpt, F_OK) == 0);
+
+    unlink(ckpt);
+    unlink(path);
+    return pass;
+}
+
+/*
+ * Fixed-length paths: sha256_32, sha256_64 and their batches agree with
+ * sha256_init/update/final for every input and batch size, including
+ * batches that leave lanes spare, and double SHA-256 of "hello" gives
+ * the known digest. Returns 1 if all pass, otherwise 0.
+ */
+int sha256_fixed_test(void)
+{
+    static const size_t counts[] = { 0, 1, 2, 5, 8, 15, 16, 17, 33, 100 };
+    static BYTE in[100][64], out[100][SHA256_BLOCK_SIZE];
+    BYTE want[SHA256_BLOCK_SIZE], got[SHA256_BLOCK_SIZE];
+    BYTE in32[100][32];
+    SHA256_CTX ctx;
+    int pass = 1;
+
+    for (size_t i = 0; i < 100; ++i)
+        for (size_t j = 0; j < 64; ++j)
+            in[i][j] = (BYTE)(i * 31 + j * 7 + (i ^ j));
+    for (size_t i = 0; i < 100; ++i)
+        memcpy(in32[i], in[i] + 16, 32);
+
+    for (size_t i = 0; i < 100; ++i) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, in[i], 64);
+        sha256_final(&ctx, want);
+        sha256_64(in[i], got);
+        pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+
+        sha256_init(&ctx);
+        sha256_update(&ctx, in32[i], 32);
+        sha256_final(&ctx, want);
+        sha256_32(in32[i], got);
+        pass &= (memcmp(got, want, SHA256_BLOCK_SIZE) == 0);
+    }
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        memset(out, 0, sizeof(out));
+        sha256_64_batch((const BYTE (*)[64])in, out, counts[c]);
+        for (size_t i = 0; i < counts[c]; ++i) {
+            sha256_64(in[i], want);
+            pass &= (memcmp(out[i], want, SHA256_BLOCK_SIZE) == 0);
+        }
+        memset(out, 0, sizeof(out));
+        sha256_32_batch((const BYTE (*)[32])in32, out, counts[c]);
+        for (size_t i = 0; i < counts[c]; ++i) {
+            sha256_32(in32[i], want);
+            pass &= (memcmp(out[i], want, SHA256_BLOCK_SIZE) == 0);
+        }
+        /* Nothing past the batch is written */
+        for (size_t i = counts[c]; i < 100; ++i)
+            pass &= (out[i][0] == 0 && out[i][31] == 0);
+    }
+
+    sha256d((const BYTE *)"hello", 5, got);
+    pass &= hex_equal(got, "9595c9df90075148eb06860365df33584b75bff782a510c6cd4883a419833d50", 32);
+    return pass;
+}
+
+static const char *engines[] = { "shani", "portable" };
+static const char *mb_engines[] = { "avx512", "avx2", "x1" };
+
 int main(void)
 {
-    printf("SHA-256 tests: %s\n", sha256_test() ? "SUCCEEDED" : "FAILED");
-    return 0;
+    int pass = 1;
+
+    /* Every kernel this CPU can run must give the same answers */
+    for (int e = 0; e < 2; e++) {
+        int ok;
+
+        if (sha256_engine_select(engines[e]) != 0) {
+            printf("SHA-256 %s: not available\n", engines[e]);
+            continue;
+        }
+        ok = sha256_test();
+        printf("SHA-256 %s tests: %s\n", engines[e], ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+        ok = sha256_fixed_test();
+        printf("SHA-256 fixed-length %s tests: %s\n", engines[e], ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    {
+        int ok = sha256_tree_test();
+
+        printf("SHA-256 tree hash tests: %s\n", ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    {
+        int ok = sha256_index_test();
+
+        printf("SHA-256 Merkle index tests: %s\n", ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    {
+        int ok = hmac_sha256_test();
+
+        printf("HMAC-SHA256 tests: %s\n", ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    {
+        int ok = sha256_checkpoint_test();
+
+        printf("SHA-256 checkpoint tests: %s\n", ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    for (int e = 0; e < 3; e++) {
+        int ok;
+
+        if (sha256_mb_engine_select(mb_engines[e]) != 0) {
+            printf("SHA-256 multi-buffer %s: not available\n", mb_engines[e]);
+            continue;
+        }
+        ok = sha256_mb_test();
+        printf("SHA-256 multi-buffer %s tests: %s\n", mb_engines[e], ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+        ok = pbkdf2_test();
+        printf("PBKDF2-HMAC-SHA256 %s tests: %s\n", mb_engines[e], ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+        ok = sha256_fixed_test();
+        printf("SHA-256 fixed-length batch %s tests: %s\n", mb_engines[e], ok ? "SUCCEEDED" : "FAILED");
+        pass &= ok;
+    }
+
+    return pass ? 0 : 1;
 }